@@ -0,0 +1,267 @@
+#ifndef VM_ALU_H
+#define VM_ALU_H
+
+#include <cstdint>
+#include "vm_instructions.h"
+
+// 13-bit ALU semantics shared by every interpreter core.
+// Each helper computes the result and updates the flags it defines;
+// flags an operation does not define are left untouched.
+
+inline uint16_t vm_alu_add(uint16_t value1, uint16_t value2, bool* flags) {
+    uint32_t result = value1 + value2;
+    flags[VM_FLAG_SIGN] = (result & 0x1000) != 0;
+    flags[VM_FLAG_ZERO] = (result & 0x1FFF) == 0;
+    flags[VM_FLAG_CARRY] = (result > 0x1FFF);
+    
+    // Overflow detection for signed addition
+    bool op1_sign = (value1 & 0x1000) != 0;
+    bool op2_sign = (value2 & 0x1000) != 0;
+    bool res_sign = (result & 0x1000) != 0;
+    flags[VM_FLAG_OVERFLOW] = (op1_sign == op2_sign) && (op1_sign != res_sign);
+    
+    return static_cast<uint16_t>(result & 0x1FFF);
+}
+
+// Shared by SUB and CMP
+inline uint16_t vm_alu_sub(uint16_t value1, uint16_t value2, bool* flags) {
+    uint16_t result = (value1 - value2) & 0x1FFF;
+    flags[VM_FLAG_SIGN] = (result & 0x1000) != 0;
+    flags[VM_FLAG_ZERO] = result == 0;
+    flags[VM_FLAG_CARRY] = value1 < value2;
+    
+    // Overflow detection for signed subtraction
+    bool op1_sign = (value1 & 0x1000) != 0;
+    bool op2_sign = (value2 & 0x1000) != 0;
+    bool res_sign = (result & 0x1000) != 0;
+    flags[VM_FLAG_OVERFLOW] = (op1_sign != op2_sign) && (op1_sign != res_sign);
+    
+    return result;
+}
+
+// Flags for AND/OR/XOR/NOT: carry and overflow are cleared
+inline uint16_t vm_alu_logic_flags(uint16_t result, bool* flags) {
+    flags[VM_FLAG_SIGN] = (result & 0x1000) != 0;
+    flags[VM_FLAG_ZERO] = result == 0;
+    flags[VM_FLAG_CARRY] = false;
+    flags[VM_FLAG_OVERFLOW] = false;
+    return result;
+}
+
+// INC/DEC leave the carry flag untouched
+inline uint16_t vm_alu_inc(uint16_t value, bool* flags) {
+    uint16_t result = (value + 1) & 0x1FFF;
+    flags[VM_FLAG_SIGN] = (result & 0x1000) != 0;
+    flags[VM_FLAG_ZERO] = result == 0;
+    flags[VM_FLAG_OVERFLOW] = value == 0x0FFF;
+    return result;
+}
+
+inline uint16_t vm_alu_dec(uint16_t value, bool* flags) {
+    uint16_t result = (value - 1) & 0x1FFF;
+    flags[VM_FLAG_SIGN] = (result & 0x1000) != 0;
+    flags[VM_FLAG_ZERO] = result == 0;
+    flags[VM_FLAG_OVERFLOW] = value == 0x1000;
+    return result;
+}
+
+// Shifts and rotates move one bit; the bit shifted out lands in carry
+inline uint16_t vm_alu_shift_flags(uint16_t result, bool carry, bool* flags) {
+    flags[VM_FLAG_SIGN] = (result & 0x1000) != 0;
+    flags[VM_FLAG_ZERO] = result == 0;
+    flags[VM_FLAG_CARRY] = carry;
+    flags[VM_FLAG_OVERFLOW] = false;
+    return result;
+}
+
+inline uint16_t vm_alu_shl(uint16_t value, bool* flags) {
+    return vm_alu_shift_flags((value << 1) & 0x1FFF, (value & 0x1000) != 0, flags);
+}
+
+inline uint16_t vm_alu_shr(uint16_t value, bool* flags) {
+    return vm_alu_shift_flags(value >> 1, (value & 1) != 0, flags);
+}
+
+inline uint16_t vm_alu_rol(uint16_t value, bool* flags) {
+    bool carry = (value & 0x1000) != 0;
+    return vm_alu_shift_flags(((value << 1) | (carry ? 1 : 0)) & 0x1FFF, carry, flags);
+}
+
+inline uint16_t vm_alu_ror(uint16_t value, bool* flags) {
+    bool carry = (value & 1) != 0;
+    return vm_alu_shift_flags((value >> 1) | (carry ? 0x1000 : 0), carry, flags);
+}
+
+// Evaluate the condition of a conditional jump
+inline bool vm_branch_taken(VMOpcode opcode, const bool* flags) {
+    bool sign_ne_overflow = flags[VM_FLAG_SIGN] != flags[VM_FLAG_OVERFLOW];
+    
+    switch (opcode) {
+        case VMOpcode::JZ:  return flags[VM_FLAG_ZERO];
+        case VMOpcode::JNZ: return !flags[VM_FLAG_ZERO];
+        case VMOpcode::JC:  return flags[VM_FLAG_CARRY];
+        case VMOpcode::JNC: return !flags[VM_FLAG_CARRY];
+        case VMOpcode::JS:  return flags[VM_FLAG_SIGN];
+        case VMOpcode::JNS: return !flags[VM_FLAG_SIGN];
+        case VMOpcode::JO:  return flags[VM_FLAG_OVERFLOW];
+        case VMOpcode::JNO: return !flags[VM_FLAG_OVERFLOW];
+        case VMOpcode::JL:  return sign_ne_overflow;
+        case VMOpcode::JG:  return !flags[VM_FLAG_ZERO] && !sign_ne_overflow;
+        case VMOpcode::JLE: return flags[VM_FLAG_ZERO] || sign_ne_overflow;
+        case VMOpcode::JGE: return !sign_ne_overflow;
+        default:            return true;
+    }
+}
+
+// Lazy flag evaluation. The interpreter cores return ALU results right
+// away and only record the operation; C/Z/S/V are computed when a jump,
+// CLC/STC/CMC or a state inspection reads them. Code that accesses
+// status_flags directly must call vm_flags_materialize() first.
+
+inline uint8_t vm_flag_operation_writes(VMFlagOperation operation) {
+    if (operation == VMFlagOperation::INC || operation == VMFlagOperation::DEC) {
+        return VM_FLAG_MASK_SIGN | VM_FLAG_MASK_ZERO | VM_FLAG_MASK_OVERFLOW;
+    }
+    return VM_FLAG_MASK_ALL;
+}
+
+// Compute the pending flags selected by mask into the flag array
+inline void vm_flags_evaluate(VMLazyFlags& lazy, bool* flags, uint8_t mask) {
+    uint8_t needed = lazy.pending & mask;
+    if (!needed) {
+        return;
+    }
+    
+    bool computed[4] = { false, false, false, false };
+    switch (lazy.operation) {
+        case VMFlagOperation::ADD:
+            vm_alu_add(lazy.value1, lazy.value2, computed);
+            break;
+        case VMFlagOperation::SUB:
+            vm_alu_sub(lazy.value1, lazy.value2, computed);
+            break;
+        case VMFlagOperation::LOGIC:
+            vm_alu_logic_flags(lazy.result, computed);
+            break;
+        case VMFlagOperation::INC:
+            vm_alu_inc(lazy.value1, computed);
+            break;
+        case VMFlagOperation::DEC:
+            vm_alu_dec(lazy.value1, computed);
+            break;
+        case VMFlagOperation::SHIFT_LEFT:
+            vm_alu_shift_flags(lazy.result, (lazy.value1 & 0x1000) != 0, computed);
+            break;
+        case VMFlagOperation::SHIFT_RIGHT:
+            vm_alu_shift_flags(lazy.result, (lazy.value1 & 1) != 0, computed);
+            break;
+        default:
+            break;
+    }
+    
+    for (int i = 0; i < 4; i++) {
+        if ((needed >> i) & 1) {
+            flags[i] = computed[i];
+        }
+    }
+    lazy.pending &= ~needed;
+}
+
+inline uint16_t vm_flags_record(ExecutionContext& context, VMFlagOperation operation,
+                                uint16_t value1, uint16_t value2, uint16_t result) {
+    VMLazyFlags& lazy = context.lazy_flags;
+    uint8_t written = vm_flag_operation_writes(operation);
+    
+    // Flags the new operation leaves alone still come from the old record
+    if (written != VM_FLAG_MASK_ALL && (lazy.pending & ~written)) {
+        vm_flags_evaluate(lazy, context.status_flags, lazy.pending & ~written);
+    }
+    
+    // Whole-record store (the record packs into one 64-bit word)
+    lazy = VMLazyFlags{ operation, written, value1, value2, result };
+    return result;
+}
+
+inline uint16_t vm_lazy_add(uint16_t value1, uint16_t value2, ExecutionContext& context) {
+    return vm_flags_record(context, VMFlagOperation::ADD, value1, value2, (value1 + value2) & 0x1FFF);
+}
+
+inline uint16_t vm_lazy_sub(uint16_t value1, uint16_t value2, ExecutionContext& context) {
+    return vm_flags_record(context, VMFlagOperation::SUB, value1, value2, (value1 - value2) & 0x1FFF);
+}
+
+inline uint16_t vm_lazy_logic(uint16_t result, ExecutionContext& context) {
+    return vm_flags_record(context, VMFlagOperation::LOGIC, 0, 0, result);
+}
+
+inline uint16_t vm_lazy_inc(uint16_t value, ExecutionContext& context) {
+    return vm_flags_record(context, VMFlagOperation::INC, value, 0, (value + 1) & 0x1FFF);
+}
+
+inline uint16_t vm_lazy_dec(uint16_t value, ExecutionContext& context) {
+    return vm_flags_record(context, VMFlagOperation::DEC, value, 0, (value - 1) & 0x1FFF);
+}
+
+inline uint16_t vm_lazy_shl(uint16_t value, ExecutionContext& context) {
+    return vm_flags_record(context, VMFlagOperation::SHIFT_LEFT, value, 0, (value << 1) & 0x1FFF);
+}
+
+inline uint16_t vm_lazy_shr(uint16_t value, ExecutionContext& context) {
+    return vm_flags_record(context, VMFlagOperation::SHIFT_RIGHT, value, 0, value >> 1);
+}
+
+inline uint16_t vm_lazy_rol(uint16_t value, ExecutionContext& context) {
+    return vm_flags_record(context, VMFlagOperation::SHIFT_LEFT, value, 0, 
+                           ((value << 1) | (value >> 12)) & 0x1FFF);
+}
+
+inline uint16_t vm_lazy_ror(uint16_t value, ExecutionContext& context) {
+    return vm_flags_record(context, VMFlagOperation::SHIFT_RIGHT, value, 0, 
+                           (value >> 1) | ((value & 1) << 12));
+}
+
+// Flag array with at least the flags in mask up to date
+inline bool* vm_flags_read(ExecutionContext& context, uint8_t mask) {
+    vm_flags_evaluate(context.lazy_flags, context.status_flags, mask);
+    return context.status_flags;
+}
+
+inline void vm_flags_materialize(ExecutionContext& context) {
+    vm_flags_evaluate(context.lazy_flags, context.status_flags, VM_FLAG_MASK_ALL);
+}
+
+inline void vm_flags_set_carry(ExecutionContext& context, bool carry) {
+    context.lazy_flags.pending &= ~VM_FLAG_MASK_CARRY;
+    context.status_flags[VM_FLAG_CARRY] = carry;
+}
+
+// Conditions decided straight from a pending record skip flag evaluation:
+// Z and S always follow the result, and a pending SUB/CMP compares its inputs
+inline bool vm_lazy_branch_taken(VMOpcode opcode, ExecutionContext& context) {
+    const VMLazyFlags& lazy = context.lazy_flags;
+    uint8_t needed = VMInstruction::flags_read(static_cast<uint16_t>(opcode));
+    
+    if ((lazy.pending & needed) == needed) {
+        int value1 = static_cast<int>(lazy.value1 ^ 0x1000) - 0x1000;
+        int value2 = static_cast<int>(lazy.value2 ^ 0x1000) - 0x1000;
+        bool compare = lazy.operation == VMFlagOperation::SUB;
+        
+        switch (opcode) {
+            case VMOpcode::JZ:  return lazy.result == 0;
+            case VMOpcode::JNZ: return lazy.result != 0;
+            case VMOpcode::JS:  return (lazy.result & 0x1000) != 0;
+            case VMOpcode::JNS: return (lazy.result & 0x1000) == 0;
+            case VMOpcode::JC:  if (compare) return lazy.value1 < lazy.value2; break;
+            case VMOpcode::JNC: if (compare) return lazy.value1 >= lazy.value2; break;
+            case VMOpcode::JL:  if (compare) return value1 < value2; break;
+            case VMOpcode::JGE: if (compare) return value1 >= value2; break;
+            case VMOpcode::JG:  if (compare) return value1 > value2; break;
+            case VMOpcode::JLE: if (compare) return value1 <= value2; break;
+            default:            break;
+        }
+    }
+    
+    return vm_branch_taken(opcode, vm_flags_read(context, needed));
+}
+
+#endif // VM_ALU_H
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef VM_AOT_H
+#define VM_AOT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "vm_instructions.h"
+
+class VirtualMachine;
+
+// Exit reasons returned by translated programs
+enum VMAotExit : uint32_t {
+    VM_AOT_EXIT_HALT = 0,        // HALT executed
+    VM_AOT_EXIT_INTERPRET = 1,   // IP is outside the translation, interpret one instruction
+    VM_AOT_EXIT_WRITE_CODE = 2   // Store hit translated code, the translation is stale
+};
+
+// Generated entry point. Runs from the IP cell against unpacked memory
+// and the context flag array until one of the exits above.
+typedef uint32_t (*VMAotFunction)(uint16_t* memory, bool* flags);
+
+// Program emitted by the translator
+struct VMAotProgram {
+    const char* name;
+    VMAotFunction run;
+    const uint16_t* image;      // Words the translation was built from
+    const uint8_t* code_map;    // Nonzero for every word translated code depends on
+};
+
+// Translates the reachable code of a loaded image into a C++ translation
+// unit defining a VMAotProgram. Reachability follows fall-through and
+// direct jump targets from the given entry points; computed jumps and
+// instructions without a translation (IN_STR, illegal opcodes) go back
+// to the interpreter at run time.
+class VMAotTranslator {
+private:
+    VirtualMachine& vm;
+    std::vector<uint16_t> entry_points;
+    bool reachable[0x2000];
+    uint8_t code_map[0x2000];
+    
+    void discover();
+    bool translatable(uint16_t ip);
+    void emit_instruction(FILE* output, uint16_t ip, uint16_t following);
+    void emit_store_check(FILE* output, const char* address, bool constant, uint16_t value);
+    void emit_jump(FILE* output, const char* indent, uint16_t target);
+    
+public:
+    VMAotTranslator(VirtualMachine& vm);
+    
+    // The IP cell of the image is always an entry point
+    void add_entry_point(uint16_t address);
+    
+    // Write the translation unit; symbol names the exported VMAotProgram
+    void translate(FILE* output, const char* symbol);
+    
+    size_t get_instruction_count() const;
+};
+
+#endif // VM_AOT_H
\ No newline at end of file
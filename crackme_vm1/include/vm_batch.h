@@ -0,0 +1,108 @@
+#ifndef VM_BATCH_H
+#define VM_BATCH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <string>
+#include "vm_instructions.h"
+
+// Batch constants
+constexpr uint32_t VM_BATCH_DEFAULT_LANES = 16;          // Two SSE2 registers of 16-bit words, one with VM_AVX2
+constexpr uint32_t VM_BATCH_MAX_WAIT = 64;               // Steps a lane may sit out before it leads
+constexpr uint64_t VM_BATCH_DEFAULT_STEP_LIMIT = 1ULL << 32;
+
+// Why a lane stopped
+enum class VMBatchStatus {
+    HALTED = 0,        // HALT or an unknown opcode, as VirtualMachine::execute
+    STEP_LIMIT = 1     // Instruction budget exhausted
+};
+
+// Final state of one input, valid for the duration of the result callback
+struct VMBatchResult {
+    size_t input_index;         // Position in the order inputs were queued
+    VMBatchStatus status;
+    uint64_t steps;             // Instructions executed
+    const std::string* output;  // Bytes written by OUT
+    bool flags[4];              // VM_FLAG_* order
+    const uint16_t* memory;     // Lane column of the batch memory
+    uint32_t stride;
+    
+    uint16_t read_memory(uint16_t address) const {
+        return memory[static_cast<size_t>(address & 0x1FFF) * stride];
+    }
+};
+
+typedef std::function<void(const VMBatchResult& result)> VMBatchCallback;
+
+// Runs one image against many inputs, Lanes instances in lockstep.
+// Memory is stored structure-of-arrays (address-major, one word per lane)
+// so an instruction touching the same address in every lane is a single
+// vector access; indirect operands become gathers. Each step decodes the
+// instruction once for every lane at the leading IP whose code words
+// match, and executes it under that lane mask. Finished lanes are
+// refilled from the input queue in place.
+//
+// IN, IN_STR and IN_HEX read the lane's input string with the semantics
+// of the stdio-based scalar handlers; OUT appends to the lane's output.
+template <uint32_t Lanes>
+class VMBatch {
+    static_assert(Lanes >= 1 && Lanes <= 64, "lane masks are 64-bit");
+    
+private:
+    struct Lane {
+        bool running;
+        size_t input_index;
+        VMMemoryIO io;
+        uint64_t steps;
+        uint32_t wait;          // Consecutive steps not selected
+    };
+    
+    uint16_t* memory;           // [address][lane]
+    uint16_t* image;            // Initial words shared by every input
+    uint16_t ip[Lanes];
+    uint8_t flags[4][Lanes];    // VM_FLAG_* index, then lane
+    Lane lanes[Lanes];
+    
+    std::deque<std::pair<size_t, std::string>> queue;
+    size_t queued;
+    uint64_t step_limit;
+    uint64_t instructions;      // Lane-instructions executed
+    uint64_t batch_steps;       // Shared decodes
+    
+    bool refill(uint32_t lane);
+    void finish(uint32_t lane, VMBatchStatus status, const VMBatchCallback& on_result);
+    uint32_t select_leader() const;
+    uint64_t step(const VMBatchCallback& on_result);  // Returns the running lane mask
+    
+public:
+    VMBatch();
+    ~VMBatch();
+    
+    VMBatch(const VMBatch&) = delete;
+    VMBatch& operator=(const VMBatch&) = delete;
+    
+    // Packed image every input starts from (initialize + load_image state)
+    void load_image(const uint8_t* packed_image, uint32_t image_size);
+    
+    void set_step_limit(uint64_t limit) { step_limit = limit; }
+    
+    // Queue an input; results are reported with its queue index
+    size_t add_input(const std::string& input);
+    
+    // Run until every queued input finished
+    void run(const VMBatchCallback& on_result);
+    
+    // Average lanes per shared decode since construction
+    double get_lane_utilization() const {
+        return batch_steps ? static_cast<double>(instructions) / batch_steps : 0.0;
+    }
+    uint64_t get_instructions() const { return instructions; }
+};
+
+extern template class VMBatch<8>;
+extern template class VMBatch<16>;
+extern template class VMBatch<32>;
+
+#endif // VM_BATCH_H
\ No newline at end of file
@@ -0,0 +1,74 @@
+#ifndef VM_CHECKPOINT_H
+#define VM_CHECKPOINT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "vm_memory.h"
+
+class VirtualMachine;
+
+// Checkpoint constants
+constexpr uint32_t VM_CHECKPOINT_NONE = 0xFFFFFFFF;
+constexpr uint16_t VM_CHECKPOINT_DEFAULT_BLOCK_WORDS = 64;
+constexpr uint32_t VM_CHECKPOINT_FILE_MAGIC = 0x4B434D56;   // "VMCK"
+constexpr uint16_t VM_CHECKPOINT_FILE_VERSION = 1;
+
+// Memory blocks changed since the parent checkpoint, plus the registers
+// and flags at capture time. The first checkpoint after tracking starts
+// (or after the log is cleared or loaded) holds every block.
+struct VMCheckpoint {
+    uint32_t id;
+    uint32_t parent;                // VM_CHECKPOINT_NONE for a full checkpoint
+    uint16_t ip;
+    uint16_t sp;
+    uint8_t flags;                  // Bit n is flag VM_FLAG_* n
+    std::vector<uint16_t> blocks;   // Changed block indices, ascending
+    std::vector<uint16_t> words;    // block_words words per changed block
+};
+
+// Delta chain of one machine. Stores outside the IP/SP cells mark their
+// block dirty; a checkpoint takes the dirty blocks and clears the marks.
+// Restoring a checkpoint makes it the parent of the next one, so the log
+// is a tree and any checkpoint can be returned to.
+//
+// Files hold the block size followed by every checkpoint, words packed to
+// 13 bits; values are little-endian.
+class VMCheckpointLog {
+private:
+    uint16_t block_words;
+    uint16_t block_shift;
+    uint16_t block_count;
+    VMDirtyBitmap dirty;                // One bit per block
+    std::vector<VMCheckpoint> checkpoints;
+    uint32_t head;                      // Checkpoint memory last matched
+    
+public:
+    // block_words is a power of two from 1 to 8192
+    explicit VMCheckpointLog(uint16_t block_words = VM_CHECKPOINT_DEFAULT_BLOCK_WORDS);
+    
+    void mark(uint16_t address) { dirty.mark(address >> block_shift); }
+    void mark_all();
+    
+    // Append a checkpoint of the machine's dirty blocks, registers and flags
+    uint32_t capture(VirtualMachine& vm);
+    
+    // Store the memory, registers and flags of a checkpoint into the
+    // machine, taking each block from the nearest checkpoint up its parent
+    // chain; words already equal are not written. Makes id the head.
+    void rebuild(uint32_t id, VirtualMachine& vm);
+    
+    // Drop every checkpoint; the next capture is full
+    void clear();
+    
+    void write(FILE* output) const;
+    void read(FILE* input);         // Replaces the log, the next capture is full
+    
+    const VMCheckpoint& get_checkpoint(uint32_t id) const { return checkpoints.at(id); }
+    uint32_t get_checkpoint_count() const { return static_cast<uint32_t>(checkpoints.size()); }
+    uint32_t get_head() const { return head; }
+    uint16_t get_block_words() const { return block_words; }
+    uint32_t get_dirty_blocks() const { return dirty.count(); }
+};
+
+#endif // VM_CHECKPOINT_H
\ No newline at end of file
@@ -1,15 +1,89 @@
 #ifndef VM_CORE_H
 #define VM_CORE_H
 
-#include <windows.h>
 #include <cstdint>
 #include <cstdlib>
+#include <memory>
+#include "vm_memory.h"
+#include "vm_decode_cache.h"
+#include "vm_superinstructions.h"
+#include "vm_jit.h"
+#include "vm_aot.h"
+#include "vm_optimizer.h"
+#include "vm_checkpoint.h"
+#include "vm_image.h"
+#include "vm_runtime.h"
+#include "vm_io.h"
+#include "vm_trace.h"
+#include "vm_profile.h"
+#include "vm_hash.h"
 
 // VM core constants
 constexpr uint16_t VM_MEMORY_SIZE = 0x2000;  // 8192 addresses
 constexpr uint16_t VM_STACK_POINTER = 0x1FFE;
 constexpr uint16_t VM_INSTRUCTION_POINTER = 0x1FFF;
 
+// Trackers that observe stores; write_memory leaves its fast path only
+// while one of them is on
+constexpr uint8_t VM_STORE_DIRTY = 1;        // Write tracking bitmap
+constexpr uint8_t VM_STORE_CHECKPOINT = 2;   // Checkpoint log blocks
+constexpr uint8_t VM_STORE_HASH = 4;         // Incremental memory hash
+constexpr uint8_t VM_STORE_CODE = 8;         // Decode cache, JIT blocks and optimizer dependencies
+
+// Memory representation used while executing
+enum class VMMemoryMode {
+    PACKED = 0,         // Access the 0x3404-byte 13-bit packed buffer directly
+    SHADOW = 1,         // Execute against an unpacked 16-bit word per address
+    COPY_ON_WRITE = 2   // Unpacked words in blocks shared with fork()ed machines;
+                        // decoded from memory every step, the dispatch mode is ignored
+};
+
+// Interpreter core used by execute()
+enum class VMDispatchMode {
+    EXECUTOR = 0,     // Predecoded handlers calling the InstructionExecutor
+    THREADED = 1,     // Direct-threaded core (computed goto where available)
+    SPECIALIZED = 2,  // Predecoded handlers specialized per opcode and modes
+    JIT = 3           // Native x86-64 basic blocks (SHADOW memory mode only)
+};
+
+// Build-time default interpreter core
+#ifndef VM_DEFAULT_DISPATCH
+#define VM_DEFAULT_DISPATCH VMDispatchMode::EXECUTOR
+#endif
+
+// Memory access policies. The checked policy bounds-checks every access;
+// the unchecked policy masks addresses to 13 bits and cannot fault.
+struct VMCheckedAccess {
+    static constexpr bool checked = true;
+};
+
+struct VMUncheckedAccess {
+    static constexpr bool checked = false;
+};
+
+// Build-time policy: release builds (NDEBUG) take the unchecked fast path
+#ifndef VM_MEMORY_POLICY
+#ifdef NDEBUG
+#define VM_MEMORY_POLICY VMUncheckedAccess
+#else
+#define VM_MEMORY_POLICY VMCheckedAccess
+#endif
+#endif
+
+typedef VM_MEMORY_POLICY VMMemoryPolicy;
+
+// Outcome of execute()
+enum class VMStatus {
+    OK = 0,            // Stopped at HALT or an unknown opcode
+    MEMORY_FAULT = 1,  // Checked policy: out-of-range access, see get_fault_address()
+    INPUT_PENDING = 2, // Bound memory input cannot complete the next read; IP is
+                       // left on it and execute() resumes there
+    CYCLE = 3,         // Cycle detection: the guest state repeated without input,
+                       // so the guest never halts. IP is left on the repeating step.
+    STEP_LIMIT = 4     // VMRuntime::steps reached the step limit; IP is left on the
+                       // next instruction
+};
+
 // VM status flags
 struct VMStatusFlags {
     bool flag_carry : 1;     // C flag (0x3402)
@@ -25,22 +99,268 @@ private:
     uint32_t buffer_size;
     VMStatusFlags status_flags;
     
+    // Unpacked copy of memory, only allocated in SHADOW mode
+    uint16_t* shadow_memory;
+    VMMemoryMode memory_mode;
+    
+    // Streams, application type and memory I/O of this machine; active
+    // on the executing thread while execute() runs
+    VMRuntime runtime;
+    
+    // Shared blocks, only allocated in COPY_ON_WRITE mode. The packed buffer
+    // is then just the transfer format, allocated when first needed.
+    VMCowMemory* cow_memory;
+    
+    // Words stored since the last restore_dirty(), allocated while write
+    // tracking is on
+    VMDirtyBitmap* dirty_words;
+    
+    // Dirty blocks and deltas, allocated when constructed with a block size
+    VMCheckpointLog* checkpoint_log;
+    
+    // Stores that bypass write_memory invalidate every tracked word
+    void mark_all_dirty();
+    
+    // VM_STORE_* trackers currently on, recomputed whenever one is attached
+    // or detached; stores take store_hooked() while any bit is set
+    uint8_t store_hooks;
+    
+    void update_store_hooks();
+    void store_hooked(uint16_t address, uint16_t value);
+    
+    // Drop tracking, caches and translations derived from the old image
+    void image_loaded();
+    
+    // Predecoded instructions and the executor they dispatch to
+    VMDecodeCache decode_cache;
+    InstructionExecutor* executor;
+    VMDispatchMode dispatch_mode;
+    
+    // Opcode n-gram profile and fused sequences
+    VMSuperinstructions superinstructions;
+    VMFusionMode fusion_mode;
+    uint64_t fusion_warmup;
+    
+    // Load-time analysis applied to decoded instructions
+    VMProgramOptimizer optimizer;
+    bool optimize_on_load;
+    
+    // Native block translator, allocated when the JIT core is selected
+    VMJit* jit;
+    
+    // Ahead-of-time translated program run in place of the selected core
+    const VMAotProgram* aot_program;
+    
+    // Step recorder, nullptr unless tracing is attached (never with VM_TRACE 0)
+    VMTracer* tracer;
+    
+    bool tracing() const { return VM_TRACE && tracer && !tracer->is_finished(); }
+    
+    // Opcode, form and site counters, nullptr unless profiling is attached
+    VMProfiler* profiler;
+    
+    // Every core but AOT translated code counts its steps; ports that log
+    // I/O against them keep runs off the translation
+    bool counting_steps() const { return runtime.port && runtime.port->counts_steps(); }
+    
+    // Sum of vm_hash_cell over the cells below SP, kept up to date by
+    // write_memory while hashing states; recomputed when invalid
+    bool state_hashing;
+    uint64_t memory_hash;
+    bool memory_hash_valid;
+    
+    bool hashing_states() const { return state_hashing || cycle_detection; }
+    uint64_t hash_memory();
+    
+    // Repeated states end the run with VMStatus::CYCLE
+    bool cycle_detection;
+    VMCycleDetector cycle_detector;
+    
+    bool cycle_repeated(ExecutionContext& context, VMOpcode opcode);
+    
+    // Runs end with VMStatus::STEP_LIMIT once VMRuntime::steps reaches it, 0 for none
+    uint64_t step_limit;
+    
+    // Instrumented runs take the single-step loop, never native code
+    bool instrumented() const { return tracing() || profiler || cycle_detection || step_limit; }
+    
+    // Context holding IP and SP while an interpreter core runs. Accesses to
+    // the 0x1FFE/0x1FFF cells are redirected to it; nullptr uses memory.
+    ExecutionContext* registers;
+    
+    void cache_registers(ExecutionContext& context);
+    void flush_registers();
+    
+    // Faults raised while execute() runs stop the run instead of throwing
+    bool executing;
+    VMStatus status;
+    uint16_t fault_address;
+    
+    uint16_t memory_fault(uint16_t address, const char* message);
+    
+    // Checked in the run loops; constant false under the unchecked policy
+    bool faulted() const { return VMMemoryPolicy::checked && status != VMStatus::OK; }
+    
+    // Interpreter cores
+    void run_handlers(ExecutionContext& context);
+    void run_handlers_profiled(ExecutionContext& context);
+    void run_threaded(ExecutionContext& context);
+    void run_jit(ExecutionContext& context);
+    void run_aot(ExecutionContext& context);
+    void run_uncached(ExecutionContext& context);
+    void run_core(ExecutionContext& context);
+    
+    // Interpreted core for the attached instruments and dispatch mode,
+    // with IP and SP already cached in the context
+    void run_interpreter(ExecutionContext& context);
+    
+    // Instruction at ip decoded from memory, bypassing the decode cache;
+    // returns the opcode word
+    uint16_t decode_uncached(uint16_t ip, VMDecodedInstruction& instruction);
+    
+    // Single step decoded from memory, bypassing the decode cache
+    bool interpret_uncached(ExecutionContext& context);
+    
+    // Tracer hooks of run_uncached around a recorded step
+    void trace_operands(VMTraceRecord& record, uint16_t ip, uint16_t word,
+                        const VMDecodedInstruction& instruction);
+    void trace_result(VMTraceRecord& record, const VMDecodedInstruction& instruction,
+                      ExecutionContext& context);
+    
+    void update_fusion();
+    
 public:
-    VirtualMachine(uint32_t buffer_size = 0x3404);
+    VirtualMachine(uint32_t buffer_size = 0x3404, 
+                   VMMemoryMode memory_mode = VMMemoryMode::PACKED,
+                   uint16_t checkpoint_block_words = 0);
     ~VirtualMachine();
     
     void initialize();
-    void execute();
+    VMStatus execute();
     void reset();
     
-    // Memory access
+    // Independent copy of this machine's memory, flags and configuration.
+    // COPY_ON_WRITE machines share their blocks and copy them on write;
+    // other modes copy memory eagerly. Not callable while executing.
+    std::unique_ptr<VirtualMachine> fork();
+    
+    // Write tracking for fast resets. Native cores (JIT, AOT) store to
+    // shadow memory directly, so running one marks every word.
+    void set_write_tracking(bool enabled);
+    const VMDirtyBitmap* get_dirty_words() const { return dirty_words; }
+    
+    // Copy the marked words back from image (one word per address), clear
+    // the bitmap and reset flags and status. Requires write tracking.
+    void restore_dirty(const uint16_t* image);
+    
+    // Incremental checkpoints, only with a nonzero checkpoint_block_words.
+    // checkpoint() records the blocks stored since the previous checkpoint
+    // (or restore) with IP, SP and flags; restore() rebuilds any recorded
+    // checkpoint. Neither is callable while executing.
+    uint32_t checkpoint();
+    void restore(uint32_t id);
+    VMCheckpointLog* get_checkpoint_log() { return checkpoint_log; }
+    
+    // Packed image transfer (the packed format stays the interchange format)
+    void load_image(const uint8_t* image, uint32_t image_size);
+    void dump_image(uint8_t* image, uint32_t image_size);
+    
+    // Load an image file and its entry IP and SP. Copy-on-write machines
+    // read the mapped words in place (the image must outlive them and
+    // their forks); other modes copy the packed image.
+    void load_image(const VMImage& image);
+    uint32_t get_buffer_size() const { return buffer_size; }
+    
+    // Flush shadow memory into the packed buffer and return it
+    uint8_t* get_memory_buffer();
+    void sync_packed_image();
+    
+    VMMemoryMode get_memory_mode() const { return memory_mode; }
+    
+    VMRuntime& get_runtime() { return runtime; }
+    const VMRuntime& get_runtime() const { return runtime; }
+    
+    // Run-time interpreter core selection
+    void set_dispatch_mode(VMDispatchMode mode);
+    VMDispatchMode get_dispatch_mode() const { return dispatch_mode; }
+    
+    // True once JIT dispatch has a code arena to translate into. Without
+    // one (non-x86-64 hosts, VM_NO_JIT, other memory modes, or a host that
+    // refuses the mapping) JIT mode runs the specialized handlers instead.
+    bool is_jit_available() const { return jit != nullptr; }
+    
+    // Superinstructions (handler cores only, the threaded core never fuses)
+    void set_fusion_mode(VMFusionMode mode, uint64_t warmup = VM_DEFAULT_FUSION_WARMUP);
+    VMFusionMode get_fusion_mode() const { return fusion_mode; }
+    VMSuperinstructions& get_superinstructions() { return superinstructions; }
+    
+    // Load-time optimization of the code reachable from the IP cell
+    void optimize_program();
+    void set_optimize_on_load(bool enabled) { optimize_on_load = enabled; }
+    const VMProgramOptimizer& get_optimizer() const { return optimizer; }
+    
+    // Translated image from vm_aot (SHADOW mode only; nullptr interprets).
+    // Falls back to the selected core when memory no longer matches it.
+    void set_aot_program(const VMAotProgram* program) { aot_program = program; }
+    const VMAotProgram* get_aot_program() const { return aot_program; }
+    
+    // Record executed steps into a tracer (not owned; nullptr detaches).
+    // Traced runs are interpreted one instruction at a time whatever the
+    // dispatch mode, until the tracer finishes.
+    void set_tracer(VMTracer* trace);
+    VMTracer* get_tracer() const { return tracer; }
+    
+    // Count every step into a profiler (not owned; nullptr detaches). Like
+    // tracing, profiled runs are interpreted one instruction at a time; an
+    // attached tracer goes first and the profile starts once it finishes.
+    void set_profiler(VMProfiler* profile);
+    VMProfiler* get_profiler() const { return profiler; }
+    
+    // Incremental state hashing: every store updates a 64-bit hash of
+    // memory in O(1), state_hash() adds IP, SP and flags. Equal states hash
+    // equal in every memory mode and core; stores made through the buffer
+    // returned by get_memory_buffer() are not seen. Without hashing,
+    // state_hash() rehashes all of memory on every call.
+    void set_state_hashing(bool enabled);
+    bool get_state_hashing() const { return state_hashing; }
+    uint64_t state_hash();
+    
+    // Stop runs whose state repeats with VMStatus::CYCLE instead of looping
+    // forever (implies state hashing). Checked after every step of the
+    // single-step loop, traced and profiled ones included: while it is on,
+    // runs are interpreted one instruction at a time whatever the dispatch
+    // mode, so THREADED, SPECIALIZED and JIT have no effect. Not callable
+    // while executing.
+    void set_cycle_detection(bool enabled);
+    bool get_cycle_detection() const { return cycle_detection; }
+    
+    // Stop runs with VMStatus::STEP_LIMIT once VMRuntime::steps reaches
+    // limit (0 for no limit). Checked in the single-step loop like cycle
+    // detection, so limited runs are interpreted whatever the dispatch
+    // mode. Not callable while executing.
+    void set_step_limit(uint64_t limit);
+    uint64_t get_step_limit() const { return step_limit; }
+    
+    // Result of the last execute() and the offending address of a fault
+    VMStatus get_status() const { return status; }
+    uint16_t get_fault_address() const { return fault_address; }
+    
+    // Memory access, checked according to VMMemoryPolicy. Outside execute()
+    // checked out-of-range accesses throw std::out_of_range.
     uint16_t read_memory(uint16_t address);
     void write_memory(uint16_t address, uint16_t value);
     
+    // Resolve an operand word to an address through 0-3 levels of indirection
+    uint16_t resolve_operand(uint16_t operand, AddressingMode mode);
+    
     // Stack operations
     void push(uint16_t value);
     uint16_t pop();
     
+    // Input handlers call this instead of reading when vm_io_input_pending():
+    // the run stops with IP on the input instruction. Returns false.
+    bool suspend_input(ExecutionContext& context);
+    
     // Flag accessors
     bool get_carry_flag() const { return status_flags.flag_carry; }
     bool get_zero_flag() const { return status_flags.flag_zero; }
@@ -53,16 +373,4 @@ public:
     void set_overflow_flag(bool value) { status_flags.flag_overflow = value; }
 };
 
-// Application type for VM initialization
-enum class ApplicationType {
-    CONSOLE = 1,
-    GUI = 2,
-    UNKNOWN = 0
-};
-
-// Global VM initialization functions
-void initialize_virtual_machine_runtime();
-void vm_initialize_console_app();
-void vm_initialize_gui_app();
-
 #endif // VM_CORE_H
\ No newline at end of file
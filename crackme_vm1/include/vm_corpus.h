@@ -0,0 +1,99 @@
+#ifndef VM_CORPUS_H
+#define VM_CORPUS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <vector>
+#include "vm_core.h"
+#include "vm_image.h"
+
+// Corpus constants
+constexpr uint32_t VM_CORPUS_FILE_MAGIC = 0x4F434D56;       // "VMCO"
+constexpr uint32_t VM_CORPUS_RESULTS_MAGIC = 0x52434D56;    // "VMCR"
+constexpr uint16_t VM_CORPUS_FILE_VERSION = 1;
+constexpr uint32_t VM_CORPUS_DEFAULT_BATCH = 256;           // Records per batch
+constexpr uint32_t VM_CORPUS_DEFAULT_DEPTH = 4;             // Batches in flight per worker
+constexpr size_t VM_CORPUS_DISCARD_BYTES = 16 << 20;        // Corpus read between page drops
+constexpr size_t VM_CORPUS_READ_BYTES = 1 << 20;            // Results read per step
+
+// Guest inputs mapped read-only. The file is a header (magic, version)
+// followed by records of a 32-bit length and that many input bytes, all
+// little-endian. Records point into the mapping and are never copied.
+class VMCorpus {
+private:
+    VMMappedFile file;
+    size_t position;
+    
+public:
+    // Throws std::runtime_error when path is not a corpus
+    explicit VMCorpus(const char* path);
+    
+    // Next record, false at the end of the corpus. Throws on a truncated record.
+    bool next(const uint8_t*& data, uint32_t& length);
+    void rewind();
+    
+    size_t get_position() const { return position; }
+    VMMappedFile& get_file() { return file; }
+    
+    static void write_header(FILE* output);
+    static void write_record(FILE* output, const void* data, uint32_t length);
+};
+
+// Outcome of one input, one row of the results file
+struct VMCorpusResult {
+    VMStatus status;
+    uint8_t flags;              // Bit n is flag VM_FLAG_* n
+    uint64_t steps;             // Instructions executed
+    uint64_t output_hash;       // FNV-1a of the bytes written by OUT
+};
+
+// Results files hold a header (magic, version) and one chunk per batch in
+// corpus order: the row count, then the status bytes, flag bytes, step
+// counts and output hashes of those rows, each column contiguous.
+// read_results calls visit for every row with its corpus index.
+void vm_corpus_read_results(FILE* input, const std::function<void(uint64_t index, const VMCorpusResult& result)>& visit);
+
+struct VMCorpusSummary {
+    uint64_t records;
+    uint64_t faults;            // Runs ending in MEMORY_FAULT
+    uint64_t cycles;            // Runs ending in CYCLE
+    uint64_t input_bytes;
+    double seconds;
+};
+
+// Runs an image against every record of a corpus through a reader ->
+// workers -> writer pipeline. The calling thread reads records into
+// batches, workers run each batch on pooled machines and a writer thread
+// emits finished batches in corpus order. A fixed set of batches cycles
+// through the stages: the reader waits for a free one, so the pipeline
+// holds at most threads * depth batches whatever the corpus size, and the
+// corpus pages already read are dropped as the reader moves on. Guests
+// are expected to halt on every input, unless cycle detection stops the
+// ones that loop.
+class VMCorpusPipeline {
+private:
+    std::vector<uint8_t> image;
+    uint32_t threads;
+    uint32_t batch_records;
+    uint32_t depth;
+    VMDispatchMode dispatch_mode;
+    bool cycle_detection;
+    
+public:
+    VMCorpusPipeline(const uint8_t* packed_image, uint32_t image_size);
+    
+    // Worker count, 0 uses every hardware thread
+    void set_threads(uint32_t count) { threads = count; }
+    void set_batch_records(uint32_t records) { batch_records = records ? records : 1; }
+    void set_depth(uint32_t batches) { depth = batches ? batches : 1; }
+    void set_dispatch_mode(VMDispatchMode mode) { dispatch_mode = mode; }
+    
+    // End runs whose state repeats with VMStatus::CYCLE (runs interpreted)
+    void set_cycle_detection(bool enabled) { cycle_detection = enabled; }
+    
+    VMCorpusSummary run(VMCorpus& corpus, FILE* results);
+};
+
+#endif // VM_CORPUS_H
\ No newline at end of file
@@ -0,0 +1,106 @@
+#ifndef VM_DECODE_CACHE_H
+#define VM_DECODE_CACHE_H
+
+#include <cstdint>
+#include "vm_instructions.h"
+
+class VirtualMachine;
+
+// Decode cache constants
+constexpr uint16_t VM_DECODE_CACHE_ENTRIES = 0x2000;  // One entry per VM address
+constexpr uint8_t VM_MAX_INSTRUCTION_LENGTH = 3;      // Opcode word + two operands
+constexpr uint8_t VM_MAX_FUSED_INSTRUCTIONS = 3;      // Longest superinstruction
+constexpr uint8_t VM_MAX_ENTRY_SPAN = VM_MAX_INSTRUCTION_LENGTH * VM_MAX_FUSED_INSTRUCTIONS;
+
+struct VMDecodedInstruction;
+
+// Handler bound to a predecoded instruction
+typedef bool (*VMInstructionHandler)(const VMDecodedInstruction& instruction,
+                                     ExecutionContext& context);
+
+// Predecoded instruction entry
+struct VMDecodedInstruction {
+    VMInstructionHandler handler;
+    VMOpcode opcode;
+    AddressingMode mode_dst;
+    AddressingMode mode_src;
+    uint8_t length;           // Words covered, 0 when the entry is not decoded
+    uint16_t operand1;        // Raw operand words following the opcode word
+    uint16_t operand2;
+    uint8_t live_flags;       // Fused entries: flags read after the sequence
+};
+
+class VMSuperinstructions;
+class VMProgramOptimizer;
+
+// Lazily filled side table of decoded instructions.
+// Every address covered by a decoded entry is marked in a write-tracking
+// bitmap so that stores into code invalidate the matching entries.
+class VMDecodeCache {
+private:
+    VMDecodedInstruction* entries;
+    uint64_t* code_bitmap;
+    uint64_t* liveness_bitmap;    // Words inspected by fusion flag liveness
+    bool specialized;
+    VMSuperinstructions* fusion;
+    const VMProgramOptimizer* optimizer;
+    
+    const VMDecodedInstruction& decode_entry(VirtualMachine& vm, uint16_t ip);
+    
+public:
+    VMDecodeCache();
+    ~VMDecodeCache();
+    
+    void initialize();
+    bool is_initialized() const { return code_bitmap != nullptr; }
+    
+    // Return the decoded instruction at ip, decoding it on first use
+    const VMDecodedInstruction& lookup(VirtualMachine& vm, uint16_t ip) {
+        const VMDecodedInstruction& entry = entries[ip & 0x1FFF];
+        if (entry.length) {
+            return entry;
+        }
+        return decode_entry(vm, ip & 0x1FFF);
+    }
+    
+    // Write tracking
+    bool is_code(uint16_t address) const {
+        return code_bitmap && 
+               (code_bitmap[address >> 6] >> (address & 63)) & 1;
+    }
+    
+    void invalidate(uint16_t address);
+    void invalidate_all();
+    
+    // Entries built from the SP/IP cells (0x1FFE/0x1FFF, the top two bits of
+    // the last bitmap word) captured the register values at decode time.
+    // Registers cached by the run loop change without write tracking, so
+    // the loop drops such entries before every step.
+    void invalidate_register_cells() {
+        if (code_bitmap[VM_DECODE_CACHE_ENTRIES / 64 - 1] >> 62) {
+            invalidate(0x1FFE);
+            invalidate(0x1FFF);
+        }
+    }
+    
+    // Decoded entry at ip without attempting fusion (fusion components)
+    const VMDecodedInstruction& lookup_unfused(VirtualMachine& vm, uint16_t ip);
+    
+    // Entries whose liveness depends on this word are dropped when it is written
+    void mark_liveness(uint16_t address);
+    
+    // Fuse learned sequences while decoding, nullptr disables fusion
+    void set_fusion(VMSuperinstructions* superinstructions);
+    
+    // Load-time optimizer whose rewrites apply to every decoded entry
+    void set_optimizer(const VMProgramOptimizer* program_optimizer);
+    
+    // Bind specialized handlers instead of the executor thunk
+    void set_specialized(bool enabled);
+};
+
+// Handlers installed by the decoder
+bool vm_handler_executor(const VMDecodedInstruction& instruction, ExecutionContext& context);
+bool vm_handler_illegal(const VMDecodedInstruction& instruction, ExecutionContext& context);
+
+#endif // VM_DECODE_CACHE_H
\ No newline at end of file
@@ -0,0 +1,130 @@
+#ifndef VM_HASH_H
+#define VM_HASH_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+// Hashing constants
+constexpr size_t VM_VISITED_DEFAULT_CAPACITY = 1 << 20;   // States per visited set
+constexpr uint64_t VM_VISITED_EMPTY = 0;                   // Free slot marker
+
+// CRC-32 (IEEE 802.3, reflected), eight bytes per table step. crc
+// continues a previous call; the first call passes 0.
+uint32_t vm_crc32(const void* data, size_t size, uint32_t crc = 0);
+
+// 64-bit mix of one value (splitmix64 finalizer)
+inline uint64_t vm_hash_mix(uint64_t value) {
+    value += 0x9E3779B97F4A7C15ULL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    return value ^ (value >> 31);
+}
+
+// Contribution of one memory cell to a state hash. A state hash is the
+// wrapping sum over every cell, so a store replaces one term in O(1).
+inline uint64_t vm_hash_cell(uint16_t address, uint16_t value) {
+    return vm_hash_mix(static_cast<uint64_t>(address) << 13 | value);
+}
+
+// Combine the hash of the cells below SP/IP with the registers and flags
+// (bit n is flag VM_FLAG_* n)
+inline uint64_t vm_hash_state(uint64_t memory_hash, uint16_t ip, uint16_t sp, uint8_t flags) {
+    return memory_hash + vm_hash_cell(0x1FFE, sp) + vm_hash_cell(0x1FFF, ip) +
+           vm_hash_mix(0x10000000ULL | flags);
+}
+
+// Brent's cycle detection over the states of one run. The state seen at
+// each power-of-two step count is kept; meeting it again means the guest
+// loops forever, since the machine is deterministic. Callers reset() the
+// detector on input, which moves the guest on whatever its state.
+//
+// A loop of length L entered after M steps is caught within about
+// 2 * (M + L) steps. States compare by memory hash, so a collision
+// (probability 2^-64 per comparison) reports a false cycle. The machine
+// only checks it in its interpreted loop, see set_cycle_detection().
+class VMCycleDetector {
+private:
+    uint64_t memory_hash;
+    uint16_t ip;
+    uint16_t sp;
+    uint8_t flags;
+    uint64_t power;
+    uint64_t length;
+    
+public:
+    VMCycleDetector() { reset(); }
+    
+    void reset() {
+        memory_hash = 0;
+        ip = sp = 0;
+        flags = 0xFF;       // Never a real flag set, so nothing matches before the first save
+        power = 1;
+        length = 0;
+    }
+    
+    // Cheap part of the comparison; flags are compared once this matches
+    bool matches(uint64_t state_memory, uint16_t state_ip, uint16_t state_sp) const {
+        return state_memory == memory_hash && state_ip == ip && state_sp == sp;
+    }
+    bool matches_flags(uint8_t state_flags) const { return state_flags == flags; }
+    
+    // Count a step; true when the current state should replace the saved one
+    bool advance() {
+        if (++length < power) {
+            return false;
+        }
+        power <<= 1;
+        length = 0;
+        return true;
+    }
+    
+    void save(uint64_t state_memory, uint16_t state_ip, uint16_t state_sp, uint8_t state_flags) {
+        memory_hash = state_memory;
+        ip = state_ip;
+        sp = state_sp;
+        flags = state_flags;
+    }
+};
+
+// Set of state hashes shared by concurrent searches. Open addressing over
+// atomic slots: lookups and inserts never lock. The set never grows; once
+// three quarters full, insert() reports every hash as new, so callers
+// stop pruning but never prune wrongly.
+//
+// Each hash carries a 64-bit tag of whoever inserted it first (for search
+// drivers, the input prefix that reached the state), so callers can tell
+// their own earlier visits from duplicates.
+class VMVisitedStates {
+private:
+    struct Slot {
+        std::atomic<uint64_t> hash;
+        std::atomic<uint64_t> tag;
+        std::atomic<bool> ready;    // tag written
+    };
+    
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    size_t limit;
+    std::atomic<size_t> count;
+    
+public:
+    // capacity is rounded up to a power of two
+    explicit VMVisitedStates(size_t capacity = VM_VISITED_DEFAULT_CAPACITY);
+    
+    VMVisitedStates(const VMVisitedStates&) = delete;
+    VMVisitedStates& operator=(const VMVisitedStates&) = delete;
+    
+    // Insert hash with tag; returns the tag stored for hash: tag itself
+    // when this call inserted it (or the set is full), the first
+    // inserter's tag otherwise. Not safe against a concurrent clear().
+    uint64_t insert(uint64_t hash, uint64_t tag);
+    
+    bool contains(uint64_t hash) const;
+    size_t size() const { return count.load(std::memory_order_relaxed); }
+    size_t get_capacity() const { return mask + 1; }
+    void clear();
+};
+
+#endif // VM_HASH_H
\ No newline at end of file
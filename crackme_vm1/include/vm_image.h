@@ -0,0 +1,121 @@
+#ifndef VM_IMAGE_H
+#define VM_IMAGE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+class VirtualMachine;
+
+// Image file constants
+constexpr uint32_t VM_IMAGE_FILE_MAGIC = 0x4D494D56;    // "VMIM"
+constexpr uint16_t VM_IMAGE_FILE_VERSION = 1;
+constexpr uint32_t VM_IMAGE_SECTION_ALIGNMENT = 64;
+constexpr size_t VM_IMAGE_SYMBOL_NAME_SIZE = 26;
+constexpr uint32_t VM_IMAGE_PACKED_SIZE = 0x3400;       // 13 bits for every address
+
+// File header. Sections start at VM_IMAGE_SECTION_ALIGNMENT-aligned
+// offsets: the packed memory image (VirtualMachine::load_image format),
+// the same memory unpacked to one word per address and the symbol table.
+// The checksum is the CRC-32 of every byte after the header; loading also
+// checks that the unpacked words match the packed image.
+struct VMImageHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint16_t entry_ip;
+    uint16_t entry_sp;
+    uint32_t memory_offset;
+    uint32_t memory_size;
+    uint32_t words_offset;
+    uint32_t symbol_offset;
+    uint32_t symbol_count;
+    uint32_t file_size;
+    uint32_t checksum;
+    uint8_t reserved[24];
+};
+
+static_assert(sizeof(VMImageHeader) == 64, "VMImageHeader is part of the file format");
+
+enum VMImageSymbolKind : uint16_t {
+    VM_IMAGE_SYMBOL_LABEL = 0,      // Named address
+    VM_IMAGE_SYMBOL_BLOCK = 1       // Basic block, length words of straight-line code
+};
+
+struct VMImageSymbol {
+    uint16_t address;
+    uint16_t length;                // Words covered, 0 for plain labels
+    uint16_t kind;                  // VMImageSymbolKind
+    char name[VM_IMAGE_SYMBOL_NAME_SIZE];   // NUL terminated and padded, may be empty
+};
+
+static_assert(sizeof(VMImageSymbol) == 32, "VMImageSymbol is part of the file format");
+
+// Whole file mapped read-only, or read into the heap where mmap is not
+// available. Throws std::runtime_error when the file cannot be opened.
+class VMMappedFile {
+private:
+    uint8_t* data;
+    size_t size;
+    bool mapped;
+    
+public:
+    explicit VMMappedFile(const char* path);
+    ~VMMappedFile();
+    
+    VMMappedFile(const VMMappedFile&) = delete;
+    VMMappedFile& operator=(const VMMappedFile&) = delete;
+    
+    const uint8_t* get_data() const { return data; }
+    size_t get_size() const { return size; }
+    
+    // Access pattern hints for files read once from front to back. Pages
+    // discarded are dropped from memory and read again if touched later.
+    void advise_sequential();
+    void discard(size_t offset, size_t length);
+};
+
+// Versioned program image mapped read-only into memory. Nothing is copied
+// or decoded after the checks in the constructor: copy-on-write
+// machines loading the image read its unpacked words in place, so any
+// number of machines (and their forks) share one mapping. Values are
+// little-endian and used in place, which assumes a little-endian host.
+class VMImage {
+private:
+    VMMappedFile file;
+    const uint8_t* data;
+    const VMImageHeader* header;
+    
+    void validate();
+    
+public:
+    // Maps path; throws std::runtime_error when it is not a valid image
+    explicit VMImage(const char* path);
+    
+    VMImage(const VMImage&) = delete;
+    VMImage& operator=(const VMImage&) = delete;
+    
+    uint16_t get_entry_ip() const { return header->entry_ip; }
+    uint16_t get_entry_sp() const { return header->entry_sp; }
+    
+    const uint8_t* get_memory() const { return data + header->memory_offset; }
+    uint32_t get_memory_size() const { return header->memory_size; }
+    const uint16_t* get_words() const { return reinterpret_cast<const uint16_t*>(data + header->words_offset); }
+    
+    uint32_t get_symbol_count() const { return header->symbol_count; }
+    const VMImageSymbol& get_symbol(uint32_t index) const;
+    
+    // First symbol with the name, nullptr if there is none
+    const VMImageSymbol* find_symbol(const char* name) const;
+    
+    // Write the machine's memory as an image; the IP and SP cells give the
+    // entry point and stack
+    static void write(FILE* output, VirtualMachine& vm, const std::vector<VMImageSymbol>& symbols);
+};
+
+// Basic blocks of the code reachable from the IP cell, following
+// fall-through and direct jump targets like the AOT translator
+std::vector<VMImageSymbol> vm_image_find_blocks(VirtualMachine& vm);
+
+#endif // VM_IMAGE_H
\ No newline at end of file
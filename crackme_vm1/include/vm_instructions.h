@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
 #include "vm_memory.h"
 
 // VM instruction opcodes (based on analysis)
@@ -65,6 +66,21 @@ enum class VMOpcode : uint16_t {
     NOP = 0x28
 };
 
+// Indices into ExecutionContext::status_flags
+enum VMFlagIndex {
+    VM_FLAG_SIGN = 0,
+    VM_FLAG_ZERO = 1,
+    VM_FLAG_CARRY = 2,
+    VM_FLAG_OVERFLOW = 3
+};
+
+// Flag bit masks used by flag read/write analysis
+constexpr uint8_t VM_FLAG_MASK_SIGN = 1 << VM_FLAG_SIGN;
+constexpr uint8_t VM_FLAG_MASK_ZERO = 1 << VM_FLAG_ZERO;
+constexpr uint8_t VM_FLAG_MASK_CARRY = 1 << VM_FLAG_CARRY;
+constexpr uint8_t VM_FLAG_MASK_OVERFLOW = 1 << VM_FLAG_OVERFLOW;
+constexpr uint8_t VM_FLAG_MASK_ALL = 0xF;
+
 // Instruction format structure
 struct VMInstruction {
     uint16_t opcode : 9;      // 9-bit opcode (bits 12-4)
@@ -76,14 +92,179 @@ struct VMInstruction {
     
     // Helper method to encode to raw instruction word
     uint16_t encode() const;
+    
+    // Number of operand words following the opcode word
+    static constexpr uint8_t operand_count(uint16_t opcode) {
+        switch (static_cast<VMOpcode>(opcode)) {
+            case VMOpcode::MOV:
+            case VMOpcode::XCHG:
+            case VMOpcode::ADD:
+            case VMOpcode::SUB:
+            case VMOpcode::AND:
+            case VMOpcode::OR:
+            case VMOpcode::XOR:
+            case VMOpcode::CMP:
+                return 2;
+                
+            case VMOpcode::INC:
+            case VMOpcode::DEC:
+            case VMOpcode::NOT:
+            case VMOpcode::SHL:
+            case VMOpcode::SHR:
+            case VMOpcode::ROL:
+            case VMOpcode::ROR:
+            case VMOpcode::JMP:
+            case VMOpcode::JZ:
+            case VMOpcode::JNZ:
+            case VMOpcode::JC:
+            case VMOpcode::JNC:
+            case VMOpcode::JS:
+            case VMOpcode::JNS:
+            case VMOpcode::JO:
+            case VMOpcode::JNO:
+            case VMOpcode::JL:
+            case VMOpcode::JG:
+            case VMOpcode::JLE:
+            case VMOpcode::JGE:
+            case VMOpcode::PUSH:
+            case VMOpcode::POP:
+            case VMOpcode::IN:
+            case VMOpcode::OUT:
+            case VMOpcode::IN_STR:
+            case VMOpcode::IN_HEX:
+                return 1;
+                
+            default:
+                // CLC/STC/CMC/HALT/NOP and unknown opcodes take no operands
+                return 0;
+        }
+    }
+    
+    static constexpr bool is_valid_opcode(uint16_t opcode) {
+        return (opcode >= static_cast<uint16_t>(VMOpcode::MOV) && 
+                opcode <= static_cast<uint16_t>(VMOpcode::JGE)) ||
+               (opcode >= static_cast<uint16_t>(VMOpcode::CLC) && 
+                opcode <= static_cast<uint16_t>(VMOpcode::HALT));
+    }
+    
+    // Instructions that may leave the straight-line instruction sequence
+    static constexpr bool is_control_flow(uint16_t opcode) {
+        return (opcode >= static_cast<uint16_t>(VMOpcode::JMP) && 
+                opcode <= static_cast<uint16_t>(VMOpcode::JGE)) ||
+               opcode == static_cast<uint16_t>(VMOpcode::HALT) ||
+               !is_valid_opcode(opcode);
+    }
+    
+    // Instructions that store to guest memory
+    static constexpr bool writes_memory(uint16_t opcode) {
+        switch (static_cast<VMOpcode>(opcode)) {
+            case VMOpcode::CMP:
+            case VMOpcode::OUT:
+            case VMOpcode::CLC:
+            case VMOpcode::STC:
+            case VMOpcode::CMC:
+            case VMOpcode::NOP:
+            case VMOpcode::HALT:
+                return false;
+            default:
+                // Jumps store the instruction pointer
+                return is_valid_opcode(opcode);
+        }
+    }
+    
+    // Flags consumed by an opcode (VM_FLAG_MASK_* bits)
+    static constexpr uint8_t flags_read(uint16_t opcode) {
+        switch (static_cast<VMOpcode>(opcode)) {
+            case VMOpcode::JZ:
+            case VMOpcode::JNZ:
+                return VM_FLAG_MASK_ZERO;
+            case VMOpcode::JC:
+            case VMOpcode::JNC:
+            case VMOpcode::CMC:
+                return VM_FLAG_MASK_CARRY;
+            case VMOpcode::JS:
+            case VMOpcode::JNS:
+                return VM_FLAG_MASK_SIGN;
+            case VMOpcode::JO:
+            case VMOpcode::JNO:
+                return VM_FLAG_MASK_OVERFLOW;
+            case VMOpcode::JL:
+            case VMOpcode::JGE:
+                return VM_FLAG_MASK_SIGN | VM_FLAG_MASK_OVERFLOW;
+            case VMOpcode::JG:
+            case VMOpcode::JLE:
+                return VM_FLAG_MASK_ZERO | VM_FLAG_MASK_SIGN | VM_FLAG_MASK_OVERFLOW;
+            default:
+                return 0;
+        }
+    }
+    
+    // Flags overwritten by an opcode (VM_FLAG_MASK_* bits)
+    static constexpr uint8_t flags_written(uint16_t opcode) {
+        switch (static_cast<VMOpcode>(opcode)) {
+            case VMOpcode::ADD:
+            case VMOpcode::SUB:
+            case VMOpcode::CMP:
+            case VMOpcode::AND:
+            case VMOpcode::OR:
+            case VMOpcode::XOR:
+            case VMOpcode::NOT:
+            case VMOpcode::SHL:
+            case VMOpcode::SHR:
+            case VMOpcode::ROL:
+            case VMOpcode::ROR:
+                return VM_FLAG_MASK_ALL;
+            case VMOpcode::INC:
+            case VMOpcode::DEC:
+                return VM_FLAG_MASK_SIGN | VM_FLAG_MASK_ZERO | VM_FLAG_MASK_OVERFLOW;
+            case VMOpcode::CLC:
+            case VMOpcode::STC:
+            case VMOpcode::CMC:
+                return VM_FLAG_MASK_CARRY;
+            default:
+                return 0;
+        }
+    }
+    
+    // Mnemonic lookup, nullptr / -1 for unknown values
+    static const char* opcode_name(uint16_t opcode);
+    static int opcode_from_name(const char* name);
+};
+
+class VirtualMachine;
+class InstructionExecutor;
+
+// Flag-setting operation recorded for lazy evaluation
+enum class VMFlagOperation : uint8_t {
+    NONE = 0,
+    ADD,
+    SUB,            // SUB and CMP
+    LOGIC,          // AND, OR, XOR, NOT
+    INC,
+    DEC,
+    SHIFT_LEFT,     // SHL and ROL: carry is the old bit 12
+    SHIFT_RIGHT     // SHR and ROR: carry is the old bit 0
+};
+
+// Last flag-setting operation and its inputs. Flags in the pending mask
+// are stale in the flag array until evaluated from this record.
+struct VMLazyFlags {
+    VMFlagOperation operation;
+    uint8_t pending;
+    uint16_t value1;
+    uint16_t value2;
+    uint16_t result;
 };
 
 // Instruction execution context
 struct ExecutionContext {
     uint8_t* memory;
-    uint16_t ip;  // Instruction pointer
-    uint16_t sp;  // Stack pointer
+    uint16_t ip;  // Instruction pointer (next instruction while a handler runs)
+    uint16_t sp;  // Stack pointer, authoritative while the VM caches registers
     bool* status_flags;
+    VirtualMachine* machine;
+    InstructionExecutor* executor;
+    VMLazyFlags lazy_flags;  // Pending evaluation of status_flags (vm_alu.h)
 };
 
 // Instruction executor interface
@@ -98,4 +279,45 @@ public:
     virtual ~InstructionExecutor() = default;
 };
 
+// Maximum number of characters stored by IN_STR
+constexpr uint16_t VM_MAX_INPUT_STRING = 0x100;
+
+// Guest I/O of the executing machine (vm_active_runtime): its memory I/O
+// when set, then its port (vm_io.h), its streams otherwise
+uint16_t vm_io_read_char();
+void vm_io_write_char(uint16_t value);
+void vm_io_read_string(VirtualMachine& vm, uint16_t address);
+uint16_t vm_io_read_hex();
+
+// In-memory guest input and output
+struct VMMemoryIO {
+    std::string input;
+    size_t input_position;
+    std::string output;
+    bool suspend;       // Suspend reads the buffered input cannot complete
+};
+
+// Stream semantics over a memory input: EOF reads 0x1FFF, hex reads as fscanf("%x")
+uint16_t vm_input_read_char(const std::string& input, size_t& position);
+uint16_t vm_input_read_hex(const std::string& input, size_t& position);
+uint16_t vm_memory_io_read_char(VMMemoryIO& io);
+uint16_t vm_memory_io_read_hex(VMMemoryIO& io);
+
+// True when the executing machine's memory input suspends and cannot yet complete an
+// IN (no character), IN_STR (no newline) or IN_HEX (number may continue)
+bool vm_io_input_pending(VMOpcode opcode);
+
+// Basic instruction executor implementation.
+// Operands are passed as resolved addresses; values are loaded through
+// the owning VirtualMachine so every memory mode is handled the same way.
+class BasicInstructionExecutor : public InstructionExecutor {
+public:
+    bool execute(VMOpcode opcode, 
+                uint16_t operand1, 
+                uint16_t operand2,
+                AddressingMode mode1,
+                AddressingMode mode2,
+                ExecutionContext& context) override;
+};
+
 #endif // VM_INSTRUCTIONS_H
\ No newline at end of file
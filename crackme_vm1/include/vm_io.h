@@ -0,0 +1,149 @@
+#ifndef VM_IO_H
+#define VM_IO_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// I/O port constants
+constexpr size_t VM_IO_DEFAULT_FLUSH_BYTES = 1 << 16;   // Buffered output flushed in bulk
+constexpr uint32_t VM_IO_LOG_MAGIC = 0x4F494D56;         // "VMIO"
+constexpr uint16_t VM_IO_LOG_VERSION = 1;
+
+// Guest I/O endpoint of a machine (VMRuntime::port). Every IN, IN_HEX,
+// IN_STR character and OUT of the machine goes through one call; reads
+// return 0x1FFF at end of input like the stream handlers.
+class VMIOPort {
+public:
+    virtual ~VMIOPort() = default;
+    
+    virtual uint16_t read_char() = 0;
+    virtual uint16_t read_hex() = 0;
+    virtual void write_char(uint8_t character) = 0;
+    
+    // Ports that log or check instruction counts (VMRuntime::steps) keep
+    // the machine off vm_aot translations, which do not count them
+    virtual bool counts_steps() const { return false; }
+};
+
+// stdio, one character at a time (what a machine without a port does)
+class VMStreamPort : public VMIOPort {
+private:
+    FILE* input;
+    FILE* output;
+    
+public:
+    VMStreamPort(FILE* input, FILE* output) : input(input), output(output) {}
+    
+    uint16_t read_char() override;
+    uint16_t read_hex() override;
+    void write_char(uint8_t character) override;
+};
+
+// Input staged in one contiguous buffer, output appended to a growable
+// buffer and written to the sink (if any) in bulk once it holds
+// flush_bytes, on flush() and on destruction
+class VMBufferedPort : public VMIOPort {
+private:
+    std::string input;
+    size_t position;
+    std::string output;
+    FILE* sink;
+    size_t flush_bytes;
+    
+public:
+    explicit VMBufferedPort(FILE* sink = nullptr, size_t flush_bytes = VM_IO_DEFAULT_FLUSH_BYTES);
+    ~VMBufferedPort();
+    
+    VMBufferedPort(const VMBufferedPort&) = delete;
+    VMBufferedPort& operator=(const VMBufferedPort&) = delete;
+    
+    // Replace the staged input; load_input() reads the stream to its end
+    void set_input(const std::string& data);
+    void load_input(FILE* stream);
+    
+    const std::string& get_output() const { return output; }
+    void clear_output() { output.clear(); }
+    void flush();
+    
+    uint16_t read_char() override;
+    uint16_t read_hex() override;
+    void write_char(uint8_t character) override;
+};
+
+// One guest I/O operation. step is the number of instructions the
+// machine had completed before the instruction performing it.
+enum class VMIOEventKind : uint8_t {
+    READ_CHAR = 0,     // IN and each IN_STR character
+    READ_HEX = 1,
+    WRITE_CHAR = 2
+};
+
+struct VMIOEvent {
+    uint64_t step;
+    VMIOEventKind kind;
+    uint16_t value;
+};
+
+// Ordered I/O events of a run. The file format is a header (magic,
+// version, event count) followed by 11-byte events (step, kind, value),
+// all little-endian.
+class VMIOLog {
+private:
+    std::vector<VMIOEvent> events;
+    
+public:
+    void append(const VMIOEvent& event) { events.push_back(event); }
+    void clear() { events.clear(); }
+    
+    size_t size() const { return events.size(); }
+    const VMIOEvent& get_event(size_t index) const { return events[index]; }
+    
+    void write(FILE* output) const;
+    void read(FILE* input);
+};
+
+// Forwards to another port and logs every event with its step
+class VMRecordingPort : public VMIOPort {
+private:
+    VMIOPort& port;
+    VMIOLog& log;
+    
+public:
+    VMRecordingPort(VMIOPort& port, VMIOLog& log) : port(port), log(log) {}
+    
+    uint16_t read_char() override;
+    uint16_t read_hex() override;
+    void write_char(uint8_t character) override;
+    bool counts_steps() const override { return true; }
+};
+
+// Feeds a recorded log back. Reads return the logged values; every event
+// must match the log in kind and step (and value for writes), otherwise
+// the run diverged and a std::runtime_error is thrown. Replayed output is
+// also passed to the optional output port.
+class VMReplayPort : public VMIOPort {
+private:
+    const VMIOLog& log;
+    size_t position;
+    VMIOPort* output;
+    
+    const VMIOEvent& next(VMIOEventKind kind);
+    
+public:
+    explicit VMReplayPort(const VMIOLog& log, VMIOPort* output = nullptr)
+        : log(log), position(0), output(output) {}
+    
+    // Events consumed so far; a complete replay consumes the whole log
+    size_t get_position() const { return position; }
+    bool is_complete() const { return position == log.size(); }
+    
+    uint16_t read_char() override;
+    uint16_t read_hex() override;
+    void write_char(uint8_t character) override;
+    bool counts_steps() const override { return true; }
+};
+
+#endif // VM_IO_H
\ No newline at end of file
@@ -0,0 +1,127 @@
+#ifndef VM_JIT_H
+#define VM_JIT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include "vm_instructions.h"
+
+class VirtualMachine;
+
+// JIT availability: x86-64 hosts only, everything else interprets
+#if !defined(VM_NO_JIT) && (defined(__x86_64__) || defined(_M_X64))
+#define VM_JIT_SUPPORTED 1
+#else
+#define VM_JIT_SUPPORTED 0
+#endif
+
+// JIT constants
+constexpr size_t VM_JIT_CODE_SIZE = 1 << 20;         // Code arena per VM
+constexpr uint16_t VM_JIT_MAX_BLOCK_INSTRUCTIONS = 64;
+constexpr int32_t VM_JIT_STEP_COUNTER = 0x2000;      // Code map offset of the native step count
+
+// Block exit reasons (bits 29-31 of the value returned by native code)
+enum VMJitExit : uint32_t {
+    VM_JIT_EXIT_CONTINUE = 0,    // Continue at the IP cell
+    VM_JIT_EXIT_HALT = 1,        // HALT executed
+    VM_JIT_EXIT_INTERPRET = 2,   // Next instruction has no translation
+    VM_JIT_EXIT_WRITE_CODE = 3   // Store hit translated code (addresses in bits 0-27)
+};
+
+// State handed to translated code
+struct VMJitFrame {
+    uint16_t* memory;       // Shadow memory, one word per address
+    bool* flags;            // ExecutionContext::status_flags layout
+    uint8_t* code_map;      // Number of blocks covering each address, then the step count
+};
+
+typedef uint32_t (*VMJitEntry)(VMJitFrame* frame);
+
+// Translated basic block
+struct VMJitBlock {
+    VMJitEntry entry;       // Loads the frame, then falls into body
+    uint8_t* body;          // Chained blocks jump here directly
+    uint16_t start;
+    uint16_t length;        // Guest words covered
+    bool valid;
+};
+
+// Exit that can be patched to jump straight into another block
+struct VMJitChainSite {
+    uint8_t* rel32;         // Displacement field of the exit jmp
+    uint8_t* stub;          // Original target returning to the dispatcher
+    uint16_t target;        // Guest IP of the successor
+    VMJitBlock* owner;
+    VMJitBlock* linked;     // Block currently jumped to, nullptr when unlinked
+};
+
+// Basic-block translator from 13-bit VM code to native x86-64.
+// Blocks end at JMP/Jcc/HALT or at the first instruction without a
+// translation (stack and I/O opcodes), which the dispatcher interprets.
+// Flags are materialized into the context flag array after every ALU op
+// and the IP cell is stored (and a step counted) before every instruction,
+// so the architectural state matches the interpreter at every block boundary.
+//
+// The arena is never writable and executable at once: it stays read-write
+// while blocks are emitted or patched and is switched to read-execute
+// before native code is entered.
+class VMJit {
+private:
+    uint8_t* code_buffer;
+    uint8_t* code_cursor;
+    bool writable;          // Arena currently read-write rather than read-execute
+    uint8_t* code_map;
+    VMJitBlock* blocks[0x2000];
+    std::vector<VMJitBlock*> live_blocks;
+    std::vector<VMJitChainSite> chain_sites;
+    
+    VMJitBlock* compile(VirtualMachine& vm, uint16_t ip);
+    void link(VMJitChainSite& site, VMJitBlock* block);
+    void unlink(VMJitChainSite& site);
+    void drop_block(VMJitBlock* block);
+    
+    // Arena protection; throws std::runtime_error when the host refuses
+    void protect(bool write);
+    
+public:
+    VMJit();
+    ~VMJit();
+    
+    // Allocate the code arena; false when the host cannot run JIT code
+    bool initialize();
+    bool is_available() const { return code_buffer != nullptr; }
+    
+    // Translated block starting at ip, compiling it on first use.
+    // Returns nullptr when the first instruction has no translation.
+    VMJitBlock* lookup(VirtualMachine& vm, uint16_t ip) {
+        VMJitBlock* block = blocks[ip & 0x1FFF];
+        if (block) {
+            return block;
+        }
+        return compile(vm, ip & 0x1FFF);
+    }
+    
+    uint32_t enter(VMJitBlock* block, VMJitFrame& frame) {
+        if (writable) {
+            protect(false);
+        }
+        return block->entry(&frame);
+    }
+    
+    // Instructions started by native code since the last call
+    uint64_t take_steps() {
+        uint64_t steps;
+        memcpy(&steps, code_map + VM_JIT_STEP_COUNTER, sizeof(steps));
+        memset(code_map + VM_JIT_STEP_COUNTER, 0, sizeof(steps));
+        return steps;
+    }
+    
+    // Write tracking
+    uint8_t* get_code_map() { return code_map; }
+    bool is_code(uint16_t address) const { return code_map[address] != 0; }
+    void invalidate(uint16_t address);
+    void flush();
+};
+
+#endif // VM_JIT_H
\ No newline at end of file
@@ -1,13 +1,19 @@
 #ifndef VM_MEMORY_H
 #define VM_MEMORY_H
 
+#include <atomic>
 #include <cstdint>
+#include <cstddef>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 // Memory buffer operations for 13-bit packed values
 class VMMemoryManager {
 public:
     // Read a 13-bit value from packed memory buffer
-    static uint16_t read_buffer_value(uint8_t* buffer_ptr, uint16_t address);
+    static uint16_t read_buffer_value(const uint8_t* buffer_ptr, uint16_t address);
     
     // Write a 13-bit value to packed memory buffer
     static void write_buffer_value(uint8_t* buffer_ptr, uint16_t address, uint16_t value);
@@ -17,6 +23,110 @@ public:
     
     // Calculate bit offset for 13-bit packed addressing
     static uint8_t calculate_bit_offset(uint16_t address);
+    
+    // Unpack all 8192 packed 13-bit values into one 16-bit word per address
+    static void unpack_buffer(const uint8_t* buffer_ptr, uint16_t* words);
+    
+    // Pack 8192 16-bit words back into the 13-bit format (flag bytes untouched)
+    static void pack_buffer(const uint16_t* words, uint8_t* buffer_ptr);
+};
+
+// Copy-on-write memory constants
+constexpr uint16_t VM_COW_BLOCK_WORDS = 64;     // 128 bytes unpacked, 104 bytes packed
+constexpr uint16_t VM_COW_BLOCK_COUNT = 0x2000 / VM_COW_BLOCK_WORDS;
+
+// Reference-counted block of unpacked words
+struct VMMemoryBlock {
+    std::atomic<uint32_t> references;
+    uint16_t words[VM_COW_BLOCK_WORDS];
+};
+
+// Unpacked memory held as shared blocks. A copy shares every block with
+// its source; a block is duplicated on the first write through a copy
+// that does not hold its only reference. Blocks never written read their
+// words from a read-only base in place (all zero by default).
+class VMCowMemory {
+private:
+    const uint16_t* views[VM_COW_BLOCK_COUNT];  // Words read for each block
+    VMMemoryBlock* blocks[VM_COW_BLOCK_COUNT];  // nullptr while the block reads the base
+    
+    VMMemoryBlock* make_private(uint16_t block);
+    static void release(VMMemoryBlock* block);
+    
+public:
+    VMCowMemory();                            // Every block zero
+    VMCowMemory(const VMCowMemory& other);    // Shares every block of other
+    
+    // Reads the 8192 words of base in place until they are written; base
+    // must outlive this memory and every copy of it
+    explicit VMCowMemory(const uint16_t* base);
+    ~VMCowMemory();
+    
+    VMCowMemory& operator=(const VMCowMemory&) = delete;
+    
+    uint16_t read(uint16_t address) const {
+        return views[address / VM_COW_BLOCK_WORDS][address % VM_COW_BLOCK_WORDS];
+    }
+    
+    void write(uint16_t address, uint16_t value) {
+        VMMemoryBlock* block = blocks[address / VM_COW_BLOCK_WORDS];
+        if (!block || block->references.load(std::memory_order_acquire) != 1) {
+            block = make_private(address / VM_COW_BLOCK_WORDS);
+        }
+        block->words[address % VM_COW_BLOCK_WORDS] = value;
+    }
+    
+    // Bulk transfer of all 8192 words
+    void load(const uint16_t* words);
+    void store(uint16_t* words) const;
+    
+    // Blocks referenced by this memory alone
+    uint32_t get_private_blocks() const;
+};
+
+// Dirty tracking constants
+constexpr uint16_t VM_DIRTY_BITMAP_WORDS = 0x2000 / 64;
+
+// Index of the lowest set bit of a non-zero mask
+inline uint32_t vm_lowest_bit(uint64_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return index;
+#else
+    return static_cast<uint32_t>(__builtin_ctzll(mask));
+#endif
+}
+
+// One bit per address. Bitmap word n covers addresses 64n..64n+63, the
+// span of copy-on-write block n.
+class VMDirtyBitmap {
+private:
+    uint64_t bits[VM_DIRTY_BITMAP_WORDS];
+    
+public:
+    VMDirtyBitmap() { clear(); }
+    
+    void mark(uint16_t address) { bits[address / 64] |= 1ULL << (address % 64); }
+    bool is_marked(uint16_t address) const { return (bits[address / 64] >> (address % 64)) & 1; }
+    
+    void mark_all();
+    void clear();
+    uint32_t count() const;
+    
+    uint64_t get_word(uint16_t index) const { return bits[index]; }
+    
+    // Calls visit(address) for every marked address in ascending order
+    template <typename Visitor>
+    void for_each(Visitor visit) const {
+        for (uint16_t index = 0; index < VM_DIRTY_BITMAP_WORDS; index++) {
+            uint64_t mask = bits[index];
+            while (mask) {
+                visit(static_cast<uint16_t>(index * 64 + vm_lowest_bit(mask)));
+                mask &= mask - 1;
+            }
+        }
+    }
 };
 
 // Addressing modes for VM instructions
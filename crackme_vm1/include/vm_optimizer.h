@@ -0,0 +1,82 @@
+#ifndef VM_OPTIMIZER_H
+#define VM_OPTIMIZER_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "vm_decode_cache.h"
+
+class VirtualMachine;
+
+// Optimizer constants
+constexpr uint8_t VM_DEAD_STORE_WINDOW = 16;   // Instructions scanned for an overwrite
+
+// Load-time analysis result for one instruction address
+struct VMOptimizedInstruction {
+    bool analyzed;
+    bool removed;             // Dead result and dead flags, executes as a NOP
+    bool flagless;            // Result is used but none of its flags are
+    uint8_t live_flags;       // Flags read on some path after the instruction
+    AddressingMode mode_dst;  // Modes and operands after indirection folding
+    AddressingMode mode_src;
+    uint16_t operand1;
+    uint16_t operand2;
+};
+
+struct VMOptimizerStats {
+    uint32_t instructions;
+    uint32_t blocks;
+    uint32_t flagless;
+    uint32_t folded_operands;
+    uint32_t removed;
+};
+
+// Load-time program optimizer. Builds the CFG of the code reachable from
+// the entry points, runs backward liveness on C/Z/S/V and block-local
+// liveness on memory cells, and rewrites decoded instructions:
+//   - ALU operations whose flags are never read get flag-free handlers
+//   - indirections through cells no reachable code stores to are folded
+//   - stores overwritten before any read are dropped
+// The result assumes the analyzed code and the folded pointer cells keep
+// their load-time values. Any store to one of them discards the whole
+// optimization and execution continues on the original code.
+class VMProgramOptimizer {
+private:
+    VMOptimizedInstruction* program;
+    uint64_t* dependency_bitmap;
+    std::vector<std::pair<uint16_t, uint16_t>> dependencies;  // (address, value)
+    bool active;
+    VMOptimizerStats stats;
+    
+    void add_dependency(VirtualMachine& vm, uint16_t address);
+    bool is_dependency(uint16_t address) const {
+        return (dependency_bitmap[address >> 6] >> (address & 63)) & 1;
+    }
+    
+public:
+    VMProgramOptimizer();
+    ~VMProgramOptimizer();
+    
+    // Analyze current memory; the IP cell is always an entry point
+    void optimize(VirtualMachine& vm, const std::vector<uint16_t>& entry_points);
+    void discard();
+    
+    bool is_active() const { return active; }
+    
+    // Stores to these words invalidate the optimized program
+    bool depends_on(uint16_t address) const {
+        return active && is_dependency(address);
+    }
+    
+    // Recheck dependencies after stores that bypassed write tracking
+    // (native JIT/AOT code); discards and returns false on any change
+    bool verify(VirtualMachine& vm);
+    
+    // Apply the analysis to a freshly decoded entry
+    void rewrite(uint16_t ip, VMDecodedInstruction& entry, bool specialized) const;
+    
+    const VMOptimizedInstruction* get_program() const { return active ? program : nullptr; }
+    const VMOptimizerStats& get_stats() const { return stats; }
+};
+
+#endif // VM_OPTIMIZER_H
\ No newline at end of file
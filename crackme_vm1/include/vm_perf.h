@@ -0,0 +1,85 @@
+#ifndef VM_PERF_H
+#define VM_PERF_H
+
+#include <cstdint>
+#include <cstdio>
+
+// Host hardware events counted around VM runs
+enum VMPerfEvent {
+    VM_PERF_CYCLES = 0,
+    VM_PERF_INSTRUCTIONS = 1,
+    VM_PERF_BRANCH_MISSES = 2,
+    VM_PERF_L1D_MISSES = 3,       // L1 data cache read misses
+    VM_PERF_ITLB_MISSES = 4,
+    VM_PERF_EVENT_COUNT = 5
+};
+
+const char* vm_perf_event_name(VMPerfEvent event);
+
+// Counter totals over one or more runs. Events the host could not count
+// are absent from the mask and stay zero; values are scaled up when the
+// kernel multiplexed the group. guest_instructions is whatever the caller
+// reported (0 when unknown).
+struct VMPerfSample {
+    uint64_t values[VM_PERF_EVENT_COUNT];
+    uint8_t available;                  // Bit n set when event n was counted
+    uint64_t runs;
+    uint64_t guest_instructions;
+    
+    bool has(VMPerfEvent event) const { return (available >> event) & 1; }
+    
+    double per_run(VMPerfEvent event) const {
+        return runs ? static_cast<double>(values[event]) / runs : 0.0;
+    }
+    double per_guest_instruction(VMPerfEvent event) const {
+        return guest_instructions ? static_cast<double>(values[event]) / guest_instructions : 0.0;
+    }
+    
+    VMPerfSample& operator+=(const VMPerfSample& other);
+    
+    // One line per counted event: total, per run and per guest instruction
+    void write_report(FILE* output) const;
+};
+
+// perf_event_open counter group on the calling thread (user space only).
+// The group is opened once and left running; start() and stop() read it
+// and stop() adds the difference to the totals, so bracketing a run costs
+// two read() calls. Unsupported events are left out of the group; without
+// perf events (other hosts, perf_event_paranoid, containers) the object is
+// unavailable and start()/stop() do nothing.
+//
+// Counters follow the thread that constructed the object, so every worker
+// thread needs its own; add their totals together afterwards.
+class VMPerfCounters {
+private:
+    int descriptors[VM_PERF_EVENT_COUNT];
+    int leader;
+    uint8_t available;
+    uint8_t slots[VM_PERF_EVENT_COUNT];     // Position of each event in a group read
+    uint32_t members;
+    
+    uint64_t start_values[VM_PERF_EVENT_COUNT];
+    uint64_t start_enabled;
+    uint64_t start_running;
+    VMPerfSample totals;
+    
+    bool read_group(uint64_t* values, uint64_t& enabled, uint64_t& running) const;
+    
+public:
+    VMPerfCounters();
+    ~VMPerfCounters();
+    
+    VMPerfCounters(const VMPerfCounters&) = delete;
+    VMPerfCounters& operator=(const VMPerfCounters&) = delete;
+    
+    bool is_available() const { return leader >= 0; }
+    uint8_t get_available() const { return available; }
+    
+    void start();
+    void stop(uint64_t guest_instructions = 0);
+    
+    const VMPerfSample& get_totals() const { return totals; }
+    void clear();
+};
+
+#endif // VM_PERF_H
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef VM_POOL_H
+#define VM_POOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include "vm_core.h"
+
+// Pool constants
+constexpr size_t VM_POOL_ALIGNMENT = 64;     // Instances start on their own cache line
+
+// Fixed set of machines loaded with one golden image. Instances are
+// constructed once in a cache-aligned arena and run with write tracking,
+// so returning one to the golden image copies back only the words its
+// runs stored instead of reloading the whole buffer. Configuration set on
+// an instance (dispatch mode, fusion, AOT program) survives restores.
+// JIT and AOT runs store from native code without write tracking and mark
+// every word dirty, so an instance that ran one copies back the whole
+// image (all 8192 words) when it is restored.
+//
+// acquire() and release() may be called from any thread; an acquired
+// instance belongs to its caller until released.
+class VMPool {
+private:
+    std::vector<uint16_t> golden;           // Image words after initialize + load_image
+    uint8_t* arena;
+    size_t stride;                          // Bytes per instance, a multiple of the alignment
+    size_t capacity;
+    size_t constructed;
+    
+    std::mutex lock;
+    std::vector<VirtualMachine*> available;
+    
+    VirtualMachine* instance(size_t index) {
+        return reinterpret_cast<VirtualMachine*>(arena + index * stride);
+    }
+    
+    void destroy();
+    
+public:
+    VMPool(const uint8_t* packed_image, uint32_t image_size, size_t capacity,
+           VMMemoryMode memory_mode = VMMemoryMode::SHADOW);
+    ~VMPool();
+    
+    VMPool(const VMPool&) = delete;
+    VMPool& operator=(const VMPool&) = delete;
+    
+    // An instance at the golden image, or nullptr when all are in use
+    VirtualMachine* acquire();
+    
+    // Restore an acquired instance and return it to the pool
+    void release(VirtualMachine* vm);
+    
+    // Return an acquired instance to the golden image in place
+    void restore(VirtualMachine& vm) { vm.restore_dirty(golden.data()); }
+    
+    const uint16_t* get_golden_image() const { return golden.data(); }
+    size_t get_capacity() const { return capacity; }
+    size_t get_available();
+};
+
+#endif // VM_POOL_H
\ No newline at end of file
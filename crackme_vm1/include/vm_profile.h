@@ -0,0 +1,136 @@
+#ifndef VM_PROFILE_H
+#define VM_PROFILE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <chrono>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define VM_PROFILE_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define VM_PROFILE_TSC 1
+#else
+#define VM_PROFILE_TSC 0
+#endif
+
+// Profiler constants
+constexpr uint32_t VM_PROFILE_DEFAULT_SAMPLE_INTERVAL = 64;  // Steps per timed step
+constexpr size_t VM_PROFILE_REPORT_ROWS = 20;                // Rows per text report table
+
+// Timestamp for sampled step costs: TSC ticks on x86, nanoseconds elsewhere
+inline uint64_t vm_profile_clock() {
+#if VM_PROFILE_TSC
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// Executions and timed samples of one opcode, form or site. Only every
+// sample_interval-th step is timed; the estimated total cost is
+// cycles / samples * count.
+struct VMProfileCounter {
+    uint64_t count;
+    uint64_t samples;
+    uint64_t cycles;
+    
+    double estimated_cycles() const {
+        return samples ? static_cast<double>(cycles) / samples * count : 0.0;
+    }
+};
+
+// Guest IP: counters of whatever instruction last ran there, plus the
+// outcome counts when it was a conditional jump
+struct VMProfileSite {
+    VMProfileCounter counter;
+    uint16_t instruction;      // Raw opcode word last executed at this IP
+    uint64_t taken;
+    uint64_t not_taken;
+};
+
+// Execution profile filled by VirtualMachine::run_uncached.
+//
+// Forms are (opcode, mode_dst, mode_src) triples and are indexed by the
+// raw opcode word, so per-opcode figures are sums over 16 forms. A timed
+// sample covers decode, dispatch and the handler, so it shows the host
+// cost of a step rather than just the operation. The indirection
+// histograms count operands by the number of memory reads
+// OperandResolver makes to reach them (the addressing mode).
+class VMProfiler {
+private:
+    VMProfileCounter* forms;   // [opcode word]
+    VMProfileSite* sites;      // [ip]
+    uint64_t depths[2][4];     // [dst/src][levels of indirection]
+    uint64_t steps;
+    uint32_t sample_interval;
+    uint32_t countdown;
+    
+public:
+    explicit VMProfiler(uint32_t sample_interval = VM_PROFILE_DEFAULT_SAMPLE_INTERVAL);
+    ~VMProfiler();
+    
+    VMProfiler(const VMProfiler&) = delete;
+    VMProfiler& operator=(const VMProfiler&) = delete;
+    
+    void clear();
+    
+    void set_sample_interval(uint32_t interval) { sample_interval = countdown = interval ? interval : 1; }
+    uint32_t get_sample_interval() const { return sample_interval; }
+    
+    // Machine side. record() counts every step; should_sample() picks the
+    // steps whose cost is then reported through record_cycles().
+    bool should_sample() {
+        if (--countdown) {
+            return false;
+        }
+        countdown = sample_interval;
+        return true;
+    }
+    
+    void record(uint16_t ip, uint16_t word, uint8_t length, uint8_t mode_dst, uint8_t mode_src) {
+        steps++;
+        forms[word].count++;
+        sites[ip].counter.count++;
+        sites[ip].instruction = word;
+        if (length > 1) {
+            depths[0][mode_dst]++;
+        }
+        if (length > 2) {
+            depths[1][mode_src]++;
+        }
+    }
+    
+    void record_cycles(uint16_t ip, uint16_t word, uint64_t cycles) {
+        forms[word].samples++;
+        forms[word].cycles += cycles;
+        sites[ip].counter.samples++;
+        sites[ip].counter.cycles += cycles;
+    }
+    
+    void record_branch(uint16_t ip, bool taken) {
+        if (taken) {
+            sites[ip].taken++;
+        } else {
+            sites[ip].not_taken++;
+        }
+    }
+    
+    // Results
+    uint64_t get_steps() const { return steps; }
+    const VMProfileCounter& get_form(uint16_t word) const { return forms[word & 0x1FFF]; }
+    const VMProfileSite& get_site(uint16_t ip) const { return sites[ip & 0x1FFF]; }
+    VMProfileCounter get_opcode(uint16_t opcode) const;
+    uint64_t get_depth(bool source, uint8_t levels) const { return depths[source ? 1 : 0][levels & 3]; }
+    
+    // Complete profile as one JSON object (zero rows omitted)
+    void write_json(FILE* output) const;
+    
+    // Flat text report: the hottest rows of every table
+    void write_report(FILE* output, size_t rows = VM_PROFILE_REPORT_ROWS) const;
+};
+
+#endif // VM_PROFILE_H
\ No newline at end of file
@@ -1,57 +1,61 @@
 #ifndef VM_RUNTIME_H
 #define VM_RUNTIME_H
 
-#include <windows.h>
 #include <cstdint>
 #include <cstdio>
 
-// Global VM runtime variables
-struct VMRuntimeData {
-    // Application type
-    uint32_t app_type;
-    
-    // Command line arguments
-    char** argv;
-    int argc;
-    char* cmd_line;
-    
-    // VM initialization flags
-    uint32_t vm_initialized;
-    uint32_t vm_initialization_lock;
-    uint32_t vm_ready;
-    
-    // Exception handling
-    PVOID original_exception_handler;
-    
-    // Standard streams
+struct VMMemoryIO;
+class VMIOPort;
+
+// Application type for VM initialization
+enum class ApplicationType {
+    CONSOLE = 1,
+    GUI = 2,
+    UNKNOWN = 0
+};
+
+// Runtime state of one machine. Guest I/O goes to memory_io when set, to
+// the port when set and to the streams otherwise; null streams mean the
+// process standard ones. Faults are reported through the machine's
+// status, never process-wide.
+struct VMRuntime {
+    ApplicationType app_type;
     FILE* stdin_stream;
     FILE* stdout_stream;
     FILE* stderr_stream;
+    VMMemoryIO* memory_io;
+    VMIOPort* port;
+    
+    // Instructions executed since initialize(), counted by every core as
+    // it starts them (fused components and native blocks included).
+    // Programs translated by vm_aot do not count.
+    uint64_t steps;
+    
+    VMRuntime()
+        : app_type(ApplicationType::UNKNOWN), stdin_stream(nullptr), stdout_stream(nullptr),
+          stderr_stream(nullptr), memory_io(nullptr), port(nullptr), steps(0) {}
+    
+    FILE* input() const { return stdin_stream ? stdin_stream : stdin; }
+    FILE* output() const { return stdout_stream ? stdout_stream : stdout; }
+    FILE* error() const { return stderr_stream ? stderr_stream : stderr; }
 };
 
-// Get global VM runtime data
-VMRuntimeData& get_vm_runtime();
-
-// Runtime initialization functions
-bool initialize_vm_runtime_critical();
-void set_vm_exception_handler();
-void set_vm_termination_handler();
-
-// TLS (Thread Local Storage) callbacks
-void tls_callback_0(uint64_t param1, uint32_t param2);
-void tls_callback_1(uint64_t param1, uint32_t param2);
-
-// VM exception handler
-LONG WINAPI vm_exception_handler(PEXCEPTION_POINTERS exception_info);
-
-// Math error handler for VM
-int vm_math_error_handler(struct _exception* math_error_info);
+// Runtime guest I/O on this thread is directed to, installed by
+// VirtualMachine::execute for the duration of a run. Without one the
+// process standard streams are used.
+const VMRuntime* vm_active_runtime();
 
-// Process main VM logic
-void vm_process_main_logic(uint8_t* buffer_ptr);
-
-// Hash/checksum initialization
-void initialize_vm_checksum();
-void cleanup_vm_hash_algorithm();
+// Installs a runtime as the active one for its lifetime (nestable)
+class VMRuntimeScope {
+private:
+    const VMRuntime* previous;
+    
+public:
+    explicit VMRuntimeScope(const VMRuntime& runtime);
+    ~VMRuntimeScope();
+    
+    VMRuntimeScope(const VMRuntimeScope&) = delete;
+    VMRuntimeScope& operator=(const VMRuntimeScope&) = delete;
+};
 
 #endif // VM_RUNTIME_H
\ No newline at end of file
@@ -0,0 +1,177 @@
+#ifndef VM_SEARCH_H
+#define VM_SEARCH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include "vm_core.h"
+#include "vm_perf.h"
+
+// Search constants
+constexpr uint64_t VM_SEARCH_DEFAULT_GRAIN = 64;          // Candidates taken per deque pop
+constexpr uint32_t VM_SEARCH_DEFAULT_REPORT_MS = 1000;    // Progress callback period
+
+// Enumerable space of guest inputs. generate() is called concurrently
+// from every worker and must not modify the space.
+class VMInputSpace {
+public:
+    virtual ~VMInputSpace() = default;
+    
+    virtual uint64_t size() const = 0;
+    virtual void generate(uint64_t index, std::string& input) const = 0;
+    
+    // True when the first n characters of any candidate can replace those
+    // of any other (longer) candidate and still give a candidate; state
+    // pruning relies on it
+    virtual bool prefixes_interchangeable() const { return false; }
+};
+
+// Integers first .. first + count - 1, one line each (decimal or hex)
+class VMRangeInputSpace : public VMInputSpace {
+private:
+    uint64_t first;
+    uint64_t count;
+    int radix;
+    
+public:
+    VMRangeInputSpace(uint64_t first, uint64_t count, int radix = 10);
+    
+    uint64_t size() const override { return count; }
+    void generate(uint64_t index, std::string& input) const override;
+};
+
+// Every string over a charset with min_length..max_length characters,
+// shortest first, as one IN_STR line
+class VMCharsetInputSpace : public VMInputSpace {
+private:
+    std::string charset;
+    uint32_t min_length;
+    uint32_t max_length;
+    std::vector<uint64_t> length_counts;   // Strings of each length from min_length
+    uint64_t total;
+    
+public:
+    VMCharsetInputSpace(const std::string& charset, uint32_t min_length, uint32_t max_length);
+    
+    uint64_t size() const override { return total; }
+    void generate(uint64_t index, std::string& input) const override;
+    bool prefixes_interchangeable() const override { return true; }
+};
+
+// Tuples of words hex values in first..last, one IN_HEX read each
+class VMHexWordInputSpace : public VMInputSpace {
+private:
+    uint32_t words;
+    uint16_t first;
+    uint64_t span;          // Values per word
+    uint64_t total;
+    
+public:
+    VMHexWordInputSpace(uint32_t words, uint16_t first = 0, uint16_t last = 0x1FFF);
+    
+    uint64_t size() const override { return total; }
+    void generate(uint64_t index, std::string& input) const override;
+};
+
+// Finished run of one candidate, valid for the duration of the predicate call
+struct VMSearchCandidate {
+    uint64_t index;
+    const std::string& input;
+    const std::string& output;      // Bytes written by OUT
+    VirtualMachine& vm;             // Worker VM holding the final memory and flags
+    VMStatus status;
+};
+
+// Success condition, called concurrently from every worker
+typedef std::function<bool(const VMSearchCandidate& candidate)> VMSearchPredicate;
+
+VMSearchPredicate vm_search_output_contains(const std::string& text);
+VMSearchPredicate vm_search_memory_equals(uint16_t address, uint16_t value);
+
+// Live progress, reported from the thread that called run()
+struct VMSearchProgress {
+    uint64_t executions;
+    uint64_t total;
+    double seconds;
+    double executions_per_second;   // Over the last report period
+};
+
+typedef std::function<void(const VMSearchProgress& progress)> VMSearchReporter;
+
+struct VMSearchResult {
+    bool found;
+    uint64_t index;
+    std::string input;
+    std::string output;
+    uint64_t executions;
+    uint64_t pruned;                // Candidates skipped by state pruning
+    uint64_t exhausted;             // Executions stopped by the step limit
+    double seconds;
+    VMPerfSample perf;              // Summed over workers, with set_perf_counters()
+};
+
+// Runs an image against every candidate of an input space on all cores.
+// Each worker takes a machine from a VMPool, reset to the image between
+// candidates, and owns a deque of candidate indices: it pops grains from
+// the front of its own deque and, once empty, steals the back half of
+// another worker's. The first candidate satisfying the
+// predicate stops every worker at its next candidate boundary; runs in
+// flight complete, so candidates are expected to halt unless a step limit
+// or cycle detection stops them.
+//
+// With prefix sharing, workers run COPY_ON_WRITE machines and feed each
+// candidate's input incrementally. Every time a read suspends after
+// consuming input, the machine is forked; the next candidate resumes
+// from the deepest snapshot whose input is a prefix of its own, so only
+// the differing suffix is executed.
+//
+// State pruning adds every snapshot's state hash to a visited set shared
+// by the workers. Candidates whose prefix reaches a state first reached
+// through another prefix are skipped: the candidate with that prefix
+// instead behaves the same. Predicates must then depend on the output,
+// memory and status only, not on the input or index.
+class VMSearch {
+private:
+    std::vector<uint8_t> image;
+    uint32_t threads;
+    uint64_t grain;
+    VMDispatchMode dispatch_mode;
+    bool prefix_sharing;
+    bool state_pruning;
+    bool cycle_detection;
+    uint64_t step_limit;
+    bool perf_counters;
+    VMSearchReporter reporter;
+    uint32_t report_interval_ms;
+    
+public:
+    VMSearch(const uint8_t* packed_image, uint32_t image_size);
+    
+    // Worker count, 0 uses every hardware thread
+    void set_threads(uint32_t count) { threads = count; }
+    void set_grain(uint64_t candidates) { grain = candidates ? candidates : 1; }
+    void set_dispatch_mode(VMDispatchMode mode) { dispatch_mode = mode; }
+    void set_prefix_sharing(bool enabled) { prefix_sharing = enabled; }
+    
+    // Skip candidates reaching duplicate states (with prefix sharing, over
+    // spaces with interchangeable prefixes; ignored otherwise)
+    void set_state_pruning(bool enabled) { state_pruning = enabled; }
+    
+    // End non-halting candidates with VMStatus::CYCLE (runs interpreted)
+    void set_cycle_detection(bool enabled) { cycle_detection = enabled; }
+    
+    // Give up on candidates after this many instructions, 0 for no limit
+    // (runs interpreted). Exhausted candidates never satisfy the predicate.
+    void set_step_limit(uint64_t steps) { step_limit = steps; }
+    
+    // Count host hardware events around every execute() (VMPerfCounters)
+    void set_perf_counters(bool enabled) { perf_counters = enabled; }
+    void set_reporter(const VMSearchReporter& callback,
+                      uint32_t interval_ms = VM_SEARCH_DEFAULT_REPORT_MS);
+    
+    VMSearchResult run(const VMInputSpace& space, const VMSearchPredicate& success);
+};
+
+#endif // VM_SEARCH_H
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef VM_SPECIALIZED_H
+#define VM_SPECIALIZED_H
+
+#include <cstdint>
+#include "vm_decode_cache.h"
+
+// Decode information for one raw 13-bit instruction word
+struct VMDecodeInfo {
+    VMInstructionHandler handler;   // Specialized for (opcode, mode_dst, mode_src)
+    VMOpcode opcode;
+    AddressingMode mode_dst;
+    AddressingMode mode_src;
+    uint8_t length;                 // Opcode word plus operand words
+};
+
+// Compile-time generated decode table indexed by the raw instruction word.
+// Replaces the bitfield unpacking of VMInstruction::decode and binds each
+// word to a handler with its addressing modes folded in.
+extern const VMDecodeInfo* const VM_DECODE_LUT;
+
+// Operand resolution with the indirection depth fixed at compile time.
+// DIRECT (0) through TRIPLE_INDIRECT (3) unroll into that many loads.
+template <int Depth, typename Machine>
+inline uint16_t vm_resolve(Machine& vm, uint16_t operand) {
+    if constexpr (Depth == 0) {
+        return operand & 0x1FFF;
+    } else {
+        return vm.read_memory(vm_resolve<Depth - 1>(vm, operand));
+    }
+}
+
+#endif // VM_SPECIALIZED_H
\ No newline at end of file
@@ -0,0 +1,101 @@
+#ifndef VM_SUPERINSTRUCTIONS_H
+#define VM_SUPERINSTRUCTIONS_H
+
+#include <cstdint>
+#include <cstddef>
+#include "vm_decode_cache.h"
+
+// Superinstruction constants
+constexpr uint16_t VM_FUSION_OPCODES = 0x40;          // Every valid opcode is below 0x40
+constexpr size_t VM_MAX_FUSION_PATTERNS = 32;
+constexpr uint64_t VM_DEFAULT_FUSION_WARMUP = 100000; // Instructions profiled by ADAPTIVE
+constexpr uint32_t VM_DEFAULT_FUSION_MIN_COUNT = 64;
+constexpr uint8_t VM_LIVENESS_WINDOW = 8;             // Instructions scanned per path
+
+// Superinstruction learning and use
+enum class VMFusionMode {
+    OFF = 0,        // Plain dispatch
+    PROFILE = 1,    // Count opcode n-grams only
+    ADAPTIVE = 2,   // Profile, then learn and fuse the hottest sequences
+    FUSE = 3        // Fuse the current (learned or preloaded) pattern set
+};
+
+// Fusable opcode sequence
+struct VMFusionPattern {
+    uint8_t length;
+    VMOpcode opcodes[VM_MAX_FUSED_INSTRUCTIONS];
+    uint64_t count;
+};
+
+// Opcode n-gram profile and the learned fusion set.
+// Only fall-through sequences are counted, and control flow (JMP/Jcc/HALT)
+// may only appear as the last instruction of a sequence.
+class VMSuperinstructions {
+private:
+    uint32_t* pair_counts;      // [op0][op1]
+    uint32_t* triple_counts;    // [op0][op1][op2]
+    uint64_t recorded;
+    uint8_t history[2];
+    uint8_t history_length;
+    
+    VMFusionPattern patterns[VM_MAX_FUSION_PATTERNS];
+    size_t pattern_count;
+    uint64_t starts_mask;       // Opcodes that begin a pattern
+    
+    void add_pattern(const VMFusionPattern& pattern);
+    uint8_t flags_live_from(VirtualMachine& vm, VMDecodeCache& cache, uint16_t ip);
+    
+public:
+    VMSuperinstructions();
+    ~VMSuperinstructions();
+    
+    // Profiling
+    void start_profiling();
+    void clear_profile();
+    uint64_t get_recorded() const { return recorded; }
+    
+    // Record an executed instruction; fallthrough is false after a taken jump
+    void record(VMOpcode opcode, bool fallthrough) {
+        uint16_t op = static_cast<uint16_t>(opcode);
+        if (!pair_counts) {
+            return;
+        }
+        if (op >= VM_FUSION_OPCODES) {
+            history_length = 0;
+            return;
+        }
+        if (!fallthrough) {
+            history_length = 0;
+        }
+        
+        if (history_length >= 1) {
+            pair_counts[history[0] * VM_FUSION_OPCODES + op]++;
+        }
+        if (history_length >= 2) {
+            triple_counts[(history[1] * VM_FUSION_OPCODES + history[0]) * 
+                          VM_FUSION_OPCODES + op]++;
+        }
+        
+        history[1] = history[0];
+        history[0] = static_cast<uint8_t>(op);
+        history_length = VMInstruction::is_control_flow(op) ? 0 : 
+                         (history_length < 2 ? history_length + 1 : 2);
+        recorded++;
+    }
+    
+    // Pick the sequences that save the most dispatches
+    size_t learn(size_t max_patterns = VM_MAX_FUSION_PATTERNS, 
+                 uint32_t min_count = VM_DEFAULT_FUSION_MIN_COUNT);
+    
+    // Fusion set access and persistence (one "OP OP [OP] count" line each)
+    size_t get_pattern_count() const { return pattern_count; }
+    const VMFusionPattern& get_pattern(size_t index) const { return patterns[index]; }
+    void clear_patterns();
+    bool save(const char* path) const;
+    bool load(const char* path);
+    
+    // Turn the decoded entry at ip into a superinstruction if a pattern starts there
+    void fuse(VirtualMachine& vm, VMDecodeCache& cache, VMDecodedInstruction& entry, uint16_t ip);
+};
+
+#endif // VM_SUPERINSTRUCTIONS_H
\ No newline at end of file
@@ -0,0 +1,177 @@
+#ifndef VM_TRACE_H
+#define VM_TRACE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Build-time switch: 0 compiles tracing out of execute()
+#ifndef VM_TRACE
+#define VM_TRACE 1
+#endif
+
+// Trace constants
+constexpr uint32_t VM_TRACE_DEFAULT_CAPACITY = 1 << 16;    // Records per ring, a power of two
+constexpr uint32_t VM_TRACE_DEFAULT_DRAIN_MS = 10;
+constexpr uint32_t VM_TRACE_FILE_MAGIC = 0x52544D56;       // "VMTR"
+constexpr uint16_t VM_TRACE_FILE_VERSION = 1;
+
+// One executed instruction. Operand fields are zero for operands the
+// instruction does not have; values are read before the step, result and
+// flags after it.
+struct VMTraceRecord {
+    uint64_t step;              // Steps the tracer has seen before this one
+    uint16_t ip;
+    uint16_t instruction;       // Raw opcode word
+    uint16_t dst_address;       // Resolved operand addresses
+    uint16_t src_address;
+    uint16_t dst_value;
+    uint16_t src_value;
+    uint16_t result;            // Word at dst_address after the step
+    uint8_t flags;              // Bit n is flag VM_FLAG_* n
+    uint8_t reserved;
+};
+
+static_assert(sizeof(VMTraceRecord) == 24, "trace records are written as-is");
+
+// Per-machine trace buffer and recording conditions. The machine thread
+// is the only producer and one drain thread the only consumer; the ring
+// never blocks the machine, records that do not fit are counted as
+// dropped.
+//
+// Recording starts at the trigger IP (immediately without one), keeps
+// every sample_interval-th step, and finishes at the stop IP or after
+// record_limit records. A finished tracer no longer slows the machine.
+class VMTracer {
+private:
+    enum class State {
+        WAITING,
+        RECORDING,
+        FINISHED
+    };
+    
+    VMTraceRecord* records;
+    uint32_t mask;
+    alignas(64) std::atomic<uint64_t> head;     // Written by the machine
+    alignas(64) std::atomic<uint64_t> tail;     // Written by the drain
+    
+    alignas(64) State state;
+    uint64_t steps;
+    uint64_t recorded;
+    uint64_t dropped;
+    uint32_t countdown;
+    
+    uint32_t sample_interval;
+    int32_t trigger_ip;
+    int32_t stop_ip;
+    uint64_t record_limit;
+    
+public:
+    explicit VMTracer(uint32_t capacity = VM_TRACE_DEFAULT_CAPACITY);
+    ~VMTracer();
+    
+    VMTracer(const VMTracer&) = delete;
+    VMTracer& operator=(const VMTracer&) = delete;
+    
+    // Recording conditions; -1 / 0 disable the trigger, stop and limit
+    void set_sample_interval(uint32_t interval) { sample_interval = countdown = interval ? interval : 1; }
+    void set_trigger_ip(int32_t ip) { trigger_ip = ip; }
+    void set_stop_ip(int32_t ip) { stop_ip = ip; }
+    void set_record_limit(uint64_t limit) { record_limit = limit; }
+    
+    // Rearm the conditions (the ring keeps undrained records)
+    void restart();
+    
+    // Machine side: count the step and decide whether to record it
+    bool should_record(uint16_t ip) {
+        steps++;
+        if (state == State::WAITING) {
+            if (trigger_ip >= 0 && ip != trigger_ip) {
+                return false;
+            }
+            state = State::RECORDING;
+        } else if (state == State::FINISHED) {
+            return false;
+        }
+        
+        if (ip == stop_ip || (record_limit && recorded >= record_limit)) {
+            state = State::FINISHED;
+            return false;
+        }
+        if (--countdown) {
+            return false;
+        }
+        countdown = sample_interval;
+        return true;
+    }
+    
+    bool is_finished() const { return state == State::FINISHED; }
+    
+    void push(const VMTraceRecord& record) {
+        recorded++;
+        uint64_t position = head.load(std::memory_order_relaxed);
+        if (position - tail.load(std::memory_order_acquire) > mask) {
+            dropped++;
+            return;
+        }
+        records[position & mask] = record;
+        head.store(position + 1, std::memory_order_release);
+    }
+    
+    // Drain side: move up to count records out of the ring
+    size_t drain(VMTraceRecord* output, size_t count);
+    
+    uint64_t get_steps() const { return steps; }
+    uint64_t get_recorded() const { return recorded; }
+    uint64_t get_dropped() const { return dropped; }
+};
+
+// Background thread draining any number of tracers into one file: a
+// header (magic, version, record size) followed by chunks of a tracer
+// id, a record count and that many VMTraceRecords. Header fields are
+// little-endian, records are in host order (little-endian on x86-64).
+class VMTraceWriter {
+private:
+    struct Source {
+        VMTracer* tracer;
+        uint32_t id;
+    };
+    
+    FILE* output;
+    uint32_t interval_ms;
+    std::vector<Source> sources;
+    std::vector<VMTraceRecord> buffer;
+    uint32_t next_id;
+    
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping;
+    std::thread thread;
+    
+    size_t drain_source(const Source& source);
+    void run();
+    
+public:
+    // Writes the header and starts the drain thread; output stays owned
+    // by the caller and must outlive close()
+    explicit VMTraceWriter(FILE* output, uint32_t interval_ms = VM_TRACE_DEFAULT_DRAIN_MS);
+    ~VMTraceWriter();
+    
+    VMTraceWriter(const VMTraceWriter&) = delete;
+    VMTraceWriter& operator=(const VMTraceWriter&) = delete;
+    
+    // Returns the id tagging the tracer's chunks. remove() drains what is
+    // left; a tracer must be removed (or the writer closed) before it is
+    // destroyed.
+    uint32_t add(VMTracer& tracer);
+    void remove(VMTracer& tracer);
+    
+    // Drain every tracer one last time and stop the thread
+    void close();
+};
+
+#endif // VM_TRACE_H
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "vm_runtime.h"
 #include <iostream>
 #include <cstring>
+#include <memory>
 
 // Main VM program data
 static const uint8_t VM_PROGRAM_DATA[] = {
@@ -9,18 +10,24 @@ static const uint8_t VM_PROGRAM_DATA[] = {
     0x80, 0xFF, 0xAF, 0x00, 0xFA, 0x64, 0x9F
 };
 
+// Application type selected by the entry point, console unless the GUI
+// wrapper ran
+static ApplicationType g_app_type = ApplicationType::CONSOLE;
+
 // Main entry point for console application
 int main(int argc, char* argv[]) {
     try {
-        // Initialize VM runtime
-        vm_initialize_console_app();
-        
-        // Create virtual machine
-        VirtualMachine vm(0x3404);
+        // Create virtual machine (executes against unpacked shadow memory)
+        VirtualMachine vm(0x3404, VMMemoryMode::SHADOW);
+        vm.get_runtime().app_type = g_app_type;
         vm.initialize();
         
-        // Load program into VM memory
-        // We need to implement proper program loading
+        // Load program into VM memory from an image file (vm_image)
+        std::unique_ptr<VMImage> image;
+        if (argc > 1) {
+            image.reset(new VMImage(argv[1]));
+            vm.load_image(*image);
+        }
         
         std::cout << "Virtual Machine Initialized" << std::endl;
         std::cout << "Memory size: 0x3404 bytes" << std::endl;
@@ -34,12 +41,15 @@ int main(int argc, char* argv[]) {
         // vm_process_main_logic(vm.get_memory_buffer());
         
         // Execute VM
-        vm.execute();
+        if (vm.execute() == VMStatus::MEMORY_FAULT) {
+            std::cerr << "VM memory fault at 0x" << std::hex << vm.get_fault_address() << std::endl;
+            return 1;
+        }
         
         std::cout << "VM execution completed" << std::endl;
         
         return 0;
-        
+    
     } catch (const std::exception& e) {
         std::cerr << "VM Error: " << e.what() << std::endl;
         return 1;
@@ -49,7 +59,7 @@ int main(int argc, char* argv[]) {
 // Entry point wrapper for different application types
 extern "C" void entry(uint64_t param1, char** param2, uint64_t param3, void* param4) {
     // Set application type to GUI
-    get_vm_runtime().app_type = 0;  // GUI mode
+    g_app_type = ApplicationType::GUI;
     
     // Call main initialization
     main(0, nullptr);
@@ -59,7 +69,7 @@ extern "C" void entry(uint64_t param1, char** param2, uint64_t param3, void* par
 extern "C" void vm_initialize_console_app_wrapper(uint64_t param1, char** param2, 
                                                   uint64_t param3, void* param4) {
     // Set application type to console
-    get_vm_runtime().app_type = 1;  // Console mode
+    g_app_type = ApplicationType::CONSOLE;
     
     // Call main initialization
     main(0, nullptr);
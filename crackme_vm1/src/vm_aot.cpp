@@ -0,0 +1,425 @@
+#include "../include/vm_aot.h"
+#include "../include/vm_core.h"
+#include "../include/vm_specialized.h"
+#include "../include/vm_alu.h"
+#include <cstring>
+#include <algorithm>
+
+// C++ expression for the resolved address of an operand
+static std::string vm_aot_operand(uint16_t operand, AddressingMode mode) {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "0x%04X", operand & 0x1FFF);
+    
+    std::string expression = buffer;
+    for (int depth = static_cast<int>(mode) & 3; depth > 0; depth--) {
+        expression = "memory[" + expression + "]";
+    }
+    return expression;
+}
+
+static const char* vm_aot_alu_function(VMOpcode opcode) {
+    switch (opcode) {
+        case VMOpcode::ADD: return "vm_alu_add";
+        case VMOpcode::SUB: return "vm_alu_sub";
+        case VMOpcode::CMP: return "vm_alu_sub";
+        case VMOpcode::INC: return "vm_alu_inc";
+        case VMOpcode::DEC: return "vm_alu_dec";
+        case VMOpcode::SHL: return "vm_alu_shl";
+        case VMOpcode::SHR: return "vm_alu_shr";
+        case VMOpcode::ROL: return "vm_alu_rol";
+        case VMOpcode::ROR: return "vm_alu_ror";
+        default:            return nullptr;
+    }
+}
+
+static const char* vm_aot_logic_operator(VMOpcode opcode) {
+    switch (opcode) {
+        case VMOpcode::AND: return "&";
+        case VMOpcode::OR:  return "|";
+        case VMOpcode::XOR: return "^";
+        default:            return nullptr;
+    }
+}
+
+VMAotTranslator::VMAotTranslator(VirtualMachine& vm) : vm(vm) {
+    memset(reachable, 0, sizeof(reachable));
+    memset(code_map, 0, sizeof(code_map));
+}
+
+void VMAotTranslator::add_entry_point(uint16_t address) {
+    entry_points.push_back(address & 0x1FFF);
+}
+
+size_t VMAotTranslator::get_instruction_count() const {
+    return std::count(reachable, reachable + 0x2000, true);
+}
+
+bool VMAotTranslator::translatable(uint16_t ip) {
+    const VMDecodeInfo& info = VM_DECODE_LUT[vm.read_memory(ip)];
+    
+    // IN_STR writes a whole run of cells and illegal opcodes stop the VM;
+    // both are left to the interpreter. Instructions overlapping the IP
+    // cell would be rewritten by their own IP update.
+    if (info.opcode == VMOpcode::IN_STR || !VMInstruction::is_valid_opcode(static_cast<uint16_t>(info.opcode))) {
+        return false;
+    }
+    return ip + info.length <= VM_INSTRUCTION_POINTER;
+}
+
+void VMAotTranslator::discover() {
+    std::vector<uint16_t> pending(entry_points);
+    pending.push_back(vm.read_memory(VM_INSTRUCTION_POINTER));
+    
+    while (!pending.empty()) {
+        uint16_t ip = pending.back();
+        pending.pop_back();
+        
+        if (reachable[ip]) {
+            continue;
+        }
+        reachable[ip] = true;
+        
+        const VMDecodeInfo& info = VM_DECODE_LUT[vm.read_memory(ip)];
+        uint16_t next_ip = (ip + info.length) & 0x1FFF;
+        
+        if (!translatable(ip)) {
+            // Execution resumes after an interpreted IN_STR
+            if (info.opcode == VMOpcode::IN_STR) {
+                pending.push_back(next_ip);
+            }
+            continue;
+        }
+        
+        // Translated code depends on every word of the instruction
+        for (uint16_t i = 0; i < info.length; i++) {
+            code_map[ip + i] = 1;
+        }
+        
+        if (info.opcode == VMOpcode::HALT) {
+            continue;
+        }
+        
+        if (info.opcode >= VMOpcode::JMP && info.opcode <= VMOpcode::JGE) {
+            // Computed targets are only known at run time
+            if (info.mode_dst == AddressingMode::DIRECT) {
+                pending.push_back(vm.read_memory(ip + 1));
+            }
+            if (info.opcode == VMOpcode::JMP) {
+                continue;
+            }
+        }
+        
+        pending.push_back(next_ip);
+    }
+}
+
+void VMAotTranslator::emit_store_check(FILE* output, const char* address, 
+                                       bool constant, uint16_t value) {
+    if (constant) {
+        // Resolved at translation time
+        if (code_map[value]) {
+            fprintf(output, "        return VM_AOT_EXIT_WRITE_CODE;\n");
+        } else if (value == VM_INSTRUCTION_POINTER) {
+            fprintf(output, "        goto dispatch;\n");
+        }
+        return;
+    }
+    
+    fprintf(output, "        if (vm_aot_code_map[%s]) {\n", address);
+    fprintf(output, "            return VM_AOT_EXIT_WRITE_CODE;\n");
+    fprintf(output, "        }\n");
+    fprintf(output, "        if (%s == VM_INSTRUCTION_POINTER) {\n", address);
+    fprintf(output, "            goto dispatch;\n");
+    fprintf(output, "        }\n");
+}
+
+void VMAotTranslator::emit_jump(FILE* output, const char* indent, uint16_t target) {
+    target &= 0x1FFF;
+    fprintf(output, "%smemory[VM_INSTRUCTION_POINTER] = 0x%04X;\n", indent, target);
+    
+    if (reachable[target]) {
+        fprintf(output, "%sgoto L_%04X;\n", indent, target);
+    } else {
+        fprintf(output, "%sgoto dispatch;\n", indent);
+    }
+}
+
+void VMAotTranslator::emit_instruction(FILE* output, uint16_t ip, uint16_t following) {
+    const VMDecodeInfo& info = VM_DECODE_LUT[vm.read_memory(ip)];
+    const char* name = VMInstruction::opcode_name(static_cast<uint16_t>(info.opcode));
+    
+    fprintf(output, "L_%04X:  // %s\n", ip, name ? name : "(illegal)");
+    
+    if (!translatable(ip)) {
+        fprintf(output, "    return VM_AOT_EXIT_INTERPRET;\n\n");
+        return;
+    }
+    
+    uint16_t operand1 = info.length > 1 ? vm.read_memory(ip + 1) : 0;
+    uint16_t operand2 = info.length > 2 ? vm.read_memory(ip + 2) : 0;
+    uint16_t next_ip = (ip + info.length) & 0x1FFF;
+    std::string dst = vm_aot_operand(operand1, info.mode_dst);
+    std::string src = vm_aot_operand(operand2, info.mode_src);
+    bool dst_constant = info.mode_dst == AddressingMode::DIRECT;
+    bool src_constant = info.mode_src == AddressingMode::DIRECT;
+    bool falls_through = true;
+    
+    fprintf(output, "    memory[VM_INSTRUCTION_POINTER] = 0x%04X;\n", next_ip);
+    
+    switch (info.opcode) {
+        case VMOpcode::MOV:
+            fprintf(output, "    {\n");
+            fprintf(output, "        const uint16_t d = %s;\n", dst.c_str());
+            fprintf(output, "        const uint16_t s = %s;\n", src.c_str());
+            fprintf(output, "        memory[d] = memory[s];\n");
+            emit_store_check(output, "d", dst_constant, operand1 & 0x1FFF);
+            fprintf(output, "    }\n");
+            break;
+            
+        case VMOpcode::XCHG:
+            fprintf(output, "    {\n");
+            fprintf(output, "        const uint16_t d = %s;\n", dst.c_str());
+            fprintf(output, "        const uint16_t s = %s;\n", src.c_str());
+            fprintf(output, "        const uint16_t value1 = memory[d];\n");
+            fprintf(output, "        const uint16_t value2 = memory[s];\n");
+            fprintf(output, "        memory[d] = value2;\n");
+            fprintf(output, "        memory[s] = value1;\n");
+            emit_store_check(output, "d", dst_constant, operand1 & 0x1FFF);
+            emit_store_check(output, "s", src_constant, operand2 & 0x1FFF);
+            fprintf(output, "    }\n");
+            break;
+            
+        case VMOpcode::ADD:
+        case VMOpcode::SUB:
+            fprintf(output, "    {\n");
+            fprintf(output, "        const uint16_t d = %s;\n", dst.c_str());
+            fprintf(output, "        const uint16_t s = %s;\n", src.c_str());
+            fprintf(output, "        memory[d] = %s(memory[d], memory[s], flags);\n", 
+                    vm_aot_alu_function(info.opcode));
+            emit_store_check(output, "d", dst_constant, operand1 & 0x1FFF);
+            fprintf(output, "    }\n");
+            break;
+            
+        case VMOpcode::CMP:
+            fprintf(output, "    vm_alu_sub(memory[%s], memory[%s], flags);\n", dst.c_str(), src.c_str());
+            break;
+            
+        case VMOpcode::AND:
+        case VMOpcode::OR:
+        case VMOpcode::XOR:
+            fprintf(output, "    {\n");
+            fprintf(output, "        const uint16_t d = %s;\n", dst.c_str());
+            fprintf(output, "        const uint16_t s = %s;\n", src.c_str());
+            fprintf(output, "        memory[d] = vm_alu_logic_flags(memory[d] %s memory[s], flags);\n", 
+                    vm_aot_logic_operator(info.opcode));
+            emit_store_check(output, "d", dst_constant, operand1 & 0x1FFF);
+            fprintf(output, "    }\n");
+            break;
+            
+        case VMOpcode::NOT:
+            fprintf(output, "    {\n");
+            fprintf(output, "        const uint16_t d = %s;\n", dst.c_str());
+            fprintf(output, "        memory[d] = vm_alu_logic_flags(~memory[d] & 0x1FFF, flags);\n");
+            emit_store_check(output, "d", dst_constant, operand1 & 0x1FFF);
+            fprintf(output, "    }\n");
+            break;
+            
+        case VMOpcode::INC:
+        case VMOpcode::DEC:
+        case VMOpcode::SHL:
+        case VMOpcode::SHR:
+        case VMOpcode::ROL:
+        case VMOpcode::ROR:
+            fprintf(output, "    {\n");
+            fprintf(output, "        const uint16_t d = %s;\n", dst.c_str());
+            fprintf(output, "        memory[d] = %s(memory[d], flags);\n", vm_aot_alu_function(info.opcode));
+            emit_store_check(output, "d", dst_constant, operand1 & 0x1FFF);
+            fprintf(output, "    }\n");
+            break;
+            
+        case VMOpcode::PUSH:
+            fprintf(output, "    {\n");
+            fprintf(output, "        const uint16_t value = memory[%s];\n", dst.c_str());
+            fprintf(output, "        const uint16_t sp = memory[VM_STACK_POINTER];\n");
+            fprintf(output, "        memory[sp] = value;\n");
+            fprintf(output, "        memory[VM_STACK_POINTER] = (sp - 1) & 0x1FFF;\n");
+            emit_store_check(output, "sp", false, 0);
+            emit_store_check(output, "VM_STACK_POINTER", true, VM_STACK_POINTER);
+            fprintf(output, "    }\n");
+            break;
+            
+        case VMOpcode::POP:
+            fprintf(output, "    {\n");
+            fprintf(output, "        const uint16_t d = %s;\n", dst.c_str());
+            fprintf(output, "        const uint16_t sp = (memory[VM_STACK_POINTER] + 1) & 0x1FFF;\n");
+            fprintf(output, "        const uint16_t value = memory[sp];\n");
+            fprintf(output, "        memory[VM_STACK_POINTER] = sp;\n");
+            fprintf(output, "        memory[d] = value;\n");
+            emit_store_check(output, "VM_STACK_POINTER", true, VM_STACK_POINTER);
+            emit_store_check(output, "d", dst_constant, operand1 & 0x1FFF);
+            fprintf(output, "    }\n");
+            break;
+            
+        case VMOpcode::IN:
+        case VMOpcode::IN_HEX:
+            // Suspended reads are left to the interpreter
+            fprintf(output, "    if (vm_io_input_pending(VMOpcode::%s)) {\n", name);
+            fprintf(output, "        memory[VM_INSTRUCTION_POINTER] = 0x%04X;\n", ip);
+            fprintf(output, "        return VM_AOT_EXIT_INTERPRET;\n");
+            fprintf(output, "    }\n");
+            fprintf(output, "    {\n");
+            fprintf(output, "        const uint16_t d = %s;\n", dst.c_str());
+            fprintf(output, "        memory[d] = %s() & 0x1FFF;\n", 
+                    info.opcode == VMOpcode::IN ? "vm_io_read_char" : "vm_io_read_hex");
+            emit_store_check(output, "d", dst_constant, operand1 & 0x1FFF);
+            fprintf(output, "    }\n");
+            break;
+            
+        case VMOpcode::OUT:
+            fprintf(output, "    vm_io_write_char(memory[%s]);\n", dst.c_str());
+            break;
+            
+        case VMOpcode::CLC:
+            fprintf(output, "    flags[VM_FLAG_CARRY] = false;\n");
+            break;
+            
+        case VMOpcode::STC:
+            fprintf(output, "    flags[VM_FLAG_CARRY] = true;\n");
+            break;
+            
+        case VMOpcode::CMC:
+            fprintf(output, "    flags[VM_FLAG_CARRY] = !flags[VM_FLAG_CARRY];\n");
+            break;
+            
+        case VMOpcode::NOP:
+            break;
+            
+        case VMOpcode::HALT:
+            fprintf(output, "    return VM_AOT_EXIT_HALT;\n");
+            falls_through = false;
+            break;
+            
+        default:
+            // JMP and Jcc
+            if (info.opcode == VMOpcode::JMP) {
+                falls_through = false;
+            } else {
+                fprintf(output, "    if (vm_branch_taken(VMOpcode::%s, flags)) {\n", name);
+            }
+            
+            const char* indent = falls_through ? "        " : "    ";
+            if (dst_constant) {
+                emit_jump(output, indent, operand1);
+            } else {
+                fprintf(output, "%smemory[VM_INSTRUCTION_POINTER] = %s;\n", indent, dst.c_str());
+                fprintf(output, "%sgoto dispatch;\n", indent);
+            }
+            
+            if (falls_through) {
+                fprintf(output, "    }\n");
+            }
+            break;
+    }
+    
+    if (falls_through && next_ip != following) {
+        fprintf(output, "    goto L_%04X;\n", next_ip);
+    }
+    fprintf(output, "\n");
+}
+
+void VMAotTranslator::translate(FILE* output, const char* symbol) {
+    discover();
+    
+    fprintf(output, "// Ahead-of-time translation of a VM image. Generated by vm_aot, do not edit.\n");
+    fprintf(output, "#include \"vm_aot.h\"\n");
+    fprintf(output, "#include \"vm_alu.h\"\n");
+    fprintf(output, "#include \"vm_core.h\"\n\n");
+    
+    // Words the translation depends on, checked before every run
+    fprintf(output, "static const uint16_t vm_aot_image[0x2000] = {");
+    for (uint32_t address = 0; address < 0x2000; address++) {
+        fprintf(output, "%s0x%04X,", address % 12 ? " " : "\n    ", 
+                code_map[address] ? vm.read_memory(address) : 0);
+    }
+    fprintf(output, "\n};\n\n");
+    
+    fprintf(output, "static const uint8_t vm_aot_code_map[0x2000] = {");
+    for (uint32_t address = 0; address < 0x2000; address++) {
+        fprintf(output, "%s%u,", address % 32 ? " " : "\n    ", code_map[address]);
+    }
+    fprintf(output, "\n};\n\n");
+    
+    fprintf(output, "static uint32_t vm_aot_run(uint16_t* memory, bool* flags) {\n");
+    fprintf(output, "    goto dispatch;\n\n");
+    
+    std::vector<uint16_t> labels;
+    for (uint32_t address = 0; address < 0x2000; address++) {
+        if (reachable[address]) {
+            labels.push_back(static_cast<uint16_t>(address));
+        }
+    }
+    
+    for (size_t i = 0; i < labels.size(); i++) {
+        uint16_t following = i + 1 < labels.size() ? labels[i + 1] : labels[0];
+        emit_instruction(output, labels[i], following);
+    }
+    
+    // Computed jumps, IP stores and entry
+    fprintf(output, "dispatch:\n");
+    fprintf(output, "    switch (memory[VM_INSTRUCTION_POINTER]) {\n");
+    for (uint16_t label : labels) {
+        fprintf(output, "        case 0x%04X: goto L_%04X;\n", label, label);
+    }
+    fprintf(output, "        default: return VM_AOT_EXIT_INTERPRET;\n");
+    fprintf(output, "    }\n");
+    fprintf(output, "}\n\n");
+    
+    fprintf(output, "extern const VMAotProgram %s = {\n", symbol);
+    fprintf(output, "    \"%s\", vm_aot_run, vm_aot_image, vm_aot_code_map\n", symbol);
+    fprintf(output, "};\n");
+}
+
+void VirtualMachine::run_aot(ExecutionContext& context) {
+    // The translation is only valid for the image it was built from
+    bool matches = shadow_memory != nullptr;
+    for (uint32_t address = 0; matches && address < VM_MEMORY_SIZE; address++) {
+        if (aot_program->code_map[address] && shadow_memory[address] != aot_program->image[address]) {
+            matches = false;
+        }
+    }
+    
+    if (!matches) {
+        run_core(context);
+        return;
+    }
+    
+    bool running = true;
+    while (running) {
+        vm_flags_materialize(context);
+        uint32_t exit = aot_program->run(shadow_memory, context.status_flags);
+        
+        if (exit == VM_AOT_EXIT_HALT) {
+            break;
+        }
+        
+        if (exit == VM_AOT_EXIT_WRITE_CODE) {
+            // Self-modified code: the interpreter takes over for the rest of the run
+            decode_cache.invalidate_all();
+            optimizer.verify(*this);
+            if (jit) {
+                jit->flush();
+            }
+            run_core(context);
+            return;
+        }
+        
+        running = interpret_uncached(context);
+    }
+    
+    // Generated stores bypass the decode cache's write tracking
+    decode_cache.invalidate_all();
+    optimizer.verify(*this);
+    if (jit) {
+        jit->flush();
+    }
+}
\ No newline at end of file
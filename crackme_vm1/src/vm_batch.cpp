@@ -0,0 +1,503 @@
+#include "../include/vm_batch.h"
+#include "../include/vm_core.h"
+#include "../include/vm_alu.h"
+#include "../include/vm_specialized.h"
+#include <cstring>
+#include <stdexcept>
+
+// Lane loops below are written branch-free over fixed-size arrays so the
+// compiler vectorizes them for the target: SSE2 on x86-64 by default,
+// AVX2 when configured with VM_AVX2.
+
+template <uint32_t Lanes>
+VMBatch<Lanes>::VMBatch()
+    : memory(nullptr), image(nullptr), queued(0),
+      step_limit(VM_BATCH_DEFAULT_STEP_LIMIT), instructions(0), batch_steps(0) {
+    memory = static_cast<uint16_t*>(calloc(static_cast<size_t>(VM_MEMORY_SIZE) * Lanes, sizeof(uint16_t)));
+    image = static_cast<uint16_t*>(calloc(VM_MEMORY_SIZE, sizeof(uint16_t)));
+    if (!memory || !image) {
+        free(memory);
+        free(image);
+        throw std::runtime_error("Failed to allocate VM batch memory");
+    }
+    
+    memset(ip, 0, sizeof(ip));
+    memset(flags, 0, sizeof(flags));
+    for (uint32_t lane = 0; lane < Lanes; lane++) {
+        lanes[lane].running = false;
+        lanes[lane].input_index = 0;
+        lanes[lane].io.input_position = 0;
+        lanes[lane].io.suspend = false;
+        lanes[lane].steps = 0;
+        lanes[lane].wait = 0;
+    }
+}
+
+template <uint32_t Lanes>
+VMBatch<Lanes>::~VMBatch() {
+    free(memory);
+    memory = nullptr;
+    
+    free(image);
+    image = nullptr;
+}
+
+template <uint32_t Lanes>
+void VMBatch<Lanes>::load_image(const uint8_t* packed_image, uint32_t image_size) {
+    // Same starting state as a scalar machine after initialize() + load_image()
+    VirtualMachine vm(0x3404, VMMemoryMode::SHADOW);
+    vm.initialize();
+    vm.load_image(packed_image, image_size);
+    
+    for (uint16_t address = 0; address < VM_MEMORY_SIZE; address++) {
+        image[address] = vm.read_memory(address);
+    }
+}
+
+template <uint32_t Lanes>
+size_t VMBatch<Lanes>::add_input(const std::string& input) {
+    queue.emplace_back(queued, input);
+    return queued++;
+}
+
+template <uint32_t Lanes>
+bool VMBatch<Lanes>::refill(uint32_t lane) {
+    Lane& state = lanes[lane];
+    state.running = false;
+    if (queue.empty()) {
+        return false;
+    }
+    
+    state.input_index = queue.front().first;
+    state.io.input.swap(queue.front().second);
+    queue.pop_front();
+    
+    state.io.input_position = 0;
+    state.io.output.clear();
+    state.steps = 0;
+    state.wait = 0;
+    state.running = true;
+    
+    for (uint16_t address = 0; address < VM_MEMORY_SIZE; address++) {
+        memory[static_cast<size_t>(address) * Lanes + lane] = image[address];
+    }
+    ip[lane] = image[VM_INSTRUCTION_POINTER];
+    for (int flag = 0; flag < 4; flag++) {
+        flags[flag][lane] = 0;
+    }
+    return true;
+}
+
+template <uint32_t Lanes>
+void VMBatch<Lanes>::finish(uint32_t lane, VMBatchStatus status, const VMBatchCallback& on_result) {
+    const Lane& state = lanes[lane];
+    
+    VMBatchResult result;
+    result.input_index = state.input_index;
+    result.status = status;
+    result.steps = state.steps;
+    result.output = &state.io.output;
+    for (int flag = 0; flag < 4; flag++) {
+        result.flags[flag] = flags[flag][lane] != 0;
+    }
+    result.memory = memory + lane;
+    result.stride = Lanes;
+    
+    if (on_result) {
+        on_result(result);
+    }
+    refill(lane);
+}
+
+template <uint32_t Lanes>
+uint32_t VMBatch<Lanes>::select_leader() const {
+    // Lanes left behind for too long lead, otherwise the lowest IP does:
+    // lanes that skipped ahead wait for the others to reconverge
+    uint32_t leader = Lanes;
+    uint32_t longest = VM_BATCH_MAX_WAIT;
+    for (uint32_t lane = 0; lane < Lanes; lane++) {
+        if (lanes[lane].running && lanes[lane].wait > longest) {
+            leader = lane;
+            longest = lanes[lane].wait;
+        }
+    }
+    if (leader < Lanes) {
+        return leader;
+    }
+    
+    for (uint32_t lane = 0; lane < Lanes; lane++) {
+        if (lanes[lane].running && (leader == Lanes || ip[lane] < ip[leader])) {
+            leader = lane;
+        }
+    }
+    return leader;
+}
+
+// Resolve an operand in every lane through 0-3 levels of indirection
+template <uint32_t Lanes>
+static inline void vm_batch_resolve(const uint16_t* memory, uint16_t operand,
+                                    AddressingMode mode, uint16_t* address) {
+    for (uint32_t lane = 0; lane < Lanes; lane++) {
+        address[lane] = operand & 0x1FFF;
+    }
+    for (int depth = static_cast<int>(mode) & 3; depth > 0; depth--) {
+        for (uint32_t lane = 0; lane < Lanes; lane++) {
+            address[lane] = memory[static_cast<size_t>(address[lane]) * Lanes + lane];
+        }
+    }
+}
+
+template <uint32_t Lanes>
+static inline void vm_batch_load(const uint16_t* memory, const uint16_t* address, uint16_t* value) {
+    for (uint32_t lane = 0; lane < Lanes; lane++) {
+        value[lane] = memory[static_cast<size_t>(address[lane]) * Lanes + lane];
+    }
+}
+
+template <uint32_t Lanes>
+static inline void vm_batch_store(uint16_t* memory, const uint16_t* address,
+                                  const uint16_t* value, const uint8_t* selected) {
+    for (uint32_t lane = 0; lane < Lanes; lane++) {
+        if (selected[lane]) {
+            memory[static_cast<size_t>(address[lane]) * Lanes + lane] = value[lane] & 0x1FFF;
+        }
+    }
+}
+
+// One ALU operation in every lane: result plus S/Z/C/V candidates
+template <uint32_t Lanes, typename Operation>
+static inline void vm_batch_alu_lanes(const uint16_t* value1, const uint16_t* value2, uint16_t* result,
+                                      uint8_t (*computed)[Lanes], Operation operation) {
+    for (uint32_t lane = 0; lane < Lanes; lane++) {
+        uint32_t value = 0;
+        uint8_t carry = 0;
+        uint8_t overflow = 0;
+        operation(value1[lane], value2[lane], value, carry, overflow);
+        
+        result[lane] = value & 0x1FFF;
+        computed[VM_FLAG_SIGN][lane] = (value >> 12) & 1;
+        computed[VM_FLAG_ZERO][lane] = (value & 0x1FFF) == 0;
+        computed[VM_FLAG_CARRY][lane] = carry;
+        computed[VM_FLAG_OVERFLOW][lane] = overflow;
+    }
+}
+
+// Same semantics as the vm_alu.h helpers, selected once per step
+template <uint32_t Lanes>
+static void vm_batch_alu(VMOpcode opcode, const uint16_t* value1, const uint16_t* value2,
+                         uint16_t* result, uint8_t (*computed)[Lanes]) {
+    switch (opcode) {
+        case VMOpcode::ADD:
+            vm_batch_alu_lanes<Lanes>(value1, value2, result, computed,
+                [](uint32_t a, uint32_t b, uint32_t& r, uint8_t& c, uint8_t& v) {
+                    r = a + b;
+                    c = r > 0x1FFF;
+                    v = (((a ^ r) & (b ^ r)) >> 12) & 1;
+                });
+            break;
+        case VMOpcode::SUB:
+        case VMOpcode::CMP:
+            vm_batch_alu_lanes<Lanes>(value1, value2, result, computed,
+                [](uint32_t a, uint32_t b, uint32_t& r, uint8_t& c, uint8_t& v) {
+                    r = (a - b) & 0x1FFF;
+                    c = a < b;
+                    v = (((a ^ b) & (a ^ r)) >> 12) & 1;
+                });
+            break;
+        case VMOpcode::AND:
+            vm_batch_alu_lanes<Lanes>(value1, value2, result, computed,
+                [](uint32_t a, uint32_t b, uint32_t& r, uint8_t&, uint8_t&) { r = a & b; });
+            break;
+        case VMOpcode::OR:
+            vm_batch_alu_lanes<Lanes>(value1, value2, result, computed,
+                [](uint32_t a, uint32_t b, uint32_t& r, uint8_t&, uint8_t&) { r = a | b; });
+            break;
+        case VMOpcode::XOR:
+            vm_batch_alu_lanes<Lanes>(value1, value2, result, computed,
+                [](uint32_t a, uint32_t b, uint32_t& r, uint8_t&, uint8_t&) { r = a ^ b; });
+            break;
+        case VMOpcode::NOT:
+            vm_batch_alu_lanes<Lanes>(value1, value2, result, computed,
+                [](uint32_t a, uint32_t, uint32_t& r, uint8_t&, uint8_t&) { r = ~a & 0x1FFF; });
+            break;
+        case VMOpcode::INC:
+            vm_batch_alu_lanes<Lanes>(value1, value2, result, computed,
+                [](uint32_t a, uint32_t, uint32_t& r, uint8_t&, uint8_t& v) {
+                    r = (a + 1) & 0x1FFF;
+                    v = a == 0x0FFF;
+                });
+            break;
+        case VMOpcode::DEC:
+            vm_batch_alu_lanes<Lanes>(value1, value2, result, computed,
+                [](uint32_t a, uint32_t, uint32_t& r, uint8_t&, uint8_t& v) {
+                    r = (a - 1) & 0x1FFF;
+                    v = a == 0x1000;
+                });
+            break;
+        case VMOpcode::SHL:
+            vm_batch_alu_lanes<Lanes>(value1, value2, result, computed,
+                [](uint32_t a, uint32_t, uint32_t& r, uint8_t& c, uint8_t&) {
+                    r = (a << 1) & 0x1FFF;
+                    c = (a >> 12) & 1;
+                });
+            break;
+        case VMOpcode::SHR:
+            vm_batch_alu_lanes<Lanes>(value1, value2, result, computed,
+                [](uint32_t a, uint32_t, uint32_t& r, uint8_t& c, uint8_t&) {
+                    r = a >> 1;
+                    c = a & 1;
+                });
+            break;
+        case VMOpcode::ROL:
+            vm_batch_alu_lanes<Lanes>(value1, value2, result, computed,
+                [](uint32_t a, uint32_t, uint32_t& r, uint8_t& c, uint8_t&) {
+                    r = ((a << 1) | (a >> 12)) & 0x1FFF;
+                    c = (a >> 12) & 1;
+                });
+            break;
+        default:
+            vm_batch_alu_lanes<Lanes>(value1, value2, result, computed,
+                [](uint32_t a, uint32_t, uint32_t& r, uint8_t& c, uint8_t&) {
+                    r = (a >> 1) | ((a & 1) << 12);
+                    c = a & 1;
+                });
+            break;
+    }
+}
+
+template <uint32_t Lanes>
+uint64_t VMBatch<Lanes>::step(const VMBatchCallback& on_result) {
+    uint32_t leader = select_leader();
+    uint16_t pc = ip[leader];
+    
+    // Shared decode: every running lane at the same IP with the same code words
+    uint16_t word = memory[static_cast<size_t>(pc) * Lanes + leader];
+    const VMDecodeInfo& info = VM_DECODE_LUT[word & 0x1FFF];
+    const uint16_t* code[3];
+    for (int i = 0; i < 3; i++) {
+        code[i] = memory + static_cast<size_t>((pc + i) & 0x1FFF) * Lanes;
+    }
+    uint16_t operand1 = info.length > 1 ? code[1][leader] : 0;
+    uint16_t operand2 = info.length > 2 ? code[2][leader] : 0;
+    
+    uint8_t selected[Lanes];
+    uint64_t mask = 0;
+    for (uint32_t lane = 0; lane < Lanes; lane++) {
+        selected[lane] = lanes[lane].running && ip[lane] == pc && code[0][lane] == word &&
+                         (info.length < 2 || code[1][lane] == operand1) &&
+                         (info.length < 3 || code[2][lane] == operand2);
+        mask |= static_cast<uint64_t>(selected[lane]) << lane;
+        lanes[lane].wait = selected[lane] ? 0 : lanes[lane].wait + 1;
+    }
+    
+    // Sequential IP into the IP cell before operands are resolved
+    uint16_t next_ip = (pc + info.length) & 0x1FFF;
+    uint16_t* ip_cell = memory + static_cast<size_t>(VM_INSTRUCTION_POINTER) * Lanes;
+    uint16_t* sp_cell = memory + static_cast<size_t>(VM_STACK_POINTER) * Lanes;
+    for (uint32_t lane = 0; lane < Lanes; lane++) {
+        ip_cell[lane] = selected[lane] ? next_ip : ip_cell[lane];
+    }
+    
+    uint16_t address1[Lanes], address2[Lanes];
+    uint16_t value1[Lanes], value2[Lanes], result[Lanes];
+    uint8_t computed[4][Lanes];
+    bool halted = false;
+    
+    vm_batch_resolve<Lanes>(memory, operand1, info.mode_dst, address1);
+    vm_batch_resolve<Lanes>(memory, operand2, info.mode_src, address2);
+    
+    switch (info.opcode) {
+        case VMOpcode::MOV:
+            vm_batch_load<Lanes>(memory, address2, value2);
+            vm_batch_store<Lanes>(memory, address1, value2, selected);
+            break;
+        
+        case VMOpcode::XCHG:
+            vm_batch_load<Lanes>(memory, address1, value1);
+            vm_batch_load<Lanes>(memory, address2, value2);
+            vm_batch_store<Lanes>(memory, address1, value2, selected);
+            vm_batch_store<Lanes>(memory, address2, value1, selected);
+            break;
+        
+        case VMOpcode::ADD:
+        case VMOpcode::SUB:
+        case VMOpcode::CMP:
+        case VMOpcode::AND:
+        case VMOpcode::OR:
+        case VMOpcode::XOR:
+        case VMOpcode::NOT:
+        case VMOpcode::INC:
+        case VMOpcode::DEC:
+        case VMOpcode::SHL:
+        case VMOpcode::SHR:
+        case VMOpcode::ROL:
+        case VMOpcode::ROR: {
+            vm_batch_load<Lanes>(memory, address2, value2);
+            vm_batch_load<Lanes>(memory, address1, value1);
+            
+            vm_batch_alu<Lanes>(info.opcode, value1, value2, result, computed);
+            
+            uint8_t written = VMInstruction::flags_written(static_cast<uint16_t>(info.opcode));
+            for (int flag = 0; flag < 4; flag++) {
+                if ((written >> flag) & 1) {
+                    for (uint32_t lane = 0; lane < Lanes; lane++) {
+                        flags[flag][lane] = selected[lane] ? computed[flag][lane] : flags[flag][lane];
+                    }
+                }
+            }
+            
+            if (info.opcode != VMOpcode::CMP) {
+                vm_batch_store<Lanes>(memory, address1, result, selected);
+            }
+            break;
+        }
+        
+        case VMOpcode::JMP:
+        case VMOpcode::JZ:
+        case VMOpcode::JNZ:
+        case VMOpcode::JC:
+        case VMOpcode::JNC:
+        case VMOpcode::JS:
+        case VMOpcode::JNS:
+        case VMOpcode::JO:
+        case VMOpcode::JNO:
+        case VMOpcode::JL:
+        case VMOpcode::JG:
+        case VMOpcode::JLE:
+        case VMOpcode::JGE:
+            for (uint32_t lane = 0; lane < Lanes; lane++) {
+                bool lane_flags[4] = {
+                    flags[VM_FLAG_SIGN][lane] != 0, flags[VM_FLAG_ZERO][lane] != 0,
+                    flags[VM_FLAG_CARRY][lane] != 0, flags[VM_FLAG_OVERFLOW][lane] != 0
+                };
+                if (selected[lane] && vm_branch_taken(info.opcode, lane_flags)) {
+                    ip_cell[lane] = address1[lane];
+                }
+            }
+            break;
+        
+        case VMOpcode::PUSH:
+            vm_batch_load<Lanes>(memory, address1, value1);
+            for (uint32_t lane = 0; lane < Lanes; lane++) {
+                if (selected[lane]) {
+                    uint16_t sp = sp_cell[lane];
+                    memory[static_cast<size_t>(sp) * Lanes + lane] = value1[lane];
+                    sp_cell[lane] = (sp - 1) & 0x1FFF;
+                }
+            }
+            break;
+        
+        case VMOpcode::POP:
+            for (uint32_t lane = 0; lane < Lanes; lane++) {
+                if (selected[lane]) {
+                    uint16_t sp = sp_cell[lane];
+                    uint16_t value = memory[static_cast<size_t>((sp + 1) & 0x1FFF) * Lanes + lane];
+                    sp_cell[lane] = (sp + 1) & 0x1FFF;
+                    memory[static_cast<size_t>(address1[lane]) * Lanes + lane] = value;
+                }
+            }
+            break;
+        
+        case VMOpcode::IN:
+        case VMOpcode::IN_HEX:
+            for (uint32_t lane = 0; lane < Lanes; lane++) {
+                if (selected[lane]) {
+                    value1[lane] = info.opcode == VMOpcode::IN ? vm_memory_io_read_char(lanes[lane].io) :
+                                                                   vm_memory_io_read_hex(lanes[lane].io);
+                }
+            }
+            vm_batch_store<Lanes>(memory, address1, value1, selected);
+            break;
+        
+        case VMOpcode::OUT:
+            vm_batch_load<Lanes>(memory, address1, value1);
+            for (uint32_t lane = 0; lane < Lanes; lane++) {
+                if (selected[lane]) {
+                    lanes[lane].io.output.push_back(static_cast<char>(value1[lane] & 0xFF));
+                }
+            }
+            break;
+        
+        case VMOpcode::IN_STR:
+            for (uint32_t lane = 0; lane < Lanes; lane++) {
+                if (!selected[lane]) {
+                    continue;
+                }
+                
+                // One line into consecutive cells, zero terminated
+                uint16_t address = address1[lane];
+                for (uint16_t count = 0; count < VM_MAX_INPUT_STRING; count++) {
+                    uint16_t character = vm_memory_io_read_char(lanes[lane].io);
+                    if (character == 0x1FFF || character == '\n') {
+                        break;
+                    }
+                    memory[static_cast<size_t>(address) * Lanes + lane] = character;
+                    address = (address + 1) & 0x1FFF;
+                }
+                memory[static_cast<size_t>(address) * Lanes + lane] = 0;
+            }
+            break;
+        
+        case VMOpcode::CLC:
+        case VMOpcode::STC:
+        case VMOpcode::CMC:
+            for (uint32_t lane = 0; lane < Lanes; lane++) {
+                uint8_t carry = info.opcode == VMOpcode::CLC ? 0 :
+                                info.opcode == VMOpcode::STC ? 1 : !flags[VM_FLAG_CARRY][lane];
+                flags[VM_FLAG_CARRY][lane] = selected[lane] ? carry : flags[VM_FLAG_CARRY][lane];
+            }
+            break;
+        
+        case VMOpcode::NOP:
+            break;
+        
+        default:
+            // HALT and unknown opcodes stop the lane
+            halted = true;
+            break;
+    }
+    
+    // Taken jumps and stores into the IP cell redirect the lane
+    uint32_t count = 0;
+    for (uint32_t lane = 0; lane < Lanes; lane++) {
+        ip[lane] = selected[lane] ? ip_cell[lane] : ip[lane];
+        lanes[lane].steps += selected[lane];
+        count += selected[lane];
+    }
+    instructions += count;
+    batch_steps++;
+    
+    for (uint32_t lane = 0; lane < Lanes; lane++) {
+        if ((mask >> lane) & 1) {
+            if (halted) {
+                finish(lane, VMBatchStatus::HALTED, on_result);
+            } else if (lanes[lane].steps >= step_limit) {
+                finish(lane, VMBatchStatus::STEP_LIMIT, on_result);
+            }
+        }
+    }
+    
+    uint64_t running_mask = 0;
+    for (uint32_t lane = 0; lane < Lanes; lane++) {
+        running_mask |= static_cast<uint64_t>(lanes[lane].running) << lane;
+    }
+    return running_mask;
+}
+
+template <uint32_t Lanes>
+void VMBatch<Lanes>::run(const VMBatchCallback& on_result) {
+    bool running = false;
+    for (uint32_t lane = 0; lane < Lanes; lane++) {
+        if (lanes[lane].running || refill(lane)) {
+            running = true;
+        }
+    }
+    
+    while (running) {
+        running = step(on_result) != 0;
+    }
+}
+
+template class VMBatch<8>;
+template class VMBatch<16>;
+template class VMBatch<32>;
\ No newline at end of file
@@ -0,0 +1,244 @@
+#include "../include/vm_checkpoint.h"
+#include "../include/vm_core.h"
+#include <stdexcept>
+
+static uint16_t vm_checkpoint_shift(uint16_t block_words) {
+    if (block_words == 0 || block_words > VM_MEMORY_SIZE || (block_words & (block_words - 1))) {
+        throw std::invalid_argument("Checkpoint block size must be a power of two up to 8192 words");
+    }
+    
+    uint16_t shift = 0;
+    while ((1u << shift) < block_words) {
+        shift++;
+    }
+    return shift;
+}
+
+VMCheckpointLog::VMCheckpointLog(uint16_t block_words)
+    : block_words(block_words), block_shift(vm_checkpoint_shift(block_words)),
+      block_count(VM_MEMORY_SIZE / block_words), head(VM_CHECKPOINT_NONE) {
+    mark_all();
+}
+
+void VMCheckpointLog::mark_all() {
+    dirty.clear();
+    for (uint16_t block = 0; block < block_count; block++) {
+        dirty.mark(block);
+    }
+}
+
+uint32_t VMCheckpointLog::capture(VirtualMachine& vm) {
+    VMCheckpoint checkpoint;
+    checkpoint.id = static_cast<uint32_t>(checkpoints.size());
+    checkpoint.parent = head;
+    checkpoint.ip = vm.read_memory(VM_INSTRUCTION_POINTER);
+    checkpoint.sp = vm.read_memory(VM_STACK_POINTER);
+    checkpoint.flags = static_cast<uint8_t>(vm.get_sign_flag() << VM_FLAG_SIGN |
+                                            vm.get_zero_flag() << VM_FLAG_ZERO |
+                                            vm.get_carry_flag() << VM_FLAG_CARRY |
+                                            vm.get_overflow_flag() << VM_FLAG_OVERFLOW);
+    
+    checkpoint.blocks.reserve(dirty.count());
+    checkpoint.words.reserve(checkpoint.blocks.capacity() * block_words);
+    dirty.for_each([&](uint16_t block) {
+        checkpoint.blocks.push_back(block);
+        for (uint32_t address = static_cast<uint32_t>(block) << block_shift;
+             address < (static_cast<uint32_t>(block) + 1) << block_shift; address++) {
+            checkpoint.words.push_back(vm.read_memory(static_cast<uint16_t>(address)));
+        }
+    });
+    
+    checkpoints.push_back(std::move(checkpoint));
+    dirty.clear();
+    head = checkpoints.back().id;
+    return head;
+}
+
+void VMCheckpointLog::rebuild(uint32_t id, VirtualMachine& vm) {
+    if (id >= checkpoints.size()) {
+        throw std::out_of_range("No such checkpoint");
+    }
+    
+    // The nearest checkpoint holding a block has its latest contents
+    VMDirtyBitmap restored;
+    uint32_t remaining = block_count;
+    for (uint32_t current = id; current != VM_CHECKPOINT_NONE && remaining; current = checkpoints[current].parent) {
+        const VMCheckpoint& checkpoint = checkpoints[current];
+        const uint16_t* words = checkpoint.words.data();
+        
+        for (uint16_t block : checkpoint.blocks) {
+            if (restored.is_marked(block)) {
+                words += block_words;
+                continue;
+            }
+            restored.mark(block);
+            remaining--;
+            
+            uint16_t address = static_cast<uint16_t>(block << block_shift);
+            for (uint16_t word = 0; word < block_words; word++, address++) {
+                if (address < VM_STACK_POINTER && vm.read_memory(address) != words[word]) {
+                    vm.write_memory(address, words[word]);
+                }
+            }
+            words += block_words;
+        }
+    }
+    
+    const VMCheckpoint& checkpoint = checkpoints[id];
+    vm.write_memory(VM_STACK_POINTER, checkpoint.sp);
+    vm.write_memory(VM_INSTRUCTION_POINTER, checkpoint.ip);
+    vm.set_sign_flag((checkpoint.flags >> VM_FLAG_SIGN) & 1);
+    vm.set_zero_flag((checkpoint.flags >> VM_FLAG_ZERO) & 1);
+    vm.set_carry_flag((checkpoint.flags >> VM_FLAG_CARRY) & 1);
+    vm.set_overflow_flag((checkpoint.flags >> VM_FLAG_OVERFLOW) & 1);
+    
+    // Memory now matches the checkpoint exactly
+    dirty.clear();
+    head = id;
+}
+
+void VMCheckpointLog::clear() {
+    checkpoints.clear();
+    head = VM_CHECKPOINT_NONE;
+    mark_all();
+}
+
+// Little-endian field and 13-bit word packing helpers
+static void vm_checkpoint_put(FILE* output, uint32_t value, int bytes) {
+    for (int byte = 0; byte < bytes; byte++) {
+        fputc((value >> (byte * 8)) & 0xFF, output);
+    }
+}
+
+static uint32_t vm_checkpoint_get(FILE* input, int bytes) {
+    uint32_t value = 0;
+    for (int byte = 0; byte < bytes; byte++) {
+        int c = fgetc(input);
+        if (c == EOF) {
+            throw std::runtime_error("Truncated checkpoint file");
+        }
+        value |= static_cast<uint32_t>(c) << (byte * 8);
+    }
+    return value;
+}
+
+void VMCheckpointLog::write(FILE* output) const {
+    vm_checkpoint_put(output, VM_CHECKPOINT_FILE_MAGIC, 4);
+    vm_checkpoint_put(output, VM_CHECKPOINT_FILE_VERSION, 2);
+    vm_checkpoint_put(output, block_words, 2);
+    vm_checkpoint_put(output, static_cast<uint32_t>(checkpoints.size()), 4);
+    
+    for (const VMCheckpoint& checkpoint : checkpoints) {
+        vm_checkpoint_put(output, checkpoint.id, 4);
+        vm_checkpoint_put(output, checkpoint.parent, 4);
+        vm_checkpoint_put(output, checkpoint.ip, 2);
+        vm_checkpoint_put(output, checkpoint.sp, 2);
+        vm_checkpoint_put(output, checkpoint.flags, 1);
+        vm_checkpoint_put(output, static_cast<uint32_t>(checkpoint.blocks.size()), 2);
+        for (uint16_t block : checkpoint.blocks) {
+            vm_checkpoint_put(output, block, 2);
+        }
+        
+        uint32_t bits = 0;
+        int pending = 0;
+        for (uint16_t word : checkpoint.words) {
+            bits |= static_cast<uint32_t>(word & 0x1FFF) << pending;
+            pending += 13;
+            while (pending >= 8) {
+                fputc(bits & 0xFF, output);
+                bits >>= 8;
+                pending -= 8;
+            }
+        }
+        if (pending) {
+            fputc(bits & 0xFF, output);
+        }
+    }
+    
+    if (ferror(output)) {
+        throw std::runtime_error("Failed to write checkpoint file");
+    }
+}
+
+void VMCheckpointLog::read(FILE* input) {
+    if (vm_checkpoint_get(input, 4) != VM_CHECKPOINT_FILE_MAGIC ||
+        vm_checkpoint_get(input, 2) != VM_CHECKPOINT_FILE_VERSION) {
+        throw std::runtime_error("Not a checkpoint file");
+    }
+    
+    uint16_t file_block_words = static_cast<uint16_t>(vm_checkpoint_get(input, 2));
+    uint16_t file_block_shift = vm_checkpoint_shift(file_block_words);
+    uint16_t file_block_count = static_cast<uint16_t>(VM_MEMORY_SIZE / file_block_words);
+    uint32_t count = vm_checkpoint_get(input, 4);
+    
+    std::vector<VMCheckpoint> loaded;
+    for (uint32_t index = 0; index < count; index++) {
+        VMCheckpoint checkpoint;
+        checkpoint.id = vm_checkpoint_get(input, 4);
+        checkpoint.parent = vm_checkpoint_get(input, 4);
+        checkpoint.ip = static_cast<uint16_t>(vm_checkpoint_get(input, 2));
+        checkpoint.sp = static_cast<uint16_t>(vm_checkpoint_get(input, 2));
+        checkpoint.flags = static_cast<uint8_t>(vm_checkpoint_get(input, 1));
+        
+        // Parents precede their children, full checkpoints hold every block
+        uint32_t blocks = vm_checkpoint_get(input, 2);
+        if (checkpoint.id != index || blocks > file_block_count ||
+            (checkpoint.parent == VM_CHECKPOINT_NONE ? blocks != file_block_count : checkpoint.parent >= index)) {
+            throw std::runtime_error("Invalid checkpoint file");
+        }
+        
+        for (uint32_t block = 0; block < blocks; block++) {
+            uint16_t value = static_cast<uint16_t>(vm_checkpoint_get(input, 2));
+            if (value >= file_block_count || (block && value <= checkpoint.blocks.back())) {
+                throw std::runtime_error("Invalid checkpoint file");
+            }
+            checkpoint.blocks.push_back(value);
+        }
+        
+        uint32_t bits = 0;
+        int pending = 0;
+        checkpoint.words.resize(static_cast<size_t>(blocks) << file_block_shift);
+        for (uint16_t& word : checkpoint.words) {
+            while (pending < 13) {
+                bits |= vm_checkpoint_get(input, 1) << pending;
+                pending += 8;
+            }
+            word = bits & 0x1FFF;
+            bits >>= 13;
+            pending -= 13;
+        }
+        
+        loaded.push_back(std::move(checkpoint));
+    }
+    
+    block_words = file_block_words;
+    block_shift = file_block_shift;
+    block_count = file_block_count;
+    checkpoints = std::move(loaded);
+    head = VM_CHECKPOINT_NONE;
+    mark_all();
+}
+
+uint32_t VirtualMachine::checkpoint() {
+    if (!checkpoint_log) {
+        throw std::logic_error("VM checkpoints not enabled");
+    }
+    if (executing) {
+        throw std::logic_error("Cannot checkpoint a VM while it executes");
+    }
+    
+    return checkpoint_log->capture(*this);
+}
+
+void VirtualMachine::restore(uint32_t id) {
+    if (!checkpoint_log) {
+        throw std::logic_error("VM checkpoints not enabled");
+    }
+    if (executing) {
+        throw std::logic_error("Cannot restore a VM while it executes");
+    }
+    
+    checkpoint_log->rebuild(id, *this);
+    status = VMStatus::OK;
+    fault_address = 0;
+}
\ No newline at end of file
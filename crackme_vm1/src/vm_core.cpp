@@ -1,19 +1,29 @@
 #include "../include/vm_core.h"
 #include "../include/vm_memory.h"
 #include "../include/vm_runtime.h"
+#include "../include/vm_specialized.h"
+#include "../include/vm_alu.h"
 #include <cstring>
 #include <stdexcept>
-#include <../include/vm_instructions.h>
+#include "../include/vm_instructions.h"
 
-// Global application type
-ApplicationType g_app_type = ApplicationType::UNKNOWN;
-
-// VM initialization flag
-static bool g_vm_initialized = false;
-
-VirtualMachine::VirtualMachine(uint32_t buffer_size) 
-    : buffer_size(buffer_size), memory_buffer(nullptr) {
+VirtualMachine::VirtualMachine(uint32_t buffer_size, VMMemoryMode memory_mode, uint16_t checkpoint_block_words) 
+    : memory_buffer(nullptr), buffer_size(buffer_size), 
+      shadow_memory(nullptr), memory_mode(memory_mode), cow_memory(nullptr),
+      dirty_words(nullptr),
+      checkpoint_log(checkpoint_block_words ? new VMCheckpointLog(checkpoint_block_words) : nullptr),
+      store_hooks(0),
+      executor(new BasicInstructionExecutor()),
+      dispatch_mode(VM_DEFAULT_DISPATCH),
+      fusion_mode(VMFusionMode::OFF), fusion_warmup(VM_DEFAULT_FUSION_WARMUP),
+      optimize_on_load(false), jit(nullptr), aot_program(nullptr),
+      tracer(nullptr), profiler(nullptr),
+      state_hashing(false), memory_hash(0), memory_hash_valid(false), cycle_detection(false), step_limit(0),
+      registers(nullptr), executing(false), status(VMStatus::OK), fault_address(0) {
+    decode_cache.set_specialized(dispatch_mode == VMDispatchMode::SPECIALIZED);
+    decode_cache.set_optimizer(&optimizer);
     status_flags = {false, false, false, false};
+    update_store_hooks();
 }
 
 VirtualMachine::~VirtualMachine() {
@@ -21,9 +31,31 @@ VirtualMachine::~VirtualMachine() {
         free(memory_buffer);
         memory_buffer = nullptr;
     }
+    
+    if (shadow_memory) {
+        free(shadow_memory);
+        shadow_memory = nullptr;
+    }
+    
+    delete cow_memory;
+    cow_memory = nullptr;
+    
+    delete dirty_words;
+    dirty_words = nullptr;
+    
+    delete checkpoint_log;
+    checkpoint_log = nullptr;
+    
+    delete executor;
+    executor = nullptr;
+    
+    delete jit;
+    jit = nullptr;
 }
 
 void VirtualMachine::initialize() {
+    runtime.steps = 0;
+    
     if (memory_buffer) {
         free(memory_buffer);
     }
@@ -33,6 +65,31 @@ void VirtualMachine::initialize() {
         throw std::runtime_error("Failed to allocate VM memory");
     }
     
+    if (memory_mode == VMMemoryMode::SHADOW) {
+        if (shadow_memory) {
+            free(shadow_memory);
+        }
+        
+        shadow_memory = static_cast<uint16_t*>(calloc(VM_MEMORY_SIZE, sizeof(uint16_t)));
+        if (!shadow_memory) {
+            throw std::runtime_error("Failed to allocate VM shadow memory");
+        }
+    }
+    
+    // Copy-on-write machines run without a decode cache so fork() stays cheap
+    if (memory_mode == VMMemoryMode::COPY_ON_WRITE) {
+        delete cow_memory;
+        cow_memory = new VMCowMemory();
+    } else {
+        decode_cache.initialize();
+    }
+    optimizer.discard();
+    if (jit) {
+        jit->flush();
+    }
+    mark_all_dirty();
+    update_store_hooks();
+    
     // Initialize stack pointer
     write_memory(VM_STACK_POINTER, VM_MEMORY_SIZE - 1);
     
@@ -43,8 +100,24 @@ void VirtualMachine::initialize() {
 }
 
 uint16_t VirtualMachine::read_memory(uint16_t address) {
-    if (address >= VM_MEMORY_SIZE) {
-        throw std::out_of_range("VM memory read out of bounds");
+    if constexpr (VMMemoryPolicy::checked) {
+        if (address >= VM_MEMORY_SIZE) {
+            return memory_fault(address, "VM memory read out of bounds");
+        }
+    } else {
+        address &= 0x1FFF;
+    }
+    
+    if (registers && address >= VM_STACK_POINTER) {
+        return address == VM_INSTRUCTION_POINTER ? registers->ip : registers->sp;
+    }
+    
+    if (shadow_memory) {
+        return shadow_memory[address];
+    }
+    
+    if (cow_memory) {
+        return cow_memory->read(address);
     }
     
     // Use the packed 13-bit read function
@@ -52,14 +125,207 @@ uint16_t VirtualMachine::read_memory(uint16_t address) {
 }
 
 void VirtualMachine::write_memory(uint16_t address, uint16_t value) {
-    if (address >= VM_MEMORY_SIZE) {
-        throw std::out_of_range("VM memory write out of bounds");
+    if constexpr (VMMemoryPolicy::checked) {
+        if (address >= VM_MEMORY_SIZE) {
+            memory_fault(address, "VM memory write out of bounds");
+            return;
+        }
+    } else {
+        address &= 0x1FFF;
+    }
+    
+    if (store_hooks) {
+        store_hooked(address, value);
+    }
+    
+    if (registers && address >= VM_STACK_POINTER) {
+        if (address == VM_INSTRUCTION_POINTER) {
+            registers->ip = value & 0x1FFF;
+        } else {
+            registers->sp = value & 0x1FFF;
+        }
+        return;
+    }
+    
+    if (shadow_memory) {
+        shadow_memory[address] = value & 0x1FFF;
+        return;
+    }
+    
+    if (cow_memory) {
+        cow_memory->write(address, value & 0x1FFF);
+        return;
     }
     
     // Use the packed 13-bit write function
     VMMemoryManager::write_buffer_value(memory_buffer, address, value & 0x1FFF);
 }
 
+void VirtualMachine::store_hooked(uint16_t address, uint16_t value) {
+    if (dirty_words) {
+        dirty_words->mark(address);
+    }
+    if (checkpoint_log && address < VM_STACK_POINTER) {
+        checkpoint_log->mark(address);
+    }
+    
+    // Replace the cell's term of the memory hash
+    if (memory_hash_valid && address < VM_STACK_POINTER) {
+        memory_hash += vm_hash_cell(address, value & 0x1FFF) - vm_hash_cell(address, read_memory(address));
+    }
+    
+    // Stores into decoded code drop the stale cache entries
+    if (decode_cache.is_code(address)) {
+        decode_cache.invalidate(address);
+    }
+    if (jit && jit->is_code(address)) {
+        jit->invalidate(address);
+    }
+    
+    // Analyzed code and folded pointers are assumed constant
+    if (optimizer.depends_on(address)) {
+        optimizer.discard();
+        decode_cache.invalidate_all();
+    }
+}
+
+void VirtualMachine::update_store_hooks() {
+    store_hooks = 0;
+    if (dirty_words) {
+        store_hooks |= VM_STORE_DIRTY;
+    }
+    if (checkpoint_log) {
+        store_hooks |= VM_STORE_CHECKPOINT;
+    }
+    if (hashing_states()) {
+        store_hooks |= VM_STORE_HASH;
+    }
+    // Discarded analyses leave the bit set until the next update
+    if (decode_cache.is_initialized() || jit || optimizer.is_active()) {
+        store_hooks |= VM_STORE_CODE;
+    }
+}
+
+uint16_t VirtualMachine::memory_fault(uint16_t address, const char* message) {
+    if (!executing) {
+        throw std::out_of_range(message);
+    }
+    
+    // Record the first fault; the access reads as zero and the run stops
+    // after the current instruction
+    if (status == VMStatus::OK) {
+        status = VMStatus::MEMORY_FAULT;
+        fault_address = address;
+    }
+    return 0;
+}
+
+uint16_t VirtualMachine::resolve_operand(uint16_t operand, AddressingMode mode) {
+    uint16_t address = operand & 0x1FFF;
+    
+    // DIRECT through TRIPLE_INDIRECT map to 0-3 memory loads
+    for (int depth = static_cast<int>(mode) & 3; depth > 0; depth--) {
+        address = read_memory(address);
+    }
+    
+    return address;
+}
+
+void VirtualMachine::load_image(const uint8_t* image, uint32_t image_size) {
+    if (!memory_buffer && !cow_memory) {
+        throw std::logic_error("VM memory not initialized");
+    }
+    if (image_size > buffer_size) {
+        throw std::out_of_range("VM image larger than memory buffer");
+    }
+    
+    // Images shorter than the buffer only replace the leading bytes
+    memcpy(get_memory_buffer(), image, image_size);
+    
+    if (shadow_memory) {
+        VMMemoryManager::unpack_buffer(memory_buffer, shadow_memory);
+    }
+    
+    if (cow_memory) {
+        uint16_t words[VM_MEMORY_SIZE];
+        VMMemoryManager::unpack_buffer(memory_buffer, words);
+        cow_memory->load(words);
+    }
+    
+    image_loaded();
+}
+
+void VirtualMachine::load_image(const VMImage& image) {
+    if (!cow_memory) {
+        load_image(image.get_memory(), image.get_memory_size());
+    } else {
+        // Nothing is copied until a block is written
+        delete cow_memory;
+        cow_memory = new VMCowMemory(image.get_words());
+        image_loaded();
+    }
+    
+    // The image cells normally hold the entry already and stay shared
+    if (read_memory(VM_STACK_POINTER) != image.get_entry_sp()) {
+        write_memory(VM_STACK_POINTER, image.get_entry_sp());
+    }
+    if (read_memory(VM_INSTRUCTION_POINTER) != image.get_entry_ip()) {
+        write_memory(VM_INSTRUCTION_POINTER, image.get_entry_ip());
+    }
+}
+
+void VirtualMachine::image_loaded() {
+    // Bulk loads bypass the per-store tracking
+    mark_all_dirty();
+    decode_cache.invalidate_all();
+    optimizer.discard();
+    if (jit) {
+        jit->flush();
+    }
+    
+    if (optimize_on_load) {
+        optimize_program();
+    }
+}
+
+void VirtualMachine::optimize_program() {
+    optimizer.optimize(*this, std::vector<uint16_t>());
+    decode_cache.invalidate_all();
+    update_store_hooks();
+}
+
+void VirtualMachine::dump_image(uint8_t* image, uint32_t image_size) {
+    if (image_size > buffer_size) {
+        throw std::out_of_range("VM image larger than memory buffer");
+    }
+    
+    memcpy(image, get_memory_buffer(), image_size);
+}
+
+uint8_t* VirtualMachine::get_memory_buffer() {
+    sync_packed_image();
+    return memory_buffer;
+}
+
+void VirtualMachine::sync_packed_image() {
+    if (shadow_memory && memory_buffer) {
+        VMMemoryManager::pack_buffer(shadow_memory, memory_buffer);
+    }
+    
+    if (cow_memory) {
+        if (!memory_buffer) {
+            memory_buffer = static_cast<uint8_t*>(calloc(buffer_size, 1));
+            if (!memory_buffer) {
+                throw std::runtime_error("Failed to allocate VM memory");
+            }
+        }
+        
+        uint16_t words[VM_MEMORY_SIZE];
+        cow_memory->store(words);
+        VMMemoryManager::pack_buffer(words, memory_buffer);
+    }
+}
+
 void VirtualMachine::push(uint16_t value) {
     uint16_t sp = read_memory(VM_STACK_POINTER);
     write_memory(sp, value);
@@ -80,54 +346,484 @@ void VirtualMachine::reset() {
     status_flags.flag_overflow = false;
 }
 
-void VirtualMachine::execute() {
-    // Main VM execution loop
-    while (true) {
-        uint16_t ip = read_memory(VM_INSTRUCTION_POINTER);
-        uint16_t instruction = read_memory(ip);
+std::unique_ptr<VirtualMachine> VirtualMachine::fork() {
+    if (executing) {
+        throw std::logic_error("Cannot fork a VM while it executes");
+    }
+    if (!memory_buffer && !cow_memory) {
+        throw std::logic_error("VM memory not initialized");
+    }
+    
+    std::unique_ptr<VirtualMachine> child(new VirtualMachine(buffer_size, memory_mode));
+    
+    if (cow_memory) {
+        child->cow_memory = new VMCowMemory(*cow_memory);
+    } else {
+        child->initialize();
+        memcpy(child->memory_buffer, memory_buffer, buffer_size);
+        if (shadow_memory) {
+            memcpy(child->shadow_memory, shadow_memory, VM_MEMORY_SIZE * sizeof(uint16_t));
+        }
+    }
+    
+    // Configuration; profiles, learned fusion and translations start fresh
+    child->runtime = runtime;
+    child->set_dispatch_mode(dispatch_mode);
+    child->aot_program = aot_program;
+    child->state_hashing = state_hashing;
+    child->cycle_detection = cycle_detection;
+    child->step_limit = step_limit;
+    child->memory_hash = memory_hash;
+    child->memory_hash_valid = memory_hash_valid;
+    child->update_store_hooks();
+    child->status_flags = status_flags;
+    child->status = status;
+    child->fault_address = fault_address;
+    return child;
+}
+
+void VirtualMachine::mark_all_dirty() {
+    memory_hash_valid = false;
+    if (dirty_words) {
+        dirty_words->mark_all();
+    }
+    if (checkpoint_log) {
+        checkpoint_log->mark_all();
+    }
+}
+
+void VirtualMachine::set_write_tracking(bool enabled) {
+    if (!enabled) {
+        delete dirty_words;
+        dirty_words = nullptr;
+    } else if (!dirty_words) {
+        dirty_words = new VMDirtyBitmap();
+    }
+    update_store_hooks();
+}
+
+void VirtualMachine::restore_dirty(const uint16_t* image) {
+    if (!dirty_words) {
+        throw std::logic_error("VM write tracking not enabled");
+    }
+    if (executing) {
+        throw std::logic_error("Cannot restore a VM while it executes");
+    }
+    
+    // Stores keep the decode cache, JIT and optimizer consistent
+    dirty_words->for_each([this, image](uint16_t address) {
+        write_memory(address, image[address]);
+    });
+    dirty_words->clear();
+    
+    reset();
+    status = VMStatus::OK;
+    fault_address = 0;
+}
+
+VMStatus VirtualMachine::execute() {
+    // Flags live in a flat array for the duration of the run
+    bool flags[4] = {
+        status_flags.flag_sign, status_flags.flag_zero,
+        status_flags.flag_carry, status_flags.flag_overflow
+    };
+    
+    ExecutionContext context = { memory_buffer, 0, 0, flags, this, executor };
+    VMRuntimeScope scope(runtime);
+    
+    status = VMStatus::OK;
+    executing = true;
+    try {
+        if (aot_program && !instrumented() && !counting_steps()) {
+            mark_all_dirty();
+            run_aot(context);
+        } else {
+            run_core(context);
+        }
+    } catch (...) {
+        executing = false;
+        throw;
+    }
+    executing = false;
+    
+    vm_flags_materialize(context);
+    status_flags.flag_sign = flags[VM_FLAG_SIGN];
+    status_flags.flag_zero = flags[VM_FLAG_ZERO];
+    status_flags.flag_carry = flags[VM_FLAG_CARRY];
+    status_flags.flag_overflow = flags[VM_FLAG_OVERFLOW];
+    
+    return status;
+}
+
+void VirtualMachine::run_core(ExecutionContext& context) {
+    // Native blocks use the IP/SP cells in shadow memory directly
+    if (dispatch_mode == VMDispatchMode::JIT && jit && shadow_memory && !instrumented()) {
+        mark_all_dirty();
+        run_jit(context);
+    } else {
+        // Interpreter cores keep IP and SP in the context for the whole run
+        cache_registers(context);
+        try {
+            run_interpreter(context);
+        } catch (...) {
+            flush_registers();
+            throw;
+        }
+        flush_registers();
+    }
+    
+    // Cores count steps as they start them; a suspended input instruction
+    // runs again on resume
+    if (status == VMStatus::INPUT_PENDING) {
+        runtime.steps--;
+    }
+}
+
+void VirtualMachine::run_interpreter(ExecutionContext& context) {
+    if (cow_memory || instrumented()) {
+        run_uncached(context);
+    } else if (dispatch_mode == VMDispatchMode::THREADED) {
+        run_threaded(context);
+    } else {
+        run_handlers(context);
+    }
+}
+
+void VirtualMachine::cache_registers(ExecutionContext& context) {
+    context.ip = read_memory(VM_INSTRUCTION_POINTER);
+    context.sp = read_memory(VM_STACK_POINTER);
+    registers = &context;
+}
+
+void VirtualMachine::flush_registers() {
+    ExecutionContext* context = registers;
+    registers = nullptr;
+    
+    if (context) {
+        write_memory(VM_STACK_POINTER, context->sp);
+        write_memory(VM_INSTRUCTION_POINTER, context->ip);
+    }
+}
+
+bool VirtualMachine::suspend_input(ExecutionContext& context) {
+    // Input instructions are opcode + one operand word
+    status = VMStatus::INPUT_PENDING;
+    context.ip = (context.ip - 2) & 0x1FFF;
+    return false;
+}
+
+inline uint16_t VirtualMachine::decode_uncached(uint16_t ip, VMDecodedInstruction& instruction) {
+    uint16_t word = read_memory(ip);
+    const VMDecodeInfo& info = VM_DECODE_LUT[word];
+    
+    instruction.handler = info.handler;
+    instruction.opcode = info.opcode;
+    instruction.mode_dst = info.mode_dst;
+    instruction.mode_src = info.mode_src;
+    instruction.length = info.length;
+    instruction.operand1 = info.length > 1 ? read_memory((ip + 1) & 0x1FFF) : 0;
+    instruction.operand2 = info.length > 2 ? read_memory((ip + 2) & 0x1FFF) : 0;
+    instruction.live_flags = VM_FLAG_MASK_ALL;
+    return word;
+}
+
+bool VirtualMachine::interpret_uncached(ExecutionContext& context) {
+    uint16_t ip = read_memory(VM_INSTRUCTION_POINTER);
+    VMDecodedInstruction instruction;
+    decode_uncached(ip, instruction);
+    
+    uint16_t next_ip = (ip + instruction.length) & 0x1FFF;
+    write_memory(VM_INSTRUCTION_POINTER, next_ip);
+    context.ip = next_ip;
+    
+    bool running = instruction.handler(instruction, context);
+    
+    if (context.ip != next_ip) {
+        write_memory(VM_INSTRUCTION_POINTER, context.ip);
+    }
+    return running && !faulted();
+}
+
+void VirtualMachine::set_dispatch_mode(VMDispatchMode mode) {
+    dispatch_mode = mode;
+    
+    // Handlers are bound at decode time
+    decode_cache.set_specialized(mode == VMDispatchMode::SPECIALIZED || 
+                                 mode == VMDispatchMode::JIT);
+    update_fusion();
+    
+    // Translated code operates on the unpacked words
+    if (mode == VMDispatchMode::JIT && memory_mode == VMMemoryMode::SHADOW && !jit) {
+        jit = new VMJit();
+        if (!jit->initialize()) {
+            delete jit;
+            jit = nullptr;
+        }
+        update_store_hooks();
+    }
+}
+
+void VirtualMachine::set_fusion_mode(VMFusionMode mode, uint64_t warmup) {
+    fusion_mode = mode;
+    fusion_warmup = warmup;
+    
+    if (mode == VMFusionMode::PROFILE || mode == VMFusionMode::ADAPTIVE) {
+        superinstructions.start_profiling();
+        superinstructions.clear_profile();
+    }
+    
+    update_fusion();
+}
+
+void VirtualMachine::update_fusion() {
+    bool fuse = fusion_mode == VMFusionMode::FUSE && 
+                dispatch_mode != VMDispatchMode::THREADED;
+    
+    decode_cache.set_fusion(fuse ? &superinstructions : nullptr);
+}
+
+void VirtualMachine::run_handlers(ExecutionContext& context) {
+    if (fusion_mode == VMFusionMode::PROFILE || fusion_mode == VMFusionMode::ADAPTIVE) {
+        run_handlers_profiled(context);
+        return;
+    }
+    
+    bool running = true;
+    
+    // Main VM execution loop. IP lives in context.ip: handlers that jump or
+    // store into the IP cell replace the sequential value.
+    while (running) {
+        decode_cache.invalidate_register_cells();
+        
+        uint16_t ip = context.ip;
+        const VMDecodedInstruction& instruction = decode_cache.lookup(*this, ip);
+        context.ip = (ip + instruction.length) & 0x1FFF;
+        runtime.steps++;
+        
+        running = instruction.handler(instruction, context) && !faulted();
+    }
+}
+
+void VirtualMachine::run_handlers_profiled(ExecutionContext& context) {
+    bool running = true;
+    uint16_t expected_ip = context.ip;
+    
+    // Same loop as run_handlers, recording fall-through opcode sequences
+    while (running) {
+        decode_cache.invalidate_register_cells();
         
-        // Update instruction pointer
-        write_memory(VM_INSTRUCTION_POINTER, (ip + 1) & 0x1FFF);
+        uint16_t ip = context.ip;
+        const VMDecodedInstruction& instruction = decode_cache.lookup(*this, ip);
+        uint16_t next_ip = (ip + instruction.length) & 0x1FFF;
         
-        // Decode and execute instruction
-        VMInstruction decoded = VMInstruction::decode(instruction);
+        superinstructions.record(instruction.opcode, ip == expected_ip);
+        expected_ip = next_ip;
+        context.ip = next_ip;
+        runtime.steps++;
         
-        // TODO: Implement instruction execution
-        // This would involve a large switch statement or lookup table
+        running = instruction.handler(instruction, context) && !faulted();
         
-        if (static_cast<VMOpcode>(decoded.opcode) == VMOpcode::HALT) {
-            break;
+        // Adaptive mode switches to fused dispatch once warmed up
+        if (fusion_mode == VMFusionMode::ADAPTIVE && 
+            superinstructions.get_recorded() >= fusion_warmup) {
+            superinstructions.learn();
+            fusion_mode = VMFusionMode::FUSE;
+            update_fusion();
+            
+            if (running) {
+                run_handlers(context);
+            }
+            return;
         }
     }
 }
 
-// Global VM initialization function
-void initialize_virtual_machine_runtime() {
-    if (g_vm_initialized) {
-        return;
+void VirtualMachine::run_uncached(ExecutionContext& context) {
+    bool running = true;
+    
+    // Forks share the hash, so compute it before the first step can suspend
+    if (cycle_detection) {
+        cycle_detector.reset();
+        if (!memory_hash_valid) {
+            memory_hash = hash_memory();
+            memory_hash_valid = true;
+        }
     }
     
-    // Initialize runtime critical sections
-    if (!initialize_vm_runtime_critical()) {
-        throw std::runtime_error("Failed to initialize VM runtime");
+    // Decode from memory every step with the specialized handler table.
+    // Instruments hook in around the handler: the tracer records its
+    // sampled steps, then the profiler counts every step once the tracer
+    // has finished, and cycle detection and the step limit check every state.
+    while (running) {
+        // Finished tracers hand the rest of the run to the regular cores
+        if (!cow_memory && !instrumented()) {
+            run_interpreter(context);
+            return;
+        }
+        
+        bool traced = tracing();
+        bool profiled = profiler && !traced;
+        bool sampled = profiled && profiler->should_sample();
+        uint64_t start = sampled ? vm_profile_clock() : 0;
+        
+        uint16_t ip = context.ip;
+        VMDecodedInstruction instruction;
+        uint16_t word = decode_uncached(ip, instruction);
+        context.ip = (ip + instruction.length) & 0x1FFF;
+        
+        // Operands are resolved as the handler sees them, IP on the next step
+        VMTraceRecord record;
+        traced = traced && tracer->should_record(ip);
+        if (traced) {
+            trace_operands(record, ip, word, instruction);
+        }
+        
+        // Conditional jump outcome from the flags it is about to test
+        if (profiled && instruction.opcode >= VMOpcode::JZ && instruction.opcode <= VMOpcode::JGE) {
+            vm_flags_materialize(context);
+            profiler->record_branch(ip, vm_branch_taken(instruction.opcode, context.status_flags));
+        }
+        
+        runtime.steps++;
+        running = instruction.handler(instruction, context) && !faulted();
+        
+        if (traced) {
+            trace_result(record, instruction, context);
+        }
+        if (profiled) {
+            // Sampled steps are timed from the fetch to the end of the handler
+            if (sampled) {
+                profiler->record_cycles(ip, word, vm_profile_clock() - start);
+            }
+            profiler->record(ip, word, instruction.length, static_cast<uint8_t>(instruction.mode_dst),
+                             static_cast<uint8_t>(instruction.mode_src));
+        }
+        if (cycle_detection && running && cycle_repeated(context, instruction.opcode)) {
+            status = VMStatus::CYCLE;
+            running = false;
+        }
+        if (step_limit && running && runtime.steps >= step_limit) {
+            status = VMStatus::STEP_LIMIT;
+            running = false;
+        }
+    }
+}
+
+bool VirtualMachine::cycle_repeated(ExecutionContext& context, VMOpcode opcode) {
+    // Input moves the guest on even when its state repeats
+    if (opcode == VMOpcode::IN || opcode == VMOpcode::IN_STR || opcode == VMOpcode::IN_HEX) {
+        cycle_detector.reset();
+        return false;
     }
     
-    // Set exception handlers
-    set_vm_exception_handler();
-    set_vm_termination_handler();
+    // Flags are only materialized for a candidate match or a new saved state
+    bool match = cycle_detector.matches(memory_hash, context.ip, context.sp);
+    bool save = cycle_detector.advance();
+    if (!match && !save) {
+        return false;
+    }
     
-    // Initialize checksum/hash algorithm
-    initialize_vm_checksum();
+    vm_flags_materialize(context);
+    uint8_t flags = 0;
+    for (int flag = 0; flag < 4; flag++) {
+        flags |= context.status_flags[flag] << flag;
+    }
+    if (match && cycle_detector.matches_flags(flags)) {
+        return true;
+    }
+    if (save) {
+        cycle_detector.save(memory_hash, context.ip, context.sp, flags);
+    }
+    return false;
+}
+
+void VirtualMachine::set_state_hashing(bool enabled) {
+    state_hashing = enabled;
+    if (!hashing_states()) {
+        memory_hash_valid = false;
+    }
+    update_store_hooks();
+}
+
+void VirtualMachine::set_cycle_detection(bool enabled) {
+    if (executing) {
+        throw std::logic_error("Cannot change cycle detection while the VM executes");
+    }
+    cycle_detection = enabled;
+    if (!hashing_states()) {
+        memory_hash_valid = false;
+    }
+    update_store_hooks();
+}
+
+void VirtualMachine::set_step_limit(uint64_t limit) {
+    if (executing) {
+        throw std::logic_error("Cannot change the step limit while the VM executes");
+    }
+    step_limit = limit;
+}
+
+uint64_t VirtualMachine::hash_memory() {
+    uint64_t hash = 0;
+    for (uint16_t address = 0; address < VM_STACK_POINTER; address++) {
+        hash += vm_hash_cell(address, read_memory(address));
+    }
+    return hash;
+}
+
+uint64_t VirtualMachine::state_hash() {
+    if (!memory_hash_valid) {
+        memory_hash = hash_memory();
+        memory_hash_valid = hashing_states();
+    }
     
-    g_vm_initialized = true;
+    uint8_t flags = status_flags.flag_sign << VM_FLAG_SIGN | status_flags.flag_zero << VM_FLAG_ZERO |
+                    status_flags.flag_carry << VM_FLAG_CARRY | status_flags.flag_overflow << VM_FLAG_OVERFLOW;
+    return vm_hash_state(memory_hash, read_memory(VM_INSTRUCTION_POINTER),
+                         read_memory(VM_STACK_POINTER), flags);
+}
+
+void VirtualMachine::set_tracer(VMTracer* trace) {
+    if (trace && !VM_TRACE) {
+        throw std::logic_error("Tracing not compiled in (VM_TRACE=0)");
+    }
+    if (executing) {
+        throw std::logic_error("Cannot attach a tracer while the VM executes");
+    }
+    tracer = trace;
 }
 
-void vm_initialize_console_app() {
-    g_app_type = ApplicationType::CONSOLE;
-    initialize_virtual_machine_runtime();
+void VirtualMachine::trace_operands(VMTraceRecord& record, uint16_t ip, uint16_t word,
+                                    const VMDecodedInstruction& instruction) {
+    record = {};
+    record.step = tracer->get_steps() - 1;
+    record.ip = ip;
+    record.instruction = word;
+    if (instruction.length > 1) {
+        record.dst_address = resolve_operand(instruction.operand1, instruction.mode_dst);
+        record.dst_value = read_memory(record.dst_address);
+    }
+    if (instruction.length > 2) {
+        record.src_address = resolve_operand(instruction.operand2, instruction.mode_src);
+        record.src_value = read_memory(record.src_address);
+    }
 }
 
-void vm_initialize_gui_app() {
-    g_app_type = ApplicationType::GUI;
-    initialize_virtual_machine_runtime();
+void VirtualMachine::trace_result(VMTraceRecord& record, const VMDecodedInstruction& instruction,
+                                  ExecutionContext& context) {
+    if (instruction.length > 1) {
+        record.result = read_memory(record.dst_address);
+    }
+    vm_flags_materialize(context);
+    for (int flag = 0; flag < 4; flag++) {
+        record.flags |= context.status_flags[flag] << flag;
+    }
+    tracer->push(record);
+}
+
+void VirtualMachine::set_profiler(VMProfiler* profile) {
+    if (executing) {
+        throw std::logic_error("Cannot attach a profiler while the VM executes");
+    }
+    profiler = profile;
 }
\ No newline at end of file
@@ -0,0 +1,403 @@
+#include "../include/vm_corpus.h"
+#include "../include/vm_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+// Little-endian values of the corpus and results files
+static void vm_corpus_put(std::vector<uint8_t>& output, uint64_t value, int bytes) {
+    for (int byte = 0; byte < bytes; byte++) {
+        output.push_back(static_cast<uint8_t>(value >> (byte * 8)));
+    }
+}
+
+static uint64_t vm_corpus_load(const uint8_t* data, int bytes) {
+    uint64_t value = 0;
+    for (int byte = 0; byte < bytes; byte++) {
+        value |= static_cast<uint64_t>(data[byte]) << (byte * 8);
+    }
+    return value;
+}
+
+static bool vm_corpus_get(FILE* input, uint64_t& value, int bytes) {
+    uint8_t data[8];
+    if (fread(data, 1, bytes, input) != static_cast<size_t>(bytes)) {
+        return false;
+    }
+    value = vm_corpus_load(data, bytes);
+    return true;
+}
+
+// FNV-1a, 64-bit
+static uint64_t vm_corpus_hash(const std::string& data) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (unsigned char character : data) {
+        hash = (hash ^ character) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+VMCorpus::VMCorpus(const char* path)
+    : file(path), position(8) {
+    if (file.get_size() < 8 || vm_corpus_load(file.get_data(), 4) != VM_CORPUS_FILE_MAGIC) {
+        throw std::runtime_error("Not a VM corpus");
+    }
+    if (vm_corpus_load(file.get_data() + 4, 2) != VM_CORPUS_FILE_VERSION) {
+        throw std::runtime_error("Unsupported VM corpus version");
+    }
+    file.advise_sequential();
+}
+
+bool VMCorpus::next(const uint8_t*& data, uint32_t& length) {
+    size_t size = file.get_size();
+    if (position >= size) {
+        return false;
+    }
+    if (size - position < 4) {
+        throw std::runtime_error("Truncated VM corpus record");
+    }
+    
+    length = static_cast<uint32_t>(vm_corpus_load(file.get_data() + position, 4));
+    if (size - position - 4 < length) {
+        throw std::runtime_error("Truncated VM corpus record");
+    }
+    data = file.get_data() + position + 4;
+    position += 4 + static_cast<size_t>(length);
+    return true;
+}
+
+void VMCorpus::rewind() {
+    position = 8;
+}
+
+void VMCorpus::write_header(FILE* output) {
+    std::vector<uint8_t> header;
+    vm_corpus_put(header, VM_CORPUS_FILE_MAGIC, 4);
+    vm_corpus_put(header, VM_CORPUS_FILE_VERSION, 2);
+    vm_corpus_put(header, 0, 2);
+    fwrite(header.data(), 1, header.size(), output);
+}
+
+void VMCorpus::write_record(FILE* output, const void* data, uint32_t length) {
+    std::vector<uint8_t> prefix;
+    vm_corpus_put(prefix, length, 4);
+    fwrite(prefix.data(), 1, prefix.size(), output);
+    fwrite(data, 1, length, output);
+}
+
+void vm_corpus_read_results(FILE* input, const std::function<void(uint64_t index, const VMCorpusResult& result)>& visit) {
+    uint64_t magic;
+    uint64_t version;
+    uint64_t reserved;
+    if (!vm_corpus_get(input, magic, 4) || magic != VM_CORPUS_RESULTS_MAGIC ||
+        !vm_corpus_get(input, version, 2) || !vm_corpus_get(input, reserved, 2)) {
+        throw std::runtime_error("Not a VM corpus results file");
+    }
+    if (version != VM_CORPUS_FILE_VERSION) {
+        throw std::runtime_error("Unsupported VM corpus results version");
+    }
+    
+    uint64_t index = 0;
+    uint64_t count;
+    std::vector<uint8_t> chunk;
+    while (vm_corpus_get(input, count, 4)) {
+        // Grow the chunk as its bytes arrive, so a corrupt row count ends
+        // in a short read rather than an allocation for rows that are not there
+        uint64_t size = count * 18;
+        chunk.clear();
+        while (chunk.size() < size) {
+            size_t offset = chunk.size();
+            size_t block = static_cast<size_t>(std::min<uint64_t>(size - offset, VM_CORPUS_READ_BYTES));
+            chunk.resize(offset + block);
+            if (fread(&chunk[offset], 1, block, input) != block) {
+                throw std::runtime_error("Truncated VM corpus results");
+            }
+        }
+        
+        const uint8_t* statuses = chunk.data();
+        const uint8_t* flags = statuses + count;
+        const uint8_t* steps = flags + count;
+        const uint8_t* hashes = steps + count * 8;
+        for (uint64_t row = 0; row < count; row++) {
+            VMCorpusResult result;
+            result.status = static_cast<VMStatus>(statuses[row]);
+            result.flags = flags[row];
+            result.steps = vm_corpus_load(steps + row * 8, 8);
+            result.output_hash = vm_corpus_load(hashes + row * 8, 8);
+            visit(index++, result);
+        }
+    }
+}
+
+// Records of one batch and their results, column by column
+struct VMCorpusBatch {
+    uint64_t sequence;          // Batch number in corpus order
+    size_t end;                 // Corpus offset after the last record
+    std::vector<const uint8_t*> inputs;
+    std::vector<uint32_t> lengths;
+    std::vector<uint8_t> statuses;
+    std::vector<uint8_t> flags;
+    std::vector<uint64_t> steps;
+    std::vector<uint64_t> hashes;
+    
+    void resize(size_t count) {
+        inputs.resize(count);
+        lengths.resize(count);
+        statuses.resize(count);
+        flags.resize(count);
+        steps.resize(count);
+        hashes.resize(count);
+    }
+};
+
+// Blocking FIFO between two stages. Every batch is owned by exactly one
+// queue or stage, so the queues never hold more than the batch count.
+class VMCorpusQueue {
+private:
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<VMCorpusBatch*> batches;
+    bool closed;
+    
+public:
+    VMCorpusQueue() : closed(false) {}
+    
+    void push(VMCorpusBatch* batch) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            batches.push_back(batch);
+        }
+        ready.notify_one();
+    }
+    
+    // nullptr once the queue is closed and empty
+    VMCorpusBatch* pop() {
+        std::unique_lock<std::mutex> guard(lock);
+        ready.wait(guard, [this]() { return closed || !batches.empty(); });
+        if (batches.empty()) {
+            return nullptr;
+        }
+        
+        VMCorpusBatch* batch = batches.front();
+        batches.pop_front();
+        return batch;
+    }
+    
+    void close() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            closed = true;
+        }
+        ready.notify_all();
+    }
+};
+
+// State shared by the stages of one run()
+struct VMCorpusShared {
+    VMCorpusQueue free;
+    VMCorpusQueue work;
+    VMCorpusQueue done;
+    
+    std::atomic<bool> failed;
+    std::mutex error_lock;
+    std::exception_ptr error;
+    std::atomic<uint64_t> faults;
+    std::atomic<uint64_t> cycles;
+    
+    VMCorpusShared() : failed(false), faults(0), cycles(0) {}
+    
+    void fail(std::exception_ptr exception) {
+        std::lock_guard<std::mutex> guard(error_lock);
+        if (!error) {
+            error = exception;
+        }
+        failed.store(true, std::memory_order_relaxed);
+    }
+};
+
+static void vm_corpus_worker(VMCorpusShared& shared, VMPool& pool, VMDispatchMode dispatch_mode,
+                             bool cycle_detection) {
+    VirtualMachine* vm = pool.acquire();
+    VMMemoryIO io;
+    io.input_position = 0;
+    io.suspend = false;
+    
+    vm->set_dispatch_mode(dispatch_mode);
+    vm->set_cycle_detection(cycle_detection);
+    vm->get_runtime().memory_io = &io;
+    
+    uint64_t faults = 0;
+    uint64_t cycles = 0;
+    while (VMCorpusBatch* batch = shared.work.pop()) {
+        // Batches keep flowing after a failure so every stage drains
+        try {
+            for (size_t row = 0; row < batch->inputs.size() && !shared.failed.load(std::memory_order_relaxed); row++) {
+                pool.restore(*vm);
+                io.input.assign(reinterpret_cast<const char*>(batch->inputs[row]), batch->lengths[row]);
+                io.input_position = 0;
+                io.output.clear();
+                
+                uint64_t steps = vm->get_runtime().steps;
+                VMStatus status = vm->execute();
+                faults += status == VMStatus::MEMORY_FAULT;
+                cycles += status == VMStatus::CYCLE;
+                
+                batch->statuses[row] = static_cast<uint8_t>(status);
+                batch->flags[row] = static_cast<uint8_t>(vm->get_sign_flag() << VM_FLAG_SIGN |
+                                                         vm->get_zero_flag() << VM_FLAG_ZERO |
+                                                         vm->get_carry_flag() << VM_FLAG_CARRY |
+                                                         vm->get_overflow_flag() << VM_FLAG_OVERFLOW);
+                batch->steps[row] = vm->get_runtime().steps - steps;
+                batch->hashes[row] = vm_corpus_hash(io.output);
+            }
+        } catch (...) {
+            shared.fail(std::current_exception());
+        }
+        shared.done.push(batch);
+    }
+    
+    shared.faults.fetch_add(faults, std::memory_order_relaxed);
+    shared.cycles.fetch_add(cycles, std::memory_order_relaxed);
+    vm->get_runtime().memory_io = nullptr;
+    vm->set_cycle_detection(false);
+    pool.release(vm);
+}
+
+// Writes finished batches in corpus order, dropping corpus pages behind them
+static void vm_corpus_writer(VMCorpusShared& shared, size_t batch_count, FILE* results, VMMappedFile& corpus) {
+    // Batches in flight span fewer sequence numbers than there are batches
+    std::vector<VMCorpusBatch*> pending(batch_count, nullptr);
+    uint64_t next = 0;
+    size_t discarded = 0;
+    std::vector<uint8_t> chunk;
+    
+    while (VMCorpusBatch* batch = shared.done.pop()) {
+        pending[batch->sequence % batch_count] = batch;
+        
+        while ((batch = pending[next % batch_count]) != nullptr) {
+            pending[next % batch_count] = nullptr;
+            next++;
+            
+            if (!shared.failed.load(std::memory_order_relaxed)) {
+                size_t count = batch->inputs.size();
+                chunk.clear();
+                vm_corpus_put(chunk, count, 4);
+                chunk.insert(chunk.end(), batch->statuses.begin(), batch->statuses.end());
+                chunk.insert(chunk.end(), batch->flags.begin(), batch->flags.end());
+                for (uint64_t steps : batch->steps) {
+                    vm_corpus_put(chunk, steps, 8);
+                }
+                for (uint64_t hash : batch->hashes) {
+                    vm_corpus_put(chunk, hash, 8);
+                }
+                
+                if (fwrite(chunk.data(), 1, chunk.size(), results) != chunk.size()) {
+                    shared.fail(std::make_exception_ptr(std::runtime_error("Failed to write VM corpus results")));
+                }
+            }
+            
+            // Every record before the batch end is finished
+            if (batch->end - discarded >= VM_CORPUS_DISCARD_BYTES) {
+                corpus.discard(discarded, batch->end - discarded);
+                discarded = batch->end;
+            }
+            shared.free.push(batch);
+        }
+    }
+}
+
+VMCorpusPipeline::VMCorpusPipeline(const uint8_t* packed_image, uint32_t image_size)
+    : image(packed_image, packed_image + image_size), threads(0), batch_records(VM_CORPUS_DEFAULT_BATCH),
+      depth(VM_CORPUS_DEFAULT_DEPTH), dispatch_mode(VMDispatchMode::THREADED),
+      cycle_detection(false) {
+    if (image_size > 0x3404) {
+        throw std::out_of_range("VM image larger than memory buffer");
+    }
+}
+
+VMCorpusSummary VMCorpusPipeline::run(VMCorpus& corpus, FILE* results) {
+    uint32_t worker_count = threads ? threads : std::thread::hardware_concurrency();
+    if (worker_count == 0) {
+        worker_count = 1;
+    }
+    
+    VMCorpusSummary summary = {};
+    auto start = std::chrono::steady_clock::now();
+    
+    std::vector<uint8_t> header;
+    vm_corpus_put(header, VM_CORPUS_RESULTS_MAGIC, 4);
+    vm_corpus_put(header, VM_CORPUS_FILE_VERSION, 2);
+    vm_corpus_put(header, 0, 2);
+    if (fwrite(header.data(), 1, header.size(), results) != header.size()) {
+        throw std::runtime_error("Failed to write VM corpus results");
+    }
+    
+    VMPool machines(image.data(), static_cast<uint32_t>(image.size()), worker_count);
+    VMCorpusShared shared;
+    
+    size_t batch_count = static_cast<size_t>(worker_count) * depth;
+    std::unique_ptr<VMCorpusBatch[]> batches(new VMCorpusBatch[batch_count]);
+    for (size_t index = 0; index < batch_count; index++) {
+        batches[index].inputs.reserve(batch_records);
+        shared.free.push(&batches[index]);
+    }
+    
+    std::thread writer(vm_corpus_writer, std::ref(shared), batch_count, results, std::ref(corpus.get_file()));
+    std::vector<std::thread> workers;
+    workers.reserve(worker_count);
+    for (uint32_t worker = 0; worker < worker_count; worker++) {
+        workers.emplace_back(vm_corpus_worker, std::ref(shared), std::ref(machines), dispatch_mode,
+                             cycle_detection);
+    }
+    
+    // Reader: fill free batches until the corpus ends
+    try {
+        uint64_t sequence = 0;
+        bool more = true;
+        while (more && !shared.failed.load(std::memory_order_relaxed)) {
+            VMCorpusBatch* batch = shared.free.pop();
+            batch->resize(batch_records);
+            
+            size_t count = 0;
+            while (count < batch_records && (more = corpus.next(batch->inputs[count], batch->lengths[count]))) {
+                summary.input_bytes += batch->lengths[count];
+                count++;
+            }
+            
+            if (count == 0) {
+                shared.free.push(batch);
+                break;
+            }
+            batch->resize(count);
+            batch->sequence = sequence++;
+            batch->end = corpus.get_position();
+            summary.records += count;
+            shared.work.push(batch);
+        }
+    } catch (...) {
+        shared.fail(std::current_exception());
+    }
+    
+    shared.work.close();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    shared.done.close();
+    writer.join();
+    
+    if (shared.error) {
+        std::rethrow_exception(shared.error);
+    }
+    
+    summary.faults = shared.faults.load(std::memory_order_relaxed);
+    summary.cycles = shared.cycles.load(std::memory_order_relaxed);
+    summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return summary;
+}
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "../include/vm_decode_cache.h"
+#include "../include/vm_core.h"
+#include "../include/vm_specialized.h"
+#include "../include/vm_superinstructions.h"
+#include "../include/vm_optimizer.h"
+#include <cstring>
+#include <stdexcept>
+
+VMDecodeCache::VMDecodeCache() 
+    : entries(nullptr), code_bitmap(nullptr), liveness_bitmap(nullptr),
+      specialized(false), fusion(nullptr), optimizer(nullptr) {
+}
+
+VMDecodeCache::~VMDecodeCache() {
+    if (entries) {
+        free(entries);
+        entries = nullptr;
+    }
+    
+    if (code_bitmap) {
+        free(code_bitmap);
+        code_bitmap = nullptr;
+    }
+    
+    if (liveness_bitmap) {
+        free(liveness_bitmap);
+        liveness_bitmap = nullptr;
+    }
+}
+
+void VMDecodeCache::initialize() {
+    if (!entries) {
+        entries = static_cast<VMDecodedInstruction*>(
+            calloc(VM_DECODE_CACHE_ENTRIES, sizeof(VMDecodedInstruction)));
+    }
+    if (!code_bitmap) {
+        code_bitmap = static_cast<uint64_t*>(
+            calloc(VM_DECODE_CACHE_ENTRIES / 64, sizeof(uint64_t)));
+    }
+    if (!liveness_bitmap) {
+        liveness_bitmap = static_cast<uint64_t*>(
+            calloc(VM_DECODE_CACHE_ENTRIES / 64, sizeof(uint64_t)));
+    }
+    if (!entries || !code_bitmap || !liveness_bitmap) {
+        throw std::runtime_error("Failed to allocate VM decode cache");
+    }
+    
+    invalidate_all();
+}
+
+const VMDecodedInstruction& VMDecodeCache::decode_entry(VirtualMachine& vm, uint16_t ip) {
+    lookup_unfused(vm, ip);
+    
+    // Replace the entry with a superinstruction if a learned sequence starts here
+    if (fusion) {
+        fusion->fuse(vm, *this, entries[ip], ip);
+    }
+    
+    return entries[ip];
+}
+
+const VMDecodedInstruction& VMDecodeCache::lookup_unfused(VirtualMachine& vm, uint16_t ip) {
+    ip &= 0x1FFF;
+    VMDecodedInstruction& entry = entries[ip];
+    if (entry.length) {
+        return entry;
+    }
+    
+    const VMDecodeInfo& info = VM_DECODE_LUT[vm.read_memory(ip)];
+    
+    entry.opcode = info.opcode;
+    entry.mode_dst = info.mode_dst;
+    entry.mode_src = info.mode_src;
+    entry.operand1 = info.length > 1 ? vm.read_memory((ip + 1) & 0x1FFF) : 0;
+    entry.operand2 = info.length > 2 ? vm.read_memory((ip + 2) & 0x1FFF) : 0;
+    
+    if (specialized || info.handler == vm_handler_illegal) {
+        entry.handler = info.handler;
+    } else {
+        entry.handler = vm_handler_executor;
+    }
+    entry.live_flags = VM_FLAG_MASK_ALL;
+    entry.length = info.length;
+    
+    if (optimizer) {
+        optimizer->rewrite(ip, entry, specialized);
+    }
+    
+    // Track every word the entry was built from
+    for (uint8_t i = 0; i < entry.length; i++) {
+        uint16_t address = (ip + i) & 0x1FFF;
+        code_bitmap[address >> 6] |= 1ULL << (address & 63);
+    }
+    
+    return entry;
+}
+
+void VMDecodeCache::invalidate(uint16_t address) {
+    // Fused entries may have skipped flags based on this word
+    if ((liveness_bitmap[address >> 6] >> (address & 63)) & 1) {
+        invalidate_all();
+        return;
+    }
+    
+    // Drop every entry whose span covers the written address
+    for (uint8_t back = 0; back < VM_MAX_ENTRY_SPAN; back++) {
+        VMDecodedInstruction& entry = entries[(address - back) & 0x1FFF];
+        if (entry.length > back) {
+            entry.length = 0;
+        }
+    }
+    
+    code_bitmap[address >> 6] &= ~(1ULL << (address & 63));
+}
+
+void VMDecodeCache::mark_liveness(uint16_t address) {
+    address &= 0x1FFF;
+    code_bitmap[address >> 6] |= 1ULL << (address & 63);
+    liveness_bitmap[address >> 6] |= 1ULL << (address & 63);
+}
+
+void VMDecodeCache::invalidate_all() {
+    if (entries) {
+        memset(entries, 0, VM_DECODE_CACHE_ENTRIES * sizeof(VMDecodedInstruction));
+    }
+    if (code_bitmap) {
+        memset(code_bitmap, 0, VM_DECODE_CACHE_ENTRIES / 8);
+    }
+    if (liveness_bitmap) {
+        memset(liveness_bitmap, 0, VM_DECODE_CACHE_ENTRIES / 8);
+    }
+}
+
+void VMDecodeCache::set_specialized(bool enabled) {
+    if (specialized != enabled) {
+        specialized = enabled;
+        invalidate_all();
+    }
+}
+
+void VMDecodeCache::set_fusion(VMSuperinstructions* superinstructions) {
+    if (fusion != superinstructions) {
+        fusion = superinstructions;
+        invalidate_all();
+    }
+}
+
+void VMDecodeCache::set_optimizer(const VMProgramOptimizer* program_optimizer) {
+    optimizer = program_optimizer;
+    invalidate_all();
+}
+
+bool vm_handler_executor(const VMDecodedInstruction& instruction, ExecutionContext& context) {
+    VirtualMachine& vm = *context.machine;
+    
+    // Indirect operands depend on memory and are resolved on every execution
+    uint16_t operand1 = vm.resolve_operand(instruction.operand1, instruction.mode_dst);
+    uint16_t operand2 = vm.resolve_operand(instruction.operand2, instruction.mode_src);
+    
+    return context.executor->execute(instruction.opcode, operand1, operand2,
+                                     instruction.mode_dst, instruction.mode_src, 
+                                     context);
+}
+
+bool vm_handler_illegal(const VMDecodedInstruction& instruction, ExecutionContext& context) {
+    // Unknown opcodes stop execution
+    return false;
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "../include/vm_hash.h"
+#include <thread>
+
+// Slicing-by-8 tables: entries[0] is the bytewise table, entries[n] the
+// CRC of a byte followed by n zero bytes
+struct VMCrcTables {
+    uint32_t entries[8][256];
+    
+    VMCrcTables() {
+        for (uint32_t entry = 0; entry < 256; entry++) {
+            uint32_t value = entry;
+            for (int bit = 0; bit < 8; bit++) {
+                value = value & 1 ? (value >> 1) ^ 0xEDB88320 : value >> 1;
+            }
+            entries[0][entry] = value;
+        }
+        for (uint32_t entry = 0; entry < 256; entry++) {
+            for (int slice = 1; slice < 8; slice++) {
+                uint32_t previous = entries[slice - 1][entry];
+                entries[slice][entry] = (previous >> 8) ^ entries[0][previous & 0xFF];
+            }
+        }
+    }
+};
+
+uint32_t vm_crc32(const void* data, size_t size, uint32_t crc) {
+    static const VMCrcTables tables;
+    const uint32_t (*entries)[256] = tables.entries;
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    
+    crc = ~crc;
+    while (size >= 8) {
+        uint32_t low = crc ^ (bytes[0] | bytes[1] << 8 | bytes[2] << 16 | static_cast<uint32_t>(bytes[3]) << 24);
+        crc = entries[7][low & 0xFF] ^ entries[6][(low >> 8) & 0xFF] ^
+              entries[5][(low >> 16) & 0xFF] ^ entries[4][low >> 24] ^
+              entries[3][bytes[4]] ^ entries[2][bytes[5]] ^
+              entries[1][bytes[6]] ^ entries[0][bytes[7]];
+        bytes += 8;
+        size -= 8;
+    }
+    while (size--) {
+        crc = entries[0][(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+VMVisitedStates::VMVisitedStates(size_t capacity)
+    : count(0) {
+    size_t slot_count = 16;
+    while (slot_count < capacity) {
+        slot_count <<= 1;
+    }
+    slots.reset(new Slot[slot_count]);
+    mask = slot_count - 1;
+    limit = slot_count / 4 * 3;
+    clear();
+}
+
+uint64_t VMVisitedStates::insert(uint64_t hash, uint64_t tag) {
+    if (hash == VM_VISITED_EMPTY) {
+        hash = 1;
+    }
+    if (count.load(std::memory_order_relaxed) >= limit) {
+        return tag;
+    }
+    
+    for (size_t index = hash & mask;; index = (index + 1) & mask) {
+        Slot& slot = slots[index];
+        uint64_t current = slot.hash.load(std::memory_order_acquire);
+        if (current == VM_VISITED_EMPTY) {
+            uint64_t expected = VM_VISITED_EMPTY;
+            if (slot.hash.compare_exchange_strong(expected, hash, std::memory_order_acq_rel)) {
+                slot.tag.store(tag, std::memory_order_relaxed);
+                slot.ready.store(true, std::memory_order_release);
+                count.fetch_add(1, std::memory_order_relaxed);
+                return tag;
+            }
+            current = expected;
+        }
+        if (current == hash) {
+            // The inserter publishes its tag right after claiming the slot
+            while (!slot.ready.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            return slot.tag.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool VMVisitedStates::contains(uint64_t hash) const {
+    if (hash == VM_VISITED_EMPTY) {
+        hash = 1;
+    }
+    for (size_t index = hash & mask;; index = (index + 1) & mask) {
+        uint64_t current = slots[index].hash.load(std::memory_order_acquire);
+        if (current == hash) {
+            return true;
+        }
+        if (current == VM_VISITED_EMPTY) {
+            return false;
+        }
+    }
+}
+
+void VMVisitedStates::clear() {
+    for (size_t index = 0; index <= mask; index++) {
+        slots[index].hash.store(VM_VISITED_EMPTY, std::memory_order_relaxed);
+        slots[index].tag.store(0, std::memory_order_relaxed);
+        slots[index].ready.store(false, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+}
\ No newline at end of file
@@ -0,0 +1,250 @@
+#include "../include/vm_image.h"
+#include "../include/vm_core.h"
+#include "../include/vm_hash.h"
+#include "../include/vm_memory.h"
+#include "../include/vm_specialized.h"
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint32_t vm_image_align(uint32_t offset) {
+    return (offset + VM_IMAGE_SECTION_ALIGNMENT - 1) & ~(VM_IMAGE_SECTION_ALIGNMENT - 1);
+}
+
+VMMappedFile::VMMappedFile(const char* path)
+    : data(nullptr), size(0), mapped(false) {
+#ifdef _WIN32
+    FILE* input = fopen(path, "rb");
+    if (!input) {
+        throw std::runtime_error(std::string("Cannot open ") + path);
+    }
+    fseek(input, 0, SEEK_END);
+    long length = ftell(input);
+    fseek(input, 0, SEEK_SET);
+    data = static_cast<uint8_t*>(malloc(length > 0 ? length : 1));
+    size = data && length > 0 ? fread(data, 1, length, input) : 0;
+    fclose(input);
+#else
+    int descriptor = open(path, O_RDONLY);
+    if (descriptor < 0) {
+        throw std::runtime_error(std::string("Cannot open ") + path);
+    }
+    
+    struct stat info;
+    if (fstat(descriptor, &info) == 0 && info.st_size > 0) {
+        void* address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (address != MAP_FAILED) {
+            data = static_cast<uint8_t*>(address);
+            size = info.st_size;
+            mapped = true;
+        }
+    }
+    close(descriptor);
+#endif
+}
+
+VMMappedFile::~VMMappedFile() {
+#ifndef _WIN32
+    if (mapped) {
+        munmap(data, size);
+        data = nullptr;
+    }
+#endif
+    free(data);
+    data = nullptr;
+}
+
+void VMMappedFile::advise_sequential() {
+#ifndef _WIN32
+    if (mapped) {
+        madvise(data, size, MADV_SEQUENTIAL);
+    }
+#endif
+}
+
+void VMMappedFile::discard(size_t offset, size_t length) {
+#ifndef _WIN32
+    // Whole pages inside the range only
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t begin = (offset + page - 1) / page * page;
+    size_t end = offset + length < size ? (offset + length) / page * page : size;
+    if (mapped && begin < end) {
+        madvise(data + begin, end - begin, MADV_DONTNEED);
+    }
+#else
+    (void)offset;
+    (void)length;
+#endif
+}
+
+VMImage::VMImage(const char* path)
+    : file(path), data(file.get_data()), header(nullptr) {
+    validate();
+}
+
+void VMImage::validate() {
+    size_t size = file.get_size();
+    if (!data || size < sizeof(VMImageHeader)) {
+        throw std::runtime_error("Not a VM image");
+    }
+    
+    header = reinterpret_cast<const VMImageHeader*>(data);
+    if (header->magic != VM_IMAGE_FILE_MAGIC || header->header_size != sizeof(VMImageHeader)) {
+        throw std::runtime_error("Not a VM image");
+    }
+    if (header->version != VM_IMAGE_FILE_VERSION) {
+        throw std::runtime_error("Unsupported VM image version " + std::to_string(header->version));
+    }
+    
+    // Sections inside the file, words and symbols aligned for in-place use
+    uint64_t symbol_end = header->symbol_offset + static_cast<uint64_t>(header->symbol_count) * sizeof(VMImageSymbol);
+    if (header->file_size != size ||
+        header->memory_size < VM_IMAGE_PACKED_SIZE ||
+        header->memory_offset + static_cast<uint64_t>(header->memory_size) > size ||
+        header->words_offset % VM_IMAGE_SECTION_ALIGNMENT ||
+        header->words_offset + static_cast<uint64_t>(VM_MEMORY_SIZE) * sizeof(uint16_t) > size ||
+        header->symbol_offset % VM_IMAGE_SECTION_ALIGNMENT || symbol_end > size ||
+        header->entry_ip >= VM_MEMORY_SIZE || header->entry_sp >= VM_MEMORY_SIZE) {
+        throw std::runtime_error("Corrupt VM image header");
+    }
+    
+    if (vm_crc32(data + sizeof(VMImageHeader), size - sizeof(VMImageHeader)) != header->checksum) {
+        throw std::runtime_error("VM image checksum mismatch");
+    }
+    
+    // Machines use the words in place as decode table indices, so they
+    // must be exactly the 13-bit values of the packed section
+    std::vector<uint16_t> words(VM_MEMORY_SIZE);
+    VMMemoryManager::unpack_buffer(get_memory(), words.data());
+    if (memcmp(words.data(), get_words(), VM_MEMORY_SIZE * sizeof(uint16_t)) != 0) {
+        throw std::runtime_error("VM image words do not match its memory section");
+    }
+}
+
+const VMImageSymbol& VMImage::get_symbol(uint32_t index) const {
+    if (index >= header->symbol_count) {
+        throw std::out_of_range("VM image symbol index out of range");
+    }
+    return reinterpret_cast<const VMImageSymbol*>(data + header->symbol_offset)[index];
+}
+
+const VMImageSymbol* VMImage::find_symbol(const char* name) const {
+    if (strlen(name) >= VM_IMAGE_SYMBOL_NAME_SIZE) {
+        return nullptr;
+    }
+    
+    for (uint32_t index = 0; index < header->symbol_count; index++) {
+        const VMImageSymbol& symbol = get_symbol(index);
+        if (strncmp(symbol.name, name, VM_IMAGE_SYMBOL_NAME_SIZE) == 0) {
+            return &symbol;
+        }
+    }
+    return nullptr;
+}
+
+void VMImage::write(FILE* output, VirtualMachine& vm, const std::vector<VMImageSymbol>& symbols) {
+    VMImageHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = VM_IMAGE_FILE_MAGIC;
+    header.version = VM_IMAGE_FILE_VERSION;
+    header.header_size = sizeof(VMImageHeader);
+    header.entry_ip = vm.read_memory(VM_INSTRUCTION_POINTER);
+    header.entry_sp = vm.read_memory(VM_STACK_POINTER);
+    header.memory_offset = sizeof(VMImageHeader);
+    header.memory_size = vm.get_buffer_size();
+    header.words_offset = vm_image_align(header.memory_offset + header.memory_size);
+    header.symbol_offset = vm_image_align(header.words_offset + VM_MEMORY_SIZE * sizeof(uint16_t));
+    header.symbol_count = static_cast<uint32_t>(symbols.size());
+    header.file_size = header.symbol_offset + header.symbol_count * static_cast<uint32_t>(sizeof(VMImageSymbol));
+    
+    std::vector<uint8_t> file(header.file_size, 0);
+    memcpy(&file[header.memory_offset], vm.get_memory_buffer(), header.memory_size);
+    
+    uint16_t* words = reinterpret_cast<uint16_t*>(&file[header.words_offset]);
+    for (uint16_t address = 0; address < VM_MEMORY_SIZE; address++) {
+        words[address] = vm.read_memory(address);
+    }
+    if (!symbols.empty()) {
+        memcpy(&file[header.symbol_offset], symbols.data(), symbols.size() * sizeof(VMImageSymbol));
+    }
+    
+    header.checksum = vm_crc32(file.data() + sizeof(header), file.size() - sizeof(header));
+    memcpy(file.data(), &header, sizeof(header));
+    
+    if (fwrite(file.data(), 1, file.size(), output) != file.size()) {
+        throw std::runtime_error("Failed to write VM image");
+    }
+}
+
+std::vector<VMImageSymbol> vm_image_find_blocks(VirtualMachine& vm) {
+    // Instruction starts reachable from the IP cell and block leaders
+    std::vector<bool> reachable(VM_MEMORY_SIZE, false);
+    std::vector<bool> leader(VM_MEMORY_SIZE, false);
+    std::vector<uint16_t> pending(1, vm.read_memory(VM_INSTRUCTION_POINTER));
+    leader[pending.back()] = true;
+    
+    while (!pending.empty()) {
+        uint16_t ip = pending.back();
+        pending.pop_back();
+        
+        if (reachable[ip]) {
+            continue;
+        }
+        reachable[ip] = true;
+        
+        const VMDecodeInfo& info = VM_DECODE_LUT[vm.read_memory(ip)];
+        uint16_t next_ip = (ip + info.length) & 0x1FFF;
+        
+        if (info.opcode == VMOpcode::HALT) {
+            continue;
+        }
+        
+        if (info.opcode >= VMOpcode::JMP && info.opcode <= VMOpcode::JGE) {
+            // Computed targets are only known at run time
+            if (info.mode_dst == AddressingMode::DIRECT) {
+                uint16_t target = vm.read_memory((ip + 1) & 0x1FFF);
+                leader[target] = true;
+                pending.push_back(target);
+            }
+            if (info.opcode == VMOpcode::JMP) {
+                continue;
+            }
+            leader[next_ip] = true;
+        }
+        
+        pending.push_back(next_ip);
+    }
+    
+    // A block runs from a leader to the next leader, jump or HALT
+    std::vector<VMImageSymbol> blocks;
+    for (uint32_t ip = 0; ip < VM_MEMORY_SIZE; ip++) {
+        if (!reachable[ip] || !leader[ip]) {
+            continue;
+        }
+        
+        VMImageSymbol block;
+        memset(&block, 0, sizeof(block));
+        block.address = static_cast<uint16_t>(ip);
+        block.kind = VM_IMAGE_SYMBOL_BLOCK;
+        
+        uint32_t end = ip;
+        while (end < VM_MEMORY_SIZE && reachable[end] && (end == ip || !leader[end])) {
+            const VMDecodeInfo& info = VM_DECODE_LUT[vm.read_memory(static_cast<uint16_t>(end))];
+            end += info.length;
+            if (info.opcode == VMOpcode::HALT || (info.opcode >= VMOpcode::JMP && info.opcode <= VMOpcode::JGE)) {
+                break;
+            }
+        }
+        block.length = static_cast<uint16_t>((end < VM_MEMORY_SIZE ? end : VM_MEMORY_SIZE) - ip);
+        blocks.push_back(block);
+    }
+    return blocks;
+}
\ No newline at end of file
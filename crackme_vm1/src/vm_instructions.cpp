@@ -1,15 +1,21 @@
 #include "../include/vm_instructions.h"
 #include "../include/vm_memory.h"
+#include "../include/vm_alu.h"
+#include "../include/vm_specialized.h"
+#include "../include/vm_core.h"
+#include "../include/vm_runtime.h"
+#include "../include/vm_io.h"
+#include <cctype>
 #include <cstring>
 
 VMInstruction VMInstruction::decode(uint16_t instruction) {
     VMInstruction decoded;
     
-    // Extract fields from instruction word
-    // Format: OOOOOOOO OOMMDDDD (9-bit opcode, 2-bit mode1, 2-bit mode2)
-    decoded.opcode = (instruction >> 4) & 0x1FF;  // 9 bits
-    decoded.mode_dst = (instruction >> 2) & 0x3;   // 2 bits
-    decoded.mode_src = instruction & 0x3;          // 2 bits
+    // Fields come from the compile-time decode table
+    const VMDecodeInfo& info = VM_DECODE_LUT[instruction & 0x1FFF];
+    decoded.opcode = static_cast<uint16_t>(info.opcode);
+    decoded.mode_dst = static_cast<uint8_t>(info.mode_dst);
+    decoded.mode_src = static_cast<uint8_t>(info.mode_src);
     
     return decoded;
 }
@@ -24,164 +30,388 @@ uint16_t VMInstruction::encode() const {
     return encoded;
 }
 
-// Basic instruction executor implementation
-class BasicInstructionExecutor : public InstructionExecutor {
-public:
-    bool execute(VMOpcode opcode, 
-                uint16_t operand1, 
-                uint16_t operand2,
-                AddressingMode mode1,
-                AddressingMode mode2,
-                ExecutionContext& context) override {
-        
-        switch (opcode) {
-            case VMOpcode::ADD: {
-                uint32_t result = operand1 + operand2;
-                context.status_flags[0] = (result & 0x2000) != 0;  // Sign flag
-                context.status_flags[1] = (result & 0x1FFF) == 0;  // Zero flag
-                context.status_flags[2] = (result > 0x1FFF);       // Carry flag
-                
-                // Overflow detection for signed addition
-                bool op1_sign = (operand1 & 0x1000) != 0;
-                bool op2_sign = (operand2 & 0x1000) != 0;
-                bool res_sign = (result & 0x1000) != 0;
-                context.status_flags[3] = (op1_sign == op2_sign) && (op1_sign != res_sign);
-                
-                // Write result
-                VMMemoryManager::write_buffer_value(context.memory, operand1, 
-                                                   static_cast<uint16_t>(result & 0x1FFF));
-                break;
-            }
-            
-            case VMOpcode::SUB: {
-                uint16_t result = operand1 - operand2;
-                context.status_flags[0] = (result & 0x1000) != 0;  // Sign flag
-                context.status_flags[1] = result == 0;             // Zero flag
-                context.status_flags[2] = operand1 < operand2;     // Carry flag
-                
-                // Overflow detection for signed subtraction
-                bool op1_sign = (operand1 & 0x1000) != 0;
-                bool op2_sign = (operand2 & 0x1000) != 0;
-                bool res_sign = (result & 0x1000) != 0;
-                context.status_flags[3] = (op1_sign != op2_sign) && (op1_sign != res_sign);
-                
-                // Write result
-                VMMemoryManager::write_buffer_value(context.memory, operand1, result);
-                break;
-            }
-            
-            case VMOpcode::AND: {
-                uint16_t result = operand1 & operand2;
-                context.status_flags[0] = (result & 0x1000) != 0;  // Sign flag
-                context.status_flags[1] = result == 0;             // Zero flag
-                context.status_flags[2] = false;                   // Clear carry
-                context.status_flags[3] = false;                   // Clear overflow
-                
-                VMMemoryManager::write_buffer_value(context.memory, operand1, result);
-                break;
-            }
-            
-            case VMOpcode::OR: {
-                uint16_t result = operand1 | operand2;
-                context.status_flags[0] = (result & 0x1000) != 0;  // Sign flag
-                context.status_flags[1] = result == 0;             // Zero flag
-                context.status_flags[2] = false;                   // Clear carry
-                context.status_flags[3] = false;                   // Clear overflow
-                
-                VMMemoryManager::write_buffer_value(context.memory, operand1, result);
-                break;
-            }
-            
-            case VMOpcode::XOR: {
-                uint16_t result = operand1 ^ operand2;
-                context.status_flags[0] = (result & 0x1000) != 0;  // Sign flag
-                context.status_flags[1] = result == 0;             // Zero flag
-                context.status_flags[2] = false;                   // Clear carry
-                context.status_flags[3] = false;                   // Clear overflow
-                
-                VMMemoryManager::write_buffer_value(context.memory, operand1, result);
-                break;
-            }
-            
-            case VMOpcode::NOT: {
-                uint16_t result = ~operand1 & 0x1FFF;
-                context.status_flags[0] = (result & 0x1000) != 0;  // Sign flag
-                context.status_flags[1] = result == 0;             // Zero flag
-                context.status_flags[2] = false;                   // Clear carry
-                context.status_flags[3] = false;                   // Clear overflow
-                
-                VMMemoryManager::write_buffer_value(context.memory, operand1, result);
-                break;
-            }
-            
-            case VMOpcode::CMP: {
-                uint16_t result = operand1 - operand2;
-                context.status_flags[0] = (result & 0x1000) != 0;  // Sign flag
-                context.status_flags[1] = result == 0;             // Zero flag
-                context.status_flags[2] = operand1 < operand2;     // Carry flag
-                
-                // Overflow detection for signed comparison
-                bool op1_sign = (operand1 & 0x1000) != 0;
-                bool op2_sign = (operand2 & 0x1000) != 0;
-                bool res_sign = (result & 0x1000) != 0;
-                context.status_flags[3] = (op1_sign != op2_sign) && (op1_sign != res_sign);
-                break;
-            }
-            
-            case VMOpcode::SHL: {
-                bool carry = (operand1 & 0x1000) != 0;
-                uint16_t result = (operand1 << 1) & 0x1FFF;
-                
-                context.status_flags[0] = (result & 0x1000) != 0;  // Sign flag
-                context.status_flags[1] = result == 0;             // Zero flag
-                context.status_flags[2] = carry;                   // Carry flag from MSB
-                context.status_flags[3] = false;                   // Clear overflow
-                
-                VMMemoryManager::write_buffer_value(context.memory, operand1, result);
-                break;
-            }
-            
-            case VMOpcode::SHR: {
-                bool carry = (operand1 & 1) != 0;
-                uint16_t result = operand1 >> 1;
-                
-                context.status_flags[0] = (result & 0x1000) != 0;  // Sign flag
-                context.status_flags[1] = result == 0;             // Zero flag
-                context.status_flags[2] = carry;                   // Carry flag from LSB
-                context.status_flags[3] = false;                   // Clear overflow
-                
-                VMMemoryManager::write_buffer_value(context.memory, operand1, result);
-                break;
-            }
-            
-            case VMOpcode::JMP: {
+// Opcode mnemonics
+struct VMOpcodeName {
+    VMOpcode opcode;
+    const char* name;
+};
+
+static const VMOpcodeName VM_OPCODE_NAMES[] = {
+    { VMOpcode::MOV, "MOV" },     { VMOpcode::XCHG, "XCHG" },
+    { VMOpcode::ADD, "ADD" },     { VMOpcode::SUB, "SUB" },
+    { VMOpcode::AND, "AND" },     { VMOpcode::INC, "INC" },
+    { VMOpcode::DEC, "DEC" },     { VMOpcode::OR, "OR" },
+    { VMOpcode::XOR, "XOR" },     { VMOpcode::NOT, "NOT" },
+    { VMOpcode::ROL, "ROL" },     { VMOpcode::ROR, "ROR" },
+    { VMOpcode::SHL, "SHL" },     { VMOpcode::SHR, "SHR" },
+    { VMOpcode::CMP, "CMP" },     { VMOpcode::JMP, "JMP" },
+    { VMOpcode::JZ, "JZ" },       { VMOpcode::JNZ, "JNZ" },
+    { VMOpcode::JC, "JC" },       { VMOpcode::JNC, "JNC" },
+    { VMOpcode::JS, "JS" },       { VMOpcode::JNS, "JNS" },
+    { VMOpcode::JO, "JO" },       { VMOpcode::JNO, "JNO" },
+    { VMOpcode::JL, "JL" },       { VMOpcode::JG, "JG" },
+    { VMOpcode::JLE, "JLE" },     { VMOpcode::JGE, "JGE" },
+    { VMOpcode::CLC, "CLC" },     { VMOpcode::STC, "STC" },
+    { VMOpcode::CMC, "CMC" },     { VMOpcode::PUSH, "PUSH" },
+    { VMOpcode::POP, "POP" },     { VMOpcode::IN, "IN" },
+    { VMOpcode::OUT, "OUT" },     { VMOpcode::IN_STR, "IN_STR" },
+    { VMOpcode::IN_HEX, "IN_HEX" }, { VMOpcode::NOP, "NOP" },
+    { VMOpcode::HALT, "HALT" }
+};
+
+const char* VMInstruction::opcode_name(uint16_t opcode) {
+    for (const VMOpcodeName& entry : VM_OPCODE_NAMES) {
+        if (static_cast<uint16_t>(entry.opcode) == opcode) {
+            return entry.name;
+        }
+    }
+    return nullptr;
+}
+
+int VMInstruction::opcode_from_name(const char* name) {
+    for (const VMOpcodeName& entry : VM_OPCODE_NAMES) {
+        if (strcmp(entry.name, name) == 0) {
+            return static_cast<int>(entry.opcode);
+        }
+    }
+    return -1;
+}
+
+// Memory I/O of the executing machine, if it has one
+static VMMemoryIO* vm_memory_io() {
+    const VMRuntime* runtime = vm_active_runtime();
+    return runtime ? runtime->memory_io : nullptr;
+}
+
+// I/O port of the executing machine, if it has one
+static VMIOPort* vm_io_port() {
+    const VMRuntime* runtime = vm_active_runtime();
+    return runtime ? runtime->port : nullptr;
+}
+
+uint16_t vm_input_read_char(const std::string& input, size_t& position) {
+    if (position >= input.size()) {
+        return 0x1FFF;
+    }
+    return static_cast<uint8_t>(input[position++]);
+}
+
+uint16_t vm_input_read_hex(const std::string& input, size_t& position) {
+    // fscanf("%x"): leading whitespace, optional sign and 0x prefix
+    
+    while (position < input.size() && isspace(static_cast<unsigned char>(input[position]))) {
+        position++;
+    }
+    
+    bool negative = false;
+    if (position < input.size() && (input[position] == '+' || input[position] == '-')) {
+        negative = input[position] == '-';
+        position++;
+    }
+    if (position + 2 < input.size() && input[position] == '0' &&
+        (input[position + 1] == 'x' || input[position + 1] == 'X') &&
+        isxdigit(static_cast<unsigned char>(input[position + 2]))) {
+        position += 2;
+    }
+    
+    unsigned int value = 0;
+    bool digits = false;
+    while (position < input.size() && isxdigit(static_cast<unsigned char>(input[position]))) {
+        char digit = input[position++];
+        value = value * 16 + (isdigit(static_cast<unsigned char>(digit)) ? digit - '0' : (tolower(digit) - 'a' + 10));
+        digits = true;
+    }
+    
+    if (!digits) {
+        return 0;
+    }
+    return (negative ? 0u - value : value) & 0x1FFF;
+}
+
+uint16_t vm_memory_io_read_char(VMMemoryIO& io) {
+    return vm_input_read_char(io.input, io.input_position);
+}
+
+uint16_t vm_memory_io_read_hex(VMMemoryIO& io) {
+    return vm_input_read_hex(io.input, io.input_position);
+}
+
+bool vm_io_input_pending(VMOpcode opcode) {
+    VMMemoryIO* io = vm_memory_io();
+    if (!io || !io->suspend) {
+        return false;
+    }
+    
+    const std::string& input = io->input;
+    size_t position = io->input_position;
+    
+    if (opcode == VMOpcode::IN_STR) {
+        return input.find('\n', position) == std::string::npos;
+    }
+    if (opcode == VMOpcode::IN_HEX) {
+        // Only a character that cannot continue the number ends it
+        while (position < input.size() && isspace(static_cast<unsigned char>(input[position]))) {
+            position++;
+        }
+        while (position < input.size() && (isxdigit(static_cast<unsigned char>(input[position])) ||
+                                           strchr("+-xX", input[position]))) {
+            position++;
+        }
+    }
+    return position >= input.size();
+}
+
+static FILE* vm_input_stream() {
+    const VMRuntime* runtime = vm_active_runtime();
+    return runtime ? runtime->input() : stdin;
+}
+
+static FILE* vm_output_stream() {
+    const VMRuntime* runtime = vm_active_runtime();
+    return runtime ? runtime->output() : stdout;
+}
+
+uint16_t vm_io_read_char() {
+    if (VMMemoryIO* io = vm_memory_io()) {
+        return vm_memory_io_read_char(*io);
+    }
+    if (VMIOPort* port = vm_io_port()) {
+        return port->read_char();
+    }
+    
+    int character = fgetc(vm_input_stream());
+    return character == EOF ? 0x1FFF : character & 0xFF;
+}
+
+void vm_io_write_char(uint16_t value) {
+    if (VMMemoryIO* io = vm_memory_io()) {
+        io->output.push_back(static_cast<char>(value & 0xFF));
+        return;
+    }
+    if (VMIOPort* port = vm_io_port()) {
+        port->write_char(static_cast<uint8_t>(value));
+        return;
+    }
+    fputc(value & 0xFF, vm_output_stream());
+}
+
+void vm_io_read_string(VirtualMachine& vm, uint16_t address) {
+    // Read one line into consecutive cells, zero terminated
+    VMMemoryIO* io = vm_memory_io();
+    VMIOPort* port = io ? nullptr : vm_io_port();
+    FILE* stream = io || port ? nullptr : vm_input_stream();
+    
+    for (uint16_t count = 0; count < VM_MAX_INPUT_STRING; count++) {
+        int character = stream ? fgetc(stream) : port ? port->read_char() : vm_memory_io_read_char(*io);
+        if (character == EOF || character == 0x1FFF || character == '\n') {
+            break;
+        }
+        vm.write_memory(address, character & 0xFF);
+        address = (address + 1) & 0x1FFF;
+    }
+    vm.write_memory(address, 0);
+}
+
+uint16_t vm_io_read_hex() {
+    if (VMMemoryIO* io = vm_memory_io()) {
+        return vm_memory_io_read_hex(*io);
+    }
+    if (VMIOPort* port = vm_io_port()) {
+        return port->read_hex();
+    }
+    
+    unsigned int value = 0;
+    if (fscanf(vm_input_stream(), "%x", &value) != 1) {
+        value = 0;
+    }
+    return value & 0x1FFF;
+}
+
+bool BasicInstructionExecutor::execute(VMOpcode opcode, 
+                                       uint16_t operand1, 
+                                       uint16_t operand2,
+                                       AddressingMode mode1,
+                                       AddressingMode mode2,
+                                       ExecutionContext& context) {
+    VirtualMachine& vm = *context.machine;
+    
+    switch (opcode) {
+        case VMOpcode::MOV: {
+            vm.write_memory(operand1, vm.read_memory(operand2));
+            break;
+        }
+        
+        case VMOpcode::XCHG: {
+            uint16_t value1 = vm.read_memory(operand1);
+            uint16_t value2 = vm.read_memory(operand2);
+            vm.write_memory(operand1, value2);
+            vm.write_memory(operand2, value1);
+            break;
+        }
+        
+        case VMOpcode::ADD: {
+            uint16_t result = vm_lazy_add(vm.read_memory(operand1), 
+                                         vm.read_memory(operand2), context);
+            vm.write_memory(operand1, result);
+            break;
+        }
+        
+        case VMOpcode::SUB: {
+            uint16_t result = vm_lazy_sub(vm.read_memory(operand1), 
+                                         vm.read_memory(operand2), context);
+            vm.write_memory(operand1, result);
+            break;
+        }
+        
+        case VMOpcode::CMP: {
+            // CMP only updates flags
+            vm_lazy_sub(vm.read_memory(operand1), vm.read_memory(operand2), context);
+            break;
+        }
+        
+        case VMOpcode::AND: {
+            uint16_t result = vm.read_memory(operand1) & vm.read_memory(operand2);
+            vm.write_memory(operand1, vm_lazy_logic(result, context));
+            break;
+        }
+        
+        case VMOpcode::OR: {
+            uint16_t result = vm.read_memory(operand1) | vm.read_memory(operand2);
+            vm.write_memory(operand1, vm_lazy_logic(result, context));
+            break;
+        }
+        
+        case VMOpcode::XOR: {
+            uint16_t result = vm.read_memory(operand1) ^ vm.read_memory(operand2);
+            vm.write_memory(operand1, vm_lazy_logic(result, context));
+            break;
+        }
+        
+        case VMOpcode::NOT: {
+            uint16_t result = ~vm.read_memory(operand1) & 0x1FFF;
+            vm.write_memory(operand1, vm_lazy_logic(result, context));
+            break;
+        }
+        
+        case VMOpcode::INC: {
+            vm.write_memory(operand1, vm_lazy_inc(vm.read_memory(operand1), context));
+            break;
+        }
+        
+        case VMOpcode::DEC: {
+            vm.write_memory(operand1, vm_lazy_dec(vm.read_memory(operand1), context));
+            break;
+        }
+        
+        case VMOpcode::SHL: {
+            vm.write_memory(operand1, vm_lazy_shl(vm.read_memory(operand1), context));
+            break;
+        }
+        
+        case VMOpcode::SHR: {
+            vm.write_memory(operand1, vm_lazy_shr(vm.read_memory(operand1), context));
+            break;
+        }
+        
+        case VMOpcode::ROL: {
+            vm.write_memory(operand1, vm_lazy_rol(vm.read_memory(operand1), context));
+            break;
+        }
+        
+        case VMOpcode::ROR: {
+            vm.write_memory(operand1, vm_lazy_ror(vm.read_memory(operand1), context));
+            break;
+        }
+        
+        case VMOpcode::JMP: {
+            context.ip = operand1 & 0x1FFF;
+            return true;  // Continue execution
+        }
+        
+        case VMOpcode::JZ:
+        case VMOpcode::JNZ:
+        case VMOpcode::JC:
+        case VMOpcode::JNC:
+        case VMOpcode::JS:
+        case VMOpcode::JNS:
+        case VMOpcode::JO:
+        case VMOpcode::JNO:
+        case VMOpcode::JL:
+        case VMOpcode::JG:
+        case VMOpcode::JLE:
+        case VMOpcode::JGE: {
+            if (vm_lazy_branch_taken(opcode, context)) {
                 context.ip = operand1 & 0x1FFF;
-                return true;  // Continue execution
             }
-            
-            case VMOpcode::JZ: {
-                if (context.status_flags[1]) {  // Zero flag
-                    context.ip = operand1 & 0x1FFF;
-                }
-                return true;
+            return true;
+        }
+        
+        case VMOpcode::PUSH: {
+            vm.push(vm.read_memory(operand1));
+            break;
+        }
+        
+        case VMOpcode::POP: {
+            vm.write_memory(operand1, vm.pop());
+            break;
+        }
+        
+        case VMOpcode::IN: {
+            if (vm_io_input_pending(opcode)) {
+                return vm.suspend_input(context);
             }
-            
-            case VMOpcode::JNZ: {
-                if (!context.status_flags[1]) {  // Not zero
-                    context.ip = operand1 & 0x1FFF;
-                }
-                return true;
+            vm.write_memory(operand1, vm_io_read_char());
+            break;
+        }
+        
+        case VMOpcode::OUT: {
+            vm_io_write_char(vm.read_memory(operand1));
+            break;
+        }
+        
+        case VMOpcode::IN_STR: {
+            if (vm_io_input_pending(opcode)) {
+                return vm.suspend_input(context);
             }
-            
-            case VMOpcode::HALT: {
-                return false;  // Stop execution
+            vm_io_read_string(vm, operand1);
+            break;
+        }
+        
+        case VMOpcode::IN_HEX: {
+            if (vm_io_input_pending(opcode)) {
+                return vm.suspend_input(context);
             }
-            
-            default:
-                // Unimplemented opcode
-                return false;
+            vm.write_memory(operand1, vm_io_read_hex());
+            break;
+        }
+        
+        case VMOpcode::CLC: {
+            vm_flags_set_carry(context, false);
+            break;
+        }
+        
+        case VMOpcode::STC: {
+            vm_flags_set_carry(context, true);
+            break;
+        }
+        
+        case VMOpcode::CMC: {
+            vm_flags_set_carry(context, !vm_flags_read(context, VM_FLAG_MASK_CARRY)[VM_FLAG_CARRY]);
+            break;
+        }
+        
+        case VMOpcode::NOP: {
+            break;
+        }
+        
+        case VMOpcode::HALT: {
+            return false;  // Stop execution
         }
         
-        return true;
+        default:
+            // Unimplemented opcode
+            return false;
     }
-};
\ No newline at end of file
+    
+    return true;
+}
\ No newline at end of file
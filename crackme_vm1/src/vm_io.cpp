@@ -0,0 +1,179 @@
+#include "../include/vm_io.h"
+#include "../include/vm_instructions.h"
+#include "../include/vm_runtime.h"
+#include <stdexcept>
+#include <string>
+
+uint16_t VMStreamPort::read_char() {
+    int character = fgetc(input);
+    return character == EOF ? 0x1FFF : character & 0xFF;
+}
+
+uint16_t VMStreamPort::read_hex() {
+    unsigned int value = 0;
+    if (fscanf(input, "%x", &value) != 1) {
+        value = 0;
+    }
+    return value & 0x1FFF;
+}
+
+void VMStreamPort::write_char(uint8_t character) {
+    fputc(character, output);
+}
+
+VMBufferedPort::VMBufferedPort(FILE* sink, size_t flush_bytes)
+    : position(0), sink(sink), flush_bytes(flush_bytes ? flush_bytes : 1) {
+    if (sink) {
+        output.reserve(flush_bytes);
+    }
+}
+
+VMBufferedPort::~VMBufferedPort() {
+    flush();
+}
+
+void VMBufferedPort::set_input(const std::string& data) {
+    input = data;
+    position = 0;
+}
+
+void VMBufferedPort::load_input(FILE* stream) {
+    input.clear();
+    position = 0;
+    
+    char chunk[4096];
+    size_t count;
+    while ((count = fread(chunk, 1, sizeof(chunk), stream)) > 0) {
+        input.append(chunk, count);
+    }
+}
+
+void VMBufferedPort::flush() {
+    if (sink && !output.empty()) {
+        fwrite(output.data(), 1, output.size(), sink);
+        fflush(sink);
+        output.clear();
+    }
+}
+
+uint16_t VMBufferedPort::read_char() {
+    return vm_input_read_char(input, position);
+}
+
+uint16_t VMBufferedPort::read_hex() {
+    return vm_input_read_hex(input, position);
+}
+
+void VMBufferedPort::write_char(uint8_t character) {
+    output.push_back(static_cast<char>(character));
+    if (sink && output.size() >= flush_bytes) {
+        flush();
+    }
+}
+
+static void vm_io_log_put(FILE* output, uint64_t value, int bytes) {
+    for (int byte = 0; byte < bytes; byte++) {
+        fputc(static_cast<int>((value >> (byte * 8)) & 0xFF), output);
+    }
+}
+
+static uint64_t vm_io_log_get(FILE* input, int bytes) {
+    uint64_t value = 0;
+    for (int byte = 0; byte < bytes; byte++) {
+        int c = fgetc(input);
+        if (c == EOF) {
+            throw std::runtime_error("Truncated VM I/O log");
+        }
+        value |= static_cast<uint64_t>(c) << (byte * 8);
+    }
+    return value;
+}
+
+void VMIOLog::write(FILE* output) const {
+    vm_io_log_put(output, VM_IO_LOG_MAGIC, 4);
+    vm_io_log_put(output, VM_IO_LOG_VERSION, 2);
+    vm_io_log_put(output, events.size(), 8);
+    
+    for (const VMIOEvent& event : events) {
+        vm_io_log_put(output, event.step, 8);
+        vm_io_log_put(output, static_cast<uint8_t>(event.kind), 1);
+        vm_io_log_put(output, event.value, 2);
+    }
+}
+
+void VMIOLog::read(FILE* input) {
+    if (vm_io_log_get(input, 4) != VM_IO_LOG_MAGIC || vm_io_log_get(input, 2) != VM_IO_LOG_VERSION) {
+        throw std::runtime_error("Not a VM I/O log");
+    }
+    
+    std::vector<VMIOEvent> loaded;
+    uint64_t count = vm_io_log_get(input, 8);
+    for (uint64_t index = 0; index < count; index++) {
+        VMIOEvent event;
+        event.step = vm_io_log_get(input, 8);
+        uint8_t kind = static_cast<uint8_t>(vm_io_log_get(input, 1));
+        if (kind > static_cast<uint8_t>(VMIOEventKind::WRITE_CHAR)) {
+            throw std::runtime_error("Invalid VM I/O log event");
+        }
+        event.kind = static_cast<VMIOEventKind>(kind);
+        event.value = static_cast<uint16_t>(vm_io_log_get(input, 2));
+        loaded.push_back(event);
+    }
+    events.swap(loaded);
+}
+
+// Instructions completed by the executing machine before the current one,
+// which its core has already counted
+static uint64_t vm_io_step() {
+    const VMRuntime* runtime = vm_active_runtime();
+    return runtime && runtime->steps ? runtime->steps - 1 : 0;
+}
+
+uint16_t VMRecordingPort::read_char() {
+    uint16_t value = port.read_char();
+    log.append({ vm_io_step(), VMIOEventKind::READ_CHAR, value });
+    return value;
+}
+
+uint16_t VMRecordingPort::read_hex() {
+    uint16_t value = port.read_hex();
+    log.append({ vm_io_step(), VMIOEventKind::READ_HEX, value });
+    return value;
+}
+
+void VMRecordingPort::write_char(uint8_t character) {
+    log.append({ vm_io_step(), VMIOEventKind::WRITE_CHAR, character });
+    port.write_char(character);
+}
+
+const VMIOEvent& VMReplayPort::next(VMIOEventKind kind) {
+    uint64_t step = vm_io_step();
+    if (position >= log.size()) {
+        throw std::runtime_error("I/O replay diverged: no recorded event left at step " + std::to_string(step));
+    }
+    
+    const VMIOEvent& event = log.get_event(position);
+    if (event.kind != kind || event.step != step) {
+        throw std::runtime_error("I/O replay diverged at event " + std::to_string(position) +
+                                 ": step " + std::to_string(step) + ", recorded " + std::to_string(event.step));
+    }
+    position++;
+    return event;
+}
+
+uint16_t VMReplayPort::read_char() {
+    return next(VMIOEventKind::READ_CHAR).value;
+}
+
+uint16_t VMReplayPort::read_hex() {
+    return next(VMIOEventKind::READ_HEX).value;
+}
+
+void VMReplayPort::write_char(uint8_t character) {
+    if (next(VMIOEventKind::WRITE_CHAR).value != character) {
+        throw std::runtime_error("I/O replay diverged: output differs at event " + std::to_string(position - 1));
+    }
+    if (output) {
+        output->write_char(character);
+    }
+}
\ No newline at end of file
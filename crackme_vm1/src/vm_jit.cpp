@@ -0,0 +1,1023 @@
+#include "../include/vm_jit.h"
+#include "../include/vm_core.h"
+#include "../include/vm_specialized.h"
+#include "../include/vm_alu.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if VM_JIT_SUPPORTED && !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+#if VM_JIT_SUPPORTED
+
+// Host registers used by translated code. Only registers that are volatile
+// in both the System V and Windows x64 ABIs are touched.
+enum VMJitRegister {
+    JIT_RAX = 0, JIT_RCX = 1, JIT_RDX = 2, JIT_RDI = 7,
+    JIT_R8 = 8, JIT_R9 = 9, JIT_R10 = 10, JIT_R11 = 11
+};
+
+// r8 = shadow memory, r9 = flags, r10 = code map
+static const int JIT_MEMORY = JIT_R8;
+static const int JIT_FLAGS = JIT_R9;
+static const int JIT_CODE_MAP = JIT_R10;
+
+// x86 condition codes
+enum VMJitCondition {
+    JIT_CC_B = 0x2, JIT_CC_AE = 0x3, JIT_CC_E = 0x4, JIT_CC_NE = 0x5
+};
+
+// 32-bit ALU opcodes (op r/m32, r32) and their /digit forms for immediates
+enum VMJitAluOp {
+    JIT_ADD = 0x01, JIT_OR = 0x09, JIT_AND = 0x21, JIT_SUB = 0x29,
+    JIT_XOR = 0x31, JIT_CMP = 0x39, JIT_MOV = 0x89
+};
+
+static int jit_alu_digit(VMJitAluOp op) {
+    switch (op) {
+        case JIT_ADD: return 0;
+        case JIT_OR:  return 1;
+        case JIT_AND: return 4;
+        case JIT_SUB: return 5;
+        case JIT_XOR: return 6;
+        default:      return 7;
+    }
+}
+
+// Memory operand [base + index * scale + disp]
+struct VMJitMem {
+    int base;
+    int index;      // -1 for none
+    int scale;
+    int32_t disp;
+};
+
+static VMJitMem jit_flag(int flag_index) {
+    return { JIT_FLAGS, -1, 1, flag_index };
+}
+
+// Minimal x86-64 encoder for the forms the translator needs
+class VMJitAssembler {
+public:
+    uint8_t* cursor;
+    uint8_t* limit;
+    bool overflow;
+    
+    VMJitAssembler(uint8_t* start, uint8_t* end) 
+        : cursor(start), limit(end), overflow(false) {
+    }
+    
+    void byte(uint8_t value) {
+        if (cursor < limit) {
+            *cursor++ = value;
+        } else {
+            overflow = true;
+        }
+    }
+    
+    void word(uint16_t value) {
+        byte(value & 0xFF);
+        byte(value >> 8);
+    }
+    
+    void dword(uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            byte((value >> (i * 8)) & 0xFF);
+        }
+    }
+    
+    void rex(bool wide, int reg, int index, int base) {
+        uint8_t prefix = 0x40 | (wide ? 8 : 0) | ((reg >> 3) & 1) << 2 |
+                         ((index >= 0 ? index >> 3 : 0) & 1) << 1 | ((base >> 3) & 1);
+        if (prefix != 0x40) {
+            byte(prefix);
+        }
+    }
+    
+    void modrm_mem(int reg, const VMJitMem& mem) {
+        int mod = (mem.disp == 0 && (mem.base & 7) != 5) ? 0 :
+                  (mem.disp >= -128 && mem.disp <= 127) ? 1 : 2;
+        
+        if (mem.index < 0 && (mem.base & 7) != 4) {
+            byte((mod << 6) | ((reg & 7) << 3) | (mem.base & 7));
+        } else {
+            int scale_bits = mem.scale == 8 ? 3 : mem.scale == 4 ? 2 : mem.scale == 2 ? 1 : 0;
+            int index = mem.index < 0 ? 4 : (mem.index & 7);
+            byte((mod << 6) | ((reg & 7) << 3) | 4);
+            byte((scale_bits << 6) | (index << 3) | (mem.base & 7));
+        }
+        
+        if (mod == 1) {
+            byte(static_cast<uint8_t>(mem.disp));
+        } else if (mod == 2) {
+            dword(static_cast<uint32_t>(mem.disp));
+        }
+    }
+    
+    void modrm_reg(int reg, int rm) {
+        byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+    }
+    
+    // movzx r32, word [mem]
+    void load_word(int reg, const VMJitMem& mem) {
+        rex(false, reg, mem.index, mem.base);
+        byte(0x0F); byte(0xB7);
+        modrm_mem(reg, mem);
+    }
+    
+    // movzx r32, byte [mem]
+    void load_byte(int reg, const VMJitMem& mem) {
+        rex(false, reg, mem.index, mem.base);
+        byte(0x0F); byte(0xB6);
+        modrm_mem(reg, mem);
+    }
+    
+    // mov r64, [mem]
+    void load_qword(int reg, const VMJitMem& mem) {
+        rex(true, reg, mem.index, mem.base);
+        byte(0x8B);
+        modrm_mem(reg, mem);
+    }
+    
+    // mov word [mem], r16
+    void store_word(const VMJitMem& mem, int reg) {
+        byte(0x66);
+        rex(false, reg, mem.index, mem.base);
+        byte(0x89);
+        modrm_mem(reg, mem);
+    }
+    
+    // mov word [mem], imm16
+    void store_word_imm(const VMJitMem& mem, uint16_t value) {
+        byte(0x66);
+        rex(false, 0, mem.index, mem.base);
+        byte(0xC7);
+        modrm_mem(0, mem);
+        word(value);
+    }
+    
+    // mov byte [mem], imm8
+    void store_byte_imm(const VMJitMem& mem, uint8_t value) {
+        rex(false, 0, mem.index, mem.base);
+        byte(0xC6);
+        modrm_mem(0, mem);
+        byte(value);
+    }
+    
+    // cmp byte [mem], imm8
+    void cmp_byte_imm(const VMJitMem& mem, uint8_t value) {
+        rex(false, 0, mem.index, mem.base);
+        byte(0x80);
+        modrm_mem(7, mem);
+        byte(value);
+    }
+    
+    // xor byte [mem], imm8
+    void xor_byte_imm(const VMJitMem& mem, uint8_t value) {
+        rex(false, 0, mem.index, mem.base);
+        byte(0x80);
+        modrm_mem(6, mem);
+        byte(value);
+    }
+    
+    // cmp r8, byte [mem] (al/cl/dl only)
+    void cmp_reg8_mem(int reg, const VMJitMem& mem) {
+        rex(false, reg, mem.index, mem.base);
+        byte(0x3A);
+        modrm_mem(reg, mem);
+    }
+    
+    // setcc byte [mem]
+    void setcc(int condition, const VMJitMem& mem) {
+        rex(false, 0, mem.index, mem.base);
+        byte(0x0F); byte(0x90 | condition);
+        modrm_mem(0, mem);
+    }
+    
+    // add qword [mem], imm8
+    void add_qword_imm(const VMJitMem& mem, int8_t value) {
+        rex(true, 0, mem.index, mem.base);
+        byte(0x83);
+        modrm_mem(0, mem);
+        byte(static_cast<uint8_t>(value));
+    }
+    
+    // op r/m32, r32
+    void alu(VMJitAluOp op, int dst, int src) {
+        rex(false, src, -1, dst);
+        byte(op);
+        modrm_reg(src, dst);
+    }
+    
+    // op r/m32, imm32
+    void alu_imm(VMJitAluOp op, int dst, uint32_t value) {
+        rex(false, 0, -1, dst);
+        byte(0x81);
+        modrm_reg(jit_alu_digit(op), dst);
+        dword(value);
+    }
+    
+    // mov r64, r64
+    void move64(int dst, int src) {
+        rex(true, src, -1, dst);
+        byte(0x89);
+        modrm_reg(src, dst);
+    }
+    
+    void move_imm(int dst, uint32_t value) {
+        rex(false, 0, -1, dst);
+        byte(0xB8 | (dst & 7));
+        dword(value);
+    }
+    
+    void test_imm(int dst, uint32_t value) {
+        rex(false, 0, -1, dst);
+        byte(0xF7);
+        modrm_reg(0, dst);
+        dword(value);
+    }
+    
+    void bit_test(int dst, uint8_t bit) {
+        rex(false, 0, -1, dst);
+        byte(0x0F); byte(0xBA);
+        modrm_reg(4, dst);
+        byte(bit);
+    }
+    
+    void shift_left(int dst, uint8_t count) {
+        rex(false, 0, -1, dst);
+        byte(0xC1);
+        modrm_reg(4, dst);
+        byte(count);
+    }
+    
+    void shift_right(int dst, uint8_t count) {
+        rex(false, 0, -1, dst);
+        byte(0xC1);
+        modrm_reg(5, dst);
+        byte(count);
+    }
+    
+    // Jumps return the address of their rel32 field for later patching
+    uint8_t* jcc(int condition) {
+        byte(0x0F); byte(0x80 | condition);
+        uint8_t* field = cursor;
+        dword(0);
+        return overflow ? nullptr : field;
+    }
+    
+    uint8_t* jmp() {
+        byte(0xE9);
+        uint8_t* field = cursor;
+        dword(0);
+        return overflow ? nullptr : field;
+    }
+    
+    void ret() {
+        byte(0xC3);
+    }
+    
+    // Fields emitted past the arena end are null and never patched
+    static void patch(uint8_t* field, const uint8_t* target) {
+        if (!field) {
+            return;
+        }
+        int32_t displacement = static_cast<int32_t>(target - (field + 4));
+        memcpy(field, &displacement, sizeof(displacement));
+    }
+};
+
+// Resolved guest address: a constant for DIRECT operands, a register otherwise
+struct VMJitAddress {
+    bool in_register;
+    int reg;
+    uint16_t constant;
+    
+    VMJitMem word() const {
+        if (in_register) {
+            return { JIT_MEMORY, reg, 2, 0 };
+        }
+        return { JIT_MEMORY, -1, 1, constant * 2 };
+    }
+    
+    VMJitMem code_map() const {
+        if (in_register) {
+            return { JIT_CODE_MAP, reg, 1, 0 };
+        }
+        return { JIT_CODE_MAP, -1, 1, constant };
+    }
+};
+
+static const VMJitMem JIT_IP_CELL = { JIT_MEMORY, -1, 1, VM_INSTRUCTION_POINTER * 2 };
+static const VMJitMem JIT_STEP_COUNTER = { JIT_CODE_MAP, -1, 1, VM_JIT_STEP_COUNTER };
+
+// Emit the loads for an operand with 0-3 levels of indirection
+static VMJitAddress jit_resolve(VMJitAssembler& as, int reg, uint16_t operand, AddressingMode mode) {
+    int depth = static_cast<int>(mode) & 3;
+    VMJitAddress address = { false, reg, static_cast<uint16_t>(operand & 0x1FFF) };
+    
+    if (depth == 0) {
+        return address;
+    }
+    
+    // Stored values are always masked to 13 bits, so they index memory directly
+    as.load_word(reg, address.word());
+    address.in_register = true;
+    for (int i = 1; i < depth; i++) {
+        as.load_word(reg, address.word());
+    }
+    return address;
+}
+
+// S and Z from a masked 13-bit result in eax
+static void jit_sign_zero(VMJitAssembler& as) {
+    as.test_imm(JIT_RAX, 0x1FFF);
+    as.setcc(JIT_CC_E, jit_flag(VM_FLAG_ZERO));
+    as.test_imm(JIT_RAX, 0x1000);
+    as.setcc(JIT_CC_NE, jit_flag(VM_FLAG_SIGN));
+}
+
+static bool jit_translatable(VMOpcode opcode) {
+    switch (opcode) {
+        case VMOpcode::MOV:
+        case VMOpcode::XCHG:
+        case VMOpcode::ADD:
+        case VMOpcode::SUB:
+        case VMOpcode::CMP:
+        case VMOpcode::AND:
+        case VMOpcode::OR:
+        case VMOpcode::XOR:
+        case VMOpcode::NOT:
+        case VMOpcode::INC:
+        case VMOpcode::DEC:
+        case VMOpcode::SHL:
+        case VMOpcode::SHR:
+        case VMOpcode::ROL:
+        case VMOpcode::ROR:
+        case VMOpcode::CLC:
+        case VMOpcode::STC:
+        case VMOpcode::CMC:
+        case VMOpcode::NOP:
+        case VMOpcode::HALT:
+            return true;
+        default:
+            return opcode >= VMOpcode::JMP && opcode <= VMOpcode::JGE;
+    }
+}
+
+// Instructions overlapping the IP cell stay interpreted (the per-instruction
+// IP store would otherwise rewrite translated code unnoticed),
+// and the per-word block counts must not saturate
+static bool jit_translatable(const VMDecodeInfo& info, uint16_t address, const uint8_t* code_map) {
+    if (!jit_translatable(info.opcode) || address + info.length > VM_INSTRUCTION_POINTER) {
+        return false;
+    }
+    for (uint16_t i = 0; i < info.length; i++) {
+        if (code_map[address + i] == 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Out-of-line exit taken when a store hits translated code
+struct VMJitWriteExit {
+    uint8_t* field;
+    VMJitAddress first;
+    VMJitAddress second;
+    bool has_second;
+};
+
+// Per-block translation state
+struct VMJitTranslation {
+    VMJitAssembler& as;
+    uint8_t* continue_stub;
+    std::vector<VMJitWriteExit> write_exits;
+    std::vector<std::pair<uint8_t*, uint16_t>> chains;
+    
+    VMJitTranslation(VMJitAssembler& assembler, uint8_t* stub) 
+        : as(assembler), continue_stub(stub) {
+    }
+    
+    // Leave the block for the successor at target (patched later when chained)
+    void chain(uint16_t target) {
+        as.store_word_imm(JIT_IP_CELL, target);
+        chains.push_back(std::make_pair(as.jmp(), target));
+    }
+    
+    void exit_with(uint32_t reason) {
+        as.move_imm(JIT_RAX, reason << 29);
+        as.ret();
+    }
+    
+    // After guest stores: leave if translated code was overwritten
+    // (the dispatcher invalidates it) or if the IP cell was rewritten.
+    // Returns false when the block must end after this instruction.
+    bool check_stores(const VMJitAddress& first, const VMJitAddress* second) {
+        VMJitWriteExit write_exit = { nullptr, first, first, second != nullptr };
+        if (second) {
+            write_exit.second = *second;
+        }
+        
+        const VMJitAddress* stores[2] = { &first, second };
+        for (const VMJitAddress* store : stores) {
+            if (!store) {
+                continue;
+            }
+            as.cmp_byte_imm(store->code_map(), 0);
+            write_exit.field = as.jcc(JIT_CC_NE);
+            write_exits.push_back(write_exit);
+        }
+        
+        bool continues = true;
+        for (const VMJitAddress* store : stores) {
+            if (!store) {
+                continue;
+            }
+            if (store->in_register) {
+                as.alu_imm(JIT_CMP, store->reg, VM_INSTRUCTION_POINTER);
+                VMJitAssembler::patch(as.jcc(JIT_CC_E), continue_stub);
+            } else if (store->constant == VM_INSTRUCTION_POINTER) {
+                continues = false;
+            }
+        }
+        
+        if (!continues) {
+            VMJitAssembler::patch(as.jmp(), continue_stub);
+        }
+        return continues;
+    }
+    
+    void emit_write_exits() {
+        for (const VMJitWriteExit& write_exit : write_exits) {
+            VMJitAssembler::patch(write_exit.field, as.cursor);
+            
+            // eax = reason | second << 13 | first, second defaults to first
+            const VMJitAddress& second = write_exit.has_second ? write_exit.second : write_exit.first;
+            if (second.in_register) {
+                as.alu(JIT_MOV, JIT_RAX, second.reg);
+            } else {
+                as.move_imm(JIT_RAX, second.constant);
+            }
+            as.shift_left(JIT_RAX, 13);
+            if (write_exit.first.in_register) {
+                as.alu(JIT_OR, JIT_RAX, write_exit.first.reg);
+            } else {
+                as.alu_imm(JIT_OR, JIT_RAX, write_exit.first.constant);
+            }
+            as.alu_imm(JIT_OR, JIT_RAX, VM_JIT_EXIT_WRITE_CODE << 29);
+            as.ret();
+        }
+    }
+};
+
+// Emit the branch condition of a Jcc; returns the fixups jumping to "taken"
+static std::vector<uint8_t*> jit_condition(VMJitAssembler& as, VMOpcode opcode) {
+    std::vector<uint8_t*> taken;
+    
+    switch (opcode) {
+        case VMOpcode::JZ:
+        case VMOpcode::JNZ:
+            as.cmp_byte_imm(jit_flag(VM_FLAG_ZERO), 0);
+            taken.push_back(as.jcc(opcode == VMOpcode::JZ ? JIT_CC_NE : JIT_CC_E));
+            break;
+        case VMOpcode::JC:
+        case VMOpcode::JNC:
+            as.cmp_byte_imm(jit_flag(VM_FLAG_CARRY), 0);
+            taken.push_back(as.jcc(opcode == VMOpcode::JC ? JIT_CC_NE : JIT_CC_E));
+            break;
+        case VMOpcode::JS:
+        case VMOpcode::JNS:
+            as.cmp_byte_imm(jit_flag(VM_FLAG_SIGN), 0);
+            taken.push_back(as.jcc(opcode == VMOpcode::JS ? JIT_CC_NE : JIT_CC_E));
+            break;
+        case VMOpcode::JO:
+        case VMOpcode::JNO:
+            as.cmp_byte_imm(jit_flag(VM_FLAG_OVERFLOW), 0);
+            taken.push_back(as.jcc(opcode == VMOpcode::JO ? JIT_CC_NE : JIT_CC_E));
+            break;
+        case VMOpcode::JL:
+        case VMOpcode::JGE:
+            as.load_byte(JIT_RAX, jit_flag(VM_FLAG_SIGN));
+            as.cmp_reg8_mem(JIT_RAX, jit_flag(VM_FLAG_OVERFLOW));
+            taken.push_back(as.jcc(opcode == VMOpcode::JL ? JIT_CC_NE : JIT_CC_E));
+            break;
+        case VMOpcode::JG: {
+            // !Z && S == V
+            as.cmp_byte_imm(jit_flag(VM_FLAG_ZERO), 0);
+            uint8_t* not_taken = as.jcc(JIT_CC_NE);
+            as.load_byte(JIT_RAX, jit_flag(VM_FLAG_SIGN));
+            as.cmp_reg8_mem(JIT_RAX, jit_flag(VM_FLAG_OVERFLOW));
+            taken.push_back(as.jcc(JIT_CC_E));
+            VMJitAssembler::patch(not_taken, as.cursor);
+            break;
+        }
+        case VMOpcode::JLE:
+            // Z || S != V
+            as.cmp_byte_imm(jit_flag(VM_FLAG_ZERO), 0);
+            taken.push_back(as.jcc(JIT_CC_NE));
+            as.load_byte(JIT_RAX, jit_flag(VM_FLAG_SIGN));
+            as.cmp_reg8_mem(JIT_RAX, jit_flag(VM_FLAG_OVERFLOW));
+            taken.push_back(as.jcc(JIT_CC_NE));
+            break;
+        default:
+            break;
+    }
+    
+    return taken;
+}
+
+// Translate one instruction; returns false when it ends the block
+static bool jit_translate(VMJitTranslation& t, VMOpcode opcode, 
+                          AddressingMode mode_dst, AddressingMode mode_src,
+                          uint16_t operand1, uint16_t operand2, uint16_t next_ip) {
+    VMJitAssembler& as = t.as;
+    
+    switch (opcode) {
+        case VMOpcode::MOV: {
+            VMJitAddress dst = jit_resolve(as, JIT_RCX, operand1, mode_dst);
+            VMJitAddress src = jit_resolve(as, JIT_RDX, operand2, mode_src);
+            as.load_word(JIT_RAX, src.word());
+            as.store_word(dst.word(), JIT_RAX);
+            return t.check_stores(dst, nullptr);
+        }
+        
+        case VMOpcode::XCHG: {
+            VMJitAddress dst = jit_resolve(as, JIT_RCX, operand1, mode_dst);
+            VMJitAddress src = jit_resolve(as, JIT_RDX, operand2, mode_src);
+            as.load_word(JIT_RAX, dst.word());
+            as.load_word(JIT_R11, src.word());
+            as.store_word(dst.word(), JIT_R11);
+            as.store_word(src.word(), JIT_RAX);
+            return t.check_stores(dst, &src);
+        }
+        
+        case VMOpcode::ADD: {
+            VMJitAddress dst = jit_resolve(as, JIT_RCX, operand1, mode_dst);
+            VMJitAddress src = jit_resolve(as, JIT_RDX, operand2, mode_src);
+            as.load_word(JIT_RAX, dst.word());
+            as.load_word(JIT_R11, src.word());
+            as.alu(JIT_MOV, JIT_RDX, JIT_RAX);
+            as.alu(JIT_ADD, JIT_RAX, JIT_R11);
+            as.bit_test(JIT_RAX, 13);
+            as.setcc(JIT_CC_B, jit_flag(VM_FLAG_CARRY));
+            
+            // V = (a ^ result) & (b ^ result) & sign bit
+            as.alu(JIT_XOR, JIT_RDX, JIT_RAX);
+            as.alu(JIT_XOR, JIT_R11, JIT_RAX);
+            as.alu(JIT_AND, JIT_RDX, JIT_R11);
+            as.test_imm(JIT_RDX, 0x1000);
+            as.setcc(JIT_CC_NE, jit_flag(VM_FLAG_OVERFLOW));
+            
+            as.alu_imm(JIT_AND, JIT_RAX, 0x1FFF);
+            jit_sign_zero(as);
+            as.store_word(dst.word(), JIT_RAX);
+            return t.check_stores(dst, nullptr);
+        }
+        
+        case VMOpcode::SUB:
+        case VMOpcode::CMP: {
+            VMJitAddress dst = jit_resolve(as, JIT_RCX, operand1, mode_dst);
+            VMJitAddress src = jit_resolve(as, JIT_RDX, operand2, mode_src);
+            as.load_word(JIT_RAX, dst.word());
+            as.load_word(JIT_R11, src.word());
+            as.alu(JIT_MOV, JIT_RDX, JIT_RAX);
+            as.alu(JIT_CMP, JIT_RAX, JIT_R11);
+            as.setcc(JIT_CC_B, jit_flag(VM_FLAG_CARRY));
+            as.alu(JIT_SUB, JIT_RAX, JIT_R11);
+            as.alu_imm(JIT_AND, JIT_RAX, 0x1FFF);
+            jit_sign_zero(as);
+            
+            // V = (a ^ b) & (a ^ result) & sign bit
+            as.alu(JIT_XOR, JIT_R11, JIT_RDX);
+            as.alu(JIT_XOR, JIT_RDX, JIT_RAX);
+            as.alu(JIT_AND, JIT_RDX, JIT_R11);
+            as.test_imm(JIT_RDX, 0x1000);
+            as.setcc(JIT_CC_NE, jit_flag(VM_FLAG_OVERFLOW));
+            
+            if (opcode == VMOpcode::CMP) {
+                return true;
+            }
+            as.store_word(dst.word(), JIT_RAX);
+            return t.check_stores(dst, nullptr);
+        }
+        
+        case VMOpcode::AND:
+        case VMOpcode::OR:
+        case VMOpcode::XOR: {
+            VMJitAddress dst = jit_resolve(as, JIT_RCX, operand1, mode_dst);
+            VMJitAddress src = jit_resolve(as, JIT_RDX, operand2, mode_src);
+            as.load_word(JIT_RAX, dst.word());
+            as.load_word(JIT_R11, src.word());
+            as.alu(opcode == VMOpcode::AND ? JIT_AND : opcode == VMOpcode::OR ? JIT_OR : JIT_XOR,
+                   JIT_RAX, JIT_R11);
+            jit_sign_zero(as);
+            as.store_byte_imm(jit_flag(VM_FLAG_CARRY), 0);
+            as.store_byte_imm(jit_flag(VM_FLAG_OVERFLOW), 0);
+            as.store_word(dst.word(), JIT_RAX);
+            return t.check_stores(dst, nullptr);
+        }
+        
+        case VMOpcode::NOT:
+        case VMOpcode::INC:
+        case VMOpcode::DEC:
+        case VMOpcode::SHL:
+        case VMOpcode::SHR:
+        case VMOpcode::ROL:
+        case VMOpcode::ROR: {
+            VMJitAddress dst = jit_resolve(as, JIT_RCX, operand1, mode_dst);
+            as.load_word(JIT_RAX, dst.word());
+            
+            switch (opcode) {
+                case VMOpcode::NOT:
+                    as.alu_imm(JIT_XOR, JIT_RAX, 0x1FFF);
+                    as.store_byte_imm(jit_flag(VM_FLAG_CARRY), 0);
+                    break;
+                case VMOpcode::INC:
+                case VMOpcode::DEC:
+                    // Carry is left untouched
+                    as.alu(JIT_MOV, JIT_RDX, JIT_RAX);
+                    as.alu_imm(opcode == VMOpcode::INC ? JIT_ADD : JIT_SUB, JIT_RAX, 1);
+                    as.alu_imm(JIT_AND, JIT_RAX, 0x1FFF);
+                    as.alu_imm(JIT_CMP, JIT_RDX, opcode == VMOpcode::INC ? 0x0FFF : 0x1000);
+                    as.setcc(JIT_CC_E, jit_flag(VM_FLAG_OVERFLOW));
+                    break;
+                case VMOpcode::SHL:
+                    as.bit_test(JIT_RAX, 12);
+                    as.setcc(JIT_CC_B, jit_flag(VM_FLAG_CARRY));
+                    as.shift_left(JIT_RAX, 1);
+                    as.alu_imm(JIT_AND, JIT_RAX, 0x1FFF);
+                    break;
+                case VMOpcode::SHR:
+                    as.bit_test(JIT_RAX, 0);
+                    as.setcc(JIT_CC_B, jit_flag(VM_FLAG_CARRY));
+                    as.shift_right(JIT_RAX, 1);
+                    break;
+                case VMOpcode::ROL:
+                    as.bit_test(JIT_RAX, 12);
+                    as.setcc(JIT_CC_B, jit_flag(VM_FLAG_CARRY));
+                    as.alu(JIT_MOV, JIT_RDX, JIT_RAX);
+                    as.shift_right(JIT_RDX, 12);
+                    as.shift_left(JIT_RAX, 1);
+                    as.alu(JIT_OR, JIT_RAX, JIT_RDX);
+                    as.alu_imm(JIT_AND, JIT_RAX, 0x1FFF);
+                    break;
+                default:
+                    as.bit_test(JIT_RAX, 0);
+                    as.setcc(JIT_CC_B, jit_flag(VM_FLAG_CARRY));
+                    as.alu(JIT_MOV, JIT_RDX, JIT_RAX);
+                    as.alu_imm(JIT_AND, JIT_RDX, 1);
+                    as.shift_left(JIT_RDX, 12);
+                    as.shift_right(JIT_RAX, 1);
+                    as.alu(JIT_OR, JIT_RAX, JIT_RDX);
+                    break;
+            }
+            
+            jit_sign_zero(as);
+            if (opcode != VMOpcode::INC && opcode != VMOpcode::DEC) {
+                as.store_byte_imm(jit_flag(VM_FLAG_OVERFLOW), 0);
+            }
+            as.store_word(dst.word(), JIT_RAX);
+            return t.check_stores(dst, nullptr);
+        }
+        
+        case VMOpcode::CLC:
+        case VMOpcode::STC:
+            as.store_byte_imm(jit_flag(VM_FLAG_CARRY), opcode == VMOpcode::STC ? 1 : 0);
+            return true;
+        
+        case VMOpcode::CMC:
+            as.xor_byte_imm(jit_flag(VM_FLAG_CARRY), 1);
+            return true;
+        
+        case VMOpcode::NOP:
+            return true;
+        
+        case VMOpcode::HALT:
+            t.exit_with(VM_JIT_EXIT_HALT);
+            return false;
+        
+        default: {
+            // JMP / Jcc
+            std::vector<uint8_t*> taken;
+            if (opcode != VMOpcode::JMP) {
+                taken = jit_condition(as, opcode);
+                t.chain(next_ip);
+                for (uint8_t* field : taken) {
+                    VMJitAssembler::patch(field, as.cursor);
+                }
+            }
+            
+            if (mode_dst == AddressingMode::DIRECT) {
+                t.chain(operand1 & 0x1FFF);
+            } else {
+                // Computed targets always return to the dispatcher
+                VMJitAddress target = jit_resolve(as, JIT_RCX, operand1, mode_dst);
+                as.store_word(JIT_IP_CELL, target.reg);
+                VMJitAssembler::patch(as.jmp(), t.continue_stub);
+            }
+            return false;
+        }
+    }
+}
+
+VMJitBlock* VMJit::compile(VirtualMachine& vm, uint16_t ip) {
+    const VMDecodeInfo& first = VM_DECODE_LUT[vm.read_memory(ip)];
+    if (!code_buffer || !jit_translatable(first, ip, code_map)) {
+        return nullptr;
+    }
+    
+    // Emitting and chaining write to the arena
+    if (!writable) {
+        protect(true);
+    }
+    
+    for (int attempt = 0; attempt < 2; attempt++) {
+        VMJitAssembler as(code_cursor, code_buffer + VM_JIT_CODE_SIZE);
+        
+        // Shared exit: IP is already in the IP cell
+        uint8_t* continue_stub = as.cursor;
+        as.alu(JIT_XOR, JIT_RAX, JIT_RAX);
+        as.ret();
+        
+        // Entry: load the frame (rdi on System V, rcx on Windows)
+        uint8_t* entry = as.cursor;
+#ifdef _WIN32
+        as.move64(JIT_R11, JIT_RCX);
+#else
+        as.move64(JIT_R11, JIT_RDI);
+#endif
+        as.load_qword(JIT_MEMORY, { JIT_R11, -1, 1, offsetof(VMJitFrame, memory) });
+        as.load_qword(JIT_FLAGS, { JIT_R11, -1, 1, offsetof(VMJitFrame, flags) });
+        as.load_qword(JIT_CODE_MAP, { JIT_R11, -1, 1, offsetof(VMJitFrame, code_map) });
+        
+        uint8_t* body = as.cursor;
+        VMJitTranslation t(as, continue_stub);
+        uint16_t address = ip;
+        uint16_t length = 0;
+        bool open = true;
+        
+        for (uint16_t count = 0; open && count < VM_JIT_MAX_BLOCK_INSTRUCTIONS; count++) {
+            const VMDecodeInfo& info = VM_DECODE_LUT[vm.read_memory(address)];
+            
+            if (!jit_translatable(info, address, code_map)) {
+                // IP cell already points here; let the dispatcher interpret it
+                t.exit_with(VM_JIT_EXIT_INTERPRET);
+                open = false;
+                break;
+            }
+            
+            uint16_t operand1 = info.length > 1 ? vm.read_memory((address + 1) & 0x1FFF) : 0;
+            uint16_t operand2 = info.length > 2 ? vm.read_memory((address + 2) & 0x1FFF) : 0;
+            uint16_t next_ip = (address + info.length) & 0x1FFF;
+            
+            as.add_qword_imm(JIT_STEP_COUNTER, 1);
+            as.store_word_imm(JIT_IP_CELL, next_ip);
+            open = jit_translate(t, info.opcode, info.mode_dst, info.mode_src, 
+                                 operand1, operand2, next_ip);
+            
+            length += info.length;
+            address = next_ip;
+        }
+        
+        if (open) {
+            t.chain(address);
+        }
+        t.emit_write_exits();
+        
+        if (as.overflow) {
+            // Arena exhausted: start over with an empty code buffer
+            flush();
+            continue;
+        }
+        
+        VMJitBlock* block = new VMJitBlock();
+        block->entry = reinterpret_cast<VMJitEntry>(entry);
+        block->body = body;
+        block->start = ip;
+        block->length = length;
+        block->valid = true;
+        code_cursor = as.cursor;
+        
+        for (uint16_t i = 0; i < length; i++) {
+            code_map[(ip + i) & 0x1FFF]++;
+        }
+        
+        for (const std::pair<uint8_t*, uint16_t>& chain : t.chains) {
+            VMJitAssembler::patch(chain.first, continue_stub);
+            chain_sites.push_back({ chain.first, continue_stub, chain.second, block, nullptr });
+        }
+        
+        blocks[ip] = block;
+        live_blocks.push_back(block);
+        
+        // Chain new exits to existing blocks and existing exits to this block
+        for (VMJitChainSite& site : chain_sites) {
+            if (!site.linked && blocks[site.target]) {
+                link(site, blocks[site.target]);
+            }
+        }
+        
+        return block;
+    }
+    
+    return nullptr;
+}
+
+void VMJit::link(VMJitChainSite& site, VMJitBlock* block) {
+    VMJitAssembler::patch(site.rel32, block->body);
+    site.linked = block;
+}
+
+void VMJit::unlink(VMJitChainSite& site) {
+    VMJitAssembler::patch(site.rel32, site.stub);
+    site.linked = nullptr;
+}
+
+void VMJit::drop_block(VMJitBlock* block) {
+    for (uint16_t i = 0; i < block->length; i++) {
+        code_map[(block->start + i) & 0x1FFF]--;
+    }
+    
+    for (VMJitChainSite& site : chain_sites) {
+        if (site.linked == block) {
+            unlink(site);
+        }
+    }
+    
+    chain_sites.erase(std::remove_if(chain_sites.begin(), chain_sites.end(),
+                                     [block](const VMJitChainSite& site) {
+                                         return site.owner == block;
+                                     }),
+                      chain_sites.end());
+    
+    if (blocks[block->start] == block) {
+        blocks[block->start] = nullptr;
+    }
+    block->valid = false;
+    delete block;
+}
+
+#else
+
+// Hosts without a JIT never translate anything
+VMJitBlock* VMJit::compile(VirtualMachine& vm, uint16_t ip) {
+    return nullptr;
+}
+
+void VMJit::link(VMJitChainSite& site, VMJitBlock* block) {
+}
+
+void VMJit::unlink(VMJitChainSite& site) {
+}
+
+void VMJit::drop_block(VMJitBlock* block) {
+    delete block;
+}
+
+#endif // VM_JIT_SUPPORTED
+
+void VMJit::protect(bool write) {
+#if VM_JIT_SUPPORTED
+#ifdef _WIN32
+    DWORD previous;
+    bool changed = VirtualProtect(code_buffer, VM_JIT_CODE_SIZE, write ? PAGE_READWRITE : PAGE_EXECUTE_READ,
+                                  &previous) != 0;
+#else
+    bool changed = mprotect(code_buffer, VM_JIT_CODE_SIZE, write ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#endif
+    if (!changed) {
+        throw std::runtime_error("Failed to change JIT arena protection");
+    }
+#endif
+    writable = write;
+}
+
+VMJit::VMJit() 
+    : code_buffer(nullptr), code_cursor(nullptr), writable(false), code_map(nullptr) {
+    memset(blocks, 0, sizeof(blocks));
+    code_map = static_cast<uint8_t*>(calloc(VM_JIT_STEP_COUNTER + sizeof(uint64_t), 1));
+}
+
+VMJit::~VMJit() {
+    flush();
+    
+#if VM_JIT_SUPPORTED
+    if (code_buffer) {
+#ifdef _WIN32
+        VirtualFree(code_buffer, 0, MEM_RELEASE);
+#else
+        munmap(code_buffer, VM_JIT_CODE_SIZE);
+#endif
+        code_buffer = nullptr;
+    }
+#endif
+    
+    if (code_map) {
+        free(code_map);
+        code_map = nullptr;
+    }
+}
+
+bool VMJit::initialize() {
+#if VM_JIT_SUPPORTED
+    if (!code_buffer && code_map) {
+#ifdef _WIN32
+        void* memory = VirtualAlloc(nullptr, VM_JIT_CODE_SIZE, 
+                                    MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+        void* memory = mmap(nullptr, VM_JIT_CODE_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            memory = nullptr;
+        }
+#endif
+        code_buffer = static_cast<uint8_t*>(memory);
+        code_cursor = code_buffer;
+        writable = true;
+    }
+#endif
+    return code_buffer != nullptr;
+}
+
+void VMJit::invalidate(uint16_t address) {
+    address &= 0x1FFF;
+    if (!code_map[address]) {
+        return;
+    }
+    
+    // Unlinking patches the exits of the surviving blocks
+    if (!writable) {
+        protect(true);
+    }
+    
+    // Drop every block whose guest range covers the address
+    for (size_t i = 0; i < live_blocks.size() && code_map[address]; ) {
+        VMJitBlock* block = live_blocks[i];
+        if (((address - block->start) & 0x1FFF) < block->length) {
+            live_blocks[i] = live_blocks.back();
+            live_blocks.pop_back();
+            drop_block(block);
+        } else {
+            i++;
+        }
+    }
+}
+
+void VMJit::flush() {
+    for (VMJitBlock* block : live_blocks) {
+        delete block;
+    }
+    
+    live_blocks.clear();
+    chain_sites.clear();
+    memset(blocks, 0, sizeof(blocks));
+    if (code_map) {
+        memset(code_map, 0, 0x2000);
+    }
+    code_cursor = code_buffer;
+}
+
+// Selected by run_core in SHADOW mode once the executable arena exists.
+// Registers stay in the IP/SP cells, where translated blocks access them.
+void VirtualMachine::run_jit(ExecutionContext& context) {
+    VMJitFrame frame = { shadow_memory, context.status_flags, jit->get_code_map() };
+    bool running = true;
+    
+    while (running) {
+        VMJitBlock* block = jit->lookup(*this, shadow_memory[VM_INSTRUCTION_POINTER]);
+        
+        if (block) {
+            // Native blocks read and write the flag array directly
+            vm_flags_materialize(context);
+            uint32_t exit = jit->enter(block, frame);
+            
+            switch (exit >> 29) {
+                case VM_JIT_EXIT_CONTINUE:
+                    continue;
+                case VM_JIT_EXIT_HALT:
+                    running = false;
+                    continue;
+                case VM_JIT_EXIT_WRITE_CODE:
+                    // The store already happened; drop the overwritten blocks
+                    jit->invalidate(exit & 0x1FFF);
+                    jit->invalidate((exit >> 13) & 0x1FFF);
+                    continue;
+                default:
+                    break;
+            }
+        }
+        
+        // No translation here: interpret a single instruction
+        runtime.steps += jit->take_steps() + 1;
+        running = interpret_uncached(context);
+    }
+    
+    runtime.steps += jit->take_steps();
+    
+    // Native stores were not seen by the decode cache or the optimizer
+    decode_cache.invalidate_all();
+    optimizer.verify(*this);
+}
\ No newline at end of file
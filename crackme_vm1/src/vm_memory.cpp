@@ -1,7 +1,7 @@
 #include "../include/vm_memory.h"
 #include <cstring>
 
-uint16_t VMMemoryManager::read_buffer_value(uint8_t* buffer_ptr, uint16_t address) {
+uint16_t VMMemoryManager::read_buffer_value(const uint8_t* buffer_ptr, uint16_t address) {
     // Each address stores 13 bits
     // Calculate byte offset: address * 13 / 8
     size_t byte_offset = (static_cast<size_t>(address) * 13) >> 3;
@@ -9,22 +9,16 @@ uint16_t VMMemoryManager::read_buffer_value(uint8_t* buffer_ptr, uint16_t addres
     // Calculate bit offset: (address * 13) % 8
     uint8_t bit_offset = (static_cast<uint8_t>(address) * 13) & 7;
     
-    // Read first byte
-    uint16_t value = static_cast<uint16_t>(buffer_ptr[byte_offset] >> bit_offset) & 0xFF;
-    
-    // If we need bits from next byte
-    if (bit_offset > 3) {  // -5 < bit_offset in original
-        value |= static_cast<uint16_t>(buffer_ptr[byte_offset + 1]) 
-                 << (8 - bit_offset) & 0x1FFF;
-    }
+    // A 13-bit value always spans the first two bytes
+    uint32_t value = static_cast<uint32_t>(buffer_ptr[byte_offset]) |
+                     static_cast<uint32_t>(buffer_ptr[byte_offset + 1]) << 8;
     
     // If we need bits from third byte
     if (bit_offset > 3) {
-        value |= static_cast<uint16_t>(buffer_ptr[byte_offset + 2]) 
-                 << (16 - bit_offset) & 0x1FFF;
+        value |= static_cast<uint32_t>(buffer_ptr[byte_offset + 2]) << 16;
     }
     
-    return value & 0x1FFF;
+    return static_cast<uint16_t>(value >> bit_offset) & 0x1FFF;
 }
 
 void VMMemoryManager::write_buffer_value(uint8_t* buffer_ptr, uint16_t address, uint16_t value) {
@@ -72,6 +66,52 @@ void VMMemoryManager::write_buffer_value(uint8_t* buffer_ptr, uint16_t address,
     }
 }
 
+size_t VMMemoryManager::calculate_byte_offset(uint16_t address) {
+    return (static_cast<size_t>(address) * 13) >> 3;
+}
+
+uint8_t VMMemoryManager::calculate_bit_offset(uint16_t address) {
+    return (static_cast<uint8_t>(address) * 13) & 7;
+}
+
+void VMMemoryManager::unpack_buffer(const uint8_t* buffer_ptr, uint16_t* words) {
+    // Stream the packed bytes through a bit accumulator instead of
+    // recomputing the byte/bit offset for every address
+    uint32_t accumulator = 0;
+    uint32_t bit_count = 0;
+    size_t byte_offset = 0;
+    
+    for (uint32_t address = 0; address < 0x2000; address++) {
+        while (bit_count < 13) {
+            accumulator |= static_cast<uint32_t>(buffer_ptr[byte_offset++]) << bit_count;
+            bit_count += 8;
+        }
+        
+        words[address] = static_cast<uint16_t>(accumulator & 0x1FFF);
+        accumulator >>= 13;
+        bit_count -= 13;
+    }
+}
+
+void VMMemoryManager::pack_buffer(const uint16_t* words, uint8_t* buffer_ptr) {
+    // 8192 * 13 bits is exactly 0x3400 bytes, so no partial byte is left
+    // over and the flag bytes that follow are never touched
+    uint32_t accumulator = 0;
+    uint32_t bit_count = 0;
+    size_t byte_offset = 0;
+    
+    for (uint32_t address = 0; address < 0x2000; address++) {
+        accumulator |= static_cast<uint32_t>(words[address] & 0x1FFF) << bit_count;
+        bit_count += 13;
+        
+        while (bit_count >= 8) {
+            buffer_ptr[byte_offset++] = static_cast<uint8_t>(accumulator);
+            accumulator >>= 8;
+            bit_count -= 8;
+        }
+    }
+}
+
 uint16_t OperandResolver::resolve_operand_address(uint8_t* buffer_ptr, 
                                                  uint16_t base_address, 
                                                  AddressingMode mode) {
@@ -81,25 +121,25 @@ uint16_t OperandResolver::resolve_operand_address(uint8_t* buffer_ptr,
         case AddressingMode::DIRECT:
             // Direct addressing, return as-is
             break;
-            
+        
         case AddressingMode::INDIRECT:
             // Single indirect: read address from memory
             resolved_address = VMMemoryManager::read_buffer_value(buffer_ptr, resolved_address);
             break;
-            
+        
         case AddressingMode::DOUBLE_INDIRECT:
             // Double indirect
             resolved_address = VMMemoryManager::read_buffer_value(buffer_ptr, resolved_address);
             resolved_address = VMMemoryManager::read_buffer_value(buffer_ptr, resolved_address);
             break;
-            
+        
         case AddressingMode::TRIPLE_INDIRECT:
             // Triple indirect
             resolved_address = VMMemoryManager::read_buffer_value(buffer_ptr, resolved_address);
             resolved_address = VMMemoryManager::read_buffer_value(buffer_ptr, resolved_address);
             resolved_address = VMMemoryManager::read_buffer_value(buffer_ptr, resolved_address);
             break;
-            
+        
         default:
             resolved_address = 0;
             break;
@@ -126,4 +166,96 @@ uint16_t OperandResolver::get_pointer_value(uint8_t* buffer_ptr,
     }
     
     return pointer_value & 0x1FFF;
+}
+
+// Base of memories that start all zero
+static const uint16_t vm_cow_zero_block[VM_COW_BLOCK_WORDS] = {};
+
+VMCowMemory::VMCowMemory() {
+    for (uint16_t block = 0; block < VM_COW_BLOCK_COUNT; block++) {
+        views[block] = vm_cow_zero_block;
+        blocks[block] = nullptr;
+    }
+}
+
+VMCowMemory::VMCowMemory(const uint16_t* base) {
+    for (uint16_t block = 0; block < VM_COW_BLOCK_COUNT; block++) {
+        views[block] = base + block * VM_COW_BLOCK_WORDS;
+        blocks[block] = nullptr;
+    }
+}
+
+VMCowMemory::VMCowMemory(const VMCowMemory& other) {
+    for (uint16_t block = 0; block < VM_COW_BLOCK_COUNT; block++) {
+        views[block] = other.views[block];
+        blocks[block] = other.blocks[block];
+        if (blocks[block]) {
+            blocks[block]->references.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+VMCowMemory::~VMCowMemory() {
+    for (uint16_t block = 0; block < VM_COW_BLOCK_COUNT; block++) {
+        release(blocks[block]);
+        blocks[block] = nullptr;
+    }
+}
+
+void VMCowMemory::release(VMMemoryBlock* block) {
+    if (block && block->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete block;
+    }
+}
+
+VMMemoryBlock* VMCowMemory::make_private(uint16_t block) {
+    VMMemoryBlock* copy = new VMMemoryBlock;
+    copy->references.store(1, std::memory_order_relaxed);
+    memcpy(copy->words, views[block], sizeof(copy->words));
+    
+    release(blocks[block]);
+    blocks[block] = copy;
+    views[block] = copy->words;
+    return copy;
+}
+
+void VMCowMemory::load(const uint16_t* words) {
+    for (uint16_t block = 0; block < VM_COW_BLOCK_COUNT; block++) {
+        if (!blocks[block] || blocks[block]->references.load(std::memory_order_acquire) != 1) {
+            make_private(block);
+        }
+        memcpy(blocks[block]->words, words + block * VM_COW_BLOCK_WORDS, sizeof(blocks[block]->words));
+    }
+}
+
+void VMCowMemory::store(uint16_t* words) const {
+    for (uint16_t block = 0; block < VM_COW_BLOCK_COUNT; block++) {
+        memcpy(words + block * VM_COW_BLOCK_WORDS, views[block], VM_COW_BLOCK_WORDS * sizeof(uint16_t));
+    }
+}
+
+uint32_t VMCowMemory::get_private_blocks() const {
+    uint32_t count = 0;
+    for (uint16_t block = 0; block < VM_COW_BLOCK_COUNT; block++) {
+        count += blocks[block] && blocks[block]->references.load(std::memory_order_relaxed) == 1;
+    }
+    return count;
+}
+
+void VMDirtyBitmap::mark_all() {
+    memset(bits, 0xFF, sizeof(bits));
+}
+
+void VMDirtyBitmap::clear() {
+    memset(bits, 0, sizeof(bits));
+}
+
+uint32_t VMDirtyBitmap::count() const {
+    uint32_t marked = 0;
+    for (uint16_t index = 0; index < VM_DIRTY_BITMAP_WORDS; index++) {
+        for (uint64_t mask = bits[index]; mask; mask &= mask - 1) {
+            marked++;
+        }
+    }
+    return marked;
 }
\ No newline at end of file
@@ -0,0 +1,507 @@
+#include "../include/vm_optimizer.h"
+#include "../include/vm_core.h"
+#include "../include/vm_specialized.h"
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+// Handler for instructions whose every effect is dead
+static bool vm_handler_removed(const VMDecodedInstruction& instruction, ExecutionContext& context) {
+    return true;
+}
+
+// ALU variants that store the result without touching the flags,
+// specialized per addressing modes like the regular handlers
+template <VMOpcode Op, AddressingMode Dst, AddressingMode Src>
+bool vm_flagless_handler(const VMDecodedInstruction& instruction, ExecutionContext& context) {
+    VirtualMachine& vm = *context.machine;
+    uint16_t address = vm_resolve<static_cast<int>(Dst)>(vm, instruction.operand1);
+    uint16_t value = vm.read_memory(address);
+    uint16_t result;
+    
+    if constexpr (Op == VMOpcode::ADD || Op == VMOpcode::SUB || Op == VMOpcode::AND ||
+                  Op == VMOpcode::OR || Op == VMOpcode::XOR) {
+        uint16_t value2 = vm.read_memory(vm_resolve<static_cast<int>(Src)>(vm, instruction.operand2));
+        
+        if constexpr (Op == VMOpcode::ADD) {
+            result = value + value2;
+        } else if constexpr (Op == VMOpcode::SUB) {
+            result = value - value2;
+        } else if constexpr (Op == VMOpcode::AND) {
+            result = value & value2;
+        } else if constexpr (Op == VMOpcode::OR) {
+            result = value | value2;
+        } else {
+            result = value ^ value2;
+        }
+    } else if constexpr (Op == VMOpcode::NOT) {
+        result = ~value;
+    } else if constexpr (Op == VMOpcode::INC) {
+        result = value + 1;
+    } else if constexpr (Op == VMOpcode::DEC) {
+        result = value - 1;
+    } else if constexpr (Op == VMOpcode::SHL) {
+        result = value << 1;
+    } else if constexpr (Op == VMOpcode::SHR) {
+        result = value >> 1;
+    } else if constexpr (Op == VMOpcode::ROL) {
+        result = (value << 1) | (value >> 12);
+    } else {
+        result = (value >> 1) | ((value & 1) << 12);
+    }
+    
+    vm.write_memory(address, result & 0x1FFF);
+    return true;
+}
+
+// Opcodes with flag-free variants, in handler table order
+static constexpr VMOpcode VM_FLAGLESS_OPCODES[] = {
+    VMOpcode::ADD, VMOpcode::SUB, VMOpcode::AND, VMOpcode::OR,
+    VMOpcode::XOR, VMOpcode::NOT, VMOpcode::INC, VMOpcode::DEC,
+    VMOpcode::SHL, VMOpcode::SHR, VMOpcode::ROL, VMOpcode::ROR
+};
+
+static constexpr size_t VM_FLAGLESS_OPCODE_COUNT = 
+    sizeof(VM_FLAGLESS_OPCODES) / sizeof(VM_FLAGLESS_OPCODES[0]);
+
+// Handler table layout: opcode index * 16 + mode_dst * 4 + mode_src
+template <size_t Index>
+constexpr VMInstructionHandler flagless_handler_at() {
+    return &vm_flagless_handler<VM_FLAGLESS_OPCODES[Index / 16],
+                                static_cast<AddressingMode>((Index >> 2) & 3),
+                                static_cast<AddressingMode>(Index & 3)>;
+}
+
+template <size_t... Indices>
+constexpr std::array<VMInstructionHandler, sizeof...(Indices)> 
+make_flagless_table(std::index_sequence<Indices...>) {
+    return {{ flagless_handler_at<Indices>()... }};
+}
+
+static constexpr auto flagless_handlers = 
+    make_flagless_table(std::make_index_sequence<VM_FLAGLESS_OPCODE_COUNT * 16>());
+
+static VMInstructionHandler vm_flagless_handler_for(VMOpcode opcode, 
+                                                    AddressingMode mode_dst, 
+                                                    AddressingMode mode_src) {
+    for (size_t i = 0; i < VM_FLAGLESS_OPCODE_COUNT; i++) {
+        if (VM_FLAGLESS_OPCODES[i] == opcode) {
+            return flagless_handlers[i * 16 + static_cast<size_t>(mode_dst) * 4 + 
+                                     static_cast<size_t>(mode_src)];
+        }
+    }
+    return nullptr;
+}
+
+// How an instruction uses the cells its operands resolve to
+struct VMOperandAccess {
+    bool reads;
+    bool writes;
+};
+
+static void vm_operand_access(VMOpcode opcode, VMOperandAccess& dst, VMOperandAccess& src) {
+    dst = { false, false };
+    src = { false, false };
+    
+    switch (opcode) {
+        case VMOpcode::MOV:
+            dst = { false, true };
+            src = { true, false };
+            break;
+        case VMOpcode::XCHG:
+            dst = { true, true };
+            src = { true, true };
+            break;
+        case VMOpcode::ADD:
+        case VMOpcode::SUB:
+        case VMOpcode::AND:
+        case VMOpcode::OR:
+        case VMOpcode::XOR:
+            dst = { true, true };
+            src = { true, false };
+            break;
+        case VMOpcode::CMP:
+            dst = { true, false };
+            src = { true, false };
+            break;
+        case VMOpcode::NOT:
+        case VMOpcode::INC:
+        case VMOpcode::DEC:
+        case VMOpcode::SHL:
+        case VMOpcode::SHR:
+        case VMOpcode::ROL:
+        case VMOpcode::ROR:
+            dst = { true, true };
+            break;
+        case VMOpcode::PUSH:
+        case VMOpcode::OUT:
+            dst = { true, false };
+            break;
+        case VMOpcode::POP:
+        case VMOpcode::IN:
+        case VMOpcode::IN_HEX:
+        case VMOpcode::IN_STR:
+            dst = { false, true };
+            break;
+        default:
+            break;
+    }
+}
+
+// Instructions that also touch memory through the stack pointer or a range
+static bool vm_has_implicit_access(VMOpcode opcode) {
+    return opcode == VMOpcode::PUSH || opcode == VMOpcode::POP || opcode == VMOpcode::IN_STR;
+}
+
+static bool vm_is_jump(VMOpcode opcode) {
+    return opcode >= VMOpcode::JMP && opcode <= VMOpcode::JGE;
+}
+
+VMProgramOptimizer::VMProgramOptimizer() 
+    : program(nullptr), dependency_bitmap(nullptr), active(false) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+VMProgramOptimizer::~VMProgramOptimizer() {
+    if (program) {
+        free(program);
+        program = nullptr;
+    }
+    
+    if (dependency_bitmap) {
+        free(dependency_bitmap);
+        dependency_bitmap = nullptr;
+    }
+}
+
+void VMProgramOptimizer::discard() {
+    active = false;
+}
+
+void VMProgramOptimizer::add_dependency(VirtualMachine& vm, uint16_t address) {
+    uint64_t bit = 1ULL << (address & 63);
+    if (!(dependency_bitmap[address >> 6] & bit)) {
+        dependency_bitmap[address >> 6] |= bit;
+        dependencies.push_back(std::make_pair(address, vm.read_memory(address)));
+    }
+}
+
+bool VMProgramOptimizer::verify(VirtualMachine& vm) {
+    if (!active) {
+        return false;
+    }
+    
+    for (const std::pair<uint16_t, uint16_t>& dependency : dependencies) {
+        if (vm.read_memory(dependency.first) != dependency.second) {
+            discard();
+            return false;
+        }
+    }
+    return true;
+}
+
+void VMProgramOptimizer::optimize(VirtualMachine& vm, const std::vector<uint16_t>& entry_points) {
+    if (!program) {
+        program = static_cast<VMOptimizedInstruction*>(
+            calloc(VM_MEMORY_SIZE, sizeof(VMOptimizedInstruction)));
+    }
+    if (!dependency_bitmap) {
+        dependency_bitmap = static_cast<uint64_t*>(calloc(VM_MEMORY_SIZE / 64, sizeof(uint64_t)));
+    }
+    if (!program || !dependency_bitmap) {
+        throw std::runtime_error("Failed to allocate VM optimizer tables");
+    }
+    
+    memset(program, 0, VM_MEMORY_SIZE * sizeof(VMOptimizedInstruction));
+    memset(dependency_bitmap, 0, VM_MEMORY_SIZE / 8);
+    memset(&stats, 0, sizeof(stats));
+    dependencies.clear();
+    active = false;
+    
+    // Control flow graph over instruction addresses. Instructions that
+    // touch the SP/IP cells or wrap around memory are left unanalyzed.
+    std::vector<uint16_t> successors[2];
+    successors[0].assign(VM_MEMORY_SIZE, 0);
+    successors[1].assign(VM_MEMORY_SIZE, 0);
+    std::vector<uint8_t> successor_count(VM_MEMORY_SIZE, 0);
+    std::vector<bool> exits(VM_MEMORY_SIZE, false);
+    std::vector<bool> leaders(VM_MEMORY_SIZE, false);
+    std::vector<bool> written(VM_MEMORY_SIZE, false);
+    std::vector<uint16_t> order;
+    
+    std::vector<uint16_t> pending(entry_points);
+    pending.push_back(vm.read_memory(VM_INSTRUCTION_POINTER));
+    for (uint16_t entry : pending) {
+        leaders[entry & 0x1FFF] = true;
+    }
+    
+    while (!pending.empty()) {
+        uint16_t ip = pending.back() & 0x1FFF;
+        pending.pop_back();
+        
+        VMOptimizedInstruction& node = program[ip];
+        if (node.analyzed) {
+            continue;
+        }
+        
+        const VMDecodeInfo& info = VM_DECODE_LUT[vm.read_memory(ip)];
+        if (!VMInstruction::is_valid_opcode(static_cast<uint16_t>(info.opcode)) ||
+            ip + info.length > VM_STACK_POINTER) {
+            continue;
+        }
+        
+        node.analyzed = true;
+        node.mode_dst = info.mode_dst;
+        node.mode_src = info.mode_src;
+        node.operand1 = info.length > 1 ? vm.read_memory(ip + 1) : 0;
+        node.operand2 = info.length > 2 ? vm.read_memory(ip + 2) : 0;
+        order.push_back(ip);
+        
+        uint16_t next_ip = ip + info.length;
+        
+        if (info.opcode == VMOpcode::HALT) {
+            exits[ip] = true;  // Flags are observable once execution stops
+        } else if (vm_is_jump(info.opcode)) {
+            if (info.opcode != VMOpcode::JMP) {
+                successors[successor_count[ip]++][ip] = next_ip;
+            }
+            if (info.mode_dst == AddressingMode::DIRECT) {
+                successors[successor_count[ip]++][ip] = node.operand1 & 0x1FFF;
+                leaders[node.operand1 & 0x1FFF] = true;
+            } else {
+                exits[ip] = true;  // Computed target
+            }
+            leaders[next_ip] = true;
+        } else {
+            successors[successor_count[ip]++][ip] = next_ip;
+        }
+        
+        for (uint8_t i = 0; i < successor_count[ip]; i++) {
+            pending.push_back(successors[i][ip]);
+        }
+        
+        // Cells reachable code stores to by constant address
+        VMOperandAccess dst, src;
+        vm_operand_access(info.opcode, dst, src);
+        if (dst.writes && info.mode_dst == AddressingMode::DIRECT) {
+            written[node.operand1 & 0x1FFF] = true;
+        }
+        if (src.writes && info.mode_src == AddressingMode::DIRECT) {
+            written[node.operand2 & 0x1FFF] = true;
+        }
+    }
+    
+    if (order.empty()) {
+        return;
+    }
+    
+    // The whole analysis depends on the code it was built from
+    for (uint16_t ip : order) {
+        for (uint8_t i = 0; i < VM_DECODE_LUT[vm.read_memory(ip)].length; i++) {
+            add_dependency(vm, ip + i);
+        }
+        if (leaders[ip]) {
+            stats.blocks++;
+        }
+    }
+    stats.instructions = static_cast<uint32_t>(order.size());
+    
+    // Fold leading indirection levels through cells that no reachable
+    // instruction stores to by constant address. Computed stores to them
+    // are caught at run time through the dependency bitmap.
+    for (uint16_t ip : order) {
+        VMOptimizedInstruction& node = program[ip];
+        AddressingMode* modes[2] = { &node.mode_dst, &node.mode_src };
+        uint16_t* operands[2] = { &node.operand1, &node.operand2 };
+        uint8_t operand_count = VMInstruction::operand_count(
+            static_cast<uint16_t>(VM_DECODE_LUT[vm.read_memory(ip)].opcode));
+        
+        for (uint8_t i = 0; i < operand_count; i++) {
+            int depth = static_cast<int>(*modes[i]);
+            uint16_t address = *operands[i] & 0x1FFF;
+            
+            while (depth > 0 && !written[address] && address < VM_STACK_POINTER) {
+                add_dependency(vm, address);
+                address = vm.read_memory(address);
+                depth--;
+            }
+            
+            if (depth != static_cast<int>(*modes[i])) {
+                *modes[i] = static_cast<AddressingMode>(depth);
+                *operands[i] = address;
+                stats.folded_operands++;
+            }
+        }
+    }
+    
+    // A store to a computed address may hit the IP cell, which acts as a
+    // jump to an unknown target. A store to analyzed code or a folded
+    // pointer discards the optimization, so execution after it runs the
+    // original code and may read any flag.
+    for (uint16_t ip : order) {
+        VMOptimizedInstruction& node = program[ip];
+        VMOpcode opcode = VM_DECODE_LUT[vm.read_memory(ip)].opcode;
+        VMOperandAccess dst, src;
+        vm_operand_access(opcode, dst, src);
+        
+        uint16_t dst_address = node.operand1 & 0x1FFF;
+        uint16_t src_address = node.operand2 & 0x1FFF;
+        bool leaving_store = vm_has_implicit_access(opcode) ||
+            (dst.writes && (node.mode_dst != AddressingMode::DIRECT || 
+                            dst_address == VM_INSTRUCTION_POINTER || is_dependency(dst_address))) ||
+            (src.writes && (node.mode_src != AddressingMode::DIRECT || 
+                            src_address == VM_INSTRUCTION_POINTER || is_dependency(src_address)));
+        if (leaving_store) {
+            exits[ip] = true;
+        }
+    }
+    
+    // Backward flag liveness to a fixed point
+    std::vector<uint8_t> live_in(VM_MEMORY_SIZE, 0);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        
+        for (size_t n = order.size(); n-- > 0; ) {
+            uint16_t ip = order[n];
+            uint16_t opcode = static_cast<uint16_t>(VM_DECODE_LUT[vm.read_memory(ip)].opcode);
+            uint8_t live_out = exits[ip] ? VM_FLAG_MASK_ALL : 0;
+            
+            for (uint8_t i = 0; i < successor_count[ip]; i++) {
+                uint16_t successor = successors[i][ip];
+                live_out |= program[successor].analyzed ? live_in[successor] : VM_FLAG_MASK_ALL;
+            }
+            
+            uint8_t in = VMInstruction::flags_read(opcode) | 
+                         (live_out & ~VMInstruction::flags_written(opcode));
+            program[ip].live_flags = live_out;
+            if (in != live_in[ip]) {
+                live_in[ip] = in;
+                changed = true;
+            }
+        }
+    }
+    
+    // Flag-free variants and block-local dead stores
+    for (uint16_t ip : order) {
+        VMOptimizedInstruction& node = program[ip];
+        VMOpcode opcode = VM_DECODE_LUT[vm.read_memory(ip)].opcode;
+        uint8_t flags_written = VMInstruction::flags_written(static_cast<uint16_t>(opcode));
+        bool flags_dead = (flags_written & node.live_flags) == 0;
+        
+        if (!flags_dead || vm_is_jump(opcode) || opcode == VMOpcode::HALT) {
+            continue;
+        }
+        
+        VMOperandAccess dst, src;
+        vm_operand_access(opcode, dst, src);
+        
+        // Flag-only instructions with dead flags do nothing observable
+        if (!dst.writes && !src.writes && flags_written) {
+            node.removed = true;
+            stats.removed++;
+            continue;
+        }
+        
+        bool pure = opcode == VMOpcode::MOV || 
+                    vm_flagless_handler_for(opcode, node.mode_dst, node.mode_src) != nullptr;
+        if (!pure) {
+            continue;
+        }
+        
+        // The result is dead if a later instruction in the same block
+        // overwrites the cell before anything can read it
+        uint16_t target = node.operand1 & 0x1FFF;
+        bool dead = false;
+        
+        if (node.mode_dst == AddressingMode::DIRECT && !is_dependency(target) && 
+            target < VM_STACK_POINTER) {
+            uint16_t next = ip;
+            
+            for (uint8_t step = 0; step < VM_DEAD_STORE_WINDOW; step++) {
+                if (successor_count[next] != 1 || exits[next]) {
+                    break;
+                }
+                next = successors[0][next];
+                
+                const VMOptimizedInstruction& scan = program[next];
+                VMOpcode scan_opcode = VM_DECODE_LUT[vm.read_memory(next)].opcode;
+                if (!scan.analyzed || vm_is_jump(scan_opcode) || 
+                    scan_opcode == VMOpcode::HALT || vm_has_implicit_access(scan_opcode)) {
+                    break;
+                }
+                
+                VMOperandAccess scan_access[2];
+                vm_operand_access(scan_opcode, scan_access[0], scan_access[1]);
+                AddressingMode modes[2] = { scan.mode_dst, scan.mode_src };
+                uint16_t addresses[2] = { 
+                    static_cast<uint16_t>(scan.operand1 & 0x1FFF), 
+                    static_cast<uint16_t>(scan.operand2 & 0x1FFF) 
+                };
+                
+                bool blocked = false;
+                bool overwrites = false;
+                for (int i = 0; i < 2 && !blocked; i++) {
+                    if (!scan_access[i].reads && !scan_access[i].writes) {
+                        continue;
+                    }
+                    // Computed addresses may alias anything
+                    if (modes[i] != AddressingMode::DIRECT) {
+                        blocked = true;
+                    } else if (scan_access[i].reads && addresses[i] == target) {
+                        blocked = true;
+                    } else if (scan_access[i].writes && 
+                               (is_dependency(addresses[i]) || addresses[i] >= VM_STACK_POINTER)) {
+                        blocked = true;
+                    } else if (scan_access[i].writes && addresses[i] == target) {
+                        overwrites = true;
+                    }
+                }
+                
+                if (blocked) {
+                    break;
+                }
+                if (overwrites) {
+                    dead = true;
+                    break;
+                }
+            }
+        }
+        
+        if (dead) {
+            node.removed = true;
+            stats.removed++;
+        } else if (flags_written && opcode != VMOpcode::MOV) {
+            node.flagless = true;
+            stats.flagless++;
+        }
+    }
+    
+    active = true;
+}
+
+void VMProgramOptimizer::rewrite(uint16_t ip, VMDecodedInstruction& entry, bool specialized) const {
+    if (!active || !program[ip].analyzed) {
+        return;
+    }
+    
+    const VMOptimizedInstruction& node = program[ip];
+    bool folded = node.mode_dst != entry.mode_dst || node.mode_src != entry.mode_src;
+    
+    entry.mode_dst = node.mode_dst;
+    entry.mode_src = node.mode_src;
+    entry.operand1 = node.operand1;
+    entry.operand2 = node.operand2;
+    
+    if (node.removed) {
+        entry.handler = vm_handler_removed;
+    } else if (node.flagless) {
+        entry.handler = vm_flagless_handler_for(entry.opcode, node.mode_dst, node.mode_src);
+    } else if (folded && specialized) {
+        uint16_t word = (static_cast<uint16_t>(entry.opcode) << 4) |
+                        (static_cast<uint16_t>(node.mode_dst) << 2) |
+                        static_cast<uint16_t>(node.mode_src);
+        entry.handler = VM_DECODE_LUT[word].handler;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include "../include/vm_perf.h"
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char* vm_perf_event_name(VMPerfEvent event) {
+    switch (event) {
+        case VM_PERF_CYCLES:        return "cycles";
+        case VM_PERF_INSTRUCTIONS:  return "instructions";
+        case VM_PERF_BRANCH_MISSES: return "branch-misses";
+        case VM_PERF_L1D_MISSES:    return "L1-dcache-load-misses";
+        case VM_PERF_ITLB_MISSES:   return "iTLB-load-misses";
+        default:                    return "?";
+    }
+}
+
+VMPerfSample& VMPerfSample::operator+=(const VMPerfSample& other) {
+    if (!other.runs) {
+        return *this;
+    }
+    
+    // Only events counted on both sides stay meaningful
+    available = runs ? (available & other.available) : other.available;
+    for (int event = 0; event < VM_PERF_EVENT_COUNT; event++) {
+        values[event] += other.values[event];
+    }
+    runs += other.runs;
+    guest_instructions += other.guest_instructions;
+    return *this;
+}
+
+void VMPerfSample::write_report(FILE* output) const {
+    if (!available) {
+        fprintf(output, "perf events unavailable\n");
+        return;
+    }
+    
+    fprintf(output, "%-22s %16s %14s %12s\n", "event", "total", "per run", "per guest op");
+    for (int index = 0; index < VM_PERF_EVENT_COUNT; index++) {
+        VMPerfEvent event = static_cast<VMPerfEvent>(index);
+        if (!has(event)) {
+            continue;
+        }
+        fprintf(output, "%-22s %16llu %14.1f ", vm_perf_event_name(event),
+                static_cast<unsigned long long>(values[event]), per_run(event));
+        if (guest_instructions) {
+            fprintf(output, "%12.3f\n", per_guest_instruction(event));
+        } else {
+            fprintf(output, "%12s\n", "-");
+        }
+    }
+    if (has(VM_PERF_CYCLES) && has(VM_PERF_INSTRUCTIONS) && values[VM_PERF_CYCLES]) {
+        fprintf(output, "IPC %.2f over %llu runs\n",
+                static_cast<double>(values[VM_PERF_INSTRUCTIONS]) / values[VM_PERF_CYCLES],
+                static_cast<unsigned long long>(runs));
+    }
+}
+
+#ifdef __linux__
+static int vm_perf_open(VMPerfEvent event, int group) {
+    static const uint64_t cache_read_miss =
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    
+    switch (event) {
+        case VM_PERF_CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case VM_PERF_INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case VM_PERF_BRANCH_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case VM_PERF_L1D_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | cache_read_miss;
+            break;
+        case VM_PERF_ITLB_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_ITLB | cache_read_miss;
+            break;
+        default:
+            return -1;
+    }
+    
+    // Calling thread, any CPU
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+}
+#endif
+
+VMPerfCounters::VMPerfCounters()
+    : leader(-1), available(0), members(0) {
+    for (int event = 0; event < VM_PERF_EVENT_COUNT; event++) {
+        descriptors[event] = -1;
+        slots[event] = 0;
+    }
+    clear();
+    
+#ifdef __linux__
+    // The first event that opens leads the group
+    for (int index = 0; index < VM_PERF_EVENT_COUNT; index++) {
+        int descriptor = vm_perf_open(static_cast<VMPerfEvent>(index), leader);
+        if (descriptor < 0) {
+            continue;
+        }
+        if (leader < 0) {
+            leader = descriptor;
+        }
+        descriptors[index] = descriptor;
+        slots[index] = static_cast<uint8_t>(members++);
+        available |= 1 << index;
+    }
+    
+    if (leader >= 0) {
+        ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+}
+
+VMPerfCounters::~VMPerfCounters() {
+#ifdef __linux__
+    for (int event = 0; event < VM_PERF_EVENT_COUNT; event++) {
+        if (descriptors[event] >= 0) {
+            close(descriptors[event]);
+            descriptors[event] = -1;
+        }
+    }
+#endif
+    leader = -1;
+}
+
+bool VMPerfCounters::read_group(uint64_t* values, uint64_t& enabled, uint64_t& running) const {
+#ifdef __linux__
+    // nr, time_enabled, time_running, then one value per member
+    uint64_t buffer[3 + VM_PERF_EVENT_COUNT];
+    ssize_t expected = static_cast<ssize_t>(sizeof(uint64_t) * (3 + members));
+    if (read(leader, buffer, sizeof(buffer)) != expected) {
+        return false;
+    }
+    
+    enabled = buffer[1];
+    running = buffer[2];
+    for (int event = 0; event < VM_PERF_EVENT_COUNT; event++) {
+        values[event] = (available >> event) & 1 ? buffer[3 + slots[event]] : 0;
+    }
+    return true;
+#else
+    (void)values;
+    (void)enabled;
+    (void)running;
+    return false;
+#endif
+}
+
+void VMPerfCounters::start() {
+    if (leader < 0) {
+        return;
+    }
+    if (!read_group(start_values, start_enabled, start_running)) {
+        start_enabled = start_running = 0;
+        memset(start_values, 0, sizeof(start_values));
+    }
+}
+
+void VMPerfCounters::stop(uint64_t guest_instructions) {
+    if (leader < 0) {
+        return;
+    }
+    
+    uint64_t values[VM_PERF_EVENT_COUNT];
+    uint64_t enabled;
+    uint64_t running;
+    if (!read_group(values, enabled, running)) {
+        return;
+    }
+    
+    // Scale for the share of the interval the group was on a PMU
+    uint64_t enabled_delta = enabled - start_enabled;
+    uint64_t running_delta = running - start_running;
+    double scale = running_delta && running_delta < enabled_delta
+                   ? static_cast<double>(enabled_delta) / running_delta : 1.0;
+    
+    VMPerfSample sample = {};
+    sample.available = available;
+    sample.runs = 1;
+    sample.guest_instructions = guest_instructions;
+    for (int event = 0; event < VM_PERF_EVENT_COUNT; event++) {
+        sample.values[event] = static_cast<uint64_t>((values[event] - start_values[event]) * scale);
+    }
+    totals += sample;
+}
+
+void VMPerfCounters::clear() {
+    memset(&totals, 0, sizeof(totals));
+    memset(start_values, 0, sizeof(start_values));
+    start_enabled = 0;
+    start_running = 0;
+}
\ No newline at end of file
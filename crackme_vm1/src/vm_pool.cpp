@@ -0,0 +1,75 @@
+#include "../include/vm_pool.h"
+#include <new>
+#include <stdexcept>
+
+VMPool::VMPool(const uint8_t* packed_image, uint32_t image_size, size_t capacity,
+               VMMemoryMode memory_mode)
+    : golden(VM_MEMORY_SIZE), arena(nullptr), capacity(capacity), constructed(0) {
+    if (capacity == 0) {
+        throw std::invalid_argument("VM pool capacity must be positive");
+    }
+    
+    stride = (sizeof(VirtualMachine) + VM_POOL_ALIGNMENT - 1) / VM_POOL_ALIGNMENT * VM_POOL_ALIGNMENT;
+    arena = static_cast<uint8_t*>(::operator new(capacity * stride, std::align_val_t(VM_POOL_ALIGNMENT)));
+    available.reserve(capacity);
+    
+    try {
+        for (size_t index = 0; index < capacity; index++) {
+            VirtualMachine* vm = new (instance(index)) VirtualMachine(0x3404, memory_mode);
+            constructed++;
+            vm->initialize();
+            vm->load_image(packed_image, image_size);
+            
+            if (index == 0) {
+                for (uint32_t address = 0; address < VM_MEMORY_SIZE; address++) {
+                    golden[address] = vm->read_memory(static_cast<uint16_t>(address));
+                }
+            }
+            
+            // Tracking starts from the loaded image
+            vm->set_write_tracking(true);
+            available.push_back(vm);
+        }
+    } catch (...) {
+        destroy();
+        throw;
+    }
+}
+
+VMPool::~VMPool() {
+    destroy();
+}
+
+void VMPool::destroy() {
+    for (size_t index = 0; index < constructed; index++) {
+        instance(index)->~VirtualMachine();
+    }
+    constructed = 0;
+    
+    ::operator delete(arena, std::align_val_t(VM_POOL_ALIGNMENT));
+    arena = nullptr;
+}
+
+VirtualMachine* VMPool::acquire() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (available.empty()) {
+        return nullptr;
+    }
+    
+    VirtualMachine* vm = available.back();
+    available.pop_back();
+    return vm;
+}
+
+void VMPool::release(VirtualMachine* vm) {
+    // Restore outside the lock, the golden image is read-only
+    restore(*vm);
+    
+    std::lock_guard<std::mutex> guard(lock);
+    available.push_back(vm);
+}
+
+size_t VMPool::get_available() {
+    std::lock_guard<std::mutex> guard(lock);
+    return available.size();
+}
\ No newline at end of file
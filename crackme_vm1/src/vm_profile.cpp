@@ -0,0 +1,225 @@
+#include "../include/vm_profile.h"
+#include "../include/vm_instructions.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+VMProfiler::VMProfiler(uint32_t sample_interval)
+    : forms(nullptr), sites(nullptr), steps(0), sample_interval(1), countdown(1) {
+    forms = new VMProfileCounter[0x2000];
+    sites = new VMProfileSite[0x2000];
+    set_sample_interval(sample_interval);
+    clear();
+}
+
+VMProfiler::~VMProfiler() {
+    delete[] forms;
+    delete[] sites;
+    forms = nullptr;
+    sites = nullptr;
+}
+
+void VMProfiler::clear() {
+    memset(forms, 0, sizeof(VMProfileCounter) * 0x2000);
+    memset(sites, 0, sizeof(VMProfileSite) * 0x2000);
+    memset(depths, 0, sizeof(depths));
+    steps = 0;
+    countdown = sample_interval;
+}
+
+VMProfileCounter VMProfiler::get_opcode(uint16_t opcode) const {
+    VMProfileCounter total = {};
+    for (uint16_t modes = 0; modes < 16; modes++) {
+        const VMProfileCounter& form = forms[((opcode << 4) | modes) & 0x1FFF];
+        total.count += form.count;
+        total.samples += form.samples;
+        total.cycles += form.cycles;
+    }
+    return total;
+}
+
+static void vm_profile_opcode_label(char* label, size_t size, uint16_t opcode) {
+    const char* name = VMInstruction::opcode_name(opcode);
+    if (name) {
+        snprintf(label, size, "%s", name);
+    } else {
+        snprintf(label, size, "?%03x", opcode);
+    }
+}
+
+static void vm_profile_counter_json(FILE* output, const VMProfileCounter& counter) {
+    fprintf(output, "\"count\": %llu, \"samples\": %llu, \"cycles\": %llu, \"estimated_cycles\": %.0f",
+            static_cast<unsigned long long>(counter.count), static_cast<unsigned long long>(counter.samples),
+            static_cast<unsigned long long>(counter.cycles), counter.estimated_cycles());
+}
+
+// Indices of the nonzero rows, hottest (by estimated cost, then count) first
+template <typename Counter>
+static std::vector<uint16_t> vm_profile_rank(size_t size, Counter counter) {
+    std::vector<uint16_t> rows;
+    for (size_t index = 0; index < size; index++) {
+        if (counter(static_cast<uint16_t>(index)).count) {
+            rows.push_back(static_cast<uint16_t>(index));
+        }
+    }
+    
+    std::stable_sort(rows.begin(), rows.end(), [&](uint16_t a, uint16_t b) {
+        const VMProfileCounter& left = counter(a);
+        const VMProfileCounter& right = counter(b);
+        if (left.estimated_cycles() != right.estimated_cycles()) {
+            return left.estimated_cycles() > right.estimated_cycles();
+        }
+        return left.count > right.count;
+    });
+    return rows;
+}
+
+void VMProfiler::write_json(FILE* output) const {
+    char label[16];
+    const char* separator;
+    
+    fprintf(output, "{\n  \"steps\": %llu,\n  \"sample_interval\": %u,\n  \"clock\": \"%s\",\n",
+            static_cast<unsigned long long>(steps), sample_interval, VM_PROFILE_TSC ? "tsc" : "ns");
+    
+    separator = "";
+    fprintf(output, "  \"opcodes\": [");
+    for (uint16_t opcode = 0; opcode < 0x200; opcode++) {
+        VMProfileCounter counter = get_opcode(opcode);
+        if (!counter.count) {
+            continue;
+        }
+        vm_profile_opcode_label(label, sizeof(label), opcode);
+        fprintf(output, "%s\n    {\"opcode\": \"%s\", \"value\": %u, ", separator, label, opcode);
+        vm_profile_counter_json(output, counter);
+        fprintf(output, "}");
+        separator = ",";
+    }
+    
+    separator = "";
+    fprintf(output, "\n  ],\n  \"forms\": [");
+    for (uint16_t word = 0; word < 0x2000; word++) {
+        if (!forms[word].count) {
+            continue;
+        }
+        vm_profile_opcode_label(label, sizeof(label), word >> 4);
+        fprintf(output, "%s\n    {\"opcode\": \"%s\", \"mode_dst\": %u, \"mode_src\": %u, ",
+                separator, label, (word >> 2) & 3, word & 3);
+        vm_profile_counter_json(output, forms[word]);
+        fprintf(output, "}");
+        separator = ",";
+    }
+    
+    separator = "";
+    fprintf(output, "\n  ],\n  \"sites\": [");
+    for (uint16_t ip = 0; ip < 0x2000; ip++) {
+        const VMProfileSite& site = sites[ip];
+        if (!site.counter.count) {
+            continue;
+        }
+        vm_profile_opcode_label(label, sizeof(label), site.instruction >> 4);
+        fprintf(output, "%s\n    {\"ip\": %u, \"opcode\": \"%s\", ", separator, ip, label);
+        vm_profile_counter_json(output, site.counter);
+        if (site.taken || site.not_taken) {
+            fprintf(output, ", \"taken\": %llu, \"not_taken\": %llu",
+                    static_cast<unsigned long long>(site.taken), static_cast<unsigned long long>(site.not_taken));
+        }
+        fprintf(output, "}");
+        separator = ",";
+    }
+    
+    fprintf(output, "\n  ],\n  \"indirection\": {\n");
+    for (int operand = 0; operand < 2; operand++) {
+        fprintf(output, "    \"%s\": [%llu, %llu, %llu, %llu]%s\n", operand ? "src" : "dst",
+                static_cast<unsigned long long>(depths[operand][0]), static_cast<unsigned long long>(depths[operand][1]),
+                static_cast<unsigned long long>(depths[operand][2]), static_cast<unsigned long long>(depths[operand][3]),
+                operand ? "" : ",");
+    }
+    fprintf(output, "  }\n}\n");
+}
+
+void VMProfiler::write_report(FILE* output, size_t rows) const {
+    char label[16];
+    const char* unit = VM_PROFILE_TSC ? "cycles" : "ns";
+    
+    double total = 0.0;
+    for (uint16_t word = 0; word < 0x2000; word++) {
+        total += forms[word].estimated_cycles();
+    }
+    double percent_scale = total > 0.0 ? 100.0 / total : 0.0;
+    
+    fprintf(output, "%llu steps, 1 in %u timed, ~%.0f %s total\n",
+            static_cast<unsigned long long>(steps), sample_interval, total, unit);
+    
+    // Opcodes
+    std::vector<VMProfileCounter> opcodes(0x200);
+    for (uint16_t opcode = 0; opcode < 0x200; opcode++) {
+        opcodes[opcode] = get_opcode(opcode);
+    }
+    std::vector<uint16_t> ranked = vm_profile_rank(opcodes.size(), [&](uint16_t index) -> const VMProfileCounter& {
+        return opcodes[index];
+    });
+    
+    fprintf(output, "\nopcode        count   %%cost  %s/step\n", unit);
+    for (size_t row = 0; row < ranked.size() && row < rows; row++) {
+        const VMProfileCounter& counter = opcodes[ranked[row]];
+        vm_profile_opcode_label(label, sizeof(label), ranked[row]);
+        fprintf(output, "%-6s %12llu  %6.2f  %8.1f\n", label, static_cast<unsigned long long>(counter.count),
+                counter.estimated_cycles() * percent_scale,
+                counter.samples ? static_cast<double>(counter.cycles) / counter.samples : 0.0);
+    }
+    
+    // Forms
+    ranked = vm_profile_rank(0x2000, [&](uint16_t index) -> const VMProfileCounter& {
+        return forms[index];
+    });
+    
+    fprintf(output, "\nform          count   %%cost  %s/step\n", unit);
+    for (size_t row = 0; row < ranked.size() && row < rows; row++) {
+        const VMProfileCounter& counter = forms[ranked[row]];
+        vm_profile_opcode_label(label, sizeof(label), ranked[row] >> 4);
+        fprintf(output, "%-6s %u,%u %10llu  %6.2f  %8.1f\n", label, (ranked[row] >> 2) & 3, ranked[row] & 3,
+                static_cast<unsigned long long>(counter.count), counter.estimated_cycles() * percent_scale,
+                counter.samples ? static_cast<double>(counter.cycles) / counter.samples : 0.0);
+    }
+    
+    // Guest hot spots
+    ranked = vm_profile_rank(0x2000, [&](uint16_t index) -> const VMProfileCounter& {
+        return sites[index].counter;
+    });
+    
+    fprintf(output, "\nip    opcode        count   %%cost\n");
+    for (size_t row = 0; row < ranked.size() && row < rows; row++) {
+        const VMProfileSite& site = sites[ranked[row]];
+        vm_profile_opcode_label(label, sizeof(label), site.instruction >> 4);
+        fprintf(output, "%04x  %-6s %12llu  %6.2f\n", ranked[row], label,
+                static_cast<unsigned long long>(site.counter.count), site.counter.estimated_cycles() * percent_scale);
+    }
+    
+    // Conditional jumps, most executed first
+    std::vector<uint16_t> branches;
+    for (uint16_t ip = 0; ip < 0x2000; ip++) {
+        if (sites[ip].taken || sites[ip].not_taken) {
+            branches.push_back(ip);
+        }
+    }
+    std::stable_sort(branches.begin(), branches.end(), [&](uint16_t a, uint16_t b) {
+        return sites[a].taken + sites[a].not_taken > sites[b].taken + sites[b].not_taken;
+    });
+    
+    fprintf(output, "\nip    branch     executed  taken%%\n");
+    for (size_t row = 0; row < branches.size() && row < rows; row++) {
+        const VMProfileSite& site = sites[branches[row]];
+        uint64_t executed = site.taken + site.not_taken;
+        vm_profile_opcode_label(label, sizeof(label), site.instruction >> 4);
+        fprintf(output, "%04x  %-6s %12llu  %6.2f\n", branches[row], label,
+                static_cast<unsigned long long>(executed), 100.0 * site.taken / executed);
+    }
+    
+    // Operand indirection
+    fprintf(output, "\nindirection   direct  indirect    double    triple\n");
+    for (int operand = 0; operand < 2; operand++) {
+        fprintf(output, "%-6s %13llu %9llu %9llu %9llu\n", operand ? "src" : "dst",
+                static_cast<unsigned long long>(depths[operand][0]), static_cast<unsigned long long>(depths[operand][1]),
+                static_cast<unsigned long long>(depths[operand][2]), static_cast<unsigned long long>(depths[operand][3]));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,576 @@
+#include "../include/vm_search.h"
+#include "../include/vm_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <condition_variable>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+VMRangeInputSpace::VMRangeInputSpace(uint64_t first, uint64_t count, int radix)
+    : first(first), count(count), radix(radix) {
+    if (radix != 10 && radix != 16) {
+        throw std::invalid_argument("Range input radix must be 10 or 16");
+    }
+}
+
+void VMRangeInputSpace::generate(uint64_t index, std::string& input) const {
+    char text[24];
+    snprintf(text, sizeof(text), radix == 16 ? "%llx\n" : "%llu\n",
+             static_cast<unsigned long long>(first + index));
+    input = text;
+}
+
+VMCharsetInputSpace::VMCharsetInputSpace(const std::string& charset, uint32_t min_length, uint32_t max_length)
+    : charset(charset), min_length(min_length), max_length(max_length), total(0) {
+    if (charset.empty() || min_length > max_length || max_length > VM_MAX_INPUT_STRING) {
+        throw std::invalid_argument("Invalid charset input space");
+    }
+    
+    const uint64_t limit = std::numeric_limits<uint64_t>::max();
+    uint64_t count = 1;
+    for (uint32_t length = 0; length <= max_length; length++) {
+        if (length >= min_length) {
+            if (count > limit - total) {
+                throw std::overflow_error("Charset input space exceeds 2^64 candidates");
+            }
+            length_counts.push_back(count);
+            total += count;
+        }
+        if (length < max_length) {
+            if (count > limit / charset.size()) {
+                throw std::overflow_error("Charset input space exceeds 2^64 candidates");
+            }
+            count *= charset.size();
+        }
+    }
+}
+
+void VMCharsetInputSpace::generate(uint64_t index, std::string& input) const {
+    uint32_t length = min_length;
+    for (uint64_t count : length_counts) {
+        if (index < count) {
+            break;
+        }
+        index -= count;
+        length++;
+    }
+    
+    // Last character varies fastest
+    input.assign(length + 1, '\n');
+    for (uint32_t position = length; position > 0; position--) {
+        input[position - 1] = charset[index % charset.size()];
+        index /= charset.size();
+    }
+}
+
+VMHexWordInputSpace::VMHexWordInputSpace(uint32_t words, uint16_t first, uint16_t last)
+    : words(words), first(first), span(0), total(1) {
+    if (words == 0 || first > last || last > 0x1FFF) {
+        throw std::invalid_argument("Invalid hex word input space");
+    }
+    
+    span = static_cast<uint64_t>(last - first) + 1;
+    for (uint32_t word = 0; word < words; word++) {
+        if (total > std::numeric_limits<uint64_t>::max() / span) {
+            throw std::overflow_error("Hex word input space exceeds 2^64 candidates");
+        }
+        total *= span;
+    }
+}
+
+void VMHexWordInputSpace::generate(uint64_t index, std::string& input) const {
+    input.clear();
+    
+    // First word varies slowest
+    uint64_t divisor = total / span;
+    for (uint32_t word = 0; word < words; word++) {
+        char text[8];
+        snprintf(text, sizeof(text), word + 1 < words ? "%x " : "%x\n",
+                 static_cast<unsigned int>(first + index / divisor));
+        input += text;
+        index %= divisor;
+        divisor = divisor / span ? divisor / span : 1;
+    }
+}
+
+VMSearchPredicate vm_search_output_contains(const std::string& text) {
+    return [text](const VMSearchCandidate& candidate) {
+        return candidate.output.find(text) != std::string::npos;
+    };
+}
+
+VMSearchPredicate vm_search_memory_equals(uint16_t address, uint16_t value) {
+    return [address, value](const VMSearchCandidate& candidate) {
+        return candidate.vm.read_memory(address) == value;
+    };
+}
+
+// Candidate indices owned by one worker: [begin, end). The owner pops
+// grains from the front, thieves split off the back half. Each worker
+// sits on its own cache lines so counters do not false-share.
+struct alignas(64) VMSearchWorker {
+    std::mutex lock;
+    uint64_t begin;
+    uint64_t end;
+    std::atomic<uint64_t> executions;
+    uint64_t pruned;
+    uint64_t exhausted;
+    
+    VMSearchWorker() : begin(0), end(0), executions(0), pruned(0), exhausted(0) {}
+};
+
+// State shared by the workers of one run()
+struct VMSearchShared {
+    const VMInputSpace& space;
+    const VMSearchPredicate& success;
+    std::unique_ptr<VMSearchWorker[]> workers;
+    uint32_t worker_count;
+    
+    // Snapshot states seen, tagged with the input prefix that reached them
+    // first; nullptr without state pruning
+    VMVisitedStates* visited;
+    
+    std::atomic<bool> stop;
+    std::mutex result_lock;
+    VMSearchResult result;
+    std::exception_ptr error;
+    
+    std::mutex done_lock;
+    std::condition_variable done;
+    uint32_t running;
+    
+    VMSearchShared(const VMInputSpace& space, const VMSearchPredicate& success, uint32_t worker_count)
+        : space(space), success(success), workers(new VMSearchWorker[worker_count]),
+          worker_count(worker_count), visited(nullptr), stop(false), running(worker_count) {
+        result.found = false;
+        result.index = 0;
+        result.executions = 0;
+        result.pruned = 0;
+        result.exhausted = 0;
+        result.seconds = 0.0;
+        memset(&result.perf, 0, sizeof(result.perf));
+    }
+};
+
+// Take the next grain of the worker's own deque
+static bool vm_search_pop(VMSearchWorker& worker, uint64_t grain, uint64_t& begin, uint64_t& end) {
+    std::lock_guard<std::mutex> guard(worker.lock);
+    if (worker.begin >= worker.end) {
+        return false;
+    }
+    
+    begin = worker.begin;
+    end = worker.end - begin > grain ? begin + grain : worker.end;
+    worker.begin = end;
+    return true;
+}
+
+// Move the back half of some other worker's deque into self
+static bool vm_search_steal(VMSearchShared& shared, uint32_t self, uint32_t& seed) {
+    // Random starting victim spreads thieves across the workers
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    
+    for (uint32_t attempt = 0; attempt < shared.worker_count; attempt++) {
+        uint32_t victim = (seed + attempt) % shared.worker_count;
+        if (victim == self) {
+            continue;
+        }
+        
+        uint64_t begin;
+        uint64_t end;
+        {
+            VMSearchWorker& worker = shared.workers[victim];
+            std::lock_guard<std::mutex> guard(worker.lock);
+            if (worker.begin >= worker.end) {
+                continue;
+            }
+            
+            end = worker.end;
+            begin = worker.begin + (worker.end - worker.begin) / 2;
+            worker.end = begin;
+        }
+        
+        VMSearchWorker& own = shared.workers[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        own.begin = begin;
+        own.end = end;
+        return true;
+    }
+    return false;
+}
+
+// Runs every candidate on a pooled machine reset to the golden image
+class VMSearchFreshRunner {
+private:
+    VMPool& pool;
+    VirtualMachine* vm;
+    VMPerfCounters* perf;
+    
+public:
+    VMSearchFreshRunner(VMPool& pool, VMDispatchMode dispatch_mode, bool cycle_detection, uint64_t step_limit,
+                        VMMemoryIO& io, VMPerfCounters* perf)
+        : pool(pool), vm(pool.acquire()), perf(perf) {
+        vm->set_dispatch_mode(dispatch_mode);
+        vm->set_cycle_detection(cycle_detection);
+        vm->set_step_limit(step_limit);
+        vm->get_runtime().memory_io = &io;
+    }
+    
+    ~VMSearchFreshRunner() {
+        vm->get_runtime().memory_io = nullptr;
+        vm->set_cycle_detection(false);
+        vm->set_step_limit(0);
+        pool.release(vm);
+    }
+    
+    VirtualMachine* run(const std::string& candidate, VMMemoryIO& io, VMStatus& status) {
+        // The step limit counts from the start of each candidate
+        pool.restore(*vm);
+        vm->get_runtime().steps = 0;
+        io.input = candidate;
+        io.input_position = 0;
+        io.output.clear();
+        io.suspend = false;
+        
+        if (perf) {
+            perf->start();
+        }
+        status = vm->execute();
+        if (perf) {
+            perf->stop();
+        }
+        return vm;
+    }
+};
+
+// FNV-1a over a string, continuing from hash
+static uint64_t vm_search_hash(const std::string& text, size_t begin, size_t end, uint64_t hash) {
+    for (size_t index = begin; index < end; index++) {
+        hash = (hash ^ static_cast<uint8_t>(text[index])) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// Resumes every candidate from the deepest snapshot taken on a prefix of
+// its input. With a visited set, a snapshot whose state (memory, registers,
+// flags, output and unconsumed input) was first reached through another
+// prefix of the same length is a duplicate: each candidate below it
+// behaves like the one with that prefix swapped in, so it is skipped.
+class VMSearchPrefixRunner {
+private:
+    struct Snapshot {
+        std::unique_ptr<VirtualMachine> vm;
+        size_t provided;        // Input characters fed when it suspended
+        size_t position;        // Characters consumed by then
+        std::string output;
+        bool duplicate;         // State first reached through another prefix
+    };
+    
+    // Stack of snapshots, each on a prefix of the previous candidate
+    std::vector<Snapshot> snapshots;
+    std::string previous;
+    std::unique_ptr<VirtualMachine> work;
+    VMStatus root_status;
+    VMPerfCounters* perf;
+    VMVisitedStates* visited;
+    
+    bool visited_before(VirtualMachine& vm, const std::string& candidate, const VMMemoryIO& io) {
+        uint64_t key = vm.state_hash() ^
+                       vm_hash_mix(vm_search_hash(io.output, 0, io.output.size(),
+                                   vm_search_hash(io.input, io.input_position, io.input.size(),
+                                                  0xCBF29CE484222325ULL ^ io.input.size())));
+        uint64_t prefix = vm_search_hash(candidate, 0, io.input.size(), 0xCBF29CE484222325ULL);
+        return visited->insert(key, prefix) != prefix;
+    }
+    
+public:
+    VMSearchPrefixRunner(const std::vector<uint8_t>& image, bool cycle_detection, uint64_t step_limit,
+                         VMVisitedStates* visited, VMMemoryIO& io, VMPerfCounters* perf)
+        : perf(perf), visited(visited) {
+        std::unique_ptr<VirtualMachine> root(new VirtualMachine(0x3404, VMMemoryMode::COPY_ON_WRITE));
+        root->initialize();
+        root->load_image(image.data(), static_cast<uint32_t>(image.size()));
+        root->get_runtime().memory_io = &io;
+        root->set_state_hashing(visited != nullptr);
+        root->set_cycle_detection(cycle_detection);
+        root->set_step_limit(step_limit);   // Forks keep counting from here
+        
+        // Run up to the first read
+        io.input.clear();
+        io.input_position = 0;
+        io.output.clear();
+        io.suspend = true;
+        root_status = root->execute();
+        
+        // Hash memory once here; every fork inherits it
+        if (visited) {
+            root->state_hash();
+        }
+        snapshots.push_back({ std::move(root), 0, 0, io.output, false });
+    }
+    
+    // nullptr when the candidate is pruned
+    VirtualMachine* run(const std::string& candidate, VMMemoryIO& io, VMStatus& status) {
+        // Programs that finish without input give every candidate the same result
+        if (root_status != VMStatus::INPUT_PENDING) {
+            io.input = candidate;
+            io.output = snapshots.front().output;
+            status = root_status;
+            return snapshots.front().vm.get();
+        }
+        
+        size_t common = 0;
+        while (common < previous.size() && common < candidate.size() && previous[common] == candidate[common]) {
+            common++;
+        }
+        while (snapshots.back().provided > common) {
+            snapshots.pop_back();
+        }
+        previous = candidate;
+        
+        const Snapshot& base = snapshots.back();
+        if (base.duplicate) {
+            return nullptr;
+        }
+        work = base.vm->fork();
+        io.input.assign(candidate, 0, base.provided);
+        io.input_position = base.position;
+        io.output = base.output;
+        io.suspend = true;
+        
+        // Feed one character per suspension; the last run sees end of input
+        size_t consumed = io.input_position;
+        status = VMStatus::INPUT_PENDING;
+        if (perf) {
+            perf->start();
+        }
+        while (status == VMStatus::INPUT_PENDING) {
+            if (io.input.size() < candidate.size()) {
+                io.input.push_back(candidate[io.input.size()]);
+            } else {
+                io.suspend = false;
+            }
+            
+            status = work->execute();
+            
+            if (status == VMStatus::INPUT_PENDING && io.input_position != consumed &&
+                io.input.size() < candidate.size()) {
+                consumed = io.input_position;
+                bool duplicate = visited && visited_before(*work, candidate, io);
+                snapshots.push_back({ duplicate ? nullptr : work->fork(), io.input.size(), io.input_position,
+                                     io.output, duplicate });
+                if (duplicate) {
+                    break;
+                }
+            }
+        }
+        if (perf) {
+            perf->stop();
+        }
+        return snapshots.back().duplicate ? nullptr : work.get();
+    }
+};
+
+template <typename Runner>
+static void vm_search_candidates(VMSearchShared& shared, uint32_t self, uint64_t grain,
+                                 Runner& runner, VMMemoryIO& io) {
+    VMSearchWorker& worker = shared.workers[self];
+    uint32_t seed = 0x9E3779B9u * (self + 1);
+    uint64_t executions = 0;
+    uint64_t begin;
+    uint64_t end;
+    std::string candidate;
+    
+    while (!shared.stop.load(std::memory_order_relaxed)) {
+        if (!vm_search_pop(worker, grain, begin, end)) {
+            if (!vm_search_steal(shared, self, seed)) {
+                break;
+            }
+            continue;
+        }
+        
+        for (uint64_t index = begin; index < end; index++) {
+            if (shared.stop.load(std::memory_order_relaxed)) {
+                break;
+            }
+            
+            shared.space.generate(index, candidate);
+            VMStatus status;
+            VirtualMachine* vm = runner.run(candidate, io, status);
+            if (!vm) {
+                worker.pruned++;
+                continue;
+            }
+            worker.executions.store(++executions, std::memory_order_relaxed);
+            if (status == VMStatus::STEP_LIMIT) {
+                worker.exhausted++;
+                continue;
+            }
+            
+            VMSearchCandidate result = { index, candidate, io.output, *vm, status };
+            if (shared.success(result)) {
+                std::lock_guard<std::mutex> guard(shared.result_lock);
+                if (!shared.result.found) {
+                    shared.result.found = true;
+                    shared.result.index = index;
+                    shared.result.input = candidate;
+                    shared.result.output = io.output;
+                }
+                shared.stop.store(true, std::memory_order_relaxed);
+                break;
+            }
+        }
+    }
+}
+
+static void vm_search_worker(VMSearchShared& shared, uint32_t self, const std::vector<uint8_t>& image,
+                             VMPool* machines, VMDispatchMode dispatch_mode, uint64_t grain,
+                             bool cycle_detection, uint64_t step_limit, bool perf_counters) {
+    VMMemoryIO io;
+    io.input_position = 0;
+    io.suspend = false;
+    
+    try {
+        // Counters are per thread, opened on the worker itself
+        std::unique_ptr<VMPerfCounters> perf;
+        if (perf_counters) {
+            perf.reset(new VMPerfCounters());
+        }
+        
+        if (machines) {
+            VMSearchFreshRunner runner(*machines, dispatch_mode, cycle_detection, step_limit, io, perf.get());
+            vm_search_candidates(shared, self, grain, runner, io);
+        } else {
+            VMSearchPrefixRunner runner(image, cycle_detection, step_limit, shared.visited, io, perf.get());
+            vm_search_candidates(shared, self, grain, runner, io);
+        }
+        
+        if (perf) {
+            std::lock_guard<std::mutex> guard(shared.result_lock);
+            shared.result.perf += perf->get_totals();
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> guard(shared.result_lock);
+        if (!shared.error) {
+            shared.error = std::current_exception();
+        }
+        shared.stop.store(true, std::memory_order_relaxed);
+    }
+    
+    std::lock_guard<std::mutex> guard(shared.done_lock);
+    shared.running--;
+    shared.done.notify_one();
+}
+
+VMSearch::VMSearch(const uint8_t* packed_image, uint32_t image_size)
+    : image(packed_image, packed_image + image_size), threads(0), grain(VM_SEARCH_DEFAULT_GRAIN),
+      dispatch_mode(VMDispatchMode::THREADED), prefix_sharing(false), state_pruning(false),
+      cycle_detection(false), step_limit(0), perf_counters(false), report_interval_ms(VM_SEARCH_DEFAULT_REPORT_MS) {
+    if (image_size > 0x3404) {
+        throw std::out_of_range("VM image larger than memory buffer");
+    }
+}
+
+void VMSearch::set_reporter(const VMSearchReporter& callback, uint32_t interval_ms) {
+    reporter = callback;
+    report_interval_ms = interval_ms ? interval_ms : 1;
+}
+
+VMSearchResult VMSearch::run(const VMInputSpace& space, const VMSearchPredicate& success) {
+    uint32_t worker_count = threads ? threads : std::thread::hardware_concurrency();
+    if (worker_count == 0) {
+        worker_count = 1;
+    }
+    
+    uint64_t total = space.size();
+    VMSearchShared shared(space, success, worker_count);
+    
+    // Even initial split; stealing rebalances whatever the candidates cost
+    for (uint32_t worker = 0; worker < worker_count; worker++) {
+        shared.workers[worker].begin = total / worker_count * worker + std::min<uint64_t>(worker, total % worker_count);
+        shared.workers[worker].end = shared.workers[worker].begin + total / worker_count + (worker < total % worker_count);
+    }
+    
+    // One pooled machine per worker unless runs resume from forks
+    std::unique_ptr<VMPool> machines;
+    std::unique_ptr<VMVisitedStates> visited;
+    if (!prefix_sharing) {
+        machines.reset(new VMPool(image.data(), static_cast<uint32_t>(image.size()), worker_count));
+    } else if (state_pruning && space.prefixes_interchangeable()) {
+        visited.reset(new VMVisitedStates());
+        shared.visited = visited.get();
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    pool.reserve(worker_count);
+    for (uint32_t worker = 0; worker < worker_count; worker++) {
+        pool.emplace_back(vm_search_worker, std::ref(shared), worker, std::cref(image), machines.get(),
+                          dispatch_mode, grain, cycle_detection, step_limit, perf_counters);
+    }
+    
+    auto count_executions = [&shared]() {
+        uint64_t executions = 0;
+        for (uint32_t worker = 0; worker < shared.worker_count; worker++) {
+            executions += shared.workers[worker].executions.load(std::memory_order_relaxed);
+        }
+        return executions;
+    };
+    
+    // Report from this thread until every worker finished
+    {
+        std::unique_lock<std::mutex> guard(shared.done_lock);
+        auto last_time = start;
+        uint64_t last_executions = 0;
+        
+        while (shared.running) {
+            shared.done.wait_for(guard, std::chrono::milliseconds(report_interval_ms));
+            if (!reporter || !shared.running) {
+                continue;
+            }
+            
+            auto now = std::chrono::steady_clock::now();
+            double period = std::chrono::duration<double>(now - last_time).count();
+            if (period * 1000 < report_interval_ms) {
+                continue;
+            }
+            
+            VMSearchProgress progress;
+            progress.executions = count_executions();
+            progress.total = total;
+            progress.seconds = std::chrono::duration<double>(now - start).count();
+            progress.executions_per_second = (progress.executions - last_executions) / period;
+            
+            last_time = now;
+            last_executions = progress.executions;
+            
+            guard.unlock();
+            reporter(progress);
+            guard.lock();
+        }
+    }
+    
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    
+    if (shared.error) {
+        std::rethrow_exception(shared.error);
+    }
+    
+    shared.result.executions = count_executions();
+    for (uint32_t worker = 0; worker < worker_count; worker++) {
+        shared.result.pruned += shared.workers[worker].pruned;
+        shared.result.exhausted += shared.workers[worker].exhausted;
+    }
+    shared.result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return shared.result;
+}
\ No newline at end of file
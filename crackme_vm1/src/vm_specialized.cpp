@@ -0,0 +1,166 @@
+#include "../include/vm_specialized.h"
+#include "../include/vm_core.h"
+#include "../include/vm_alu.h"
+#include <array>
+#include <utility>
+
+// One handler per (opcode, mode_dst, mode_src); every branch on the
+// opcode or the modes is resolved by the compiler
+template <VMOpcode Op, AddressingMode Dst, AddressingMode Src>
+bool vm_specialized_handler(const VMDecodedInstruction& instruction, ExecutionContext& context) {
+    constexpr int dst_depth = static_cast<int>(Dst);
+    constexpr int src_depth = static_cast<int>(Src);
+    
+    VirtualMachine& vm = *context.machine;
+    
+    if constexpr (Op == VMOpcode::MOV) {
+        uint16_t address = vm_resolve<dst_depth>(vm, instruction.operand1);
+        vm.write_memory(address, vm.read_memory(vm_resolve<src_depth>(vm, instruction.operand2)));
+    } else if constexpr (Op == VMOpcode::XCHG) {
+        uint16_t address1 = vm_resolve<dst_depth>(vm, instruction.operand1);
+        uint16_t address2 = vm_resolve<src_depth>(vm, instruction.operand2);
+        uint16_t value1 = vm.read_memory(address1);
+        vm.write_memory(address1, vm.read_memory(address2));
+        vm.write_memory(address2, value1);
+    } else if constexpr (Op == VMOpcode::ADD || Op == VMOpcode::SUB || Op == VMOpcode::CMP ||
+                         Op == VMOpcode::AND || Op == VMOpcode::OR || Op == VMOpcode::XOR) {
+        uint16_t address = vm_resolve<dst_depth>(vm, instruction.operand1);
+        uint16_t value2 = vm.read_memory(vm_resolve<src_depth>(vm, instruction.operand2));
+        uint16_t value1 = vm.read_memory(address);
+        
+        if constexpr (Op == VMOpcode::ADD) {
+            vm.write_memory(address, vm_lazy_add(value1, value2, context));
+        } else if constexpr (Op == VMOpcode::SUB) {
+            vm.write_memory(address, vm_lazy_sub(value1, value2, context));
+        } else if constexpr (Op == VMOpcode::CMP) {
+            vm_lazy_sub(value1, value2, context);
+        } else if constexpr (Op == VMOpcode::AND) {
+            vm.write_memory(address, vm_lazy_logic(value1 & value2, context));
+        } else if constexpr (Op == VMOpcode::OR) {
+            vm.write_memory(address, vm_lazy_logic(value1 | value2, context));
+        } else {
+            vm.write_memory(address, vm_lazy_logic(value1 ^ value2, context));
+        }
+    } else if constexpr (Op == VMOpcode::NOT || Op == VMOpcode::INC || Op == VMOpcode::DEC ||
+                         Op == VMOpcode::SHL || Op == VMOpcode::SHR ||
+                         Op == VMOpcode::ROL || Op == VMOpcode::ROR) {
+        uint16_t address = vm_resolve<dst_depth>(vm, instruction.operand1);
+        uint16_t value = vm.read_memory(address);
+        
+        if constexpr (Op == VMOpcode::NOT) {
+            vm.write_memory(address, vm_lazy_logic(~value & 0x1FFF, context));
+        } else if constexpr (Op == VMOpcode::INC) {
+            vm.write_memory(address, vm_lazy_inc(value, context));
+        } else if constexpr (Op == VMOpcode::DEC) {
+            vm.write_memory(address, vm_lazy_dec(value, context));
+        } else if constexpr (Op == VMOpcode::SHL) {
+            vm.write_memory(address, vm_lazy_shl(value, context));
+        } else if constexpr (Op == VMOpcode::SHR) {
+            vm.write_memory(address, vm_lazy_shr(value, context));
+        } else if constexpr (Op == VMOpcode::ROL) {
+            vm.write_memory(address, vm_lazy_rol(value, context));
+        } else {
+            vm.write_memory(address, vm_lazy_ror(value, context));
+        }
+    } else if constexpr (Op == VMOpcode::JMP) {
+        context.ip = vm_resolve<dst_depth>(vm, instruction.operand1);
+    } else if constexpr (Op >= VMOpcode::JZ && Op <= VMOpcode::JGE) {
+        if (vm_lazy_branch_taken(Op, context)) {
+            context.ip = vm_resolve<dst_depth>(vm, instruction.operand1);
+        }
+    } else if constexpr (Op == VMOpcode::PUSH) {
+        vm.push(vm.read_memory(vm_resolve<dst_depth>(vm, instruction.operand1)));
+    } else if constexpr (Op == VMOpcode::POP) {
+        vm.write_memory(vm_resolve<dst_depth>(vm, instruction.operand1), vm.pop());
+    } else if constexpr (Op == VMOpcode::IN) {
+        if (vm_io_input_pending(Op)) {
+            return vm.suspend_input(context);
+        }
+        vm.write_memory(vm_resolve<dst_depth>(vm, instruction.operand1), vm_io_read_char());
+    } else if constexpr (Op == VMOpcode::OUT) {
+        vm_io_write_char(vm.read_memory(vm_resolve<dst_depth>(vm, instruction.operand1)));
+    } else if constexpr (Op == VMOpcode::IN_STR) {
+        if (vm_io_input_pending(Op)) {
+            return vm.suspend_input(context);
+        }
+        vm_io_read_string(vm, vm_resolve<dst_depth>(vm, instruction.operand1));
+    } else if constexpr (Op == VMOpcode::IN_HEX) {
+        if (vm_io_input_pending(Op)) {
+            return vm.suspend_input(context);
+        }
+        vm.write_memory(vm_resolve<dst_depth>(vm, instruction.operand1), vm_io_read_hex());
+    } else if constexpr (Op == VMOpcode::CLC) {
+        vm_flags_set_carry(context, false);
+    } else if constexpr (Op == VMOpcode::STC) {
+        vm_flags_set_carry(context, true);
+    } else if constexpr (Op == VMOpcode::CMC) {
+        vm_flags_set_carry(context, !vm_flags_read(context, VM_FLAG_MASK_CARRY)[VM_FLAG_CARRY]);
+    } else if constexpr (Op == VMOpcode::HALT) {
+        return false;  // Stop execution
+    }
+    
+    return true;
+}
+
+// Opcodes with specialized handlers, in handler table order
+static constexpr VMOpcode VM_SPECIALIZED_OPCODES[] = {
+    VMOpcode::MOV, VMOpcode::XCHG, VMOpcode::ADD, VMOpcode::SUB,
+    VMOpcode::AND, VMOpcode::INC, VMOpcode::DEC, VMOpcode::OR,
+    VMOpcode::XOR, VMOpcode::NOT, VMOpcode::ROL, VMOpcode::ROR,
+    VMOpcode::SHL, VMOpcode::SHR, VMOpcode::CMP, VMOpcode::JMP,
+    VMOpcode::JZ, VMOpcode::JNZ, VMOpcode::JC, VMOpcode::JNC,
+    VMOpcode::JS, VMOpcode::JNS, VMOpcode::JO, VMOpcode::JNO,
+    VMOpcode::JL, VMOpcode::JG, VMOpcode::JLE, VMOpcode::JGE,
+    VMOpcode::CLC, VMOpcode::STC, VMOpcode::CMC, VMOpcode::PUSH,
+    VMOpcode::POP, VMOpcode::IN, VMOpcode::OUT, VMOpcode::IN_STR,
+    VMOpcode::IN_HEX, VMOpcode::NOP, VMOpcode::HALT
+};
+
+static constexpr size_t VM_SPECIALIZED_OPCODE_COUNT = 
+    sizeof(VM_SPECIALIZED_OPCODES) / sizeof(VM_SPECIALIZED_OPCODES[0]);
+
+// Handler table layout: opcode index * 16 + mode_dst * 4 + mode_src
+template <size_t Index>
+constexpr VMInstructionHandler specialized_handler_at() {
+    return &vm_specialized_handler<VM_SPECIALIZED_OPCODES[Index / 16],
+                                   static_cast<AddressingMode>((Index >> 2) & 3),
+                                   static_cast<AddressingMode>(Index & 3)>;
+}
+
+template <size_t... Indices>
+constexpr std::array<VMInstructionHandler, sizeof...(Indices)> 
+make_handler_table(std::index_sequence<Indices...>) {
+    return {{ specialized_handler_at<Indices>()... }};
+}
+
+static constexpr auto specialized_handlers = 
+    make_handler_table(std::make_index_sequence<VM_SPECIALIZED_OPCODE_COUNT * 16>());
+
+static constexpr std::array<VMDecodeInfo, 0x2000> make_decode_lut() {
+    std::array<VMDecodeInfo, 0x2000> lut = {};
+    
+    for (uint16_t word = 0; word < 0x2000; word++) {
+        // Format: OOOOOOOO OOMMDDDD (9-bit opcode, 2-bit mode1, 2-bit mode2)
+        uint16_t opcode = (word >> 4) & 0x1FF;
+        VMDecodeInfo& info = lut[word];
+        
+        info.opcode = static_cast<VMOpcode>(opcode);
+        info.mode_dst = static_cast<AddressingMode>((word >> 2) & 0x3);
+        info.mode_src = static_cast<AddressingMode>(word & 0x3);
+        info.length = 1 + VMInstruction::operand_count(opcode);
+        info.handler = vm_handler_illegal;
+        
+        for (size_t i = 0; i < VM_SPECIALIZED_OPCODE_COUNT; i++) {
+            if (static_cast<uint16_t>(VM_SPECIALIZED_OPCODES[i]) == opcode) {
+                info.handler = specialized_handlers[i * 16 + (word & 0xF)];
+                break;
+            }
+        }
+    }
+    
+    return lut;
+}
+
+static constexpr std::array<VMDecodeInfo, 0x2000> decode_lut = make_decode_lut();
+
+const VMDecodeInfo* const VM_DECODE_LUT = decode_lut.data();
\ No newline at end of file
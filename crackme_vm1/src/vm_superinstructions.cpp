@@ -0,0 +1,506 @@
+#include "../include/vm_superinstructions.h"
+#include "../include/vm_core.h"
+#include "../include/vm_alu.h"
+#include "../include/vm_specialized.h"
+#include <algorithm>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+// Signed view of a 13-bit value
+static inline int vm_signed13(uint16_t value) {
+    return static_cast<int>(value ^ 0x1000) - 0x1000;
+}
+
+// CMP semantics with the flags only recorded when read after the sequence.
+// The branch condition is evaluated straight from the operands.
+template <VMOpcode Jcc>
+static inline bool vm_compare_branch(uint16_t value1, uint16_t value2, 
+                                     uint8_t live_flags, ExecutionContext& context) {
+    bool taken;
+    
+    if constexpr (Jcc == VMOpcode::JZ) {
+        taken = value1 == value2;
+    } else if constexpr (Jcc == VMOpcode::JNZ) {
+        taken = value1 != value2;
+    } else if constexpr (Jcc == VMOpcode::JC) {
+        taken = value1 < value2;
+    } else if constexpr (Jcc == VMOpcode::JNC) {
+        taken = value1 >= value2;
+    } else if constexpr (Jcc == VMOpcode::JL) {
+        taken = vm_signed13(value1) < vm_signed13(value2);
+    } else if constexpr (Jcc == VMOpcode::JGE) {
+        taken = vm_signed13(value1) >= vm_signed13(value2);
+    } else if constexpr (Jcc == VMOpcode::JG) {
+        taken = vm_signed13(value1) > vm_signed13(value2);
+    } else if constexpr (Jcc == VMOpcode::JLE) {
+        taken = vm_signed13(value1) <= vm_signed13(value2);
+    } else {
+        bool computed[4];
+        vm_alu_sub(value1, value2, computed);
+        taken = vm_branch_taken(Jcc, computed);
+    }
+    
+    if (live_flags) {
+        vm_lazy_sub(value1, value2, context);
+    }
+    
+    return taken;
+}
+
+// Components run with IP at their own next instruction, as unfused. After
+// a component store: stop the sequence if the store rewrote the
+// instruction pointer cell or invalidated the superinstruction itself.
+static inline bool vm_fusion_interrupted(const VMDecodedInstruction& instruction,
+                                         uint16_t next, ExecutionContext& context) {
+    // Continue at the value the guest stored into IP, or with the next
+    // component through a fresh decode
+    return context.ip != next || instruction.length == 0;
+}
+
+// The core counted the first component; the others count as they start
+static inline void vm_fusion_step(ExecutionContext& context) {
+    context.machine->get_runtime().steps++;
+}
+
+// CMP a, b ; Jcc target
+template <VMOpcode Jcc>
+static bool vm_fused_cmp_jcc(const VMDecodedInstruction& instruction, ExecutionContext& context) {
+    VirtualMachine& vm = *context.machine;
+    const VMDecodedInstruction& jump = (&instruction)[3];
+    uint16_t end = context.ip;
+    uint16_t start = (end - instruction.length) & 0x1FFF;
+    
+    context.ip = start + 3;
+    uint16_t value1 = vm.read_memory(vm.resolve_operand(instruction.operand1, instruction.mode_dst));
+    uint16_t value2 = vm.read_memory(vm.resolve_operand(instruction.operand2, instruction.mode_src));
+    
+    vm_fusion_step(context);
+    context.ip = end;
+    if (vm_compare_branch<Jcc>(value1, value2, instruction.live_flags, context)) {
+        context.ip = vm.resolve_operand(jump.operand1, jump.mode_dst);
+    }
+    return true;
+}
+
+// INC a ; CMP b, c ; Jcc target (loop tail)
+template <VMOpcode Jcc>
+static bool vm_fused_inc_cmp_jcc(const VMDecodedInstruction& instruction, ExecutionContext& context) {
+    VirtualMachine& vm = *context.machine;
+    const VMDecodedInstruction& compare = (&instruction)[2];
+    const VMDecodedInstruction& jump = (&instruction)[5];
+    uint16_t end = context.ip;
+    uint16_t start = (end - instruction.length) & 0x1FFF;
+    
+    // INC flags are all overwritten by the CMP
+    context.ip = start + 2;
+    uint16_t address = vm.resolve_operand(instruction.operand1, instruction.mode_dst);
+    uint16_t value = vm.read_memory(address);
+    vm.write_memory(address, (value + 1) & 0x1FFF);
+    
+    if (vm_fusion_interrupted(instruction, start + 2, context)) {
+        vm_lazy_inc(value, context);
+        return true;
+    }
+    
+    vm_fusion_step(context);
+    context.ip = start + 5;
+    uint16_t value1 = vm.read_memory(vm.resolve_operand(compare.operand1, compare.mode_dst));
+    uint16_t value2 = vm.read_memory(vm.resolve_operand(compare.operand2, compare.mode_src));
+    
+    vm_fusion_step(context);
+    context.ip = end;
+    if (vm_compare_branch<Jcc>(value1, value2, instruction.live_flags, context)) {
+        context.ip = vm.resolve_operand(jump.operand1, jump.mode_dst);
+    }
+    return true;
+}
+
+// XOR a, b ; ROL c (mixing step)
+static bool vm_fused_xor_rol(const VMDecodedInstruction& instruction, ExecutionContext& context) {
+    VirtualMachine& vm = *context.machine;
+    const VMDecodedInstruction& rotate = (&instruction)[3];
+    uint16_t end = context.ip;
+    uint16_t start = (end - instruction.length) & 0x1FFF;
+    
+    // XOR flags are all overwritten by the ROL
+    context.ip = start + 3;
+    uint16_t address = vm.resolve_operand(instruction.operand1, instruction.mode_dst);
+    uint16_t value2 = vm.read_memory(vm.resolve_operand(instruction.operand2, instruction.mode_src));
+    uint16_t result = vm.read_memory(address) ^ value2;
+    vm.write_memory(address, result);
+    
+    if (vm_fusion_interrupted(instruction, start + 3, context)) {
+        vm_lazy_logic(result, context);
+        return true;
+    }
+    
+    vm_fusion_step(context);
+    context.ip = end;
+    address = vm.resolve_operand(rotate.operand1, rotate.mode_dst);
+    result = vm_lazy_rol(vm.read_memory(address), context);
+    vm.write_memory(address, result);
+    return true;
+}
+
+// Any other learned sequence: run the specialized component handlers
+// back to back under a single dispatch
+static bool vm_fused_generic(const VMDecodedInstruction& instruction, ExecutionContext& context) {
+    uint8_t span = instruction.length;
+    uint16_t start = (context.ip - span) & 0x1FFF;
+    const VMDecodedInstruction* component = &instruction;
+    uint8_t offset = 0;
+    
+    while (true) {
+        uint16_t word = (static_cast<uint16_t>(component->opcode) << 4) |
+                        (static_cast<uint16_t>(component->mode_dst) << 2) |
+                        static_cast<uint16_t>(component->mode_src);
+        const VMDecodeInfo& info = VM_DECODE_LUT[word & 0x1FFF];
+        if (offset) {
+            vm_fusion_step(context);
+        }
+        offset += info.length;
+        context.ip = (start + offset) & 0x1FFF;
+        
+        // A suspended read leaves IP on its own component
+        if (!info.handler(*component, context)) {
+            return false;
+        }
+        if (offset >= span) {
+            return true;
+        }
+        if (vm_fusion_interrupted(instruction, (start + offset) & 0x1FFF, context)) {
+            return true;
+        }
+        
+        component += info.length;
+    }
+}
+
+// Fused handler tables indexed by Jcc opcode - JZ
+static const VMInstructionHandler VM_FUSED_CMP_JCC[] = {
+    vm_fused_cmp_jcc<VMOpcode::JZ>, vm_fused_cmp_jcc<VMOpcode::JNZ>,
+    vm_fused_cmp_jcc<VMOpcode::JC>, vm_fused_cmp_jcc<VMOpcode::JNC>,
+    vm_fused_cmp_jcc<VMOpcode::JS>, vm_fused_cmp_jcc<VMOpcode::JNS>,
+    vm_fused_cmp_jcc<VMOpcode::JO>, vm_fused_cmp_jcc<VMOpcode::JNO>,
+    vm_fused_cmp_jcc<VMOpcode::JL>, vm_fused_cmp_jcc<VMOpcode::JG>,
+    vm_fused_cmp_jcc<VMOpcode::JLE>, vm_fused_cmp_jcc<VMOpcode::JGE>
+};
+
+static const VMInstructionHandler VM_FUSED_INC_CMP_JCC[] = {
+    vm_fused_inc_cmp_jcc<VMOpcode::JZ>, vm_fused_inc_cmp_jcc<VMOpcode::JNZ>,
+    vm_fused_inc_cmp_jcc<VMOpcode::JC>, vm_fused_inc_cmp_jcc<VMOpcode::JNC>,
+    vm_fused_inc_cmp_jcc<VMOpcode::JS>, vm_fused_inc_cmp_jcc<VMOpcode::JNS>,
+    vm_fused_inc_cmp_jcc<VMOpcode::JO>, vm_fused_inc_cmp_jcc<VMOpcode::JNO>,
+    vm_fused_inc_cmp_jcc<VMOpcode::JL>, vm_fused_inc_cmp_jcc<VMOpcode::JG>,
+    vm_fused_inc_cmp_jcc<VMOpcode::JLE>, vm_fused_inc_cmp_jcc<VMOpcode::JGE>
+};
+
+static inline bool vm_is_conditional_jump(VMOpcode opcode) {
+    return opcode >= VMOpcode::JZ && opcode <= VMOpcode::JGE;
+}
+
+VMSuperinstructions::VMSuperinstructions()
+    : pair_counts(nullptr), triple_counts(nullptr), recorded(0),
+      history_length(0), pattern_count(0), starts_mask(0) {
+    history[0] = history[1] = 0;
+}
+
+VMSuperinstructions::~VMSuperinstructions() {
+    if (pair_counts) {
+        free(pair_counts);
+        pair_counts = nullptr;
+    }
+    
+    if (triple_counts) {
+        free(triple_counts);
+        triple_counts = nullptr;
+    }
+}
+
+void VMSuperinstructions::start_profiling() {
+    if (!pair_counts) {
+        pair_counts = static_cast<uint32_t*>(
+            calloc(VM_FUSION_OPCODES * VM_FUSION_OPCODES, sizeof(uint32_t)));
+    }
+    if (!triple_counts) {
+        triple_counts = static_cast<uint32_t*>(
+            calloc(VM_FUSION_OPCODES * VM_FUSION_OPCODES * VM_FUSION_OPCODES, sizeof(uint32_t)));
+    }
+    if (!pair_counts || !triple_counts) {
+        throw std::runtime_error("Failed to allocate VM n-gram profile");
+    }
+    
+    history_length = 0;
+}
+
+void VMSuperinstructions::clear_profile() {
+    if (pair_counts) {
+        memset(pair_counts, 0, VM_FUSION_OPCODES * VM_FUSION_OPCODES * sizeof(uint32_t));
+    }
+    if (triple_counts) {
+        memset(triple_counts, 0, 
+               VM_FUSION_OPCODES * VM_FUSION_OPCODES * VM_FUSION_OPCODES * sizeof(uint32_t));
+    }
+    
+    recorded = 0;
+    history_length = 0;
+}
+
+void VMSuperinstructions::add_pattern(const VMFusionPattern& pattern) {
+    if (pattern_count >= VM_MAX_FUSION_PATTERNS) {
+        return;
+    }
+    
+    patterns[pattern_count++] = pattern;
+    starts_mask |= 1ULL << static_cast<uint16_t>(pattern.opcodes[0]);
+}
+
+void VMSuperinstructions::clear_patterns() {
+    pattern_count = 0;
+    starts_mask = 0;
+}
+
+size_t VMSuperinstructions::learn(size_t max_patterns, uint32_t min_count) {
+    clear_patterns();
+    if (!pair_counts) {
+        return 0;
+    }
+    
+    std::vector<VMFusionPattern> candidates;
+    
+    for (uint16_t op0 = 0; op0 < VM_FUSION_OPCODES; op0++) {
+        if (VMInstruction::is_control_flow(op0)) {
+            continue;
+        }
+        
+        for (uint16_t op1 = 0; op1 < VM_FUSION_OPCODES; op1++) {
+            uint32_t count = pair_counts[op0 * VM_FUSION_OPCODES + op1];
+            if (count >= min_count) {
+                VMFusionPattern pattern = {};
+                pattern.length = 2;
+                pattern.opcodes[0] = static_cast<VMOpcode>(op0);
+                pattern.opcodes[1] = static_cast<VMOpcode>(op1);
+                pattern.count = count;
+                candidates.push_back(pattern);
+            }
+            
+            if (VMInstruction::is_control_flow(op1)) {
+                continue;
+            }
+            
+            for (uint16_t op2 = 0; op2 < VM_FUSION_OPCODES; op2++) {
+                count = triple_counts[(op0 * VM_FUSION_OPCODES + op1) * VM_FUSION_OPCODES + op2];
+                if (count >= min_count) {
+                    VMFusionPattern pattern = {};
+                    pattern.length = 3;
+                    pattern.opcodes[0] = static_cast<VMOpcode>(op0);
+                    pattern.opcodes[1] = static_cast<VMOpcode>(op1);
+                    pattern.opcodes[2] = static_cast<VMOpcode>(op2);
+                    pattern.count = count;
+                    candidates.push_back(pattern);
+                }
+            }
+        }
+    }
+    
+    // A sequence of n instructions saves n - 1 dispatches per execution
+    std::sort(candidates.begin(), candidates.end(), 
+              [](const VMFusionPattern& a, const VMFusionPattern& b) {
+                  return a.count * (a.length - 1) > b.count * (b.length - 1);
+              });
+    
+    for (size_t i = 0; i < candidates.size() && pattern_count < max_patterns; i++) {
+        add_pattern(candidates[i]);
+    }
+    
+    return pattern_count;
+}
+
+bool VMSuperinstructions::save(const char* path) const {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < pattern_count; i++) {
+        const VMFusionPattern& pattern = patterns[i];
+        for (uint8_t j = 0; j < pattern.length; j++) {
+            fprintf(file, "%s ", VMInstruction::opcode_name(static_cast<uint16_t>(pattern.opcodes[j])));
+        }
+        fprintf(file, "%llu\n", static_cast<unsigned long long>(pattern.count));
+    }
+    
+    return fclose(file) == 0;
+}
+
+bool VMSuperinstructions::load(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    
+    clear_patterns();
+    
+    char line[128];
+    bool valid = true;
+    
+    while (fgets(line, sizeof(line), file)) {
+        VMFusionPattern pattern = {};
+        char* token = strtok(line, " \t\r\n");
+        
+        if (!token || token[0] == '#') {
+            continue;
+        }
+        
+        while (token) {
+            int opcode = VMInstruction::opcode_from_name(token);
+            if (opcode < 0) {
+                // Trailing execution count
+                pattern.count = strtoull(token, nullptr, 10);
+                break;
+            }
+            if (pattern.length >= VM_MAX_FUSED_INSTRUCTIONS) {
+                valid = false;
+                break;
+            }
+            pattern.opcodes[pattern.length++] = static_cast<VMOpcode>(opcode);
+            token = strtok(nullptr, " \t\r\n");
+        }
+        
+        // Control flow may only end a sequence
+        for (uint8_t i = 0; i + 1 < pattern.length; i++) {
+            if (VMInstruction::is_control_flow(static_cast<uint16_t>(pattern.opcodes[i]))) {
+                valid = false;
+            }
+        }
+        
+        if (!valid || pattern.length < 2) {
+            valid = false;
+            break;
+        }
+        
+        add_pattern(pattern);
+    }
+    
+    fclose(file);
+    
+    if (!valid) {
+        clear_patterns();
+    }
+    return valid;
+}
+
+uint8_t VMSuperinstructions::flags_live_from(VirtualMachine& vm, VMDecodeCache& cache, uint16_t ip) {
+    uint8_t live = 0;
+    uint8_t killed = 0;
+    
+    for (uint8_t step = 0; step < VM_LIVENESS_WINDOW; step++) {
+        const VMDecodeInfo& info = VM_DECODE_LUT[vm.read_memory(ip)];
+        uint16_t opcode = static_cast<uint16_t>(info.opcode);
+        
+        // Rewriting any word inspected here drops the fused entries
+        for (uint8_t i = 0; i < info.length; i++) {
+            cache.mark_liveness(ip + i);
+        }
+        
+        live |= VMInstruction::flags_read(opcode) & ~killed;
+        killed |= VMInstruction::flags_written(opcode);
+        if (killed == VM_FLAG_MASK_ALL) {
+            return live;
+        }
+        
+        // Follow direct jumps; anything else that leaves the straight line,
+        // or may rewrite the code that follows, ends the scan
+        if (info.opcode == VMOpcode::JMP && info.mode_dst == AddressingMode::DIRECT) {
+            ip = vm.read_memory((ip + 1) & 0x1FFF);
+            continue;
+        }
+        if (VMInstruction::is_control_flow(opcode) || VMInstruction::writes_memory(opcode)) {
+            break;
+        }
+        
+        ip = (ip + info.length) & 0x1FFF;
+    }
+    
+    return live | (VM_FLAG_MASK_ALL & ~killed);
+}
+
+void VMSuperinstructions::fuse(VirtualMachine& vm, VMDecodeCache& cache, 
+                               VMDecodedInstruction& entry, uint16_t ip) {
+    if (!((starts_mask >> static_cast<uint16_t>(entry.opcode)) & 1)) {
+        return;
+    }
+    
+    // Decode the instructions that follow without fusing them
+    const VMDecodedInstruction* components[VM_MAX_FUSED_INSTRUCTIONS] = { &entry };
+    uint16_t offsets[VM_MAX_FUSED_INSTRUCTIONS + 1] = { 0, entry.length };
+    uint8_t available = 1;
+    
+    while (available < VM_MAX_FUSED_INSTRUCTIONS &&
+           !VMInstruction::is_control_flow(static_cast<uint16_t>(components[available - 1]->opcode))) {
+        uint32_t address = static_cast<uint32_t>(ip) + offsets[available];
+        if (address >= VM_DECODE_CACHE_ENTRIES) {
+            break;  // Superinstructions never wrap around the address space
+        }
+        
+        components[available] = &cache.lookup_unfused(vm, static_cast<uint16_t>(address));
+        offsets[available + 1] = offsets[available] + 
+            1 + VMInstruction::operand_count(static_cast<uint16_t>(components[available]->opcode));
+        available++;
+    }
+    
+    // Longest matching pattern wins
+    const VMFusionPattern* match = nullptr;
+    for (size_t i = 0; i < pattern_count; i++) {
+        const VMFusionPattern& pattern = patterns[i];
+        if (pattern.length > available || (match && match->length >= pattern.length)) {
+            continue;
+        }
+        
+        bool matches = true;
+        for (uint8_t j = 0; j < pattern.length && matches; j++) {
+            matches = components[j]->opcode == pattern.opcodes[j];
+        }
+        if (matches) {
+            match = &pattern;
+        }
+    }
+    
+    if (!match || ip + offsets[match->length] > VM_DECODE_CACHE_ENTRIES) {
+        return;
+    }
+    
+    uint16_t end = (ip + offsets[match->length]) & 0x1FFF;
+    VMOpcode last = match->opcodes[match->length - 1];
+    VMInstructionHandler handler = vm_fused_generic;
+    uint8_t live_flags = VM_FLAG_MASK_ALL;
+    
+    if (match->length == 2 && match->opcodes[0] == VMOpcode::CMP && vm_is_conditional_jump(last)) {
+        handler = VM_FUSED_CMP_JCC[static_cast<uint16_t>(last) - static_cast<uint16_t>(VMOpcode::JZ)];
+    } else if (match->length == 3 && match->opcodes[0] == VMOpcode::INC &&
+               match->opcodes[1] == VMOpcode::CMP && vm_is_conditional_jump(last)) {
+        handler = VM_FUSED_INC_CMP_JCC[static_cast<uint16_t>(last) - static_cast<uint16_t>(VMOpcode::JZ)];
+    } else if (match->length == 2 && match->opcodes[0] == VMOpcode::XOR && last == VMOpcode::ROL) {
+        handler = vm_fused_xor_rol;
+    }
+    
+    if (handler != vm_fused_generic) {
+        const VMDecodedInstruction& tail = *components[match->length - 1];
+        live_flags = flags_live_from(vm, cache, end);
+        
+        // Taken branches continue at the target as well
+        if (vm_is_conditional_jump(last)) {
+            if (tail.mode_dst == AddressingMode::DIRECT) {
+                live_flags |= flags_live_from(vm, cache, tail.operand1 & 0x1FFF);
+            } else {
+                live_flags = VM_FLAG_MASK_ALL;
+            }
+        }
+    }
+    
+    entry.handler = handler;
+    entry.live_flags = live_flags;
+    entry.length = static_cast<uint8_t>(offsets[match->length]);
+}
\ No newline at end of file
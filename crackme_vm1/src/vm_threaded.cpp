@@ -0,0 +1,272 @@
+#include "../include/vm_core.h"
+#include "../include/vm_alu.h"
+
+// Direct-threaded interpreter core.
+// With GCC/Clang labels-as-values every handler ends in its own indirect
+// jump, so the host predictor sees one dispatch site per opcode instead of
+// the single shared switch branch. Other compilers fall back to a switch.
+#if !defined(VM_NO_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+#define VM_USE_COMPUTED_GOTO 1
+#else
+#define VM_USE_COMPUTED_GOTO 0
+#endif
+
+#if VM_USE_COMPUTED_GOTO
+#define VM_HANDLER(name) op_##name:
+#define VM_DISPATCH()                                                      \
+    do {                                                                   \
+        if (faulted()) {                                                   \
+            return;                                                        \
+        }                                                                  \
+        decode_cache.invalidate_register_cells();                          \
+        ip = context.ip;                                                   \
+        instruction = &decode_cache.lookup(*this, ip);                     \
+        context.ip = (ip + instruction->length) & 0x1FFF;                  \
+        runtime.steps++;                                                   \
+        goto *dispatch_table[static_cast<uint16_t>(instruction->opcode) & 0x1FF]; \
+    } while (0)
+#else
+#define VM_HANDLER(name) case VMOpcode::name:
+#define VM_DISPATCH() continue
+#endif
+
+// Resolved operand addresses of the current instruction
+#define VM_OPERAND1() resolve_operand(instruction->operand1, instruction->mode_dst)
+#define VM_OPERAND2() resolve_operand(instruction->operand2, instruction->mode_src)
+
+// Conditional jump handler body
+#define VM_JUMP_IF(condition)                                              \
+    if (condition) {                                                       \
+        context.ip = VM_OPERAND1();                                        \
+    }                                                                      \
+    VM_DISPATCH()
+
+void VirtualMachine::run_threaded(ExecutionContext& context) {
+    uint16_t ip;
+    const VMDecodedInstruction* instruction;
+    
+#if VM_USE_COMPUTED_GOTO
+    // One slot per 9-bit opcode, unknown opcodes stop execution. Built
+    // once by the compiler: slots 0x00-0x2F by value, the rest illegal.
+#define VM_ILLEGAL_8 &&op_ILLEGAL, &&op_ILLEGAL, &&op_ILLEGAL, &&op_ILLEGAL, \
+                     &&op_ILLEGAL, &&op_ILLEGAL, &&op_ILLEGAL, &&op_ILLEGAL
+#define VM_ILLEGAL_64 VM_ILLEGAL_8, VM_ILLEGAL_8, VM_ILLEGAL_8, VM_ILLEGAL_8, \
+                      VM_ILLEGAL_8, VM_ILLEGAL_8, VM_ILLEGAL_8, VM_ILLEGAL_8
+    static const void* const dispatch_table[0x200] = {
+        /* 00 */ &&op_ILLEGAL, &&op_MOV, &&op_XCHG, &&op_ADD, &&op_SUB, &&op_AND, &&op_INC, &&op_DEC,
+        /* 08 */ &&op_OR, &&op_XOR, &&op_NOT, &&op_ROL, &&op_ROR, &&op_SHL, &&op_SHR, &&op_CMP,
+        /* 10 */ &&op_JMP, &&op_JZ, &&op_JNZ, &&op_JC, &&op_JNC, &&op_JS, &&op_JNS, &&op_JO,
+        /* 18 */ &&op_JNO, &&op_JL, &&op_JG, &&op_JLE, &&op_JGE, &&op_ILLEGAL, &&op_ILLEGAL, &&op_CLC,
+        /* 20 */ &&op_STC, &&op_CMC, &&op_PUSH, &&op_POP, &&op_IN, &&op_OUT, &&op_IN_STR, &&op_IN_HEX,
+        /* 28 */ &&op_NOP, &&op_HALT, &&op_ILLEGAL, &&op_ILLEGAL, &&op_ILLEGAL, &&op_ILLEGAL, &&op_ILLEGAL, &&op_ILLEGAL,
+        /* 30 */ VM_ILLEGAL_8, VM_ILLEGAL_8,
+        /* 40 */ VM_ILLEGAL_64, VM_ILLEGAL_64, VM_ILLEGAL_64, VM_ILLEGAL_64,
+                 VM_ILLEGAL_64, VM_ILLEGAL_64, VM_ILLEGAL_64
+    };
+#undef VM_ILLEGAL_64
+#undef VM_ILLEGAL_8
+    
+    VM_DISPATCH();
+#else
+    for (;;) {
+        if (faulted()) {
+            return;
+        }
+        decode_cache.invalidate_register_cells();
+        ip = context.ip;
+        instruction = &decode_cache.lookup(*this, ip);
+        context.ip = (ip + instruction->length) & 0x1FFF;
+        runtime.steps++;
+        
+        switch (instruction->opcode) {
+#endif
+    
+    VM_HANDLER(MOV) {
+        uint16_t address = VM_OPERAND1();
+        write_memory(address, read_memory(VM_OPERAND2()));
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(XCHG) {
+        uint16_t address1 = VM_OPERAND1();
+        uint16_t address2 = VM_OPERAND2();
+        uint16_t value1 = read_memory(address1);
+        write_memory(address1, read_memory(address2));
+        write_memory(address2, value1);
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(ADD) {
+        uint16_t address = VM_OPERAND1();
+        uint16_t value2 = read_memory(VM_OPERAND2());
+        write_memory(address, vm_lazy_add(read_memory(address), value2, context));
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(SUB) {
+        uint16_t address = VM_OPERAND1();
+        uint16_t value2 = read_memory(VM_OPERAND2());
+        write_memory(address, vm_lazy_sub(read_memory(address), value2, context));
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(CMP) {
+        uint16_t value1 = read_memory(VM_OPERAND1());
+        vm_lazy_sub(value1, read_memory(VM_OPERAND2()), context);
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(AND) {
+        uint16_t address = VM_OPERAND1();
+        uint16_t value2 = read_memory(VM_OPERAND2());
+        write_memory(address, vm_lazy_logic(read_memory(address) & value2, context));
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(OR) {
+        uint16_t address = VM_OPERAND1();
+        uint16_t value2 = read_memory(VM_OPERAND2());
+        write_memory(address, vm_lazy_logic(read_memory(address) | value2, context));
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(XOR) {
+        uint16_t address = VM_OPERAND1();
+        uint16_t value2 = read_memory(VM_OPERAND2());
+        write_memory(address, vm_lazy_logic(read_memory(address) ^ value2, context));
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(NOT) {
+        uint16_t address = VM_OPERAND1();
+        write_memory(address, vm_lazy_logic(~read_memory(address) & 0x1FFF, context));
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(INC) {
+        uint16_t address = VM_OPERAND1();
+        write_memory(address, vm_lazy_inc(read_memory(address), context));
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(DEC) {
+        uint16_t address = VM_OPERAND1();
+        write_memory(address, vm_lazy_dec(read_memory(address), context));
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(SHL) {
+        uint16_t address = VM_OPERAND1();
+        write_memory(address, vm_lazy_shl(read_memory(address), context));
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(SHR) {
+        uint16_t address = VM_OPERAND1();
+        write_memory(address, vm_lazy_shr(read_memory(address), context));
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(ROL) {
+        uint16_t address = VM_OPERAND1();
+        write_memory(address, vm_lazy_rol(read_memory(address), context));
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(ROR) {
+        uint16_t address = VM_OPERAND1();
+        write_memory(address, vm_lazy_ror(read_memory(address), context));
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(JMP) { VM_JUMP_IF(true); }
+    VM_HANDLER(JZ)  { VM_JUMP_IF(vm_lazy_branch_taken(VMOpcode::JZ, context)); }
+    VM_HANDLER(JNZ) { VM_JUMP_IF(vm_lazy_branch_taken(VMOpcode::JNZ, context)); }
+    VM_HANDLER(JC)  { VM_JUMP_IF(vm_lazy_branch_taken(VMOpcode::JC, context)); }
+    VM_HANDLER(JNC) { VM_JUMP_IF(vm_lazy_branch_taken(VMOpcode::JNC, context)); }
+    VM_HANDLER(JS)  { VM_JUMP_IF(vm_lazy_branch_taken(VMOpcode::JS, context)); }
+    VM_HANDLER(JNS) { VM_JUMP_IF(vm_lazy_branch_taken(VMOpcode::JNS, context)); }
+    VM_HANDLER(JO)  { VM_JUMP_IF(vm_lazy_branch_taken(VMOpcode::JO, context)); }
+    VM_HANDLER(JNO) { VM_JUMP_IF(vm_lazy_branch_taken(VMOpcode::JNO, context)); }
+    VM_HANDLER(JL)  { VM_JUMP_IF(vm_lazy_branch_taken(VMOpcode::JL, context)); }
+    VM_HANDLER(JG)  { VM_JUMP_IF(vm_lazy_branch_taken(VMOpcode::JG, context)); }
+    VM_HANDLER(JLE) { VM_JUMP_IF(vm_lazy_branch_taken(VMOpcode::JLE, context)); }
+    VM_HANDLER(JGE) { VM_JUMP_IF(vm_lazy_branch_taken(VMOpcode::JGE, context)); }
+    
+    VM_HANDLER(CLC) {
+        vm_flags_set_carry(context, false);
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(STC) {
+        vm_flags_set_carry(context, true);
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(CMC) {
+        vm_flags_set_carry(context, !vm_flags_read(context, VM_FLAG_MASK_CARRY)[VM_FLAG_CARRY]);
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(PUSH) {
+        push(read_memory(VM_OPERAND1()));
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(POP) {
+        write_memory(VM_OPERAND1(), pop());
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(IN) {
+        if (vm_io_input_pending(VMOpcode::IN)) {
+            suspend_input(context);
+            return;
+        }
+        write_memory(VM_OPERAND1(), vm_io_read_char());
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(OUT) {
+        vm_io_write_char(read_memory(VM_OPERAND1()));
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(IN_STR) {
+        if (vm_io_input_pending(VMOpcode::IN_STR)) {
+            suspend_input(context);
+            return;
+        }
+        vm_io_read_string(*this, VM_OPERAND1());
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(IN_HEX) {
+        if (vm_io_input_pending(VMOpcode::IN_HEX)) {
+            suspend_input(context);
+            return;
+        }
+        write_memory(VM_OPERAND1(), vm_io_read_hex());
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(NOP) {
+        VM_DISPATCH();
+    }
+    
+    VM_HANDLER(HALT) {
+        return;
+    }
+    
+#if VM_USE_COMPUTED_GOTO
+op_ILLEGAL:
+    // Unknown opcodes stop execution
+    return;
+#else
+            default:
+                // Unknown opcodes stop execution
+                return;
+        }
+    }
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "../include/vm_trace.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+VMTracer::VMTracer(uint32_t capacity)
+    : records(nullptr), mask(capacity - 1), head(0), tail(0),
+      state(State::WAITING), steps(0), recorded(0), dropped(0), countdown(1),
+      sample_interval(1), trigger_ip(-1), stop_ip(-1), record_limit(0) {
+    if (capacity == 0 || (capacity & (capacity - 1))) {
+        throw std::invalid_argument("Trace capacity must be a power of two");
+    }
+    records = new VMTraceRecord[capacity];
+}
+
+VMTracer::~VMTracer() {
+    delete[] records;
+    records = nullptr;
+}
+
+void VMTracer::restart() {
+    state = State::WAITING;
+    recorded = 0;
+    countdown = sample_interval;
+}
+
+size_t VMTracer::drain(VMTraceRecord* output, size_t count) {
+    uint64_t position = tail.load(std::memory_order_relaxed);
+    uint64_t available = head.load(std::memory_order_acquire) - position;
+    size_t taken = static_cast<size_t>(std::min<uint64_t>(available, count));
+    
+    for (size_t index = 0; index < taken; index++) {
+        output[index] = records[(position + index) & mask];
+    }
+    tail.store(position + taken, std::memory_order_release);
+    return taken;
+}
+
+static void vm_trace_put(FILE* output, uint32_t value, int bytes) {
+    for (int byte = 0; byte < bytes; byte++) {
+        fputc((value >> (byte * 8)) & 0xFF, output);
+    }
+}
+
+VMTraceWriter::VMTraceWriter(FILE* output, uint32_t interval_ms)
+    : output(output), interval_ms(interval_ms ? interval_ms : 1), buffer(VM_TRACE_DEFAULT_CAPACITY),
+      next_id(0), stopping(false) {
+    vm_trace_put(output, VM_TRACE_FILE_MAGIC, 4);
+    vm_trace_put(output, VM_TRACE_FILE_VERSION, 2);
+    vm_trace_put(output, sizeof(VMTraceRecord), 2);
+    
+    thread = std::thread(&VMTraceWriter::run, this);
+}
+
+VMTraceWriter::~VMTraceWriter() {
+    close();
+}
+
+uint32_t VMTraceWriter::add(VMTracer& tracer) {
+    std::lock_guard<std::mutex> guard(lock);
+    sources.push_back({ &tracer, next_id });
+    return next_id++;
+}
+
+void VMTraceWriter::remove(VMTracer& tracer) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (size_t index = 0; index < sources.size(); index++) {
+        if (sources[index].tracer == &tracer) {
+            while (drain_source(sources[index])) {
+            }
+            sources.erase(sources.begin() + index);
+            return;
+        }
+    }
+}
+
+// Called with the lock held; returns the records written
+size_t VMTraceWriter::drain_source(const Source& source) {
+    size_t count = source.tracer->drain(buffer.data(), buffer.size());
+    if (count) {
+        vm_trace_put(output, source.id, 4);
+        vm_trace_put(output, static_cast<uint32_t>(count), 4);
+        fwrite(buffer.data(), sizeof(VMTraceRecord), count, output);
+    }
+    return count;
+}
+
+void VMTraceWriter::run() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stopping) {
+        size_t written = 0;
+        for (const Source& source : sources) {
+            written += drain_source(source);
+        }
+        
+        // Keep going while the machines keep up with a full buffer
+        if (written < buffer.size()) {
+            wake.wait_for(guard, std::chrono::milliseconds(interval_ms));
+        }
+    }
+    
+    for (const Source& source : sources) {
+        while (drain_source(source)) {
+        }
+    }
+    fflush(output);
+}
+
+void VMTraceWriter::close() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (stopping) {
+            return;
+        }
+        stopping = true;
+    }
+    
+    wake.notify_one();
+    thread.join();
+    sources.clear();
+}
\ No newline at end of file
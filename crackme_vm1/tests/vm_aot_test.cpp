@@ -0,0 +1,69 @@
+#include "vm_test_random.h"
+
+// Programs translated by vm_aot against the reference core. The build
+// writes the image of each random program below, runs vm_aot on it and
+// links the translation in; this test regenerates the same programs and
+// runs them with the translation attached. Self-modifying programs leave
+// the translation at their first store into code, the others run to HALT
+// in translated code. Translated code does not count steps, so step
+// counts are not compared.
+
+constexpr uint32_t TEST_INPUTS_PER_PROGRAM = 8;
+constexpr uint32_t TEST_SELF_MODIFYING = 4;     // Seeds above are translated without self-modification
+
+// vm_aot_test_program_<seed>, seeds 1 to 8 (see CMakeLists.txt)
+extern const VMAotProgram vm_aot_test_program_1;
+extern const VMAotProgram vm_aot_test_program_2;
+extern const VMAotProgram vm_aot_test_program_3;
+extern const VMAotProgram vm_aot_test_program_4;
+extern const VMAotProgram vm_aot_test_program_5;
+extern const VMAotProgram vm_aot_test_program_6;
+extern const VMAotProgram vm_aot_test_program_7;
+extern const VMAotProgram vm_aot_test_program_8;
+
+static const VMAotProgram* const TEST_TRANSLATIONS[] = {
+    &vm_aot_test_program_1, &vm_aot_test_program_2, &vm_aot_test_program_3, &vm_aot_test_program_4,
+    &vm_aot_test_program_5, &vm_aot_test_program_6, &vm_aot_test_program_7, &vm_aot_test_program_8,
+};
+
+static const VMTestConfig TEST_AOT_CONFIG = {
+    "aot", VMMemoryMode::SHADOW, VMDispatchMode::EXECUTOR, VMFusionMode::OFF, false
+};
+
+static VMTestState run_translated(const VMTestProgram& program, const VMAotProgram* translation,
+                                  const std::string& input) {
+    VMTestMachine machine(program, TEST_AOT_CONFIG);
+    VirtualMachine& vm = machine.vm;
+    vm.set_aot_program(translation);
+    
+    VMMemoryIO io;
+    io.input = input;
+    io.input_position = 0;
+    io.suspend = false;
+    vm.get_runtime().memory_io = &io;
+    
+    VMStatus status = vm.execute();
+    vm.get_runtime().memory_io = nullptr;
+    return vm_test_capture(vm, status, io.output);
+}
+
+int main() {
+    uint32_t seed = 1;
+    for (const VMAotProgram* translation : TEST_TRANSLATIONS) {
+        RandomProgram generator(seed, seed <= TEST_SELF_MODIFYING);
+        VMTestProgram program = generator.generate();
+        
+        for (uint32_t run = 0; run < TEST_INPUTS_PER_PROGRAM; run++) {
+            std::string input = generator.input();
+            char what[48];
+            snprintf(what, sizeof(what), "program %u input %u", seed, run);
+            
+            VMTestState reference = vm_test_run(program, VM_TEST_REFERENCE, input);
+            VMTestState state = run_translated(program, translation, input);
+            state.steps = reference.steps;
+            vm_test_same(what, TEST_AOT_CONFIG, reference, state);
+        }
+        seed++;
+    }
+    return vm_test_result("vm_aot_test");
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#include "vm_test_random.h"
+#include <cstdlib>
+#include <cstring>
+
+// Build step of vm_aot_test: vm_aot_test_image <image> <seed> [static]
+// writes the packed image of the random program with that seed, without
+// self-modification when static is given, for vm_aot to translate.
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: vm_aot_test_image <image> <seed> [static]\n");
+        return 2;
+    }
+    
+    bool self_modifying = argc < 4 || strcmp(argv[3], "static") != 0;
+    RandomProgram generator(static_cast<uint32_t>(strtoul(argv[2], nullptr, 0)), self_modifying);
+    VMTestProgram program = generator.generate();
+    
+    VirtualMachine vm(0x3404, VMMemoryMode::SHADOW);
+    vm.initialize();
+    program.load(vm);
+    
+    FILE* output = fopen(argv[1], "wb");
+    if (!output) {
+        fprintf(stderr, "vm_aot_test_image: cannot create %s\n", argv[1]);
+        return 1;
+    }
+    size_t written = fwrite(vm.get_memory_buffer(), 1, vm.get_buffer_size(), output);
+    fclose(output);
+    return written == vm.get_buffer_size() ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "vm_test_random.h"
+#include "../include/vm_batch.h"
+#include <algorithm>
+
+// Batched lanes against the reference core. Every random program runs
+// with more inputs than lanes, so finished lanes are refilled while the
+// others are still running, then once more under a step limit that stops
+// at least half of the runs one step short of the median length.
+
+constexpr uint32_t TEST_PROGRAMS = 40;
+constexpr uint32_t TEST_BATCHES_PER_LANE = 3;   // Inputs per lane and program
+
+template <uint32_t Lanes>
+static void check_batch(const char* what, const VMTestProgram& program, const std::vector<std::string>& inputs,
+                        const std::vector<VMTestState>& references, uint64_t step_limit) {
+    VirtualMachine vm(0x3404, VMMemoryMode::SHADOW);
+    vm.initialize();
+    program.load(vm);
+    
+    VMBatch<Lanes> batch;
+    batch.load_image(vm.get_memory_buffer(), vm.get_buffer_size());
+    batch.set_step_limit(step_limit);
+    for (const std::string& input : inputs) {
+        batch.add_input(input);
+    }
+    
+    std::vector<bool> reported(inputs.size(), false);
+    batch.run([&](const VMBatchResult& result) {
+        if (!VM_TEST_CHECK(result.input_index < inputs.size() && !reported[result.input_index])) {
+            return;
+        }
+        reported[result.input_index] = true;
+        const VMTestState& reference = references[result.input_index];
+        
+        // Runs stopped by the limit have nothing to compare but their length
+        if (reference.steps > step_limit) {
+            if (!VM_TEST_CHECK(result.status == VMBatchStatus::STEP_LIMIT && result.steps == step_limit)) {
+                fprintf(stderr, "%s (%u lanes): input %zu\n", what, Lanes, result.input_index);
+            }
+            return;
+        }
+        
+        VMTestState state;
+        for (uint16_t address = 0; address < VM_MEMORY_SIZE; address++) {
+            state.memory.push_back(result.read_memory(address));
+        }
+        state.flags = static_cast<uint8_t>(result.flags[VM_FLAG_SIGN] << VM_FLAG_SIGN |
+                                           result.flags[VM_FLAG_ZERO] << VM_FLAG_ZERO |
+                                           result.flags[VM_FLAG_CARRY] << VM_FLAG_CARRY |
+                                           result.flags[VM_FLAG_OVERFLOW] << VM_FLAG_OVERFLOW);
+        VM_TEST_CHECK(result.status == VMBatchStatus::HALTED);
+        state.status = VMStatus::OK;
+        state.output = *result.output;
+        state.steps = result.steps;
+        
+        char name[48];
+        snprintf(name, sizeof(name), "batch-%u-input-%zu", Lanes, result.input_index);
+        VMTestConfig config = VM_TEST_REFERENCE;
+        config.name = name;
+        vm_test_same(what, config, reference, state);
+    });
+    
+    for (size_t index = 0; index < inputs.size(); index++) {
+        if (!reported[index]) {
+            fprintf(stderr, "%s (%u lanes): no result for input %zu\n", what, Lanes, index);
+            vm_test_failures++;
+        }
+    }
+}
+
+template <uint32_t Lanes>
+static void test_lanes() {
+    for (uint32_t seed = 1; seed <= TEST_PROGRAMS; seed++) {
+        RandomProgram generator(seed);
+        VMTestProgram program = generator.generate();
+        
+        std::vector<std::string> inputs;
+        std::vector<VMTestState> references;
+        std::vector<uint64_t> steps;
+        for (uint32_t index = 0; index < Lanes * TEST_BATCHES_PER_LANE + 1; index++) {
+            inputs.push_back(generator.input());
+            references.push_back(vm_test_run(program, VM_TEST_REFERENCE, inputs.back()));
+            VM_TEST_CHECK(references.back().status == VMStatus::OK);
+            steps.push_back(references.back().steps);
+        }
+        std::nth_element(steps.begin(), steps.begin() + steps.size() / 2, steps.end());
+        
+        char what[32];
+        snprintf(what, sizeof(what), "program %u", seed);
+        check_batch<Lanes>(what, program, inputs, references, VM_BATCH_DEFAULT_STEP_LIMIT);
+        
+        snprintf(what, sizeof(what), "program %u limited", seed);
+        check_batch<Lanes>(what, program, inputs, references, steps[steps.size() / 2] - 1);
+    }
+}
+
+int main() {
+    test_lanes<8>();
+    test_lanes<16>();
+    test_lanes<32>();
+    return vm_test_result("vm_batch_test");
+}
\ No newline at end of file
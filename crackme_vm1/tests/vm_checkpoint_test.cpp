@@ -0,0 +1,147 @@
+#include "vm_test_random.h"
+#include "../include/vm_checkpoint.h"
+#include <stdexcept>
+
+// Checkpoint trees against the states they were captured from. A random
+// program runs, then random stores and flag changes alternate with
+// checkpoints and with restores of earlier ones, so later checkpoints
+// branch off the middle of the log. Every checkpoint is restored again at
+// the end, in place and on a packed machine reading the log from a file,
+// and damaged files must be rejected.
+
+constexpr uint32_t TEST_CHECKPOINTS = 20;
+constexpr uint32_t TEST_STORES = 40;            // Stores between checkpoints
+constexpr uint16_t TEST_BLOCK_WORDS = 64;
+constexpr uint32_t TEST_SEED = 7;
+
+// Header: magic, version, block size, checkpoint count
+constexpr size_t TEST_HEADER_BYTES = 12;
+// Checkpoint: id, parent, IP, SP, flags, block count
+constexpr size_t TEST_CHECKPOINT_BYTES = 15;
+
+// Memory and flags; restores do not rewind the step count
+static VMTestState capture(VirtualMachine& vm) {
+    VMTestState state = vm_test_capture(vm, VMStatus::OK, std::string());
+    state.steps = 0;
+    return state;
+}
+
+static std::vector<uint8_t> write_log(VMCheckpointLog& log) {
+    FILE* file = tmpfile();
+    log.write(file);
+    std::vector<uint8_t> bytes(static_cast<size_t>(ftell(file)));
+    rewind(file);
+    VM_TEST_CHECK(fread(bytes.data(), 1, bytes.size(), file) == bytes.size());
+    fclose(file);
+    return bytes;
+}
+
+static void read_log(VMCheckpointLog& log, const std::vector<uint8_t>& bytes) {
+    FILE* file = tmpfile();
+    fwrite(bytes.data(), 1, bytes.size(), file);
+    rewind(file);
+    try {
+        log.read(file);
+    } catch (...) {
+        fclose(file);
+        throw;
+    }
+    fclose(file);
+}
+
+static void check_restores(const char* what, VirtualMachine& vm, const std::vector<VMTestState>& states) {
+    for (uint32_t id = states.size(); id-- > 0; ) {
+        vm.restore(id);
+        VM_TEST_CHECK(vm.get_checkpoint_log()->get_head() == id);
+        
+        char name[32];
+        snprintf(name, sizeof(name), "checkpoint %u", id);
+        VMTestConfig config = VM_TEST_REFERENCE;
+        config.name = name;
+        vm_test_same(what, config, states[id], capture(vm));
+    }
+}
+
+static bool rejected(const std::vector<uint8_t>& bytes) {
+    VMCheckpointLog log(TEST_BLOCK_WORDS);
+    try {
+        read_log(log, bytes);
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+int main() {
+    std::mt19937 random(TEST_SEED);
+    VirtualMachine vm(0x3404, VMMemoryMode::SHADOW, TEST_BLOCK_WORDS);
+    vm.initialize();
+    
+    RandomProgram generator(TEST_SEED);
+    VMTestProgram program = generator.generate();
+    program.load(vm);
+    
+    std::vector<VMTestState> states;
+    std::vector<uint32_t> parents;
+    states.push_back(capture(vm));
+    parents.push_back(VM_CHECKPOINT_NONE);
+    VM_TEST_CHECK(vm.checkpoint() == 0);
+    
+    // Guest stores first, then host ones
+    VMMemoryIO io;
+    io.input = generator.input();
+    io.input_position = 0;
+    io.suspend = false;
+    vm.get_runtime().memory_io = &io;
+    VM_TEST_CHECK(vm.execute() == VMStatus::OK);
+    vm.get_runtime().memory_io = nullptr;
+    
+    while (states.size() < TEST_CHECKPOINTS) {
+        uint32_t parent = vm.get_checkpoint_log()->get_head();
+        for (uint32_t store = 0; store < TEST_STORES; store++) {
+            vm.write_memory(static_cast<uint16_t>(random() % VM_STACK_POINTER), static_cast<uint16_t>(random() & 0x1FFF));
+        }
+        vm.write_memory(VM_STACK_POINTER, static_cast<uint16_t>(random() & 0x1FFF));
+        vm.write_memory(VM_INSTRUCTION_POINTER, static_cast<uint16_t>(random() & 0x1FFF));
+        vm.set_carry_flag(random() & 1);
+        vm.set_zero_flag(random() & 1);
+        
+        states.push_back(capture(vm));
+        parents.push_back(parent);
+        VM_TEST_CHECK(vm.checkpoint() == states.size() - 1);
+        
+        // Every third checkpoint branches off a random earlier one
+        if (states.size() % 3 == 0) {
+            vm.restore(static_cast<uint32_t>(random() % (states.size() - 1)));
+        }
+    }
+    
+    VMCheckpointLog* log = vm.get_checkpoint_log();
+    for (uint32_t id = 0; id < states.size(); id++) {
+        VM_TEST_CHECK(log->get_checkpoint(id).parent == parents[id]);
+    }
+    check_restores("in place", vm, states);
+    
+    // Round trip through a file into a machine of another memory mode
+    std::vector<uint8_t> bytes = write_log(*log);
+    VirtualMachine packed(0x3404, VMMemoryMode::PACKED, TEST_BLOCK_WORDS);
+    packed.initialize();
+    read_log(*packed.get_checkpoint_log(), bytes);
+    VM_TEST_CHECK(packed.get_checkpoint_log()->get_checkpoint_count() == states.size());
+    check_restores("packed from file", packed, states);
+    
+    // A file cut short, and a checkpoint whose parent follows it
+    VM_TEST_CHECK(!rejected(bytes));
+    std::vector<uint8_t> truncated(bytes.begin(), bytes.end() - 3);
+    VM_TEST_CHECK(rejected(truncated));
+    
+    const VMCheckpoint& first = log->get_checkpoint(0);
+    size_t second = TEST_HEADER_BYTES + TEST_CHECKPOINT_BYTES + first.blocks.size() * 2 +
+                    (first.words.size() * 13 + 7) / 8;
+    std::vector<uint8_t> corrupt = bytes;
+    VM_TEST_CHECK(corrupt[second] == 1 && corrupt[second + 4] == 0);
+    corrupt[second + 4] = 5;
+    VM_TEST_CHECK(rejected(corrupt));
+    
+    return vm_test_result("vm_checkpoint_test");
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "vm_test.h"
+#include "../include/vm_corpus.h"
+#include <cstring>
+#include <stdexcept>
+
+// Corpus pipeline against the reference core, and results files whose
+// last chunk claims more rows than it holds.
+
+constexpr const char* TEST_CORPUS_PATH = "vm_corpus_test.vmc";
+constexpr uint16_t TEST_CHARACTER = 0x100;
+constexpr uint16_t TEST_EXPECTED = 0x101;
+
+static const char* const TEST_INPUTS[] = { "a", "b", "c", "bb" };
+constexpr size_t TEST_INPUT_COUNT = sizeof(TEST_INPUTS) / sizeof(TEST_INPUTS[0]);
+
+// IN c ; OUT c ; CMP c, 'b' ; HALT
+static VMTestProgram echo_program() {
+    VMTestProgram program;
+    program.emit(VMOpcode::IN, TEST_CHARACTER);
+    program.emit(VMOpcode::OUT, TEST_CHARACTER);
+    program.emit(VMOpcode::CMP, TEST_CHARACTER, TEST_EXPECTED);
+    program.emit(VMOpcode::HALT);
+    program.set(TEST_EXPECTED, 'b');
+    return program;
+}
+
+static void write_corpus() {
+    FILE* output = fopen(TEST_CORPUS_PATH, "wb");
+    VM_TEST_CHECK(output != nullptr);
+    VMCorpus::write_header(output);
+    for (const char* input : TEST_INPUTS) {
+        VMCorpus::write_record(output, input, static_cast<uint32_t>(strlen(input)));
+    }
+    fclose(output);
+}
+
+static uint64_t read_rows(FILE* results, std::vector<VMCorpusResult>& rows) {
+    rewind(results);
+    rows.clear();
+    vm_corpus_read_results(results, [&rows](uint64_t index, const VMCorpusResult& result) {
+        VM_TEST_CHECK(index == rows.size());
+        rows.push_back(result);
+    });
+    return rows.size();
+}
+
+static void test_pipeline() {
+    VMTestProgram program = echo_program();
+    VirtualMachine vm(0x3404, VMMemoryMode::SHADOW);
+    vm.initialize();
+    program.load(vm);
+    write_corpus();
+    
+    for (VMDispatchMode dispatch_mode : { VMDispatchMode::THREADED, VMDispatchMode::EXECUTOR }) {
+        VMCorpus corpus(TEST_CORPUS_PATH);
+        VMCorpusPipeline pipeline(vm.get_memory_buffer(), vm.get_buffer_size());
+        pipeline.set_threads(2);
+        pipeline.set_batch_records(3);
+        pipeline.set_dispatch_mode(dispatch_mode);
+        
+        FILE* results = tmpfile();
+        VMCorpusSummary summary = pipeline.run(corpus, results);
+        VM_TEST_CHECK(summary.records == TEST_INPUT_COUNT);
+        
+        std::vector<VMCorpusResult> rows;
+        VM_TEST_CHECK(read_rows(results, rows) == TEST_INPUT_COUNT);
+        for (size_t row = 0; row < rows.size() && row < TEST_INPUT_COUNT; row++) {
+            VMTestState reference = vm_test_run(program, VM_TEST_REFERENCE, TEST_INPUTS[row]);
+            VM_TEST_CHECK(rows[row].status == reference.status);
+            VM_TEST_CHECK(rows[row].flags == reference.flags);
+            VM_TEST_CHECK(rows[row].steps == 4);
+        }
+        
+        // A chunk claiming 2^32 - 1 rows holding a few bytes: the rows
+        // before it are read, then the short read is reported
+        const uint8_t corrupt[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0, 0, 0 };
+        fseek(results, 0, SEEK_END);
+        fwrite(corrupt, 1, sizeof(corrupt), results);
+        
+        bool rejected = false;
+        try {
+            read_rows(results, rows);
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        VM_TEST_CHECK(rejected);
+        VM_TEST_CHECK(rows.size() == TEST_INPUT_COUNT);
+        fclose(results);
+    }
+    
+    remove(TEST_CORPUS_PATH);
+}
+
+int main() {
+    test_pipeline();
+    return vm_test_result("vm_corpus_test");
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include "vm_test.h"
+
+// Cycle detection under every instrument that runs the machine one step
+// at a time. Guests that loop forever must end with VMStatus::CYCLE
+// whether or not a tracer or profiler is attached.
+
+// Data cells
+constexpr uint16_t TEST_COUNTER = 0x300;
+
+static const VMMemoryMode TEST_MEMORY_MODES[] = {
+    VMMemoryMode::PACKED, VMMemoryMode::SHADOW, VMMemoryMode::COPY_ON_WRITE
+};
+static const char* const TEST_MEMORY_NAMES[] = { "packed", "shadow", "cow" };
+
+static const VMTestInstrument TEST_INSTRUMENTS[] = { VM_TEST_PLAIN, VM_TEST_TRACED, VM_TEST_PROFILED };
+static const char* const TEST_INSTRUMENT_NAMES[] = { "plain", "traced", "profiled" };
+
+static void check_cycle(const char* what, const VMTestProgram& program) {
+    for (int memory = 0; memory < 3; memory++) {
+        for (int instrument = 0; instrument < 3; instrument++) {
+            VMTestConfig config = { what, TEST_MEMORY_MODES[memory], VMDispatchMode::THREADED,
+                                    VMFusionMode::OFF, false, TEST_INSTRUMENTS[instrument] };
+            VMTestMachine machine(program, config);
+            machine.vm.set_cycle_detection(true);
+            
+            VMStatus status = machine.vm.execute();
+            if (status != VMStatus::CYCLE) {
+                fprintf(stderr, "%s (%s-%s): status %d, expected CYCLE\n", what, TEST_MEMORY_NAMES[memory],
+                        TEST_INSTRUMENT_NAMES[instrument], static_cast<int>(status));
+                vm_test_failures++;
+            }
+        }
+    }
+}
+
+// JMP 0 -- the same state after every step
+static void test_jump_to_self() {
+    VMTestProgram program;
+    program.emit(VMOpcode::JMP, 0);
+    check_cycle("JMP 0", program);
+}
+
+// INC counter ; JMP 0 -- the state repeats once the counter wraps
+static void test_wrapping_counter() {
+    VMTestProgram program;
+    program.emit(VMOpcode::INC, TEST_COUNTER);
+    program.emit(VMOpcode::JMP, 0);
+    check_cycle("INC counter ; JMP 0", program);
+}
+
+int main() {
+    test_jump_to_self();
+    test_wrapping_counter();
+    return vm_test_result("vm_cycle_test");
+}
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include "vm_test_random.h"
+
+// Random programs (vm_test_random.h) through every memory mode, core,
+// fusion and optimizer combination and every single-step instrument,
+// compared against the reference core.
+
+constexpr uint32_t TEST_PROGRAMS = 150;
+
+static const VMMemoryMode TEST_MEMORY_MODES[] = {
+    VMMemoryMode::PACKED, VMMemoryMode::SHADOW, VMMemoryMode::COPY_ON_WRITE
+};
+static const char* const TEST_MEMORY_NAMES[] = { "packed", "shadow", "cow" };
+
+static const VMDispatchMode TEST_DISPATCH_MODES[] = {
+    VMDispatchMode::EXECUTOR, VMDispatchMode::THREADED, VMDispatchMode::SPECIALIZED, VMDispatchMode::JIT
+};
+static const char* const TEST_DISPATCH_NAMES[] = { "executor", "threaded", "specialized", "jit" };
+
+// Same run with input delivered one character at a time: every read of a
+// missing character suspends and the run resumes once it arrives
+static VMTestState run_suspended(const VMTestProgram& program, const VMTestConfig& config, const std::string& input) {
+    VMTestMachine machine(program, config);
+    VirtualMachine& vm = machine.vm;
+    
+    VMMemoryIO io;
+    io.input_position = 0;
+    io.suspend = true;
+    vm.get_runtime().memory_io = &io;
+    
+    VMStatus status = vm.execute();
+    while (status == VMStatus::INPUT_PENDING) {
+        if (io.input.size() < input.size()) {
+            io.input.push_back(input[io.input.size()]);
+        } else {
+            io.suspend = false;
+        }
+        status = vm.execute();
+    }
+    vm.get_runtime().memory_io = nullptr;
+    return vm_test_capture(vm, status, io.output);
+}
+
+static const VMTestInstrument TEST_INSTRUMENTS[] = { VM_TEST_TRACED, VM_TEST_PROFILED, VM_TEST_CYCLES };
+static const char* const TEST_INSTRUMENT_NAMES[] = { "traced", "profiled", "cycles" };
+
+int main() {
+    // Every core with and without fusion and the optimizer, then each
+    // instrument in every memory mode (instrumented steps ignore the core
+    // until the tracer hands the run over)
+    std::vector<VMTestConfig> configs;
+    std::vector<std::string> names;
+    names.reserve(3 * 4 * 4 + 3 * 3);
+    for (int memory = 0; memory < 3; memory++) {
+        for (int dispatch = 0; dispatch < 4; dispatch++) {
+            for (int variant = 0; variant < 4; variant++) {
+                bool fused = variant & 1;
+                bool optimized = variant & 2;
+                names.push_back(std::string(TEST_MEMORY_NAMES[memory]) + "-" + TEST_DISPATCH_NAMES[dispatch] +
+                                (fused ? "-fused" : "") + (optimized ? "-optimized" : ""));
+                configs.push_back({ names.back().c_str(), TEST_MEMORY_MODES[memory], TEST_DISPATCH_MODES[dispatch],
+                                    fused ? VMFusionMode::ADAPTIVE : VMFusionMode::OFF, optimized });
+            }
+        }
+        for (int instrument = 0; instrument < 3; instrument++) {
+            names.push_back(std::string(TEST_MEMORY_NAMES[memory]) + "-" + TEST_INSTRUMENT_NAMES[instrument]);
+            configs.push_back({ names.back().c_str(), TEST_MEMORY_MODES[memory], VMDispatchMode::SPECIALIZED,
+                                VMFusionMode::ADAPTIVE, true, TEST_INSTRUMENTS[instrument] });
+        }
+    }
+    
+    for (uint32_t seed = 1; seed <= TEST_PROGRAMS; seed++) {
+        RandomProgram generator(seed);
+        VMTestProgram program = generator.generate();
+        std::string input = generator.input();
+        
+        char what[32];
+        snprintf(what, sizeof(what), "program %u", seed);
+        VMTestState reference = vm_test_run(program, VM_TEST_REFERENCE, input);
+        VM_TEST_CHECK(reference.status == VMStatus::OK);
+        
+        for (const VMTestConfig& config : configs) {
+            vm_test_same(what, config, reference, vm_test_run(program, config, input));
+        }
+        
+        snprintf(what, sizeof(what), "program %u suspended", seed);
+        for (const VMTestConfig& config : configs) {
+            vm_test_same(what, config, reference, run_suspended(program, config, input));
+        }
+    }
+    return vm_test_result("vm_differential_test");
+}
\ No newline at end of file
@@ -0,0 +1,188 @@
+#include "vm_test.h"
+
+// Superinstructions against the reference core. Each program warms up a
+// loop until its sequence is fused, then takes the fused sequence once
+// more with a component reading or writing the IP cell, which must hold
+// that component's own next instruction as in unfused execution.
+
+// Data cells
+constexpr uint16_t TEST_COUNTER = 0x290;    // Also the word of a HALT
+constexpr uint16_t TEST_POINTER = 0x300;
+constexpr uint16_t TEST_LIMIT = 0x301;
+constexpr uint16_t TEST_RESUME = 0x302;     // JMP [resume] after the loop
+constexpr uint16_t TEST_RECORD = 0x303;
+constexpr uint16_t TEST_MIXED = 0x304;
+constexpr uint16_t TEST_BOUND = 0x305;
+constexpr uint16_t TEST_CONSTANTS = 0x380;
+
+// Loop trip count, enough to outlast the fusion warmup
+constexpr uint16_t TEST_ITERATIONS = 500;
+
+static const VMTestConfig FUSED_CONFIGS[] = {
+    { "packed-executor-fused", VMMemoryMode::PACKED, VMDispatchMode::EXECUTOR, VMFusionMode::ADAPTIVE, false },
+    { "shadow-executor-fused", VMMemoryMode::SHADOW, VMDispatchMode::EXECUTOR, VMFusionMode::ADAPTIVE, false },
+    { "shadow-specialized-fused", VMMemoryMode::SHADOW, VMDispatchMode::SPECIALIZED, VMFusionMode::ADAPTIVE, false },
+    { "specialized-fused-optimized", VMMemoryMode::SHADOW, VMDispatchMode::SPECIALIZED, VMFusionMode::ADAPTIVE, true },
+};
+
+// Program with a loop left through JMP [resume]: the first time to a
+// setup block that retargets the loop operands and re-enters it, the
+// second time to HALT
+class FusionProgram {
+private:
+    VMTestProgram program;
+    uint16_t constants;
+    
+public:
+    FusionProgram() : constants(TEST_CONSTANTS) {}
+    
+    VMTestProgram& code() { return program; }
+    
+    // Address of a cell holding value
+    uint16_t constant(uint16_t value) {
+        program.set(constants, value);
+        return constants++;
+    }
+    
+    // JMP [resume]; returns the address of the setup block that follows
+    uint16_t leave_loop() {
+        program.emit(VMOpcode::JMP, TEST_RESUME, AddressingMode::INDIRECT);
+        return program.here();
+    }
+};
+
+static void check_fused(const char* what, const VMTestProgram& program) {
+    VMTestState reference = vm_test_run(program, VM_TEST_REFERENCE);
+    VM_TEST_CHECK(reference.status == VMStatus::OK);
+    for (const VMTestConfig& config : FUSED_CONFIGS) {
+        vm_test_same(what, config, reference, vm_test_run(program, config));
+    }
+}
+
+// Close the loop with its setup block
+template <typename Setup>
+static VMTestProgram with_setup(FusionProgram& fusion, uint16_t loop, Setup setup) {
+    VMTestProgram& program = fusion.code();
+    uint16_t setup_address = fusion.leave_loop();
+    
+    // HALT sits right after the setup block's JMP; its address is only
+    // known once the block is emitted, so patch the MOV operand afterwards
+    uint16_t halt_cell = fusion.constant(0);
+    program.emit(VMOpcode::MOV, TEST_RESUME, halt_cell);
+    setup(fusion);
+    program.emit(VMOpcode::JMP, loop);
+    program.set(halt_cell, program.here());
+    program.emit(VMOpcode::HALT);
+    
+    program.set(TEST_RESUME, setup_address);
+    return program;
+}
+
+// INC [pointer] ; CMP counter, limit ; JL loop -- the INC then hits the IP cell
+static void test_inc_writes_ip() {
+    FusionProgram fusion;
+    VMTestProgram& program = fusion.code();
+    
+    program.emit(VMOpcode::MOV, TEST_POINTER, fusion.constant(TEST_COUNTER));
+    uint16_t loop = program.here();
+    program.emit(VMOpcode::INC, TEST_POINTER, AddressingMode::INDIRECT);
+    program.emit(VMOpcode::CMP, TEST_COUNTER, TEST_LIMIT);  // Operand word TEST_COUNTER decodes as HALT
+    program.emit(VMOpcode::JL, loop);
+    
+    program.set(TEST_LIMIT, TEST_ITERATIONS);
+    check_fused("INC of the IP cell in INC CMP JL", with_setup(fusion, loop, [](FusionProgram& f) {
+        f.code().emit(VMOpcode::MOV, TEST_POINTER, f.constant(VM_INSTRUCTION_POINTER));
+        f.code().emit(VMOpcode::MOV, TEST_COUNTER, f.constant(0));
+    }));
+}
+
+// INC counter ; CMP counter, [pointer] ; JL loop -- the CMP then reads the IP cell
+static void test_compare_reads_ip() {
+    FusionProgram fusion;
+    VMTestProgram& program = fusion.code();
+    
+    program.emit(VMOpcode::MOV, TEST_POINTER, fusion.constant(TEST_LIMIT));
+    uint16_t loop = program.here();
+    program.emit(VMOpcode::INC, TEST_COUNTER);
+    program.emit(VMOpcode::CMP, TEST_COUNTER, TEST_POINTER, AddressingMode::DIRECT, AddressingMode::INDIRECT);
+    program.emit(VMOpcode::JL, loop);
+    
+    // Unfused, the CMP sees its own next IP (loop + 5) and the counter equal to it
+    program.set(TEST_LIMIT, TEST_ITERATIONS);
+    check_fused("CMP of the IP cell in INC CMP JL", with_setup(fusion, loop, [loop](FusionProgram& f) {
+        f.code().emit(VMOpcode::MOV, TEST_POINTER, f.constant(VM_INSTRUCTION_POINTER));
+        f.code().emit(VMOpcode::MOV, TEST_COUNTER, f.constant(static_cast<uint16_t>(loop + 4)));
+    }));
+}
+
+// CMP [pointer], [bound] ; JGE out ; ADD counter, one ; JMP loop
+static void test_compare_jump_reads_ip() {
+    FusionProgram fusion;
+    VMTestProgram& program = fusion.code();
+    
+    program.emit(VMOpcode::MOV, TEST_POINTER, fusion.constant(TEST_COUNTER));
+    program.emit(VMOpcode::MOV, TEST_BOUND, fusion.constant(TEST_LIMIT));
+    uint16_t loop = program.here();
+    program.emit(VMOpcode::CMP, TEST_POINTER, TEST_BOUND, AddressingMode::INDIRECT, AddressingMode::INDIRECT);
+    uint16_t exit_jump = program.here();
+    program.emit(VMOpcode::JGE, 0);
+    program.emit(VMOpcode::ADD, TEST_COUNTER, fusion.constant(1));
+    program.emit(VMOpcode::JMP, loop);
+    program.set(exit_jump + 1, program.here());
+    
+    // Unfused, the CMP reads loop + 3 and compares equal
+    program.set(TEST_LIMIT, TEST_ITERATIONS);
+    check_fused("CMP of the IP cell in CMP JGE", with_setup(fusion, loop, [loop](FusionProgram& f) {
+        f.code().emit(VMOpcode::MOV, TEST_POINTER, f.constant(VM_INSTRUCTION_POINTER));
+        f.code().emit(VMOpcode::MOV, TEST_BOUND, f.constant(f.constant(static_cast<uint16_t>(loop + 3))));
+    }));
+}
+
+// XOR record, [pointer] ; ROL mixed ; INC counter ; CMP counter, limit ; JL loop
+static void test_xor_reads_ip() {
+    FusionProgram fusion;
+    VMTestProgram& program = fusion.code();
+    
+    program.emit(VMOpcode::MOV, TEST_POINTER, fusion.constant(TEST_LIMIT));
+    uint16_t loop = program.here();
+    program.emit(VMOpcode::XOR, TEST_RECORD, TEST_POINTER, AddressingMode::DIRECT, AddressingMode::INDIRECT);
+    program.emit(VMOpcode::ROL, TEST_MIXED);
+    program.emit(VMOpcode::INC, TEST_COUNTER);
+    program.emit(VMOpcode::CMP, TEST_COUNTER, TEST_LIMIT);
+    program.emit(VMOpcode::JL, loop);
+    
+    program.set(TEST_LIMIT, TEST_ITERATIONS);
+    check_fused("XOR of the IP cell in XOR ROL", with_setup(fusion, loop, [](FusionProgram& f) {
+        f.code().emit(VMOpcode::MOV, TEST_POINTER, f.constant(VM_INSTRUCTION_POINTER));
+        f.code().emit(VMOpcode::MOV, TEST_COUNTER, f.constant(TEST_ITERATIONS - 1));
+    }));
+}
+
+// MOV record, [pointer] ; MOV mixed, [pointer] ; DEC counter ; JNZ loop
+static void test_generic_reads_ip() {
+    FusionProgram fusion;
+    VMTestProgram& program = fusion.code();
+    
+    program.emit(VMOpcode::MOV, TEST_POINTER, fusion.constant(TEST_LIMIT));
+    program.emit(VMOpcode::MOV, TEST_COUNTER, fusion.constant(TEST_ITERATIONS));
+    uint16_t loop = program.here();
+    program.emit(VMOpcode::MOV, TEST_RECORD, TEST_POINTER, AddressingMode::DIRECT, AddressingMode::INDIRECT);
+    program.emit(VMOpcode::MOV, TEST_MIXED, TEST_POINTER, AddressingMode::DIRECT, AddressingMode::INDIRECT);
+    program.emit(VMOpcode::DEC, TEST_COUNTER);
+    program.emit(VMOpcode::JNZ, loop);
+    
+    program.set(TEST_LIMIT, TEST_ITERATIONS);
+    check_fused("MOV of the IP cell in a generic sequence", with_setup(fusion, loop, [](FusionProgram& f) {
+        f.code().emit(VMOpcode::MOV, TEST_POINTER, f.constant(VM_INSTRUCTION_POINTER));
+        f.code().emit(VMOpcode::MOV, TEST_COUNTER, f.constant(1));
+    }));
+}
+
+int main() {
+    test_inc_writes_ip();
+    test_compare_reads_ip();
+    test_compare_jump_reads_ip();
+    test_xor_reads_ip();
+    test_generic_reads_ip();
+    return vm_test_result("vm_fusion_test");
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "vm_test.h"
+#include "../include/vm_hash.h"
+#include "../include/vm_image.h"
+#include <cstring>
+#include <stdexcept>
+
+// Image loading: a valid image runs like the machine it was written
+// from, a corrupted one is rejected even with a matching checksum.
+
+constexpr const char* TEST_IMAGE_PATH = "vm_image_test.vmi";
+
+static std::vector<uint8_t> write_image(const VMTestProgram& program) {
+    VirtualMachine vm(0x3404, VMMemoryMode::SHADOW);
+    vm.initialize();
+    program.load(vm);
+    
+    FILE* output = fopen(TEST_IMAGE_PATH, "wb");
+    VM_TEST_CHECK(output != nullptr);
+    VMImage::write(output, vm, vm_image_find_blocks(vm));
+    fclose(output);
+    
+    FILE* input = fopen(TEST_IMAGE_PATH, "rb");
+    std::vector<uint8_t> file;
+    int byte;
+    while ((byte = fgetc(input)) != EOF) {
+        file.push_back(static_cast<uint8_t>(byte));
+    }
+    fclose(input);
+    return file;
+}
+
+// Store a modified image with its checksum fixed up
+static void save_image(std::vector<uint8_t> file) {
+    VMImageHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    header.checksum = vm_crc32(file.data() + sizeof(header), file.size() - sizeof(header));
+    memcpy(file.data(), &header, sizeof(header));
+    
+    FILE* output = fopen(TEST_IMAGE_PATH, "wb");
+    fwrite(file.data(), 1, file.size(), output);
+    fclose(output);
+}
+
+static bool image_rejected() {
+    try {
+        VMImage image(TEST_IMAGE_PATH);
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+static void set_word(std::vector<uint8_t>& file, uint16_t address, uint16_t value) {
+    VMImageHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    memcpy(&file[header.words_offset + address * sizeof(uint16_t)], &value, sizeof(value));
+}
+
+static void test_images() {
+    VMTestProgram program;
+    program.emit(VMOpcode::INC, 0x100);
+    program.emit(VMOpcode::OUT, 0x100);
+    program.emit(VMOpcode::HALT);
+    program.set(0x100, 'A');
+    
+    std::vector<uint8_t> file = write_image(program);
+    VM_TEST_CHECK(!image_rejected());
+    
+    // Every memory mode loads the same machine
+    VMTestState reference = vm_test_run(program, VM_TEST_REFERENCE);
+    for (VMMemoryMode mode : { VMMemoryMode::PACKED, VMMemoryMode::SHADOW, VMMemoryMode::COPY_ON_WRITE }) {
+        VMImage image(TEST_IMAGE_PATH);
+        VirtualMachine vm(0x3404, mode);
+        vm.initialize();
+        vm.load_image(image);
+        
+        VMMemoryIO io = {};
+        vm.get_runtime().memory_io = &io;
+        VMStatus status = vm.execute();
+        vm.get_runtime().memory_io = nullptr;
+        
+        VMTestConfig config = VM_TEST_REFERENCE;
+        config.memory_mode = mode;
+        vm_test_same("image load", config, reference, vm_test_capture(vm, status, io.output));
+    }
+    
+    // A word no 13-bit cell can hold
+    std::vector<uint8_t> corrupt = file;
+    set_word(corrupt, 0, 0xFFF0);
+    save_image(corrupt);
+    VM_TEST_CHECK(image_rejected());
+    
+    // A valid word that disagrees with the packed section
+    corrupt = file;
+    set_word(corrupt, 1, 0x101);
+    save_image(corrupt);
+    VM_TEST_CHECK(image_rejected());
+    
+    // A packed section too short to hold every word
+    corrupt = file;
+    VMImageHeader header;
+    memcpy(&header, corrupt.data(), sizeof(header));
+    header.memory_size = VM_IMAGE_PACKED_SIZE - 1;
+    memcpy(corrupt.data(), &header, sizeof(header));
+    save_image(corrupt);
+    VM_TEST_CHECK(image_rejected());
+    
+    remove(TEST_IMAGE_PATH);
+}
+
+int main() {
+    test_images();
+    return vm_test_result("vm_image_test");
+}
\ No newline at end of file
@@ -0,0 +1,163 @@
+#include "vm_test.h"
+#include "../include/vm_io.h"
+#include <cstring>
+#include <stdexcept>
+
+// I/O record and replay. A guest reads a line with IN_STR and a key with
+// IN_HEX, then writes each character plus the key with OUT. The run is
+// recorded with a step limit stopping it halfway and resumed, then
+// replayed on every core, from the log and from a copy read back from a
+// file, to the same output. Guests that take a different step or write a
+// different character must be reported as diverged.
+
+// Data cells
+constexpr uint16_t TEST_LINE = 0x100;
+constexpr uint16_t TEST_KEY = 0x180;
+constexpr uint16_t TEST_POINTER = 0x181;
+constexpr uint16_t TEST_CHARACTER = 0x182;
+constexpr uint16_t TEST_ZERO = 0x183;
+
+static const char TEST_INPUT[] = "replay\n2\n";
+static const char TEST_OUTPUT[] = "tgrnc{";
+constexpr uint64_t TEST_SUSPEND_STEPS = 20;
+
+enum TestGuest {
+    TEST_RECORDED = 0,
+    TEST_SHIFTED = 1,           // One more instruction before the loop
+    TEST_XORED = 2              // XOR instead of ADD: same steps, other output
+};
+
+// IN_STR line ; IN_HEX key ; p starts at line
+// loop: MOV c, [p] ; CMP c, 0 ; JZ done ; ADD c, key ; OUT c ; INC p ; JMP loop
+// done: HALT
+static VMTestProgram io_program(TestGuest guest) {
+    VMTestProgram program;
+    program.emit(VMOpcode::IN_STR, TEST_LINE);
+    program.emit(VMOpcode::IN_HEX, TEST_KEY);
+    if (guest == TEST_SHIFTED) {
+        program.emit(VMOpcode::NOP);
+    }
+    
+    uint16_t loop = program.here();
+    program.emit(VMOpcode::MOV, TEST_CHARACTER, TEST_POINTER, AddressingMode::DIRECT, AddressingMode::INDIRECT);
+    program.emit(VMOpcode::CMP, TEST_CHARACTER, TEST_ZERO);
+    uint16_t branch = program.here();
+    program.emit(VMOpcode::JZ, 0);
+    program.emit(guest == TEST_XORED ? VMOpcode::XOR : VMOpcode::ADD, TEST_CHARACTER, TEST_KEY);
+    program.emit(VMOpcode::OUT, TEST_CHARACTER);
+    program.emit(VMOpcode::INC, TEST_POINTER);
+    program.emit(VMOpcode::JMP, loop);
+    program.set(branch + 1, program.here());
+    program.emit(VMOpcode::HALT);
+    
+    program.set(TEST_POINTER, TEST_LINE);
+    program.set(TEST_ZERO, 0);
+    return program;
+}
+
+// Recorded run, stopped by the step limit and resumed without one
+static VMTestState record(VMIOLog& log) {
+    VMTestMachine machine(io_program(TEST_RECORDED), VM_TEST_REFERENCE);
+    VirtualMachine& vm = machine.vm;
+    
+    VMBufferedPort port;
+    port.set_input(TEST_INPUT);
+    VMRecordingPort recorder(port, log);
+    vm.get_runtime().port = &recorder;
+    
+    vm.set_step_limit(TEST_SUSPEND_STEPS);
+    VM_TEST_CHECK(vm.execute() == VMStatus::STEP_LIMIT);
+    VM_TEST_CHECK(vm.get_runtime().steps == TEST_SUSPEND_STEPS && port.get_output().size() < strlen(TEST_OUTPUT));
+    vm.set_step_limit(0);
+    VMStatus status = vm.execute();
+    
+    vm.get_runtime().port = nullptr;
+    return vm_test_capture(vm, status, port.get_output());
+}
+
+static VMTestState replay(const VMIOLog& log, const VMTestConfig& config, TestGuest guest = TEST_RECORDED) {
+    VMTestMachine machine(io_program(guest), config);
+    VirtualMachine& vm = machine.vm;
+    
+    VMBufferedPort output;
+    VMReplayPort replayer(log, &output);
+    vm.get_runtime().port = &replayer;
+    VMStatus status = vm.execute();
+    vm.get_runtime().port = nullptr;
+    
+    VM_TEST_CHECK(replayer.is_complete());
+    return vm_test_capture(vm, status, output.get_output());
+}
+
+static bool diverges(const VMIOLog& log, TestGuest guest) {
+    try {
+        replay(log, VM_TEST_REFERENCE, guest);
+    } catch (const std::runtime_error& error) {
+        return strncmp(error.what(), "I/O replay diverged", 19) == 0;
+    }
+    return false;
+}
+
+static void read_log(VMIOLog& log, FILE* file, long size) {
+    rewind(file);
+    std::vector<char> bytes(static_cast<size_t>(size));
+    VM_TEST_CHECK(fread(bytes.data(), 1, bytes.size(), file) == bytes.size());
+    
+    FILE* copy = tmpfile();
+    fwrite(bytes.data(), 1, bytes.size(), copy);
+    rewind(copy);
+    try {
+        log.read(copy);
+    } catch (...) {
+        fclose(copy);
+        throw;
+    }
+    fclose(copy);
+}
+
+int main() {
+    VMIOLog log;
+    VMTestState recorded = record(log);
+    VM_TEST_CHECK(recorded.status == VMStatus::OK && recorded.output == TEST_OUTPUT);
+    VM_TEST_CHECK(log.size() == strlen("replay") + 1 + 1 + strlen(TEST_OUTPUT));
+    
+    // Every core, each counting the steps the events are checked against
+    static const VMDispatchMode dispatch_modes[] = {
+        VMDispatchMode::EXECUTOR, VMDispatchMode::THREADED, VMDispatchMode::SPECIALIZED, VMDispatchMode::JIT
+    };
+    static const char* const dispatch_names[] = { "executor", "threaded", "specialized", "jit" };
+    for (int dispatch = 0; dispatch < 4; dispatch++) {
+        VMTestConfig config = { dispatch_names[dispatch], VMMemoryMode::SHADOW, dispatch_modes[dispatch],
+                                VMFusionMode::OFF, false };
+        vm_test_same("replay", config, recorded, replay(log, config));
+    }
+    
+    // File round trip; a log cut short is rejected
+    FILE* file = tmpfile();
+    log.write(file);
+    long size = ftell(file);
+    
+    VMIOLog loaded;
+    read_log(loaded, file, size);
+    VM_TEST_CHECK(loaded.size() == log.size());
+    for (size_t index = 0; index < loaded.size() && index < log.size(); index++) {
+        const VMIOEvent& event = loaded.get_event(index);
+        const VMIOEvent& expected = log.get_event(index);
+        VM_TEST_CHECK(event.step == expected.step && event.kind == expected.kind && event.value == expected.value);
+    }
+    vm_test_same("replay from file", VM_TEST_REFERENCE, recorded, replay(loaded, VM_TEST_REFERENCE));
+    
+    bool truncated = false;
+    try {
+        VMIOLog cut;
+        read_log(cut, file, size - 1);
+    } catch (const std::runtime_error&) {
+        truncated = true;
+    }
+    VM_TEST_CHECK(truncated);
+    fclose(file);
+    
+    VM_TEST_CHECK(diverges(log, TEST_SHIFTED));
+    VM_TEST_CHECK(diverges(log, TEST_XORED));
+    return vm_test_result("vm_io_test");
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "vm_test.h"
+
+// Optimized programs against the reference core. A store into analyzed
+// code discards the optimization, so the flags of everything before it
+// must still be computed.
+
+// Data cells
+constexpr uint16_t TEST_COUNTER = 0x300;
+constexpr uint16_t TEST_MASK = 0x301;
+constexpr uint16_t TEST_VALUE = 0x302;
+
+static const VMTestConfig OPTIMIZED_CONFIGS[] = {
+    { "packed-executor-optimized", VMMemoryMode::PACKED, VMDispatchMode::EXECUTOR, VMFusionMode::OFF, true },
+    { "shadow-executor-optimized", VMMemoryMode::SHADOW, VMDispatchMode::EXECUTOR, VMFusionMode::OFF, true },
+    { "shadow-specialized-optimized", VMMemoryMode::SHADOW, VMDispatchMode::SPECIALIZED, VMFusionMode::OFF, true },
+    { "shadow-jit-optimized", VMMemoryMode::SHADOW, VMDispatchMode::JIT, VMFusionMode::OFF, true },
+};
+
+static void check_optimized(const char* what, const VMTestProgram& program, const std::string& input) {
+    VMTestState reference = vm_test_run(program, VM_TEST_REFERENCE, input);
+    for (const VMTestConfig& config : OPTIMIZED_CONFIGS) {
+        vm_test_same(what, config, reference, vm_test_run(program, config, input));
+    }
+}
+
+// XOR code, mask ; INC counter ; CLC ; HALT -- the XOR turns the INC into
+// an illegal opcode, so its own sign flag is the final one
+static void test_store_into_code() {
+    VMTestProgram program;
+    
+    uint16_t store = program.here();
+    program.emit(VMOpcode::XOR, 0, TEST_MASK);
+    uint16_t target = program.here();
+    program.emit(VMOpcode::INC, TEST_COUNTER);
+    program.emit(VMOpcode::CLC);
+    program.emit(VMOpcode::HALT);
+    
+    program.set(store + 1, target);
+    program.set(TEST_MASK, 0x1000);
+    check_optimized("XOR into the next instruction", program, "");
+}
+
+// STC ; JC next ; AND value, mask ; IN code ; CMP counter, value ; HALT --
+// the IN turns the CMP into a MOV, so the AND carry is the final one
+static void test_input_into_code() {
+    VMTestProgram program;
+    
+    program.emit(VMOpcode::STC);
+    uint16_t branch = program.here();
+    program.emit(VMOpcode::JC, 0);
+    program.set(branch + 1, program.here());
+    program.emit(VMOpcode::AND, TEST_VALUE, TEST_MASK);
+    uint16_t read = program.here();
+    program.emit(VMOpcode::IN, 0);
+    uint16_t target = program.here();
+    program.emit(VMOpcode::CMP, TEST_COUNTER, TEST_VALUE);
+    program.emit(VMOpcode::HALT);
+    
+    program.set(read + 1, target);
+    program.set(TEST_VALUE, 0x0F0);
+    program.set(TEST_MASK, 0x03C);
+    check_optimized("IN into the next instruction", program, "\x10");  // MOV, direct operands
+}
+
+int main() {
+    test_store_into_code();
+    test_input_into_code();
+    return vm_test_result("vm_optimizer_test");
+}
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include "vm_test.h"
+#include "../include/vm_search.h"
+
+// Search modes against each other on a guest that XORs four input
+// characters into an accumulator. Fresh runs, prefix sharing and state
+// pruning must agree on whether a target accumulator is reachable; a
+// found input must reach it, and a search that finds nothing must have
+// run or pruned every candidate. Under a step limit, candidates that spin
+// forever once they reach the target are given up on in every mode.
+
+// Data cells
+constexpr uint16_t TEST_ACCUMULATOR = 0x100;
+constexpr uint16_t TEST_CHARACTER = 0x101;
+constexpr uint16_t TEST_COUNT = 0x102;
+constexpr uint16_t TEST_ZERO = 0x103;
+constexpr uint16_t TEST_TARGET = 0x104;
+
+constexpr uint16_t TEST_REACHABLE = 'h' ^ 'g' ^ 'a' ^ 'a';
+constexpr uint16_t TEST_UNREACHABLE = 0x100;    // Above every XOR of lowercase letters
+constexpr uint64_t TEST_STEP_LIMIT = 200;
+
+enum TestMode {
+    TEST_FRESH = 0,
+    TEST_PREFIX = 1,
+    TEST_PRUNED = 2
+};
+static const char* const TEST_MODE_NAMES[] = { "fresh", "prefix", "pruned" };
+
+// loop: IN c ; XOR acc, c ; MOV c, 0 ; DEC count ; JNZ loop ; HALT --
+// clearing c leaves the accumulator as the only state the prefix decides.
+// Spinning programs instead end in CMP acc, target ; JZ spin ; HALT ;
+// spin: INC c ; JMP spin.
+static VMTestProgram xor_program(bool spinning) {
+    VMTestProgram program;
+    uint16_t loop = program.here();
+    program.emit(VMOpcode::IN, TEST_CHARACTER);
+    program.emit(VMOpcode::XOR, TEST_ACCUMULATOR, TEST_CHARACTER);
+    program.emit(VMOpcode::MOV, TEST_CHARACTER, TEST_ZERO);
+    program.emit(VMOpcode::DEC, TEST_COUNT);
+    program.emit(VMOpcode::JNZ, loop);
+    if (spinning) {
+        program.emit(VMOpcode::CMP, TEST_ACCUMULATOR, TEST_TARGET);
+        uint16_t branch = program.here();
+        program.emit(VMOpcode::JZ, 0);
+        program.emit(VMOpcode::HALT);
+        uint16_t spin = program.here();
+        program.emit(VMOpcode::INC, TEST_CHARACTER);
+        program.emit(VMOpcode::JMP, spin);
+        program.set(branch + 1, spin);
+        program.set(TEST_TARGET, TEST_REACHABLE);
+    } else {
+        program.emit(VMOpcode::HALT);
+    }
+    program.set(TEST_COUNT, 4);
+    return program;
+}
+
+static VMSearchResult search(VirtualMachine& vm, TestMode mode, uint16_t target, uint64_t step_limit = 0) {
+    VMSearch search(vm.get_memory_buffer(), vm.get_buffer_size());
+    search.set_threads(4);
+    search.set_grain(16);
+    search.set_prefix_sharing(mode != TEST_FRESH);
+    search.set_state_pruning(mode == TEST_PRUNED);
+    search.set_step_limit(step_limit);
+    
+    VMCharsetInputSpace space("abcdefgh", 4, 4);
+    VMSearchResult result = search.run(space, vm_search_memory_equals(TEST_ACCUMULATOR, target));
+    
+    if (result.found) {
+        uint16_t accumulator = 0;
+        for (size_t index = 0; index < 4; index++) {
+            accumulator ^= static_cast<uint8_t>(result.input[index]);
+        }
+        VM_TEST_CHECK(result.input.size() == 5 && accumulator == target);
+    } else {
+        VM_TEST_CHECK(result.executions + result.pruned == space.size());
+    }
+    VM_TEST_CHECK(mode == TEST_PRUNED || result.pruned == 0);
+    VM_TEST_CHECK(step_limit || result.exhausted == 0);
+    return result;
+}
+
+static void test_modes(VirtualMachine& vm, uint16_t target, bool reachable) {
+    for (int mode = TEST_FRESH; mode <= TEST_PRUNED; mode++) {
+        VMSearchResult result = search(vm, static_cast<TestMode>(mode), target);
+        if (result.found != reachable) {
+            fprintf(stderr, "target %x (%s): found %d, expected %d\n", target, TEST_MODE_NAMES[mode],
+                    result.found, reachable);
+            vm_test_failures++;
+        }
+        
+        // Four characters leave at most 16 accumulators: most prefixes repeat one
+        if (mode == TEST_PRUNED && !reachable) {
+            VM_TEST_CHECK(result.pruned > result.executions);
+        }
+    }
+}
+
+// Candidates reaching the target spin instead of halting: the limit stops
+// them before the predicate sees them, so nothing is found
+static void test_step_limit(VirtualMachine& vm) {
+    for (int mode = TEST_FRESH; mode <= TEST_PRUNED; mode++) {
+        VMSearchResult result = search(vm, static_cast<TestMode>(mode), TEST_REACHABLE, TEST_STEP_LIMIT);
+        if (result.found || result.exhausted == 0) {
+            fprintf(stderr, "step limit (%s): found %d, %llu exhausted\n", TEST_MODE_NAMES[mode], result.found,
+                    static_cast<unsigned long long>(result.exhausted));
+            vm_test_failures++;
+        }
+    }
+}
+
+int main() {
+    VirtualMachine vm(0x3404, VMMemoryMode::SHADOW);
+    vm.initialize();
+    xor_program(false).load(vm);
+    
+    test_modes(vm, TEST_REACHABLE, true);
+    test_modes(vm, TEST_UNREACHABLE, false);
+    
+    VirtualMachine spinning(0x3404, VMMemoryMode::SHADOW);
+    spinning.initialize();
+    xor_program(true).load(spinning);
+    test_step_limit(spinning);
+    return vm_test_result("vm_search_test");
+}
\ No newline at end of file
@@ -0,0 +1,212 @@
+#ifndef VM_TEST_H
+#define VM_TEST_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../include/vm_core.h"
+
+// Test constants
+constexpr uint64_t VM_TEST_FUSION_WARMUP = 1000;    // Instructions profiled before fusing
+
+// Failed checks in this test program
+inline int vm_test_failures = 0;
+
+#define VM_TEST_CHECK(condition) \
+    vm_test_check((condition), #condition, __FILE__, __LINE__)
+
+inline bool vm_test_check(bool passed, const char* expression, const char* file, int line) {
+    if (!passed) {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+        vm_test_failures++;
+    }
+    return passed;
+}
+
+// Exit status of a test program
+inline int vm_test_result(const char* name) {
+    if (vm_test_failures) {
+        fprintf(stderr, "%s: %d checks failed\n", name, vm_test_failures);
+        return 1;
+    }
+    printf("%s: passed\n", name);
+    return 0;
+}
+
+// Guest program assembled word by word from address 0. Data cells may
+// sit anywhere above the code.
+struct VMTestProgram {
+    std::vector<uint16_t> words;
+    uint16_t code_end = 0;
+    
+    uint16_t here() const { return code_end; }
+    
+    void emit_word(uint16_t word) {
+        set(code_end++, word);
+    }
+    
+    void emit(VMOpcode opcode, AddressingMode dst = AddressingMode::DIRECT,
+              AddressingMode src = AddressingMode::DIRECT) {
+        emit_word(static_cast<uint16_t>(static_cast<uint16_t>(opcode) << 4 |
+                                        static_cast<uint16_t>(dst) << 2 |
+                                        static_cast<uint16_t>(src)));
+    }
+    
+    void emit(VMOpcode opcode, uint16_t operand1, AddressingMode dst = AddressingMode::DIRECT) {
+        emit(opcode, dst);
+        emit_word(operand1);
+    }
+    
+    void emit(VMOpcode opcode, uint16_t operand1, uint16_t operand2,
+              AddressingMode dst = AddressingMode::DIRECT, AddressingMode src = AddressingMode::DIRECT) {
+        emit(opcode, dst, src);
+        emit_word(operand1);
+        emit_word(operand2);
+    }
+    
+    // Data word at address, growing the program as needed
+    void set(uint16_t address, uint16_t value) {
+        if (address >= words.size()) {
+            words.resize(address + 1, 0);
+        }
+        words[address] = value;
+    }
+    
+    void load(VirtualMachine& vm) const {
+        for (size_t address = 0; address < words.size(); address++) {
+            vm.write_memory(static_cast<uint16_t>(address), words[address]);
+        }
+    }
+};
+
+// Instruments that run the machine one step at a time
+enum VMTestInstrument {
+    VM_TEST_PLAIN = 0,
+    VM_TEST_TRACED = 1,         // Tracer finishing after VM_TEST_TRACE_LIMIT records
+    VM_TEST_PROFILED = 2,
+    VM_TEST_CYCLES = 3          // Cycle detection
+};
+
+constexpr uint64_t VM_TEST_TRACE_LIMIT = 100;
+
+// Machine configuration under test
+struct VMTestConfig {
+    const char* name;
+    VMMemoryMode memory_mode;
+    VMDispatchMode dispatch_mode;
+    VMFusionMode fusion_mode;
+    bool optimize;
+    VMTestInstrument instrument = VM_TEST_PLAIN;
+};
+
+// Reference: packed memory, executor core, nothing fused or optimized
+constexpr VMTestConfig VM_TEST_REFERENCE = {
+    "reference", VMMemoryMode::PACKED, VMDispatchMode::EXECUTOR, VMFusionMode::OFF, false
+};
+
+// Everything a run leaves behind
+struct VMTestState {
+    std::vector<uint16_t> memory;
+    uint8_t flags;              // Bit n is flag VM_FLAG_* n
+    VMStatus status;
+    std::string output;
+    uint64_t steps;             // VMRuntime::steps after the run
+};
+
+inline VMTestState vm_test_capture(VirtualMachine& vm, VMStatus status, const std::string& output) {
+    VMTestState state;
+    for (uint16_t address = 0; address < VM_MEMORY_SIZE; address++) {
+        state.memory.push_back(vm.read_memory(address));
+    }
+    state.flags = static_cast<uint8_t>(vm.get_sign_flag() << VM_FLAG_SIGN | vm.get_zero_flag() << VM_FLAG_ZERO |
+                                       vm.get_carry_flag() << VM_FLAG_CARRY |
+                                       vm.get_overflow_flag() << VM_FLAG_OVERFLOW);
+    state.status = status;
+    state.output = output;
+    state.steps = vm.get_runtime().steps;
+    return state;
+}
+
+// Fresh machine configured and loaded with a program. The instruments
+// outlive the machine they are attached to.
+struct VMTestMachine {
+    VMTracer tracer;
+    VMProfiler profiler;
+    VirtualMachine vm;
+    
+    VMTestMachine(const VMTestProgram& program, const VMTestConfig& config)
+        : vm(0x3404, config.memory_mode) {
+        vm.initialize();
+        vm.set_dispatch_mode(config.dispatch_mode);
+        if (config.dispatch_mode == VMDispatchMode::JIT && config.memory_mode == VMMemoryMode::SHADOW) {
+            VM_TEST_CHECK(vm.is_jit_available() == VM_JIT_SUPPORTED);
+        }
+        if (config.fusion_mode != VMFusionMode::OFF) {
+            vm.set_fusion_mode(config.fusion_mode, VM_TEST_FUSION_WARMUP);
+        }
+        if (config.instrument == VM_TEST_TRACED && VM_TRACE) {
+            tracer.set_record_limit(VM_TEST_TRACE_LIMIT);
+            vm.set_tracer(&tracer);
+        }
+        if (config.instrument == VM_TEST_PROFILED) {
+            vm.set_profiler(&profiler);
+        }
+        vm.set_cycle_detection(config.instrument == VM_TEST_CYCLES);
+        program.load(vm);
+        if (config.optimize) {
+            vm.optimize_program();
+        }
+    }
+};
+
+// Run a program on a fresh machine, input read from memory
+inline VMTestState vm_test_run(const VMTestProgram& program, const VMTestConfig& config,
+                               const std::string& input = std::string()) {
+    VMTestMachine machine(program, config);
+    VirtualMachine& vm = machine.vm;
+    
+    VMMemoryIO io;
+    io.input = input;
+    io.input_position = 0;
+    io.suspend = false;
+    vm.get_runtime().memory_io = &io;
+    
+    VMStatus status = vm.execute();
+    vm.get_runtime().memory_io = nullptr;
+    return vm_test_capture(vm, status, io.output);
+}
+
+// Check a state against the reference one, reporting the first difference
+inline bool vm_test_same(const char* what, const VMTestConfig& config,
+                         const VMTestState& reference, const VMTestState& state) {
+    char difference[96] = "";
+    if (state.status != reference.status) {
+        snprintf(difference, sizeof(difference), "status %d, expected %d",
+                 static_cast<int>(state.status), static_cast<int>(reference.status));
+    } else if (state.flags != reference.flags) {
+        snprintf(difference, sizeof(difference), "flags %x, expected %x", state.flags, reference.flags);
+    } else if (state.output != reference.output) {
+        snprintf(difference, sizeof(difference), "output differs");
+    } else if (state.steps != reference.steps) {
+        snprintf(difference, sizeof(difference), "%llu steps, expected %llu",
+                 static_cast<unsigned long long>(state.steps), static_cast<unsigned long long>(reference.steps));
+    } else {
+        for (size_t address = 0; address < reference.memory.size(); address++) {
+            if (state.memory[address] != reference.memory[address]) {
+                snprintf(difference, sizeof(difference), "[%04zx] = %04x, expected %04x", address,
+                         state.memory[address], reference.memory[address]);
+                break;
+            }
+        }
+    }
+    
+    if (difference[0]) {
+        fprintf(stderr, "%s (%s): %s\n", what, config.name, difference);
+        vm_test_failures++;
+        return false;
+    }
+    return true;
+}
+
+#endif // VM_TEST_H
\ No newline at end of file
@@ -0,0 +1,228 @@
+#ifndef VM_TEST_RANDOM_H
+#define VM_TEST_RANDOM_H
+
+#include <random>
+#include "vm_test.h"
+
+// Random guest programs shared by the tests that compare a core against
+// the reference one. Each program loops over a random body with
+// conditional skips, stack and I/O instructions, reads of the IP and SP
+// cells and self-modifying XORs that toggle ALU opcodes and data operands
+// of the body. Every program halts: the loop counter, pointer cells and
+// code outside those toggles are never stored to.
+
+// Memory layout
+constexpr uint16_t TEST_DATA = 0x1000;          // 256 cells, any instruction may store here
+constexpr uint16_t TEST_STRING = 0x10C0;        // IN_STR target, inside the data cells
+constexpr uint16_t TEST_POINTERS = 0x1100;      // 16 cells pointing into the data cells
+constexpr uint16_t TEST_DOUBLE = 0x1110;        // 8 cells pointing to pointer cells
+constexpr uint16_t TEST_MASKS = 0x1200;         // Self-modification masks
+constexpr uint16_t TEST_COUNTER = 0x1300;
+constexpr uint16_t TEST_STACK = 0x1F00;
+
+// Generator limits
+constexpr uint32_t TEST_BODY_MIN = 8;
+constexpr uint32_t TEST_BODY_MAX = 40;
+constexpr uint32_t TEST_INPUT_MAX = 24;
+
+// Two-operand instructions that only read their source; self-modification
+// toggles one into another, which may also turn its flags on or off
+static const VMOpcode TEST_TOGGLED[] = {
+    VMOpcode::MOV, VMOpcode::ADD, VMOpcode::SUB, VMOpcode::AND, VMOpcode::OR, VMOpcode::XOR, VMOpcode::CMP
+};
+constexpr uint32_t TEST_TOGGLED_COUNT = sizeof(TEST_TOGGLED) / sizeof(TEST_TOGGLED[0]);
+
+static const VMOpcode TEST_UNARY[] = {
+    VMOpcode::INC, VMOpcode::DEC, VMOpcode::NOT, VMOpcode::ROL, VMOpcode::ROR, VMOpcode::SHL, VMOpcode::SHR
+};
+
+class RandomProgram {
+private:
+    std::mt19937 random;
+    VMTestProgram program;
+    uint16_t masks;
+    bool self_modifying;
+    
+    // Code words the self-modifying XORs may toggle, with a fixed mask each
+    // so that every word only ever holds one of two values
+    std::vector<std::pair<uint16_t, uint16_t>> toggles;
+    std::vector<uint16_t> stores;   // Operand words of the self-modifying XORs
+    std::vector<int> store_targets; // Toggle each store rewrites, -1 for a random one
+    
+    uint32_t below(uint32_t bound) { return random() % bound; }
+    
+    uint16_t data() { return static_cast<uint16_t>(TEST_DATA + below(0x100)); }
+    
+    // Writable operand: a data cell, directly or through a pointer cell
+    std::pair<uint16_t, AddressingMode> destination() {
+        if (below(3) == 0) {
+            return { static_cast<uint16_t>(TEST_POINTERS + below(16)), AddressingMode::INDIRECT };
+        }
+        return { data(), AddressingMode::DIRECT };
+    }
+    
+    // Readable operand: anything a destination can be, a pointer chain,
+    // the code itself or the SP and IP cells
+    std::pair<uint16_t, AddressingMode> source() {
+        switch (below(8)) {
+            case 0:
+                return { static_cast<uint16_t>(TEST_DOUBLE + below(8)), AddressingMode::DOUBLE_INDIRECT };
+            case 1:
+                return { static_cast<uint16_t>(below(2) ? VM_INSTRUCTION_POINTER : VM_STACK_POINTER),
+                         AddressingMode::DIRECT };
+            case 2:
+                return { static_cast<uint16_t>(below(program.here() + 1)), AddressingMode::DIRECT };
+            default:
+                return destination();
+        }
+    }
+    
+    // Destination operand word of the instruction just emitted, when it
+    // names a data cell directly
+    void add_data_toggle(AddressingMode mode) {
+        if (mode == AddressingMode::DIRECT) {
+            toggles.push_back({ static_cast<uint16_t>(program.here() - 2), static_cast<uint16_t>(1 + below(0xFF)) });
+        }
+    }
+    
+    void emit_binary() {
+        auto dst = destination();
+        uint32_t kind = below(TEST_TOGGLED_COUNT + 1);
+        if (kind < TEST_TOGGLED_COUNT) {
+            VMOpcode opcode = TEST_TOGGLED[kind];
+            VMOpcode other = TEST_TOGGLED[(kind + 1 + below(TEST_TOGGLED_COUNT - 1)) % TEST_TOGGLED_COUNT];
+            auto src = source();
+            uint16_t at = program.here();
+            program.emit(opcode, dst.first, src.first, dst.second, src.second);
+            toggles.push_back({ at, static_cast<uint16_t>((static_cast<uint16_t>(opcode) ^ static_cast<uint16_t>(other)) << 4) });
+            add_data_toggle(dst.second);
+        } else {
+            auto src = destination();
+            program.emit(VMOpcode::XCHG, dst.first, src.first, dst.second, src.second);
+        }
+    }
+    
+    void emit_instruction() {
+        switch (below(16)) {
+            case 0: case 1: case 2: case 3: case 4: case 5:
+                emit_binary();
+                break;
+            case 6: case 7: {
+                auto dst = destination();
+                program.emit(TEST_UNARY[below(7)], dst.first, dst.second);
+                break;
+            }
+            case 8: {
+                static const VMOpcode flag_ops[] = { VMOpcode::CLC, VMOpcode::STC, VMOpcode::CMC, VMOpcode::NOP };
+                program.emit(flag_ops[below(4)]);
+                break;
+            }
+            case 9:
+                program.emit(VMOpcode::PUSH, below(4) ? data() : VM_INSTRUCTION_POINTER);
+                program.emit(VMOpcode::POP, data());
+                break;
+            case 10: {
+                static const VMOpcode input_ops[] = { VMOpcode::IN, VMOpcode::IN_HEX, VMOpcode::IN_STR };
+                VMOpcode opcode = input_ops[below(3)];
+                program.emit(opcode, opcode == VMOpcode::IN_STR ? TEST_STRING : data());
+                break;
+            }
+            case 11:
+                program.emit(VMOpcode::OUT, data());
+                break;
+            case 12: case 13:
+                emit_skip();
+                break;
+            default:
+                emit_store();
+                break;
+        }
+    }
+    
+    // Jcc over a random two-operand instruction
+    void emit_skip() {
+        uint16_t branch = program.here();
+        program.emit(static_cast<VMOpcode>(static_cast<uint16_t>(VMOpcode::JZ) + below(12)), 0);
+        emit_binary();
+        program.set(branch + 1, program.here());
+    }
+    
+    // XOR code, mask; operands are filled in once the body is known. Half
+    // the stores rewrite the instruction right after them, between a
+    // compare whose flags are live and a branch: the branch must see the
+    // flags of the XOR whatever the rewritten instruction does.
+    void emit_store() {
+        bool adjacent = below(2);
+        if (adjacent) {
+            program.emit(VMOpcode::CMP, data(), data());
+            emit_skip();
+        }
+        
+        stores.push_back(program.here() + 1);
+        store_targets.push_back(adjacent ? static_cast<int>(toggles.size()) : -1);
+        program.emit(VMOpcode::XOR, 0, 0);
+        
+        if (adjacent) {
+            emit_binary();
+            emit_skip();
+        }
+    }
+    
+public:
+    // Without self-modification the XORs all store to the first data cell
+    explicit RandomProgram(uint32_t seed, bool self_modifying = true)
+        : random(seed), masks(TEST_MASKS), self_modifying(self_modifying) {}
+    
+    VMTestProgram generate() {
+        program.set(VM_STACK_POINTER, TEST_STACK);
+        program.emit(VMOpcode::MOV, TEST_COUNTER, masks);
+        program.set(masks++, static_cast<uint16_t>(20 + below(100)));
+        
+        uint16_t loop = program.here();
+        uint32_t body = TEST_BODY_MIN + below(TEST_BODY_MAX - TEST_BODY_MIN);
+        for (uint32_t count = 0; count < body; count++) {
+            emit_instruction();
+        }
+        program.emit(VMOpcode::DEC, TEST_COUNTER);
+        program.emit(VMOpcode::JNZ, loop);
+        program.emit(VMOpcode::HALT);
+        
+        for (size_t store = 0; store < stores.size(); store++) {
+            int target = store_targets[store];
+            if (target < 0 || static_cast<size_t>(target) >= toggles.size()) {
+                target = toggles.empty() ? -1 : static_cast<int>(below(static_cast<uint32_t>(toggles.size())));
+            }
+            if (!self_modifying) {
+                target = -1;
+            }
+            program.set(stores[store], target < 0 ? TEST_DATA : toggles[target].first);
+            program.set(stores[store] + 1, masks);
+            if (target >= 0) {
+                program.set(masks, toggles[target].second);
+            }
+            masks++;
+        }
+        
+        for (uint16_t address = TEST_DATA; address < TEST_DATA + 0x100; address++) {
+            program.set(address, static_cast<uint16_t>(below(0x2000)));
+        }
+        for (uint16_t pointer = 0; pointer < 16; pointer++) {
+            program.set(TEST_POINTERS + pointer, data());
+        }
+        for (uint16_t pointer = 0; pointer < 8; pointer++) {
+            program.set(TEST_DOUBLE + pointer, static_cast<uint16_t>(TEST_POINTERS + below(16)));
+        }
+        return program;
+    }
+    
+    std::string input() {
+        static const char alphabet[] = "0123456789abcdefx-XYZ \n";
+        std::string text(below(TEST_INPUT_MAX + 1), ' ');
+        for (char& character : text) {
+            character = alphabet[below(sizeof(alphabet) - 1)];
+        }
+        return text;
+    }
+};
+
+#endif // VM_TEST_RANDOM_H
\ No newline at end of file
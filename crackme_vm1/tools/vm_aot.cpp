@@ -0,0 +1,53 @@
+#include "../include/vm_core.h"
+#include "../include/vm_aot.h"
+#include <iostream>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+// Ahead-of-time translator: vm_aot <image> <output.cpp> [symbol] [entry...]
+// The image is a packed memory dump as accepted by VirtualMachine::load_image.
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: vm_aot <image> <output.cpp> [symbol] [entry...]" << std::endl;
+        return 2;
+    }
+    
+    try {
+        FILE* input = fopen(argv[1], "rb");
+        if (!input) {
+            std::cerr << "vm_aot: cannot open " << argv[1] << std::endl;
+            return 1;
+        }
+        
+        std::vector<uint8_t> image(0x3404);
+        size_t image_size = fread(image.data(), 1, image.size(), input);
+        fclose(input);
+        
+        VirtualMachine vm(0x3404, VMMemoryMode::SHADOW);
+        vm.initialize();
+        vm.load_image(image.data(), static_cast<uint32_t>(image_size));
+        
+        VMAotTranslator translator(vm);
+        for (int i = 4; i < argc; i++) {
+            translator.add_entry_point(static_cast<uint16_t>(strtoul(argv[i], nullptr, 0)));
+        }
+        
+        FILE* output = fopen(argv[2], "w");
+        if (!output) {
+            std::cerr << "vm_aot: cannot create " << argv[2] << std::endl;
+            return 1;
+        }
+        
+        translator.translate(output, argc > 3 ? argv[3] : "vm_aot_program");
+        fclose(output);
+        
+        std::cout << "Translated " << translator.get_instruction_count() 
+                  << " instructions" << std::endl;
+        return 0;
+        
+    } catch (const std::exception& e) {
+        std::cerr << "VM Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
\ No newline at end of file
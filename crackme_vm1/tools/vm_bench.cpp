@@ -0,0 +1,448 @@
+#include "../include/vm_core.h"
+#include "../include/vm_instructions.h"
+#include "../include/vm_profile.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Benchmark suite: vm_bench [output.json [baseline.json [tolerance %]]]
+// Microbenchmarks of the memory, decode, operand and stack primitives and
+// macrobenchmarks of synthetic guest programs on every interpreter core.
+// Each figure is the fastest of VM_BENCH_TRIALS timed trials in ns per
+// operation (per guest instruction for programs), which is far less
+// sensitive to other load on the host than a mean or median. With a baseline, every
+// result more than tolerance percent slower than its baseline entry is
+// reported and the exit status is 1.
+
+// Benchmark constants
+constexpr int VM_BENCH_TRIALS = 7;
+constexpr double VM_BENCH_TRIAL_SECONDS = 0.02;
+constexpr double VM_BENCH_DEFAULT_TOLERANCE = 15.0;     // Percent
+constexpr uint16_t VM_BENCH_LOOP_COUNT = 2000;          // Iterations per guest program run
+
+struct VMBenchResult {
+    std::string name;
+    double ns_per_op;
+    uint64_t guest_instructions;    // Per run, macrobenchmarks only
+};
+
+// Keeps benchmarked results observable
+static volatile uint32_t vm_bench_sink;
+
+// Fastest trial's ns per operation of body(), which performs ops operations. The
+// repetition count is calibrated so one trial lasts VM_BENCH_TRIAL_SECONDS.
+static double vm_bench_measure(const std::function<void()>& body, uint64_t ops) {
+    typedef std::chrono::steady_clock Clock;
+    
+    uint64_t repetitions = 1;
+    while (true) {
+        Clock::time_point start = Clock::now();
+        for (uint64_t repetition = 0; repetition < repetitions; repetition++) {
+            body();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (seconds >= VM_BENCH_TRIAL_SECONDS / 4 || repetitions >= (1ULL << 30)) {
+            repetitions = std::max<uint64_t>(1, static_cast<uint64_t>(repetitions * VM_BENCH_TRIAL_SECONDS / std::max(seconds, 1e-9)));
+            break;
+        }
+        repetitions *= 4;
+    }
+    
+    double best = 0.0;
+    for (int trial = 0; trial < VM_BENCH_TRIALS; trial++) {
+        Clock::time_point start = Clock::now();
+        for (uint64_t repetition = 0; repetition < repetitions; repetition++) {
+            body();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        double time = seconds * 1e9 / (static_cast<double>(repetitions) * ops);
+        if (trial == 0 || time < best) {
+            best = time;
+        }
+    }
+    return best;
+}
+
+// Guest program under construction: code from address 0, data wherever
+// the program places it
+struct VMBenchProgram {
+    std::vector<uint16_t> words;    // Memory image, code copied in by finish()
+    std::vector<uint16_t> code;
+    
+    VMBenchProgram() : words(0x2000, 0) {}
+    
+    uint16_t here() const { return static_cast<uint16_t>(code.size()); }
+    
+    void emit(VMOpcode opcode, uint8_t mode_dst = 0, uint8_t mode_src = 0) {
+        code.push_back(static_cast<uint16_t>((static_cast<uint16_t>(opcode) << 4) | (mode_dst << 2) | mode_src));
+    }
+    void emit_unary(VMOpcode opcode, uint16_t dst, uint8_t mode_dst = 0) {
+        emit(opcode, mode_dst, 0);
+        code.push_back(dst);
+    }
+    void emit_binary(VMOpcode opcode, uint16_t dst, uint16_t src, uint8_t mode_dst = 0, uint8_t mode_src = 0) {
+        emit(opcode, mode_dst, mode_src);
+        code.push_back(dst);
+        code.push_back(src);
+    }
+    
+    // Loop tail: ++counter until it reaches the limit cell
+    void loop(uint16_t top, uint16_t counter, uint16_t limit) {
+        emit_unary(VMOpcode::INC, counter);
+        emit_binary(VMOpcode::CMP, counter, limit);
+        emit_unary(VMOpcode::JNZ, top);
+    }
+    
+    void finish() {
+        emit(VMOpcode::HALT);
+        std::copy(code.begin(), code.end(), words.begin());
+    }
+};
+
+// Data layout shared by the synthetic programs
+constexpr uint16_t VM_BENCH_COUNTER = 0x1000;
+constexpr uint16_t VM_BENCH_LIMIT = 0x1001;
+constexpr uint16_t VM_BENCH_ZERO = 0x1002;
+constexpr uint16_t VM_BENCH_VALUES = 0x1100;    // 256 pseudo-random words
+constexpr uint16_t VM_BENCH_POINTERS = 0x1200;  // Pointer chains into the values
+constexpr uint16_t VM_BENCH_STACK = 0x1F00;     // Initial SP, grows down
+
+static uint16_t vm_bench_random(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return static_cast<uint16_t>(state >> 19);
+}
+
+static void vm_bench_data(VMBenchProgram& program) {
+    uint32_t state = 0x13579BDF;
+    program.words[VM_BENCH_LIMIT] = VM_BENCH_LOOP_COUNT;
+    for (uint16_t index = 0; index < 256; index++) {
+        program.words[VM_BENCH_VALUES + index] = vm_bench_random(state);
+    }
+    
+    // Three levels: POINTERS -> POINTERS+16 -> POINTERS+32 -> VALUES
+    for (uint16_t index = 0; index < 16; index++) {
+        program.words[VM_BENCH_POINTERS + index] = VM_BENCH_POINTERS + 16 + index;
+        program.words[VM_BENCH_POINTERS + 16 + index] = VM_BENCH_POINTERS + 32 + index;
+        program.words[VM_BENCH_POINTERS + 32 + index] = VM_BENCH_VALUES + vm_bench_random(state) % 256;
+    }
+}
+
+// Arithmetic and shifts on direct operands
+static VMBenchProgram vm_bench_alu_program() {
+    VMBenchProgram program;
+    program.emit_binary(VMOpcode::MOV, VM_BENCH_COUNTER, VM_BENCH_ZERO);
+    uint16_t top = program.here();
+    program.emit_binary(VMOpcode::ADD, VM_BENCH_VALUES, VM_BENCH_VALUES + 1);
+    program.emit_binary(VMOpcode::XOR, VM_BENCH_VALUES + 2, VM_BENCH_VALUES);
+    program.emit_unary(VMOpcode::SHL, VM_BENCH_VALUES + 3);
+    program.emit_unary(VMOpcode::ROR, VM_BENCH_VALUES + 2);
+    program.emit_binary(VMOpcode::SUB, VM_BENCH_VALUES + 4, VM_BENCH_VALUES + 2);
+    program.emit_binary(VMOpcode::AND, VM_BENCH_VALUES + 5, VM_BENCH_VALUES + 4);
+    program.emit_binary(VMOpcode::OR, VM_BENCH_VALUES + 3, VM_BENCH_VALUES + 5);
+    program.emit_unary(VMOpcode::NOT, VM_BENCH_VALUES + 1);
+    program.loop(top, VM_BENCH_COUNTER, VM_BENCH_LIMIT);
+    program.finish();
+    vm_bench_data(program);
+    return program;
+}
+
+// Data-dependent conditional jumps over a scrambled value
+static VMBenchProgram vm_bench_branch_program() {
+    VMBenchProgram program;
+    const uint16_t value = VM_BENCH_VALUES;
+    const uint16_t mix = VM_BENCH_VALUES + 1;
+    const uint16_t mask = VM_BENCH_VALUES + 2;
+    const uint16_t scratch = VM_BENCH_VALUES + 3;
+    
+    program.emit_binary(VMOpcode::MOV, VM_BENCH_COUNTER, VM_BENCH_ZERO);
+    uint16_t top = program.here();
+    program.emit_unary(VMOpcode::ROL, value);
+    program.emit_binary(VMOpcode::XOR, value, mix);
+    program.emit_binary(VMOpcode::ADD, mix, value);
+    for (int bit = 0; bit < 4; bit++) {
+        // if (value & mask) scratch++ else scratch--, mask rotates each test
+        program.emit_binary(VMOpcode::MOV, scratch + 1, value);
+        program.emit_binary(VMOpcode::AND, scratch + 1, mask);
+        uint16_t jump = program.here();
+        program.emit_unary(VMOpcode::JZ, static_cast<uint16_t>(jump + 6));
+        program.emit_unary(VMOpcode::INC, scratch);
+        program.emit_unary(VMOpcode::JMP, static_cast<uint16_t>(jump + 8));
+        program.emit_unary(VMOpcode::DEC, scratch);
+        program.emit_unary(VMOpcode::ROL, mask);
+    }
+    program.loop(top, VM_BENCH_COUNTER, VM_BENCH_LIMIT);
+    program.finish();
+    vm_bench_data(program);
+    program.words[mask] = 0x0421;
+    return program;
+}
+
+// Operands through one, two and three levels of indirection
+static VMBenchProgram vm_bench_indirect_program() {
+    VMBenchProgram program;
+    program.emit_binary(VMOpcode::MOV, VM_BENCH_COUNTER, VM_BENCH_ZERO);
+    uint16_t top = program.here();
+    for (uint16_t index = 0; index < 4; index++) {
+        program.emit_binary(VMOpcode::ADD, static_cast<uint16_t>(VM_BENCH_VALUES + 0x80 + index),
+                     static_cast<uint16_t>(VM_BENCH_POINTERS + index), 0, 3);
+        program.emit_binary(VMOpcode::XOR, static_cast<uint16_t>(VM_BENCH_POINTERS + 16 + index),
+                     static_cast<uint16_t>(VM_BENCH_POINTERS + 4 + index), 2, 3);
+        program.emit_binary(VMOpcode::MOV, static_cast<uint16_t>(VM_BENCH_VALUES + 0x90 + index),
+                     static_cast<uint16_t>(VM_BENCH_POINTERS + 32 + index), 0, 1);
+    }
+    program.loop(top, VM_BENCH_COUNTER, VM_BENCH_LIMIT);
+    program.finish();
+    vm_bench_data(program);
+    return program;
+}
+
+// Balanced pushes and pops
+static VMBenchProgram vm_bench_stack_program() {
+    VMBenchProgram program;
+    program.emit_binary(VMOpcode::MOV, VM_BENCH_COUNTER, VM_BENCH_ZERO);
+    uint16_t top = program.here();
+    for (uint16_t index = 0; index < 6; index++) {
+        program.emit_unary(VMOpcode::PUSH, static_cast<uint16_t>(VM_BENCH_VALUES + index));
+    }
+    for (uint16_t index = 0; index < 6; index++) {
+        program.emit_unary(VMOpcode::POP, static_cast<uint16_t>(VM_BENCH_VALUES + 0x40 + index));
+    }
+    program.loop(top, VM_BENCH_COUNTER, VM_BENCH_LIMIT);
+    program.finish();
+    vm_bench_data(program);
+    return program;
+}
+
+static void vm_bench_micro(std::vector<VMBenchResult>& results) {
+    std::vector<uint8_t> buffer(0x3404, 0);
+    uint32_t state = 0x2468ACE1;
+    for (uint8_t& byte : buffer) {
+        byte = static_cast<uint8_t>(vm_bench_random(state));
+    }
+    
+    // Packed word access at each of the 8 bit offsets a 13-bit word can start at
+    std::vector<uint16_t> addresses[8];
+    for (uint16_t address = 0; address < 0x1FFE; address++) {
+        addresses[VMMemoryManager::calculate_bit_offset(address)].push_back(address);
+    }
+    for (int offset = 0; offset < 8; offset++) {
+        const std::vector<uint16_t>& list = addresses[offset];
+        
+        double read = vm_bench_measure([&]() {
+            uint32_t sum = 0;
+            for (uint16_t address : list) {
+                sum += VMMemoryManager::read_buffer_value(buffer.data(), address);
+            }
+            vm_bench_sink = sum;
+        }, list.size());
+        results.push_back({ "micro/read_buffer_value/bit" + std::to_string(offset), read, 0 });
+        
+        double write = vm_bench_measure([&]() {
+            uint16_t value = static_cast<uint16_t>(vm_bench_sink);
+            for (uint16_t address : list) {
+                VMMemoryManager::write_buffer_value(buffer.data(), address, value++ & 0x1FFF);
+            }
+            vm_bench_sink = value;
+        }, list.size());
+        results.push_back({ "micro/write_buffer_value/bit" + std::to_string(offset), write, 0 });
+    }
+    
+    // Decode of every instruction word
+    double decode = vm_bench_measure([]() {
+        uint32_t sum = 0;
+        for (uint16_t word = 0; word < 0x2000; word++) {
+            VMInstruction instruction = VMInstruction::decode(word);
+            sum += instruction.opcode + instruction.mode_dst + instruction.mode_src;
+        }
+        vm_bench_sink = sum;
+    }, 0x2000);
+    results.push_back({ "micro/instruction_decode", decode, 0 });
+    
+    // Operand resolution per addressing mode, through random pointers
+    static const char* const mode_names[] = { "direct", "indirect", "double_indirect", "triple_indirect" };
+    for (int mode = 0; mode < 4; mode++) {
+        double resolve = vm_bench_measure([&]() {
+            uint32_t sum = 0;
+            for (uint16_t address = 0; address < 0x1000; address++) {
+                sum += OperandResolver::resolve_operand_address(buffer.data(), address,
+                                                                static_cast<AddressingMode>(mode));
+            }
+            vm_bench_sink = sum;
+        }, 0x1000);
+        results.push_back({ std::string("micro/resolve_operand/") + mode_names[mode], resolve, 0 });
+    }
+    
+    // Stack pairs on a machine outside execute()
+    static const VMMemoryMode memory_modes[] = { VMMemoryMode::PACKED, VMMemoryMode::SHADOW };
+    static const char* const memory_names[] = { "packed", "shadow" };
+    for (int mode = 0; mode < 2; mode++) {
+        VirtualMachine vm(0x3404, memory_modes[mode]);
+        vm.initialize();
+        double stack = vm_bench_measure([&]() {
+            uint32_t sum = 0;
+            for (uint16_t value = 0; value < 256; value++) {
+                vm.push(value);
+                sum += vm.pop();
+            }
+            vm_bench_sink = sum;
+        }, 256);
+        results.push_back({ std::string("micro/push_pop/") + memory_names[mode], stack, 0 });
+    }
+}
+
+static void vm_bench_macro(std::vector<VMBenchResult>& results) {
+    struct Workload {
+        const char* name;
+        VMBenchProgram program;
+    };
+    std::vector<Workload> workloads;
+    workloads.push_back({ "alu", vm_bench_alu_program() });
+    workloads.push_back({ "branch", vm_bench_branch_program() });
+    workloads.push_back({ "indirect", vm_bench_indirect_program() });
+    workloads.push_back({ "stack", vm_bench_stack_program() });
+    
+    static const char* const core_names[] = { "executor", "threaded", "specialized", "jit" };
+    FILE* sink = fopen(
+#ifdef _WIN32
+        "NUL",
+#else
+        "/dev/null",
+#endif
+        "w");
+    
+    for (const Workload& workload : workloads) {
+        VirtualMachine vm(0x3404, VMMemoryMode::SHADOW);
+        vm.get_runtime().stdout_stream = sink;
+        vm.initialize();
+        for (uint16_t address = 0; address < VM_STACK_POINTER; address++) {
+            vm.write_memory(address, workload.program.words[address]);
+        }
+        
+        // Programs reinitialize their counter, so a rerun only resets IP and SP
+        auto rerun = [&]() {
+            vm.write_memory(VM_INSTRUCTION_POINTER, 0);
+            vm.write_memory(VM_STACK_POINTER, VM_BENCH_STACK);
+            vm.execute();
+        };
+        
+        VMProfiler profiler;
+        vm.set_profiler(&profiler);
+        rerun();
+        vm.set_profiler(nullptr);
+        uint64_t steps = profiler.get_steps();
+        
+        for (int core = 0; core < 4; core++) {
+            vm.set_dispatch_mode(static_cast<VMDispatchMode>(core));
+            if (static_cast<VMDispatchMode>(core) == VMDispatchMode::JIT && !vm.is_jit_available()) {
+                std::cerr << "vm_bench: JIT unavailable, macro/" << workload.name
+                          << "/jit measures the specialized handlers" << std::endl;
+            }
+            rerun();
+            double time = vm_bench_measure(rerun, steps);
+            results.push_back({ std::string("macro/") + workload.name + "/" + core_names[core], time, steps });
+        }
+    }
+    
+    if (sink) {
+        fclose(sink);
+    }
+}
+
+// One result per line, in suite order, so files diff cleanly
+static void vm_bench_write_json(FILE* output, const std::vector<VMBenchResult>& results) {
+    fprintf(output, "{\n  \"version\": 1,\n  \"unit\": \"ns_per_op\",\n  \"results\": [\n");
+    for (size_t index = 0; index < results.size(); index++) {
+        const VMBenchResult& result = results[index];
+        fprintf(output, "    {\"name\": \"%s\", \"ns_per_op\": %.4f", result.name.c_str(), result.ns_per_op);
+        if (result.guest_instructions) {
+            fprintf(output, ", \"guest_instructions\": %llu",
+                    static_cast<unsigned long long>(result.guest_instructions));
+        }
+        fprintf(output, "}%s\n", index + 1 < results.size() ? "," : "");
+    }
+    fprintf(output, "  ]\n}\n");
+}
+
+// Reads the name/ns_per_op pairs of a file written by vm_bench_write_json
+static bool vm_bench_read_json(const char* path, std::map<std::string, double>& baseline) {
+    FILE* input = fopen(path, "r");
+    if (!input) {
+        return false;
+    }
+    
+    char line[512];
+    while (fgets(line, sizeof(line), input)) {
+        const char* name = strstr(line, "\"name\": \"");
+        const char* value = strstr(line, "\"ns_per_op\": ");
+        if (!name || !value) {
+            continue;
+        }
+        name += strlen("\"name\": \"");
+        const char* end = strchr(name, '"');
+        if (end) {
+            baseline[std::string(name, end)] = strtod(value + strlen("\"ns_per_op\": "), nullptr);
+        }
+    }
+    fclose(input);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        double tolerance = argc > 3 ? strtod(argv[3], nullptr) : VM_BENCH_DEFAULT_TOLERANCE;
+        std::map<std::string, double> baseline;
+        if (argc > 2 && !vm_bench_read_json(argv[2], baseline)) {
+            std::cerr << "vm_bench: cannot read baseline " << argv[2] << std::endl;
+            return 2;
+        }
+        
+        std::vector<VMBenchResult> results;
+        vm_bench_micro(results);
+        vm_bench_macro(results);
+        
+        int regressions = 0;
+        for (const VMBenchResult& result : results) {
+            printf("%-40s %10.3f ns", result.name.c_str(), result.ns_per_op);
+            
+            auto entry = baseline.find(result.name);
+            if (entry != baseline.end() && entry->second > 0) {
+                double change = (result.ns_per_op / entry->second - 1.0) * 100.0;
+                printf("  %+7.1f%%", change);
+                if (change > tolerance) {
+                    printf("  REGRESSION");
+                    regressions++;
+                }
+            } else if (!baseline.empty()) {
+                printf("  (new)");
+            }
+            printf("\n");
+        }
+        
+        if (argc > 1) {
+            FILE* output = fopen(argv[1], "w");
+            if (!output) {
+                std::cerr << "vm_bench: cannot create " << argv[1] << std::endl;
+                return 2;
+            }
+            vm_bench_write_json(output, results);
+            fclose(output);
+        }
+        
+        if (regressions) {
+            fprintf(stderr, "%d benchmarks regressed by more than %.1f%%\n", regressions, tolerance);
+            return 1;
+        }
+        return 0;
+    
+    } catch (const std::exception& e) {
+        std::cerr << "VM Error: " << e.what() << std::endl;
+        return 2;
+    }
+}
\ No newline at end of file
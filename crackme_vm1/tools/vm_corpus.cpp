@@ -0,0 +1,109 @@
+#include "../include/vm_core.h"
+#include "../include/vm_corpus.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Corpus evaluation:
+//   vm_corpus pack <corpus>                         one record per stdin line (newline kept)
+//   vm_corpus run <image> <corpus> <results> [threads] [cycles]
+//   vm_corpus dump <results>                        one row per input
+// cycles stops inputs on which the guest loops forever.
+static void usage() {
+    std::cerr << "usage: vm_corpus pack <corpus>" << std::endl
+              << "       vm_corpus run <image> <corpus> <results> [threads] [cycles]" << std::endl
+              << "       vm_corpus dump <results>" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+    
+    try {
+        if (strcmp(argv[1], "pack") == 0) {
+            FILE* output = fopen(argv[2], "wb");
+            if (!output) {
+                std::cerr << "vm_corpus: cannot create " << argv[2] << std::endl;
+                return 1;
+            }
+            
+            VMCorpus::write_header(output);
+            uint64_t records = 0;
+            std::string line;
+            while (std::getline(std::cin, line)) {
+                line.push_back('\n');
+                VMCorpus::write_record(output, line.data(), static_cast<uint32_t>(line.size()));
+                records++;
+            }
+            fclose(output);
+            
+            std::cout << "Packed " << records << " records" << std::endl;
+            return 0;
+        }
+        
+        if (strcmp(argv[1], "dump") == 0) {
+            FILE* input = fopen(argv[2], "rb");
+            if (!input) {
+                std::cerr << "vm_corpus: cannot open " << argv[2] << std::endl;
+                return 1;
+            }
+            
+            vm_corpus_read_results(input, [](uint64_t index, const VMCorpusResult& result) {
+                printf("%llu %d %x %llu %016llx\n", static_cast<unsigned long long>(index),
+                       static_cast<int>(result.status), result.flags,
+                       static_cast<unsigned long long>(result.steps),
+                       static_cast<unsigned long long>(result.output_hash));
+            });
+            fclose(input);
+            return 0;
+        }
+        
+        if (strcmp(argv[1], "run") != 0 || argc < 5) {
+            usage();
+            return 2;
+        }
+        
+        FILE* input = fopen(argv[2], "rb");
+        if (!input) {
+            std::cerr << "vm_corpus: cannot open " << argv[2] << std::endl;
+            return 1;
+        }
+        
+        std::vector<uint8_t> image(0x3404);
+        size_t image_size = fread(image.data(), 1, image.size(), input);
+        fclose(input);
+        
+        VMCorpus corpus(argv[3]);
+        VMCorpusPipeline pipeline(image.data(), static_cast<uint32_t>(image_size));
+        for (int arg = 5; arg < argc; arg++) {
+            if (strcmp(argv[arg], "cycles") == 0) {
+                pipeline.set_cycle_detection(true);
+            } else {
+                pipeline.set_threads(static_cast<uint32_t>(strtoul(argv[arg], nullptr, 0)));
+            }
+        }
+        
+        FILE* results = fopen(argv[4], "wb");
+        if (!results) {
+            std::cerr << "vm_corpus: cannot create " << argv[4] << std::endl;
+            return 1;
+        }
+        
+        VMCorpusSummary summary = pipeline.run(corpus, results);
+        fclose(results);
+        
+        std::cout << summary.records << " inputs (" << summary.input_bytes << " bytes) in "
+                  << summary.seconds << " s (" << (summary.seconds > 0 ? summary.records / summary.seconds : 0)
+                  << " inputs/s), " << summary.faults << " faults, " << summary.cycles << " cycles" << std::endl;
+        return 0;
+    
+    } catch (const std::exception& e) {
+        std::cerr << "VM Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "../include/vm_core.h"
+#include "../include/vm_image.h"
+#include <iostream>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Image builder: vm_image <packed image> <output image> [symbols]
+// The packed image is a memory dump as accepted by VirtualMachine::load_image;
+// its IP and SP cells become the entry. The symbols file holds one
+// "name address" label per line, names cut to 25 characters. Basic
+// blocks reachable from the entry are added to the symbol table.
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: vm_image <packed image> <output image> [symbols]" << std::endl;
+        return 2;
+    }
+    
+    try {
+        FILE* input = fopen(argv[1], "rb");
+        if (!input) {
+            std::cerr << "vm_image: cannot open " << argv[1] << std::endl;
+            return 1;
+        }
+        
+        std::vector<uint8_t> image(0x3404);
+        size_t image_size = fread(image.data(), 1, image.size(), input);
+        fclose(input);
+        
+        VirtualMachine vm(0x3404, VMMemoryMode::SHADOW);
+        vm.initialize();
+        vm.load_image(image.data(), static_cast<uint32_t>(image_size));
+        
+        std::vector<VMImageSymbol> symbols;
+        if (argc > 3) {
+            input = fopen(argv[3], "r");
+            if (!input) {
+                std::cerr << "vm_image: cannot open " << argv[3] << std::endl;
+                return 1;
+            }
+            
+            char name[64];
+            int address;
+            while (fscanf(input, "%63s %i", name, &address) == 2) {
+                VMImageSymbol symbol;
+                memset(&symbol, 0, sizeof(symbol));
+                symbol.address = address & 0x1FFF;
+                symbol.kind = VM_IMAGE_SYMBOL_LABEL;
+                size_t length = strnlen(name, VM_IMAGE_SYMBOL_NAME_SIZE - 1);
+                memcpy(symbol.name, name, length);
+                symbol.name[length] = '\0';
+                symbols.push_back(symbol);
+            }
+            fclose(input);
+        }
+        
+        std::vector<VMImageSymbol> blocks = vm_image_find_blocks(vm);
+        symbols.insert(symbols.end(), blocks.begin(), blocks.end());
+        
+        FILE* output = fopen(argv[2], "wb");
+        if (!output) {
+            std::cerr << "vm_image: cannot create " << argv[2] << std::endl;
+            return 1;
+        }
+        
+        VMImage::write(output, vm, symbols);
+        fclose(output);
+        
+        std::cout << "Wrote " << blocks.size() << " basic blocks, "
+                  << symbols.size() - blocks.size() << " labels" << std::endl;
+        return 0;
+    
+    } catch (const std::exception& e) {
+        std::cerr << "VM Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include "../include/vm_core.h"
+#include "../include/vm_perf.h"
+#include "../include/vm_profile.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+// Hardware counters per interpreter core: vm_perf <image> [runs] [input]
+// Runs the image runs times on every dispatch mode with the input file
+// (empty without one) fed through memory I/O, counting each execute().
+// Guest instruction counts come from one extra profiled run.
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: vm_perf <image> [runs] [input]" << std::endl;
+        return 2;
+    }
+    
+    try {
+        FILE* file = fopen(argv[1], "rb");
+        if (!file) {
+            std::cerr << "vm_perf: cannot open " << argv[1] << std::endl;
+            return 1;
+        }
+        
+        std::vector<uint8_t> image(0x3404);
+        uint32_t image_size = static_cast<uint32_t>(fread(image.data(), 1, image.size(), file));
+        fclose(file);
+        
+        uint32_t runs = argc > 2 ? static_cast<uint32_t>(strtoul(argv[2], nullptr, 0)) : 100;
+        
+        VMMemoryIO io;
+        io.input_position = 0;
+        io.suspend = false;
+        if (argc > 3) {
+            file = fopen(argv[3], "rb");
+            if (!file) {
+                std::cerr << "vm_perf: cannot open " << argv[3] << std::endl;
+                return 1;
+            }
+            int c;
+            while ((c = fgetc(file)) != EOF) {
+                io.input.push_back(static_cast<char>(c));
+            }
+            fclose(file);
+        }
+        
+        VirtualMachine vm(0x3404, VMMemoryMode::SHADOW);
+        vm.get_runtime().memory_io = &io;
+        
+        auto prepare = [&]() {
+            vm.initialize();
+            vm.load_image(image.data(), image_size);
+            io.input_position = 0;
+            io.output.clear();
+        };
+        
+        VMProfiler profiler;
+        prepare();
+        vm.set_profiler(&profiler);
+        vm.execute();
+        vm.set_profiler(nullptr);
+        uint64_t steps = profiler.get_steps();
+        
+        VMPerfCounters counters;
+        if (!counters.is_available()) {
+            std::cerr << "vm_perf: perf events unavailable on this host" << std::endl;
+            return 1;
+        }
+        
+        static const char* const mode_names[] = { "EXECUTOR", "THREADED", "SPECIALIZED", "JIT" };
+        std::cout << steps << " guest instructions per run, " << runs << " runs per core" << std::endl;
+        
+        for (int mode = 0; mode < 4; mode++) {
+            vm.set_dispatch_mode(static_cast<VMDispatchMode>(mode));
+            if (static_cast<VMDispatchMode>(mode) == VMDispatchMode::JIT && !vm.is_jit_available()) {
+                std::cerr << "vm_perf: JIT unavailable, JIT counts the specialized handlers" << std::endl;
+            }
+            counters.clear();
+            
+            for (uint32_t run = 0; run < runs; run++) {
+                prepare();
+                counters.start();
+                vm.execute();
+                counters.stop(steps);
+            }
+            
+            std::cout << std::endl << mode_names[mode] << std::endl;
+            fflush(stdout);
+            counters.get_totals().write_report(stdout);
+        }
+        return 0;
+    
+    } catch (const std::exception& e) {
+        std::cerr << "VM Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
\ No newline at end of file
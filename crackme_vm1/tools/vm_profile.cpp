@@ -0,0 +1,57 @@
+#include "../include/vm_core.h"
+#include "../include/vm_profile.h"
+#include <iostream>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+// Execution profiler: vm_profile <image> <profile.json> [sample interval]
+// Runs the image against the console streams, writes the JSON profile
+// and prints the text report to stderr.
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: vm_profile <image> <profile.json> [sample interval]" << std::endl;
+        return 2;
+    }
+    
+    try {
+        FILE* input = fopen(argv[1], "rb");
+        if (!input) {
+            std::cerr << "vm_profile: cannot open " << argv[1] << std::endl;
+            return 1;
+        }
+        
+        std::vector<uint8_t> image(0x3404);
+        size_t image_size = fread(image.data(), 1, image.size(), input);
+        fclose(input);
+        
+        VMProfiler profiler(argc > 3 ? static_cast<uint32_t>(strtoul(argv[3], nullptr, 0))
+                                     : VM_PROFILE_DEFAULT_SAMPLE_INTERVAL);
+        
+        VirtualMachine vm(0x3404, VMMemoryMode::SHADOW);
+        vm.initialize();
+        vm.load_image(image.data(), static_cast<uint32_t>(image_size));
+        vm.set_profiler(&profiler);
+        
+        VMStatus status = vm.execute();
+        fflush(stdout);
+        if (status == VMStatus::MEMORY_FAULT) {
+            std::cerr << "VM memory fault at 0x" << std::hex << vm.get_fault_address() << std::dec << std::endl;
+        }
+        
+        FILE* output = fopen(argv[2], "w");
+        if (!output) {
+            std::cerr << "vm_profile: cannot create " << argv[2] << std::endl;
+            return 1;
+        }
+        profiler.write_json(output);
+        fclose(output);
+        
+        profiler.write_report(stderr);
+        return status == VMStatus::MEMORY_FAULT ? 1 : 0;
+    
+    } catch (const std::exception& e) {
+        std::cerr << "VM Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include "../include/vm_core.h"
+#include "../include/vm_search.h"
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Parallel input search: vm_search <image> <space> <condition> [threads] [prefix] [prune] [cycles] [limit <steps>] [perf]
+//   space:     range <first> <count> [hex] | charset <chars> <min> <max> | hex <words>
+//   condition: output <text> | memory <address> <value>
+//   prefix:    resume candidates from forks taken at shared input prefixes
+//   prune:     with prefix, skip candidates whose prefix reaches an already seen state
+//   cycles:    stop candidates whose state repeats instead of running forever
+//   limit:     give up on candidates after that many instructions
+//   perf:      report host hardware counters summed over every execution
+static void usage() {
+    std::cerr << "usage: vm_search <image> <space> <condition> [threads] [prefix] [prune] [cycles] [limit <steps>] [perf]"
+              << std::endl
+              << "  space:     range <first> <count> [hex] | charset <chars> <min> <max> | hex <words>" << std::endl
+              << "  condition: output <text> | memory <address> <value>" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 5) {
+        usage();
+        return 2;
+    }
+    
+    try {
+        FILE* input = fopen(argv[1], "rb");
+        if (!input) {
+            std::cerr << "vm_search: cannot open " << argv[1] << std::endl;
+            return 1;
+        }
+        
+        std::vector<uint8_t> image(0x3404);
+        size_t image_size = fread(image.data(), 1, image.size(), input);
+        fclose(input);
+        
+        int arg = 2;
+        std::unique_ptr<VMInputSpace> space;
+        if (strcmp(argv[arg], "range") == 0 && arg + 2 < argc) {
+            bool hex = arg + 3 < argc && strcmp(argv[arg + 3], "hex") == 0;
+            space.reset(new VMRangeInputSpace(strtoull(argv[arg + 1], nullptr, 0),
+                                              strtoull(argv[arg + 2], nullptr, 0), hex ? 16 : 10));
+            arg += hex ? 4 : 3;
+        } else if (strcmp(argv[arg], "charset") == 0 && arg + 3 < argc) {
+            space.reset(new VMCharsetInputSpace(argv[arg + 1],
+                                                static_cast<uint32_t>(strtoul(argv[arg + 2], nullptr, 0)),
+                                                static_cast<uint32_t>(strtoul(argv[arg + 3], nullptr, 0))));
+            arg += 4;
+        } else if (strcmp(argv[arg], "hex") == 0 && arg + 1 < argc) {
+            space.reset(new VMHexWordInputSpace(static_cast<uint32_t>(strtoul(argv[arg + 1], nullptr, 0))));
+            arg += 2;
+        } else {
+            usage();
+            return 2;
+        }
+        
+        VMSearchPredicate success;
+        if (arg + 1 < argc && strcmp(argv[arg], "output") == 0) {
+            success = vm_search_output_contains(argv[arg + 1]);
+            arg += 2;
+        } else if (arg + 2 < argc && strcmp(argv[arg], "memory") == 0) {
+            success = vm_search_memory_equals(static_cast<uint16_t>(strtoul(argv[arg + 1], nullptr, 0)),
+                                              static_cast<uint16_t>(strtoul(argv[arg + 2], nullptr, 0)));
+            arg += 3;
+        } else {
+            usage();
+            return 2;
+        }
+        
+        VMSearch search(image.data(), static_cast<uint32_t>(image_size));
+        if (arg < argc && strtoul(argv[arg], nullptr, 0) != 0) {
+            search.set_threads(static_cast<uint32_t>(strtoul(argv[arg], nullptr, 0)));
+            arg++;
+        }
+        bool perf = false;
+        for (; arg < argc; arg++) {
+            if (strcmp(argv[arg], "prefix") == 0) {
+                search.set_prefix_sharing(true);
+            } else if (strcmp(argv[arg], "prune") == 0) {
+                search.set_state_pruning(true);
+            } else if (strcmp(argv[arg], "cycles") == 0) {
+                search.set_cycle_detection(true);
+            } else if (strcmp(argv[arg], "limit") == 0 && arg + 1 < argc) {
+                search.set_step_limit(strtoull(argv[++arg], nullptr, 0));
+            } else if (strcmp(argv[arg], "perf") == 0) {
+                perf = true;
+            }
+        }
+        search.set_perf_counters(perf);
+        
+        search.set_reporter([](const VMSearchProgress& progress) {
+            fprintf(stderr, "\r%llu / %llu executions, %.0f exec/s   ",
+                    static_cast<unsigned long long>(progress.executions),
+                    static_cast<unsigned long long>(progress.total),
+                    progress.executions_per_second);
+        });
+        
+        VMSearchResult result = search.run(*space, success);
+        fprintf(stderr, "\n");
+        
+        std::cout << result.executions << " executions in " << result.seconds << " s ("
+                  << (result.seconds > 0 ? result.executions / result.seconds : 0) << " exec/s)" << std::endl;
+        if (result.pruned) {
+            std::cout << result.pruned << " candidates pruned as duplicate states" << std::endl;
+        }
+        if (result.exhausted) {
+            std::cout << result.exhausted << " candidates stopped by the step limit" << std::endl;
+        }
+        if (perf) {
+            fflush(stdout);
+            result.perf.write_report(stdout);
+        }
+        
+        if (!result.found) {
+            std::cout << "No input satisfied the condition" << std::endl;
+            return 1;
+        }
+        
+        std::cout << "Found candidate " << result.index << ": " << result.input;
+        if (result.input.empty() || result.input.back() != '\n') {
+            std::cout << std::endl;
+        }
+        return 0;
+    
+    } catch (const std::exception& e) {
+        std::cerr << "VM Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "../include/vm_trace.h"
+#include "../include/vm_instructions.h"
+#include <iostream>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+// Trace decoder: vm_trace <trace> [tracer id]
+// Prints one line per record of a VMTraceWriter file:
+//   tracer step ip: mnemonic dst=[address]value src=[address]value -> result flags
+static uint32_t read_field(FILE* input, int bytes, bool& ok) {
+    uint32_t value = 0;
+    for (int byte = 0; byte < bytes; byte++) {
+        int c = fgetc(input);
+        if (c == EOF) {
+            ok = false;
+            return 0;
+        }
+        value |= static_cast<uint32_t>(c) << (byte * 8);
+    }
+    return value;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: vm_trace <trace> [tracer id]" << std::endl;
+        return 2;
+    }
+    
+    FILE* input = fopen(argv[1], "rb");
+    if (!input) {
+        std::cerr << "vm_trace: cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+    
+    bool ok = true;
+    if (read_field(input, 4, ok) != VM_TRACE_FILE_MAGIC || read_field(input, 2, ok) != VM_TRACE_FILE_VERSION ||
+        read_field(input, 2, ok) != sizeof(VMTraceRecord) || !ok) {
+        std::cerr << "vm_trace: " << argv[1] << " is not a trace file" << std::endl;
+        fclose(input);
+        return 1;
+    }
+    
+    bool filter = argc > 2;
+    uint32_t wanted = filter ? static_cast<uint32_t>(strtoul(argv[2], nullptr, 0)) : 0;
+    uint64_t printed = 0;
+    std::vector<VMTraceRecord> records;
+    
+    while (true) {
+        uint32_t id = read_field(input, 4, ok);
+        uint32_t count = read_field(input, 4, ok);
+        if (!ok) {
+            break;
+        }
+        
+        records.resize(count);
+        if (fread(records.data(), sizeof(VMTraceRecord), count, input) != count) {
+            std::cerr << "vm_trace: truncated chunk" << std::endl;
+            fclose(input);
+            return 1;
+        }
+        if (filter && id != wanted) {
+            continue;
+        }
+        
+        for (const VMTraceRecord& record : records) {
+            uint16_t opcode = record.instruction >> 4;
+            const char* name = VMInstruction::opcode_name(opcode);
+            
+            printf("%u %llu %04x: ", id, static_cast<unsigned long long>(record.step), record.ip);
+            if (name) {
+                printf("%-6s", name);
+            } else {
+                printf("?%03x  ", opcode);
+            }
+            printf(" dst=[%04x]%04x src=[%04x]%04x -> %04x %c%c%c%c\n",
+                   record.dst_address, record.dst_value, record.src_address, record.src_value, record.result,
+                   (record.flags >> VM_FLAG_SIGN) & 1 ? 'S' : '-',
+                   (record.flags >> VM_FLAG_ZERO) & 1 ? 'Z' : '-',
+                   (record.flags >> VM_FLAG_CARRY) & 1 ? 'C' : '-',
+                   (record.flags >> VM_FLAG_OVERFLOW) & 1 ? 'V' : '-');
+            printed++;
+        }
+    }
+    
+    fclose(input);
+    fprintf(stderr, "%llu records\n", static_cast<unsigned long long>(printed));
+    return 0;
+}
\ No newline at end of file